@@ -0,0 +1,646 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-align.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to line up two files that have had bytes inserted,
+ * deleted or moved.  Each file is scanned on all CPUs with a gear rolling
+ * hash, and the places where its top bits are zero are anchors; they depend
+ * only on the 64 bytes there, so the same bytes give the same anchors
+ * wherever they are in either file.  Anchors are matched by a hash of the
+ * 256 bytes from there on, using only the ones that are unique in both
+ * files.  The longest run of matches that are in the same order in both is
+ * the main line-up and the rest have moved.  Matches with the same shift
+ * are joined into segments and each is grown a byte at a time until the
+ * files differ, and what is left over was inserted.  About 16 bytes are kept
+ * for every 8KB of each file.
+ */
+
+#include "rb-align.h"
+
+/* a match between anchors in the two files */
+struct align_pair {
+    uint64_t a;
+    uint64_t b;
+    int inorder;
+};
+
+
+/* align_init makes the gear table and an empty context */
+struct align_ctx *align_init()
+{
+    struct align_ctx *ctx;
+    uint64_t x, z;
+    int i;
+
+    ctx = (struct align_ctx *) calloc(1, sizeof(struct align_ctx));
+    if (!ctx) {
+        FAIL_MSG("align_init: calloc() failed\n");
+        return NULL;
+    }
+
+
+    /* splitmix64, so both files get the same table every time */
+    x = 0x5242414c49474e31ULL;
+    for (i = 0; i < 256; i++) {
+        x += 0x9e3779b97f4a7c15ULL;
+        z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        ctx->gear[i] = z ^ (z >> 31);
+    }
+
+    return ctx;
+}
+
+
+/* align_fp hashes the ALIGN_FP_LEN bytes at p */
+static inline uint64_t align_fp(const uint8_t * p)
+{
+    uint64_t h, w;
+    int i;
+
+    h = ALIGN_FP_LEN;
+    for (i = 0; i < ALIGN_FP_LEN; i += 8) {
+        memcpy(&w, p + i, 8);
+        h ^= w;
+        h = ((h << 29) | (h >> 35)) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    return h ^ (h >> 32);
+}
+
+
+/* align_add adds an anchor to a thread's list */
+static int align_add(struct align_list *list, uint64_t offset, uint64_t fp)
+{
+    struct align_anchor *tmp;
+    unsigned long size;
+
+    if (list->count == list->size) {
+        size = list->size ? list->size * 2 : 1024;
+        tmp = (struct align_anchor *) realloc(list->anchors,
+                                              size *
+                                              sizeof(struct align_anchor));
+        if (!tmp) {
+            FAIL_MSG("align_add: realloc() failed\n");
+            return 1;
+        }
+
+        list->anchors = tmp;
+        list->size = size;
+    }
+
+    list->anchors[list->count].offset = offset;
+    list->anchors[list->count].fp = fp;
+    list->count++;
+
+    return 0;
+}
+
+
+/* align_scan is the scan callback; it finds the anchors that start in the
+ * block, using the overlap for the hash of the bytes after them */
+static int align_scan(void *arg, int thread, unsigned long block,
+                      unsigned long offset, const uint8_t * buf,
+                      unsigned long len, unsigned long total)
+{
+    struct align_ctx *ctx = (struct align_ctx *) arg;
+    struct align_list *list = &ctx->lists[thread];
+    const uint64_t *gear = ctx->gear;
+    unsigned long q, w, end, last;
+    uint64_t h, fp, lastfp;
+    int have;
+
+    end = len + ALIGN_WINDOW - 1;
+    if (end > total) {
+        end = total;
+    }
+
+    h = 0;
+    have = 0;
+    last = 0;
+    lastfp = 0;
+    for (q = 0; q < end; q++) {
+        h = (h << 1) + gear[buf[q]];
+        if ((h & ALIGN_MASK) || (q < ALIGN_WINDOW - 1)) {
+            continue;
+        }
+
+        w = q - (ALIGN_WINDOW - 1);
+        if (w + ALIGN_FP_LEN > total) {
+            break;
+        }
+        if (have && (w - last < ALIGN_MIN_GAP)) {
+            continue;
+        }
+
+        /* a run of the same bytes only needs its first anchor */
+        fp = align_fp(buf + w);
+        last = w;
+        if (have && (fp == lastfp)) {
+            continue;
+        }
+        have = 1;
+        lastfp = fp;
+
+        if (align_add(list, offset + w, fp) != 0) {
+            FAIL_MSG("align_scan: align_add() failed\n");
+            return 1;
+        }
+
+    }
+
+    return 0;
+}
+
+
+/* align_cmp_fp orders anchors by their hash */
+static int align_cmp_fp(const void *x, const void *y)
+{
+    const struct align_anchor *a = (const struct align_anchor *) x;
+    const struct align_anchor *b = (const struct align_anchor *) y;
+
+    if (a->fp != b->fp) {
+        return a->fp < b->fp ? -1 : 1;
+    }
+    if (a->offset != b->offset) {
+        return a->offset < b->offset ? -1 : 1;
+    }
+    return 0;
+}
+
+
+/* align_cmp_pair orders matches by where they are in the first file */
+static int align_cmp_pair(const void *x, const void *y)
+{
+    const struct align_pair *a = (const struct align_pair *) x;
+    const struct align_pair *b = (const struct align_pair *) y;
+
+    if (a->a != b->a) {
+        return a->a < b->a ? -1 : 1;
+    }
+    return 0;
+}
+
+
+/* align_anchors finds the anchors in one of the files, on all CPUs,
+ * through scan so it can be cancelled and its progress seen */
+int align_anchors(struct align_ctx *ctx, int side, struct scan_ctx *scan,
+                  int fd, unsigned long size)
+{
+    unsigned long count, n;
+    int i;
+
+    if (!ctx || !scan || ((side != ALIGN_FIRST) && (side != ALIGN_SECOND))
+        || ctx->anchors[side]) {
+        FAIL_MSG("align_anchors: invalid params\n");
+        return 1;
+    }
+
+
+    for (i = 0; i < SCAN_MAX_THREADS; i++) {
+        ctx->lists[i].count = 0;
+    }
+
+    if (size) {
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, size, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        if (rb_scan_init(scan, fd, 0, size, SCAN_BLOCK_SIZE, ALIGN_FP_LEN,
+                         align_scan, ctx) != 0) {
+            FAIL_MSG("align_anchors: rb_scan_init() failed\n");
+            return 2;
+        }
+
+
+        if (__atomic_load_n(&ctx->cancel, __ATOMIC_RELAXED)) {
+            return 3;
+        }
+
+        if (rb_scan(scan) != 0) {
+            FAIL_MSG("align_anchors: rb_scan() failed\n");
+            return 4;
+        }
+
+    }
+
+    /* gather them up, ordered by hash for matching */
+    count = 0;
+    for (i = 0; i < SCAN_MAX_THREADS; i++) {
+        count += ctx->lists[i].count;
+    }
+
+    ctx->anchors[side] = (struct align_anchor *)
+        malloc((count + 1) * sizeof(struct align_anchor));
+    if (!ctx->anchors[side]) {
+        FAIL_MSG("align_anchors: malloc() failed\n");
+        return 5;
+    }
+
+
+    n = 0;
+    for (i = 0; i < SCAN_MAX_THREADS; i++) {
+        memcpy(ctx->anchors[side] + n, ctx->lists[i].anchors,
+               ctx->lists[i].count * sizeof(struct align_anchor));
+        n += ctx->lists[i].count;
+    }
+    ctx->nanchors[side] = count;
+
+    qsort(ctx->anchors[side], count, sizeof(struct align_anchor),
+          align_cmp_fp);
+
+    return 0;
+}
+
+
+/* align_grow returns how many bytes stay the same from a in the first file
+ * and a + delta in the second, up to limit, going backwards from a if back
+ * is set */
+static unsigned long align_grow(struct align_ctx *ctx, int fd1, int fd2,
+                                unsigned long a, long delta,
+                                unsigned long limit, int back,
+                                uint8_t * buf1, uint8_t * buf2)
+{
+    unsigned long done, len, at, i;
+    long len1, len2;
+
+    done = 0;
+    while ((done < limit) && !__atomic_load_n(&ctx->cancel,
+                                              __ATOMIC_RELAXED)) {
+        len = limit - done;
+        if (len > ALIGN_CHUNK) {
+            len = ALIGN_CHUNK;
+        }
+        at = back ? a - done - len : a + done;
+
+        len1 = blkdev_pread(fd1, buf1, len, at);
+        len2 = blkdev_pread(fd2, buf2, len, at + delta);
+        if ((len1 != (long) len) || (len2 != (long) len)) {
+            break;
+        }
+
+        if (back) {
+            for (i = len; i && (buf1[i - 1] == buf2[i - 1]); i--) {
+            }
+            done += len - i;
+            if (i) {
+                break;
+            }
+        } else {
+            for (i = 0; (i < len) && (buf1[i] == buf2[i]); i++) {
+            }
+            done += i;
+            if (i < len) {
+                break;
+            }
+        }
+    }
+
+    return done;
+}
+
+
+/* align_pairs matches the anchors whose hashes are unique in both files,
+ * returning how many through count */
+static struct align_pair *align_pairs(struct align_ctx *ctx,
+                                      unsigned long *count)
+{
+    struct align_anchor *a, *b;
+    struct align_pair *pairs;
+    unsigned long i, j, ni, nj, n;
+
+    a = ctx->anchors[ALIGN_FIRST];
+    b = ctx->anchors[ALIGN_SECOND];
+    n = ctx->nanchors[ALIGN_FIRST] < ctx->nanchors[ALIGN_SECOND]
+        ? ctx->nanchors[ALIGN_FIRST] : ctx->nanchors[ALIGN_SECOND];
+
+    pairs = (struct align_pair *) malloc((n + 1) *
+                                         sizeof(struct align_pair));
+    if (!pairs) {
+        FAIL_MSG("align_pairs: malloc() failed\n");
+        return NULL;
+    }
+
+
+    n = 0;
+    i = 0;
+    j = 0;
+    while ((i < ctx->nanchors[ALIGN_FIRST])
+           && (j < ctx->nanchors[ALIGN_SECOND])) {
+        /* the runs of each hash */
+        for (ni = i + 1;
+             (ni < ctx->nanchors[ALIGN_FIRST]) && (a[ni].fp == a[i].fp);
+             ni++) {
+        }
+        for (nj = j + 1;
+             (nj < ctx->nanchors[ALIGN_SECOND]) && (b[nj].fp == b[j].fp);
+             nj++) {
+        }
+
+        if (a[i].fp < b[j].fp) {
+            i = ni;
+        } else if (a[i].fp > b[j].fp) {
+            j = nj;
+        } else {
+            if ((ni - i == 1) && (nj - j == 1)) {
+                pairs[n].a = a[i].offset;
+                pairs[n].b = b[j].offset;
+                pairs[n].inorder = 0;
+                n++;
+            }
+            i = ni;
+            j = nj;
+        }
+    }
+
+    *count = n;
+
+    return pairs;
+}
+
+
+/* align_order marks the longest run of matches that are in the same order
+ * in both files, with patience sorting */
+static int align_order(struct align_pair *pairs, unsigned long n)
+{
+    long *tails, *prev;
+    long len, lo, hi, mid, k;
+    unsigned long i;
+
+    if (!n) {
+        return 0;
+    }
+
+    tails = (long *) malloc(n * sizeof(long));
+    prev = (long *) malloc(n * sizeof(long));
+    if (!tails || !prev) {
+        FAIL_MSG("align_order: malloc() failed\n");
+        free(tails);
+        free(prev);
+        return 1;
+    }
+
+
+    len = 0;
+    for (i = 0; i < n; i++) {
+        lo = 0;
+        hi = len;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (pairs[tails[mid]].b < pairs[i].b) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        prev[i] = lo ? tails[lo - 1] : -1;
+        tails[lo] = i;
+        if (lo == len) {
+            len++;
+        }
+    }
+
+    for (k = tails[len - 1]; k >= 0; k = prev[k]) {
+        pairs[k].inorder = 1;
+    }
+
+    free(tails);
+    free(prev);
+
+    return 0;
+}
+
+
+/* align_match lines the files up from their anchors, leaving the segments
+ * in ctx->segs in the order they are in the first file */
+int align_match(struct align_ctx *ctx, int fd1, unsigned long size1,
+                int fd2, unsigned long size2)
+{
+    struct align_pair *pairs;
+    struct align_seg *segs, *s;
+    unsigned long npairs, nsegs, i, limit, lastin, covered;
+    uint8_t *buf1, *buf2;
+    long delta;
+    int havein;
+
+    if (!ctx || !ctx->anchors[ALIGN_FIRST] || !ctx->anchors[ALIGN_SECOND]
+        || ctx->segs) {
+        FAIL_MSG("align_match: invalid params\n");
+        return 1;
+    }
+
+
+    pairs = align_pairs(ctx, &npairs);
+    if (!pairs) {
+        FAIL_MSG("align_match: align_pairs() failed\n");
+        return 2;
+    }
+
+
+    /* the anchors aren't needed now */
+    free(ctx->anchors[ALIGN_FIRST]);
+    free(ctx->anchors[ALIGN_SECOND]);
+    ctx->anchors[ALIGN_FIRST] = NULL;
+    ctx->anchors[ALIGN_SECOND] = NULL;
+    ctx->nanchors[ALIGN_FIRST] = 0;
+    ctx->nanchors[ALIGN_SECOND] = 0;
+
+    qsort(pairs, npairs, sizeof(struct align_pair), align_cmp_pair);
+
+    if (align_order(pairs, npairs) != 0) {
+        FAIL_MSG("align_match: align_order() failed\n");
+        free(pairs);
+        return 3;
+    }
+
+
+    segs = (struct align_seg *) malloc((npairs + 1) *
+                                       sizeof(struct align_seg));
+    buf1 = (uint8_t *) malloc(ALIGN_CHUNK);
+    buf2 = (uint8_t *) malloc(ALIGN_CHUNK);
+    if (!segs || !buf1 || !buf2) {
+        FAIL_MSG("align_match: malloc() failed\n");
+        free(pairs);
+        free(segs);
+        free(buf1);
+        free(buf2);
+        return 4;
+    }
+
+
+    /* matches with the same shift make a segment */
+    nsegs = 0;
+    for (i = 0; i < npairs; i++) {
+        delta = (long) pairs[i].b - (long) pairs[i].a;
+        s = nsegs ? &segs[nsegs - 1] : NULL;
+        if (s && (s->delta == delta) && (s->moved == !pairs[i].inorder)) {
+            s->end = pairs[i].a + ALIGN_FP_LEN;
+            continue;
+        }
+
+        if (s && (s->end > pairs[i].a)) {
+            s->end = pairs[i].a;
+        }
+        s = &segs[nsegs++];
+        s->start = pairs[i].a;
+        s->end = pairs[i].a + ALIGN_FP_LEN;
+        s->delta = delta;
+        s->moved = !pairs[i].inorder;
+        s->deleted = 0;
+    }
+    free(pairs);
+
+    /* grow each one forwards up to the next, then backwards to the last */
+    for (i = 0; i < nsegs; i++) {
+        s = &segs[i];
+        limit = ((i + 1 < nsegs) ? segs[i + 1].start : size1) - s->end;
+        if (s->end + s->delta + limit > size2) {
+            limit = size2 - (s->end + s->delta);
+        }
+        s->end += align_grow(ctx, fd1, fd2, s->end, s->delta, limit, 0,
+                             buf1, buf2);
+    }
+    for (i = 0; i < nsegs; i++) {
+        s = &segs[i];
+        limit = s->start - (i ? segs[i - 1].end : 0);
+        if ((long) limit > (long) s->start + s->delta) {
+            limit = s->start + s->delta;
+        }
+        s->start -= align_grow(ctx, fd1, fd2, s->start, s->delta, limit, 1,
+                               buf1, buf2);
+    }
+    free(buf1);
+    free(buf2);
+
+    if (__atomic_load_n(&ctx->cancel, __ATOMIC_RELAXED)) {
+        free(segs);
+        return 5;
+    }
+
+    /* join segments in order with the same shift, whatever is between
+     * them was changed in place, and note where bytes were deleted */
+    ctx->matched = 0;
+    ctx->moved = 0;
+    ctx->deleted = 0;
+    covered = 0;
+    lastin = 0;
+    havein = 0;
+    ctx->nsegs = 0;
+    for (i = 0; i < nsegs; i++) {
+        s = &segs[i];
+        if (!s->moved && havein && (lastin == ctx->nsegs - 1)
+            && (segs[lastin].delta == s->delta)) {
+            covered += s->end - segs[lastin].end;
+            segs[lastin].end = s->end;
+            continue;
+        }
+
+        if (!s->moved && havein && (s->delta > segs[lastin].delta)) {
+            s->deleted = s->delta - segs[lastin].delta;
+        } else if (!s->moved && !havein && (s->delta > 0)) {
+            s->deleted = s->delta;
+        }
+        ctx->deleted += s->deleted;
+
+        segs[ctx->nsegs] = *s;
+        if (!s->moved) {
+            lastin = ctx->nsegs;
+            havein = 1;
+        }
+        covered += s->end - s->start;
+        ctx->nsegs++;
+    }
+
+    /* and the end of the second file that is left over */
+    if (havein && (segs[lastin].end + segs[lastin].delta < size2)
+        && (segs[lastin].end == size1)) {
+        ctx->deleted += size2 - (segs[lastin].end + segs[lastin].delta);
+    }
+
+    for (i = 0; i < ctx->nsegs; i++) {
+        if (segs[i].moved) {
+            ctx->moved += segs[i].end - segs[i].start;
+        } else {
+            ctx->matched += segs[i].end - segs[i].start;
+        }
+    }
+    ctx->inserted = size1 > covered ? size1 - covered : 0;
+    ctx->segs = segs;
+
+    return 0;
+}
+
+
+/* align_find returns the segment that holds offset, or the one before it,
+ * or -1 if there is none before it */
+long align_find(struct align_ctx *ctx, unsigned long offset)
+{
+    long lo, hi, mid;
+
+    if (!ctx || !ctx->segs) {
+        return -1;
+    }
+
+    lo = 0;
+    hi = ctx->nsegs;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (ctx->segs[mid].start <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo - 1;
+}
+
+
+/* align_delta returns how far the bytes at offset in the first file have
+ * shifted in the second, from the nearest segment in order before it */
+long align_delta(struct align_ctx *ctx, unsigned long offset)
+{
+    long k;
+
+    k = align_find(ctx, offset);
+    if ((k >= 0) && (offset < ctx->segs[k].end)) {
+        return ctx->segs[k].delta;
+    }
+
+    for (; (k >= 0) && ctx->segs[k].moved; k--) {
+    }
+
+    return k >= 0 ? ctx->segs[k].delta : 0;
+}
+
+
+/* align_free frees the context */
+int align_free(struct align_ctx *ctx)
+{
+    int i;
+
+    if (!ctx) {
+        FAIL_MSG("align_free: invalid params\n");
+        return 1;
+    }
+
+
+    for (i = 0; i < SCAN_MAX_THREADS; i++) {
+        free(ctx->lists[i].anchors);
+    }
+    free(ctx->anchors[ALIGN_FIRST]);
+    free(ctx->anchors[ALIGN_SECOND]);
+    free(ctx->segs);
+    free(ctx);
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-align.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_ALIGN_H
+#define _RB_ALIGN_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "rb-scan.h"
+#include "rb-blkdev.h"
+#include "macro.h"
+
+/* the rolling hash covers this many bytes */
+#define ALIGN_WINDOW 64
+/* an anchor is where the top bits of the hash are zero, about one in 8KB */
+#define ALIGN_MASK_BITS 13
+#define ALIGN_MASK (((1ULL << ALIGN_MASK_BITS) - 1) << (64 - ALIGN_MASK_BITS))
+/* anchors are matched by a hash of the bytes from there on */
+#define ALIGN_FP_LEN 256
+/* anchors closer than this are left out, for runs of the same bytes */
+#define ALIGN_MIN_GAP ALIGN_WINDOW
+/* matches are grown a byte at a time, read this much at once */
+#define ALIGN_CHUNK (64 * 1024)
+
+/* the two files */
+#define ALIGN_FIRST 0
+#define ALIGN_SECOND 1
+
+/* a content-defined place in a file */
+struct align_anchor {
+    uint64_t fp;
+    uint64_t offset;
+};
+
+/* anchors found by one scan thread */
+struct align_list {
+    struct align_anchor *anchors;
+    unsigned long count;
+    unsigned long size;
+};
+
+/* bytes of the first file that are at start + delta in the second */
+struct align_seg {
+    unsigned long start;
+    unsigned long end;
+    long delta;
+    int moved;                  /* out of order with the rest */
+    unsigned long deleted;      /* bytes of the second file missing before */
+};
+
+/* how two files line up */
+struct align_ctx {
+    uint64_t gear[256];
+
+    struct align_list lists[SCAN_MAX_THREADS];
+    struct align_anchor *anchors[2];
+    unsigned long nanchors[2];
+
+    struct align_seg *segs;
+    unsigned long nsegs;
+
+    /* bytes of the first file in each kind of segment */
+    unsigned long matched;
+    unsigned long moved;
+    unsigned long inserted;
+    unsigned long deleted;
+
+    int cancel;
+};
+
+struct align_ctx *align_init();
+int align_anchors(struct align_ctx *ctx, int side, struct scan_ctx *scan,
+                  int fd, unsigned long size);
+int align_match(struct align_ctx *ctx, int fd1, unsigned long size1,
+                int fd2, unsigned long size2);
+long align_find(struct align_ctx *ctx, unsigned long offset);
+long align_delta(struct align_ctx *ctx, unsigned long offset);
+int align_free(struct align_ctx *ctx);
+
+#endif
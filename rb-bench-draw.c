@@ -0,0 +1,154 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-bench-draw.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides the benchmark for the main window draw_img().  It stands in for
+ * rb-gtk.c and rubbermarbles.c by defining the window state that rb-draw.c
+ * uses, and points it at the benchmark file as load_file() would.
+ */
+
+#include "rb-draw.h"
+#include "rb-bench.h"
+
+
+/* the main window state rb-draw.c expects */
+struct filemmap mmap_ctx;
+struct pixbuf displays[5];
+struct window zoom[2];
+struct savepic save[5];
+struct displayset disp;
+struct search_ctx *search = NULL;
+struct class_ctx *classify = NULL;
+struct change_ctx *changes = NULL;
+struct zsrc_ctx *zsrc = NULL;
+struct cmp_ctx *compare = NULL;
+struct dup_ctx *dupes = NULL;
+
+/* the trigraph object owns the shm pointer */
+extern struct rb_shm *shm;
+
+
+/* bench_load points the window state at a file, as load_file() does */
+static int bench_load(int fd)
+{
+    static struct rb_shm benchshm;
+    int i;
+
+    memset(&benchshm, 0, sizeof(struct rb_shm));
+    benchshm.fd = fd;
+    if (fstat(fd, &benchshm.filestat) != 0) {
+        FAIL_ERR("bench_load: fstat() failed\n");
+        return 1;
+    }
+
+    benchshm.buf_type = BUF_TYPE_FD;
+    benchshm.bufsize = benchshm.filestat.st_size;
+    shm = &benchshm;
+
+    /* drop the previous file's mapping */
+    if (mmap_ctx.filedata) {
+        munmap(mmap_ctx.filedata, mmap_ctx.mmap_size);
+    }
+    memset(&mmap_ctx, 0, sizeof(struct filemmap));
+
+    zoom[ZOOM_WHOLE].start = -1;
+    zoom[ZOOM_WHOLE].end = -1;
+    zoom[ZOOM_ZOOM].start = -1;
+    zoom[ZOOM_ZOOM].end = -1;
+
+    zoom[ZOOM_WHOLE].step_hilbert =
+        (long double) benchshm.filestat.st_size / (512 * 512);
+    zoom[ZOOM_WHOLE].step_zigzag =
+        (long double) benchshm.filestat.st_size / (128 * 512);
+    zoom[ZOOM_ZOOM].step_hilbert = zoom[ZOOM_WHOLE].step_hilbert;
+    zoom[ZOOM_ZOOM].step_zigzag = zoom[ZOOM_WHOLE].step_zigzag;
+
+    displays[PIXBUF_WHOLE_HILBERT].width = 512;
+    displays[PIXBUF_WHOLE_HILBERT].height = 512;
+    displays[PIXBUF_WHOLE_ZIGZAG].width = 128;
+    displays[PIXBUF_WHOLE_ZIGZAG].height = 512;
+
+    disp.disp_hilbert = DISP_HILBERTFLIPPED;
+    disp.disp_zigzag = DISP_LINEAR;
+
+    for (i = 0; i < 5; i++) {
+        if (save[i].pic) {
+            free(save[i].pic);
+            save[i].pic = NULL;
+        }
+    }
+
+    return 0;
+}
+
+
+/* bench_draw times drawing the whole file windows in each colour scheme */
+int bench_draw(int fd, char *input)
+{
+    static int pixbufs[] = { PIXBUF_WHOLE_HILBERT, PIXBUF_WHOLE_HILBERT,
+        PIXBUF_WHOLE_ZIGZAG
+    };
+    static int layouts[] = { DISP_HILBERTFLIPPED, DISP_MORTON, DISP_LINEAR };
+    static char *layoutnames[] = { "hilbert", "morton", "zigzag" };
+    static int cols[] = { COL_CORTESI, COL_GREYSCALE, COL_COLSCALE };
+    static char *colnames[] = { "", "cortesi", "greyscale", "colscale" };
+    struct bench_result res;
+    int p, c;
+    int pixbufnum;
+
+    if (fd < 0) {
+        FAIL_MSG("bench_draw: invalid params\n");
+        return 1;
+    }
+
+
+    if (bench_load(fd) != 0) {
+        FAIL_MSG("bench_draw: bench_load() failed\n");
+        return 2;
+    }
+
+
+    for (p = 0; p < 3; p++) {
+        pixbufnum = pixbufs[p];
+        if (pixbufnum == PIXBUF_WHOLE_HILBERT) {
+            disp.disp_hilbert = layouts[p];
+        } else {
+            disp.disp_zigzag = layouts[p];
+        }
+        for (c = 0; c < 3; c++) {
+            disp.col_set = cols[c];
+
+            /* a saved bitmap would skip the draw loop */
+            free(save[pixbufnum].pic);
+            save[pixbufnum].pic = NULL;
+
+            bench_start(&res, "draw_img", input);
+            if (draw_img(pixbufnum) != 0) {
+                FAIL_MSG("bench_draw: draw_img() failed\n");
+                return 3;
+            }
+            res.bytes = shm->filestat.st_size;
+            res.pixels =
+                displays[pixbufnum].width * displays[pixbufnum].height;
+            snprintf(res.params, sizeof(res.params), "%s %s",
+                     layoutnames[p], colnames[cols[c]]);
+            bench_stop(&res);
+        }
+    }
+
+    /* leave nothing mapped for the next file */
+    if (mmap_ctx.filedata) {
+        munmap(mmap_ctx.filedata, mmap_ctx.mmap_size);
+    }
+    memset(&mmap_ctx, 0, sizeof(struct filemmap));
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-bench-hd.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides the benchmark for the hexdump populate().  The benchmark builds
+ * its own copy of rb-hexdump.c with its globals renamed and its labels
+ * replaced by plain buffers (see BENCHHD in the Makefile), so the table can
+ * be filled in without a display.  This file is built with the same
+ * renames.
+ */
+
+#include "rb-hexdump.h"
+#include "rb-bench.h"
+
+
+/* a label without a widget */
+struct bench_label {
+    char text[BENCH_LABELSIZE];
+};
+
+
+/* bench_label_set_text stands in for gtk_label_set_text() */
+void bench_label_set_text(GtkLabel * label, const gchar * str)
+{
+    struct bench_label *l = (struct bench_label *) label;
+    size_t len;
+
+    /* copy just the string, as strncpy() would pad the whole label */
+    len = strlen(str);
+    if (len > BENCH_LABELSIZE - 1) {
+        len = BENCH_LABELSIZE - 1;
+    }
+    memcpy(l->text, str, len);
+    l->text[len] = 0x00;
+}
+
+
+/* bench_hexdump times scrolling through a file a screen at a time */
+int bench_hexdump(int fd, char *input)
+{
+    struct hd_ctx ctx;
+    struct bench_label *labels;
+    GtkWidget **widgets;
+    struct bench_result res;
+    unsigned long limit;
+    unsigned long screen;
+    unsigned long rows;
+    int nlabels;
+    int dsize;
+    int endian;
+    int i;
+
+    if (fd < 0) {
+        FAIL_MSG("bench_hexdump: invalid params\n");
+        return 1;
+    }
+
+
+    memset(&ctx, 0, sizeof(struct hd_ctx));
+    if (fstat(fd, &ctx.filestat) != 0) {
+        FAIL_ERR("bench_hexdump: fstat() failed\n");
+        return 2;
+    }
+
+
+    /* 16 bytes a row, with the address and ascii columns */
+    nlabels = BENCH_HD_ROWS * (16 + 2);
+    labels =
+        (struct bench_label *) calloc(nlabels, sizeof(struct bench_label));
+    widgets = (GtkWidget **) calloc(nlabels, sizeof(GtkWidget *));
+    if (!labels || !widgets) {
+        FAIL_MSG("bench_hexdump: calloc() failed\n");
+        free(labels);
+        free(widgets);
+        return 3;
+    }
+
+
+    for (i = 0; i < nlabels; i++) {
+        widgets[i] = (GtkWidget *) & labels[i];
+    }
+
+    ctx.fd = fd;
+    ctx.type = BUF_TYPE_FD;
+    ctx.offset = 0;
+    ctx.bufsize = ctx.filestat.st_size;
+    ctx.table_widgets = widgets;
+
+    limit = ctx.bufsize < BENCH_HD_SIZE ? ctx.bufsize : BENCH_HD_SIZE;
+
+    for (dsize = 1; dsize <= 8; dsize *= 2) {
+        for (endian = HD_LITTLE_ENDIAN; endian <= HD_BIG_ENDIAN; endian++) {
+            ctx.dsize = dsize;
+            ctx.endian = endian;
+            ctx.cols = 16 / dsize;
+            ctx.rows = BENCH_HD_ROWS;
+            ctx.tablecols = ctx.cols;
+            ctx.tablerows = BENCH_HD_ROWS;
+            ctx.totalrows = ctx.bufsize / 16;
+            ctx.nudge = 0;
+            ctx.colnudge = 0;
+
+            screen = BENCH_HD_ROWS * 16;
+            rows = 0;
+
+            bench_start(&res, "populate", input);
+            for (ctx.scroll_offset = 0; ctx.scroll_offset < limit;
+                 ctx.scroll_offset += screen) {
+                if (populate(&ctx) != 0) {
+                    FAIL_MSG("bench_hexdump: populate() failed\n");
+                    if (ctx.mmap_ptr) {
+                        unmapmem(&ctx);
+                    }
+                    free(labels);
+                    free(widgets);
+                    return 4;
+                }
+                rows += BENCH_HD_ROWS;
+            }
+            res.bytes = rows * 16;
+            snprintf(res.params, sizeof(res.params), "dsize %d %s", dsize,
+                     endian == HD_BIG_ENDIAN ? "big" : "little");
+            bench_stop(&res);
+
+            if (ctx.mmap_ptr) {
+                unmapmem(&ctx);
+            }
+        }
+    }
+
+    free(labels);
+    free(widgets);
+
+    return 0;
+}
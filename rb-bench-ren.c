@@ -0,0 +1,137 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-bench-ren.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides the benchmarks for the rb-render draw_img() and shannon_char().
+ * rb-ren-draw.c shares function names with rb-draw.c, so the benchmark
+ * builds its own copy with them renamed (see BENCHREN in the Makefile), and
+ * this file is built with the same renames so the names below match it.
+ */
+
+#include "rb-ren-draw.h"
+#include "rb-bench.h"
+
+
+/* the visualiser state rb-ren-draw.c expects */
+struct filemmap *mmap_ctx = NULL;
+struct savepic save;
+
+
+/* bench_render times rendering a file as bytes and as entropy */
+int bench_render(int fd, char *input)
+{
+    static int cols[] =
+        { COL_CORTESI, COL_GREYSCALE, COL_COLSCALE, COL_COLSCALE2 };
+    static char *colnames[] =
+        { "", "cortesi", "greyscale", "colscale", "colscale2" };
+    struct ren_ctx ctx;
+    struct bench_result res;
+    int c;
+    int buftype;
+
+    if (fd < 0) {
+        FAIL_MSG("bench_render: invalid params\n");
+        return 1;
+    }
+
+
+    if (!mmap_ctx) {
+        mmap_ctx = rb_init_mmap();
+        if (!mmap_ctx) {
+            FAIL_MSG("bench_render: rb_init_mmap() failed\n");
+            return 2;
+        }
+
+        build_shannon_lookup();
+    }
+
+    memset(&ctx, 0, sizeof(struct ren_ctx));
+    if (fstat(fd, &ctx.filestat) != 0) {
+        FAIL_ERR("bench_render: fstat() failed\n");
+        return 3;
+    }
+
+    ctx.fd = fd;
+    ctx.xsize = 512;
+    ctx.ysize = 512;
+    ctx.offset = 0;
+    ctx.bufsize = ctx.filestat.st_size;
+    ctx.disp_hilbert = DISP_HILBERTFLIPPED;
+
+    for (buftype = REN_HILBERT; buftype <= REN_SHANNON; buftype++) {
+        ctx.buftype = buftype;
+        for (c = 0; c < 4; c++) {
+            ctx.col_set = cols[c];
+
+            /* start each run without a mapping */
+            rb_munmap(mmap_ctx);
+            mmap_ctx->mmap_ptr = NULL;
+            mmap_ctx->ptr = NULL;
+
+            bench_start(&res, "ren_draw_img", input);
+            if (draw_img(&ctx) != 0) {
+                FAIL_MSG("bench_render: draw_img() failed\n");
+                return 4;
+            }
+            res.bytes = ctx.bufsize;
+            res.pixels = ctx.xsize * ctx.ysize;
+            snprintf(res.params, sizeof(res.params), "%s %s",
+                     buftype == REN_HILBERT ? "hilbert" : "shannon",
+                     colnames[cols[c]]);
+            bench_stop(&res);
+        }
+    }
+
+    rb_munmap(mmap_ctx);
+    mmap_ctx->mmap_ptr = NULL;
+    mmap_ctx->ptr = NULL;
+
+    if (ctx.surface) {
+        cairo_surface_destroy(ctx.surface);
+    }
+
+    return 0;
+}
+
+
+/* bench_shannon times the entropy of windows spread across a buffer */
+int bench_shannon(uint8_t * buf, unsigned long size, char *input)
+{
+    struct bench_result res;
+    volatile unsigned char sink;
+    unsigned long calls;
+    unsigned long stride;
+    unsigned long i;
+
+    if (!buf || (size <= SHANNON_BS)) {
+        FAIL_MSG("bench_shannon: invalid params\n");
+        return 1;
+    }
+
+
+    build_shannon_lookup();
+
+    /* one call per pixel, as rb-shannon makes them */
+    calls = size < BENCH_SHANNON_CALLS ? size : BENCH_SHANNON_CALLS;
+    stride = size / calls;
+
+    sink = 0;
+    bench_start(&res, "shannon_char", input);
+    for (i = 0; i < calls; i++) {
+        sink ^= shannon_char(buf, size, i * stride);
+    }
+    res.bytes = calls * SHANNON_BS;
+    res.pixels = calls;
+    snprintf(res.params, sizeof(res.params), "window %d", SHANNON_BS);
+    bench_stop(&res);
+
+    return 0;
+}
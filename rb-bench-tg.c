@@ -0,0 +1,96 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-bench-tg.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides the benchmark for the trigraph and bigraph vertex loader.  It
+ * fills in the trigraph globals that the shm would and never opens a
+ * window, so no GL context is needed.
+ */
+
+#include "trigraph.h"
+#include "rb-bench.h"
+
+
+/* the trigraph globals */
+extern struct tg_ctx *ctx;
+extern struct rb_shm *shm;
+extern sem_t *sem;
+
+
+/* bench_trigraph times loading the vertices for each graph and word size */
+int bench_trigraph(uint8_t * buf, unsigned long size, char *input)
+{
+    static char *typenames[] = { "trigraph", "delayedtrigraph", "bigraph",
+        "delayedbigraph"
+    };
+    static struct tg_ctx tg;
+    static struct rb_shm benchshm;
+    static sem_t benchsem;
+    static int initialised = 0;
+    struct bench_result res;
+    unsigned int type;
+    unsigned int dsize;
+
+    if (!buf || !size) {
+        FAIL_MSG("bench_trigraph: invalid params\n");
+        return 1;
+    }
+
+
+    if (!initialised) {
+        if (sem_init(&benchsem, 0, 1) != 0) {
+            FAIL_ERR("bench_trigraph: sem_init() failed\n");
+            return 2;
+        }
+
+        initialised = 1;
+    }
+
+    /* the loader only checks that there is a shm */
+    if (!shm) {
+        shm = &benchshm;
+    }
+    sem = &benchsem;
+    ctx = &tg;
+
+    if (size > BENCH_TG_SIZE) {
+        size = BENCH_TG_SIZE;
+    }
+
+    for (type = TG_NORMAL; type <= BG_DELAYED; type++) {
+        for (dsize = 1; dsize <= 8; dsize *= 2) {
+            memset(&tg, 0, sizeof(struct tg_ctx));
+            tg.buf = buf;
+            tg.bufsize = size;
+            tg.type = type;
+            tg.dsize = dsize;
+            tg.endian = TG_LITTLE_ENDIAN;
+
+            bench_start(&res, "tg_load_buffer", input);
+            if (tg_load_buffer() != 0) {
+                FAIL_MSG("bench_trigraph: tg_load_buffer() failed\n");
+                return 3;
+            }
+            res.bytes = size;
+            res.pixels = tg.vert_count;
+            snprintf(res.params, sizeof(res.params), "%s dsize %d",
+                     typenames[type], dsize);
+            bench_stop(&res);
+
+            free(tg.vertices);
+            free(tg.colours);
+        }
+    }
+
+    ctx = NULL;
+
+    return 0;
+}
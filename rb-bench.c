@@ -0,0 +1,802 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-bench.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides a benchmark for the drawing and formatting kernels.  Each kernel
+ * is run on its own, without a display, over synthetic inputs built from a
+ * fixed seed so that runs are comparable.  The time per byte and per pixel
+ * is reported, with the hardware counters where the kernel allows them, as
+ * text or as JSON.
+ */
+
+#include "rb-bench.h"
+#include "rb-hilbert.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+/* output and filter options */
+static int bench_json = 0;
+static int bench_results = 0;
+static char *bench_kernel = NULL;
+static unsigned long bench_insize = 0;
+
+/* hardware counters */
+static int bench_counting = 0;
+#ifdef __linux__
+static int bench_perf_fd[BENCH_COUNTERS] = { -1, -1, -1, -1 };
+static const uint64_t bench_perf_config[BENCH_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+#endif
+
+/* words for the text input */
+static char *bench_words[] = {
+    "the", "of", "and", "to", "in", "is", "that", "for", "it", "as",
+    "with", "was", "on", "be", "by", "file", "data", "offset", "marbles",
+    "hilbert", "entropy", "visualiser", "buffer", "window", "pixel"
+};
+
+
+/* bench_now returns a monotonic time in nanoseconds */
+double bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec * 1e9) + (double) ts.tv_nsec;
+}
+
+
+/* bench_fill fills a buffer from a fixed seed so runs are comparable */
+int bench_fill(uint8_t * buf, unsigned long size, uint32_t seed)
+{
+    unsigned long i;
+
+    if (!buf) {
+        FAIL_MSG("bench_fill: invalid params\n");
+        return 1;
+    }
+
+
+    /* xorshift32 */
+    for (i = 0; i < size; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        buf[i] = seed & 0xff;
+    }
+
+    return 0;
+}
+
+
+/* bench_text fills a buffer with lines of words */
+static int bench_text(uint8_t * buf, unsigned long size, uint32_t seed)
+{
+    unsigned long i;
+    int nwords;
+    int line;
+    char *word;
+
+    nwords = sizeof(bench_words) / sizeof(bench_words[0]);
+    line = 0;
+    i = 0;
+    while (i < size) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        word = bench_words[seed % nwords];
+        while (*word && (i < size)) {
+            buf[i++] = *word++;
+            line++;
+        }
+        if (i < size) {
+            if (line > 72) {
+                buf[i++] = '\n';
+                line = 0;
+            } else {
+                buf[i++] = ' ';
+                line++;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/* bench_input fills a buffer with one of the synthetic inputs */
+int bench_input(uint8_t * buf, unsigned long size, int type)
+{
+    unsigned long pos;
+    unsigned long len;
+    unsigned long i;
+    int segment;
+
+    if (!buf || (type < 0) || (type >= BENCH_INPUTS)) {
+        FAIL_MSG("bench_input: invalid params\n");
+        return 1;
+    }
+
+
+    bench_insize = size;
+
+    switch (type) {
+    case BENCH_RANDOM:
+        bench_fill(buf, size, 0x12345678);
+        break;
+    case BENCH_ZEROS:
+        memset(buf, 0, size);
+        break;
+    case BENCH_TEXT:
+        bench_text(buf, size, 0x12345678);
+        break;
+    case BENCH_MIXED:
+        /* 64KB segments of random, zeros, text and a table of counters */
+        segment = 0;
+        for (pos = 0; pos < size; pos += len) {
+            len = 64 * 1024;
+            if (pos + len > size) {
+                len = size - pos;
+            }
+            switch (segment % 4) {
+            case 0:
+                bench_fill(buf + pos, len, 0x12345678 + segment);
+                break;
+            case 1:
+                memset(buf + pos, 0, len);
+                break;
+            case 2:
+                bench_text(buf + pos, len, 0x12345678 + segment);
+                break;
+            case 3:
+                for (i = 0; i < len; i++) {
+                    buf[pos + i] = ((pos + i) / 4 >> ((i % 4) * 8)) & 0xff;
+                }
+                break;
+            }
+            segment++;
+        }
+        break;
+    }
+
+    return 0;
+}
+
+
+/* bench_input_name returns the name of a synthetic input */
+char *bench_input_name(int type)
+{
+    switch (type) {
+    case BENCH_RANDOM:
+        return "random";
+    case BENCH_ZEROS:
+        return "zeros";
+    case BENCH_TEXT:
+        return "text";
+    case BENCH_MIXED:
+        return "mixed";
+    }
+
+    return "unknown";
+}
+
+
+/* bench_mkstemp creates an unlinked temporary file */
+static int bench_mkstemp()
+{
+    char path[PATH_MAX];
+    char *dir;
+    int fd;
+
+    dir = getenv("TMPDIR");
+    if (!dir) {
+        dir = "/tmp";
+    }
+    snprintf(path, PATH_MAX, "%s/rb-bench-XXXXXX", dir);
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        FAIL_ERR("bench_mkstemp: mkstemp() failed\n");
+        return -1;
+    }
+
+    unlink(path);
+
+    return fd;
+}
+
+
+/* bench_tempfile writes a buffer to an unlinked temporary file */
+int bench_tempfile(const uint8_t * buf, unsigned long size)
+{
+    unsigned long got;
+    ssize_t ret;
+    int fd;
+
+    if (!buf || !size) {
+        FAIL_MSG("bench_tempfile: invalid params\n");
+        return -1;
+    }
+
+
+    fd = bench_mkstemp();
+    if (fd < 0) {
+        FAIL_MSG("bench_tempfile: bench_mkstemp() failed\n");
+        return -1;
+    }
+
+
+    for (got = 0; got < size; got += ret) {
+        ret = write(fd, buf + got, size - got);
+        if (ret <= 0) {
+            FAIL_ERR("bench_tempfile: write() failed\n");
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+
+/* bench_sparse creates a sparse temporary file with islands of mixed data */
+int bench_sparse(unsigned long size)
+{
+    uint8_t *island;
+    unsigned long pos;
+    int fd;
+
+    if (size < BENCH_SPARSE_ISLAND) {
+        FAIL_MSG("bench_sparse: invalid params\n");
+        return -1;
+    }
+
+
+    island = (uint8_t *) malloc(BENCH_SPARSE_ISLAND);
+    if (!island) {
+        FAIL_MSG("bench_sparse: malloc() failed\n");
+        return -1;
+    }
+
+
+    fd = bench_mkstemp();
+    if (fd < 0) {
+        FAIL_MSG("bench_sparse: bench_mkstemp() failed\n");
+        free(island);
+        return -1;
+    }
+
+
+    if (ftruncate(fd, size) != 0) {
+        FAIL_ERR("bench_sparse: ftruncate() failed\n");
+        close(fd);
+        free(island);
+        return -1;
+    }
+
+
+    bench_input(island, BENCH_SPARSE_ISLAND, BENCH_MIXED);
+    for (pos = 0; pos + BENCH_SPARSE_ISLAND <= size;
+         pos += BENCH_SPARSE_STRIDE) {
+        if (pwrite(fd, island, BENCH_SPARSE_ISLAND, pos) !=
+            BENCH_SPARSE_ISLAND) {
+            FAIL_ERR("bench_sparse: pwrite() failed\n");
+            close(fd);
+            free(island);
+            return -1;
+        }
+    }
+
+    free(island);
+    bench_insize = size;
+
+    return fd;
+}
+
+
+/* bench_perf_open opens the hardware counters for this process */
+int bench_perf_open()
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < BENCH_COUNTERS; i++) {
+        memset(&attr, 0, sizeof(struct perf_event_attr));
+        attr.size = sizeof(struct perf_event_attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = bench_perf_config[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        bench_perf_fd[i] =
+            syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (bench_perf_fd[i] < 0) {
+            bench_perf_close();
+            return 1;
+        }
+    }
+
+    bench_counting = 1;
+
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+
+/* bench_perf_close closes the hardware counters */
+void bench_perf_close()
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < BENCH_COUNTERS; i++) {
+        if (bench_perf_fd[i] >= 0) {
+            close(bench_perf_fd[i]);
+            bench_perf_fd[i] = -1;
+        }
+    }
+#endif
+
+    bench_counting = 0;
+}
+
+
+/* bench_want returns whether a kernel was selected */
+int bench_want(char *kernel)
+{
+    if (!bench_kernel) {
+        return 1;
+    }
+
+    return strstr(kernel, bench_kernel) != NULL;
+}
+
+
+/* bench_start resets the counters and starts the clock */
+void bench_start(struct bench_result *res, char *kernel, char *input)
+{
+#ifdef __linux__
+    int i;
+#endif
+
+    memset(res, 0, sizeof(struct bench_result));
+    res->kernel = kernel;
+    res->input = input;
+
+#ifdef __linux__
+    if (bench_counting) {
+        for (i = 0; i < BENCH_COUNTERS; i++) {
+            ioctl(bench_perf_fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(bench_perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+
+    res->start = bench_now();
+}
+
+
+/* bench_stop stops the clock, reads the counters and reports the run */
+void bench_stop(struct bench_result *res)
+{
+#ifdef __linux__
+    int i;
+#endif
+
+    res->ns = bench_now() - res->start;
+
+#ifdef __linux__
+    if (bench_counting) {
+        res->counted = 1;
+        for (i = 0; i < BENCH_COUNTERS; i++) {
+            ioctl(bench_perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(bench_perf_fd[i], &res->count[i], sizeof(uint64_t))
+                != sizeof(uint64_t)) {
+                res->counted = 0;
+            }
+        }
+    }
+#endif
+
+    bench_report(res);
+}
+
+
+/* bench_report prints one result, as a line of text or a JSON object */
+void bench_report(struct bench_result *res)
+{
+    if (bench_json) {
+        printf("%s    {\"kernel\": \"%s\", \"input\": \"%s\", "
+               "\"size\": %lu, \"params\": \"%s\", \"bytes\": %lu, "
+               "\"pixels\": %lu, \"ns\": %.0f, ", bench_results ? ",\n" : "",
+               res->kernel, res->input, bench_insize, res->params,
+               res->bytes, res->pixels, res->ns);
+        if (res->bytes) {
+            printf("\"ns_per_byte\": %.4f, ", res->ns / res->bytes);
+        } else {
+            printf("\"ns_per_byte\": null, ");
+        }
+        if (res->pixels) {
+            printf("\"ns_per_pixel\": %.4f, ", res->ns / res->pixels);
+        } else {
+            printf("\"ns_per_pixel\": null, ");
+        }
+        if (res->counted) {
+            printf("\"cycles\": %llu, \"instructions\": %llu, "
+                   "\"cache_misses\": %llu, \"branch_misses\": %llu}",
+                   (unsigned long long) res->count[BENCH_CYCLES],
+                   (unsigned long long) res->count[BENCH_INSTRUCTIONS],
+                   (unsigned long long) res->count[BENCH_CACHE_MISSES],
+                   (unsigned long long) res->count[BENCH_BRANCH_MISSES]);
+        } else {
+            printf("\"cycles\": null, \"instructions\": null, "
+                   "\"cache_misses\": null, \"branch_misses\": null}");
+        }
+    } else {
+        printf("%-14s %-7s %6luM %-22s", res->kernel, res->input,
+               bench_insize >> 20, res->params);
+        if (res->bytes) {
+            printf(" %9.3f ns/byte ", res->ns / res->bytes);
+        } else {
+            printf(" %17s", "");
+        }
+        if (res->pixels) {
+            printf(" %9.3f ns/pixel", res->ns / res->pixels);
+        } else {
+            printf(" %16s", "");
+        }
+        if (res->counted && res->count[BENCH_CYCLES]) {
+            printf(" %5.2f IPC %10llu cache-miss %10llu branch-miss",
+                   (double) res->count[BENCH_INSTRUCTIONS] /
+                   res->count[BENCH_CYCLES],
+                   (unsigned long long) res->count[BENCH_CACHE_MISSES],
+                   (unsigned long long) res->count[BENCH_BRANCH_MISSES]);
+        }
+        printf("\n");
+    }
+
+    fflush(stdout);
+    bench_results++;
+}
+
+
+/* ref_row is the per value snprintf() formatter the hexdump used to use */
+int ref_row(char *out, const uint8_t * buf, int count, int dsize,
+            int endian)
+{
+    int e, k;
+    uint64_t value;
+
+    for (e = 0; e < count / dsize; e++) {
+        value = 0;
+        if (endian == HEXFMT_BIG_ENDIAN) {
+            for (k = 0; k < dsize; k++) {
+                value = (value << 8) | buf[(e * dsize) + k];
+            }
+        } else {
+            for (k = dsize - 1; k >= 0; k--) {
+                value = (value << 8) | buf[(e * dsize) + k];
+            }
+        }
+        snprintf(out + (e * HEXFMT_STRIDE), HEXFMT_STRIDE, " %0*llx",
+                 dsize * 2, (unsigned long long) value);
+    }
+
+    return 0;
+}
+
+
+/* ref_ascii is the byte by byte ascii column the hexdump used to build */
+int ref_ascii(char *out, const uint8_t * buf, int count)
+{
+    int i;
+
+    out[0] = ' ';
+    for (i = 0; i < count; i++) {
+        if ((buf[i] >= 0x20) && (buf[i] < 0x7f)) {
+            out[i + 1] = buf[i];
+        } else {
+            out[i + 1] = '.';
+        }
+    }
+    out[count + 1] = 0x00;
+
+    return 0;
+}
+
+
+/* bench_rows formats the buffer a row at a time */
+int bench_rows(const uint8_t * buf, unsigned long size, int rowbytes,
+               int dsize, int endian, int kernel)
+{
+    char out[HEXFMT_MAXROW * HEXFMT_STRIDE];
+    unsigned long pos;
+
+    for (pos = 0; pos + rowbytes <= size; pos += rowbytes) {
+        switch (kernel) {
+        case BENCH_REF_ROW:
+            ref_row(out, buf + pos, rowbytes, dsize, endian);
+            break;
+        case BENCH_HEXFMT_ROW:
+            hexfmt_row(out, HEXFMT_STRIDE, buf + pos, rowbytes, dsize,
+                       endian);
+            break;
+        case BENCH_REF_ASCII:
+            ref_ascii(out, buf + pos, rowbytes);
+            break;
+        case BENCH_HEXFMT_ASCII:
+            hexfmt_ascii(out, buf + pos, rowbytes, rowbytes);
+            break;
+        case BENCH_REF_ADDR:
+            snprintf(out, HEXFMT_ADDRSIZE, "%016llx:",
+                     (unsigned long long) pos);
+            break;
+        case BENCH_HEXFMT_ADDR:
+            hexfmt_addr(out, pos);
+            break;
+        case BENCH_HEXFMT_LINE:
+            hexfmt_line(out, pos, buf + pos, rowbytes, rowbytes, dsize,
+                        endian);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+/* bench_hexfmt times the row formatters against the snprintf() code */
+int bench_hexfmt(const uint8_t * buf, unsigned long size, char *input)
+{
+    static char *names[] = { "snprintf_row", "hexfmt_row",
+        "byte_ascii", "hexfmt_ascii", "snprintf_addr", "hexfmt_addr",
+        "hexfmt_line"
+    };
+    struct bench_result res;
+    int kernel;
+    int dsize;
+    int endian;
+
+    if (!buf || !size) {
+        FAIL_MSG("bench_hexfmt: invalid params\n");
+        return 1;
+    }
+
+
+    /* every word size and endianness, 16 bytes per row */
+    for (kernel = BENCH_REF_ROW; kernel <= BENCH_HEXFMT_LINE; kernel++) {
+        for (dsize = 1; dsize <= 8; dsize *= 2) {
+            for (endian = HEXFMT_LITTLE_ENDIAN;
+                 endian <= HEXFMT_BIG_ENDIAN; endian++) {
+                /* the ascii and address columns don't have a word size */
+                if (((kernel == BENCH_REF_ASCII)
+                     || (kernel == BENCH_HEXFMT_ASCII)
+                     || (kernel == BENCH_REF_ADDR)
+                     || (kernel == BENCH_HEXFMT_ADDR))
+                    && ((dsize != 1) || (endian != HEXFMT_LITTLE_ENDIAN))) {
+                    continue;
+                }
+
+                bench_start(&res, names[kernel], input);
+                bench_rows(buf, size, 16, dsize, endian, kernel);
+                res.bytes = size;
+                snprintf(res.params, sizeof(res.params), "dsize %d %s",
+                         dsize,
+                         endian == HEXFMT_BIG_ENDIAN ? "big" : "little");
+                bench_stop(&res);
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/* bench_d2xy times the hilbert curve for the window sizes */
+int bench_d2xy()
+{
+    struct bench_result res;
+    volatile int sink;
+    int n, d;
+    int x, y;
+
+    sink = 0;
+    for (n = 512; n <= 4096; n *= 8) {
+        bench_start(&res, "d2xy", "none");
+        for (d = 0; d < n * n; d++) {
+            d2xy(n, d, &x, &y);
+            sink += x ^ y;
+        }
+        res.pixels = (unsigned long) n * n;
+        snprintf(res.params, sizeof(res.params), "%dx%d", n, n);
+        bench_stop(&res);
+    }
+
+    return 0;
+}
+
+
+/* bench_want_file returns whether any kernel that reads a file was selected */
+static int bench_want_file()
+{
+    return bench_want("draw_img") || bench_want("ren_draw_img")
+        || bench_want("populate");
+}
+
+
+/* bench_file runs the kernels that read from a file descriptor */
+static int bench_file(int fd, char *input)
+{
+    if (bench_want("draw_img") && (bench_draw(fd, input) != 0)) {
+        FAIL_MSG("bench_file: bench_draw() failed\n");
+        return 1;
+    }
+
+    if (bench_want("ren_draw_img") && (bench_render(fd, input) != 0)) {
+        FAIL_MSG("bench_file: bench_render() failed\n");
+        return 2;
+    }
+
+    if (bench_want("populate") && (bench_hexdump(fd, input) != 0)) {
+        FAIL_MSG("bench_file: bench_hexdump() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint8_t *buf;
+    unsigned long size;
+    unsigned long sparse;
+    unsigned long sizes[3];
+    unsigned long cur, prev;
+    char *input;
+    int type;
+    int opt;
+    int fd;
+    int i;
+
+    size = BENCH_SIZE;
+    sparse = BENCH_SPARSE_SIZE;
+    while ((opt = getopt(argc, argv, "js:g:k:h")) != -1) {
+        switch (opt) {
+        case 'j':
+            bench_json = 1;
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            sparse = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            bench_kernel = optarg;
+            break;
+        default:
+            size = 0;
+            break;
+        }
+    }
+    if ((optind != argc) || !size
+        || (sparse && (sparse < BENCH_SPARSE_ISLAND))) {
+        printf("Usage: rb-bench [-j] [-s bytes] [-g sparse bytes] "
+               "[-k kernel]\n\n"
+               "Benchmark for the Rubber Marbles kernels\n\n"
+               "  -j  print the results as JSON\n"
+               "  -s  largest in-memory input (default %d)\n"
+               "  -g  size of the sparse file, 0 to skip (default %lu)\n"
+               "  -k  only run kernels whose names contain this, from\n"
+               "      hexfmt, d2xy, shannon_char, tg_load_buffer, draw_img,\n"
+               "      ren_draw_img and populate\n", BENCH_SIZE,
+               BENCH_SPARSE_SIZE);
+        exit(1);
+    }
+
+    buf = (uint8_t *) malloc(size);
+    if (!buf) {
+        FAIL_MSG("main: malloc() failed\n");
+        return 2;
+    }
+
+
+    hexfmt_init();
+    if (bench_perf_open() != 0) {
+        fprintf(stderr, "rb-bench: hardware counters not available\n");
+    }
+
+    if (bench_json) {
+        printf("{\n  \"counters\": %s,\n  \"results\": [\n",
+               bench_counting ? "true" : "false");
+    }
+
+    if (bench_want("d2xy")) {
+        bench_d2xy();
+    }
+
+    /* every input at each size up to the largest */
+    sizes[0] = BENCH_SMALL;
+    sizes[1] = BENCH_MEDIUM;
+    sizes[2] = size;
+    prev = 0;
+    for (i = 0; i < 3; i++) {
+        cur = sizes[i] < size ? sizes[i] : size;
+        if (cur == prev) {
+            continue;
+        }
+        prev = cur;
+
+        for (type = 0; type < BENCH_INPUTS; type++) {
+            input = bench_input_name(type);
+            bench_input(buf, cur, type);
+
+            /* the formatters don't depend on the data */
+            if ((type == BENCH_RANDOM) && bench_want("hexfmt")) {
+                bench_hexfmt(buf, cur, input);
+            }
+            if (bench_want("shannon_char")) {
+                bench_shannon(buf, cur, input);
+            }
+            if (bench_want("tg_load_buffer")) {
+                bench_trigraph(buf, cur, input);
+            }
+
+            if (bench_want_file()) {
+                fd = bench_tempfile(buf, cur);
+                if (fd < 0) {
+                    FAIL_MSG("main: bench_tempfile() failed\n");
+                    return 3;
+                }
+
+                bench_file(fd, input);
+                close(fd);
+            }
+        }
+    }
+
+    /* a multi-GB file that is mostly holes */
+    if (sparse && bench_want_file()) {
+        fd = bench_sparse(sparse);
+        if (fd < 0) {
+            FAIL_MSG("main: bench_sparse() failed\n");
+            return 4;
+        }
+
+        bench_file(fd, "sparse");
+        close(fd);
+    }
+
+    if (bench_json) {
+        printf("\n  ]\n}\n");
+    }
+
+    bench_perf_close();
+    free(buf);
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-bench.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_BENCH_H
+#define _RB_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "rb-hexfmt.h"
+#include "macro.h"
+
+/* largest in-memory input */
+#define BENCH_SIZE (64 * 1024 * 1024)
+/* smaller inputs, run when below the largest */
+#define BENCH_SMALL (1024 * 1024)
+#define BENCH_MEDIUM (8 * 1024 * 1024)
+
+/* the sparse file is mostly holes with an island of data at every stride */
+#define BENCH_SPARSE_SIZE (4UL * 1024 * 1024 * 1024)
+#define BENCH_SPARSE_STRIDE (256UL * 1024 * 1024)
+#define BENCH_SPARSE_ISLAND (1024 * 1024)
+
+/* per kernel limits, so a run stays in minutes */
+#define BENCH_TG_SIZE (1024 * 1024)
+#define BENCH_HD_SIZE (4 * 1024 * 1024)
+#define BENCH_HD_ROWS 64
+#define BENCH_SHANNON_CALLS (1024 * 1024)
+#define BENCH_LABELSIZE 4096
+
+/* synthetic inputs */
+#define BENCH_RANDOM 0
+#define BENCH_ZEROS 1
+#define BENCH_TEXT 2
+#define BENCH_MIXED 3
+#define BENCH_INPUTS 4
+
+/* hexfmt kernels */
+#define BENCH_REF_ROW 0
+#define BENCH_HEXFMT_ROW 1
+#define BENCH_REF_ASCII 2
+#define BENCH_HEXFMT_ASCII 3
+#define BENCH_REF_ADDR 4
+#define BENCH_HEXFMT_ADDR 5
+#define BENCH_HEXFMT_LINE 6
+
+/* hardware counters */
+#define BENCH_CYCLES 0
+#define BENCH_INSTRUCTIONS 1
+#define BENCH_CACHE_MISSES 2
+#define BENCH_BRANCH_MISSES 3
+#define BENCH_COUNTERS 4
+
+/* one timed run */
+struct bench_result {
+    char *kernel;
+    char *input;
+    char params[64];
+    unsigned long bytes;
+    unsigned long pixels;
+    double start;
+    double ns;
+    int counted;
+    uint64_t count[BENCH_COUNTERS];
+};
+
+double bench_now();
+int bench_fill(uint8_t * buf, unsigned long size, uint32_t seed);
+int bench_input(uint8_t * buf, unsigned long size, int type);
+char *bench_input_name(int type);
+int bench_tempfile(const uint8_t * buf, unsigned long size);
+int bench_sparse(unsigned long size);
+int bench_perf_open();
+void bench_perf_close();
+int bench_want(char *kernel);
+void bench_start(struct bench_result *res, char *kernel, char *input);
+void bench_stop(struct bench_result *res);
+void bench_report(struct bench_result *res);
+
+int ref_row(char *out, const uint8_t * buf, int count, int dsize,
+            int endian);
+int ref_ascii(char *out, const uint8_t * buf, int count);
+int bench_rows(const uint8_t * buf, unsigned long size, int rowbytes,
+               int dsize, int endian, int kernel);
+int bench_hexfmt(const uint8_t * buf, unsigned long size, char *input);
+int bench_d2xy();
+
+/* kernels from the main window and the visualisers */
+int bench_draw(int fd, char *input);
+int bench_render(int fd, char *input);
+int bench_shannon(uint8_t * buf, unsigned long size, char *input);
+int bench_trigraph(uint8_t * buf, unsigned long size, char *input);
+int bench_hexdump(int fd, char *input);
+
+#endif
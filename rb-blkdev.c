@@ -0,0 +1,215 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-blkdev.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to read block devices and raw partitions as if they
+ * were files.  stat() says a device is 0 bytes long, so its size is asked
+ * of the driver, along with the logical block size that reads are aligned
+ * to.  Ordinary files are passed straight through.
+ */
+
+#include "rb-blkdev.h"
+
+
+/* blkdev_is_dev returns 1 if the stat is of a device rather than a file */
+int blkdev_is_dev(struct stat *filestat)
+{
+    if (!filestat) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    /* the raw /dev/rdisk devices are character devices */
+    return S_ISBLK(filestat->st_mode) || S_ISCHR(filestat->st_mode);
+#else
+    return S_ISBLK(filestat->st_mode);
+#endif
+}
+
+
+/* blkdev_fstat is fstat() that fills in st_size and st_blksize for block
+ * devices from the driver */
+int blkdev_fstat(int fd, struct stat *filestat)
+{
+#ifdef __linux__
+    uint64_t size;
+    int sectsize;
+#endif
+#ifdef __APPLE__
+    uint64_t count;
+    uint32_t sectsize;
+#endif
+
+    if ((fd < 0) || !filestat) {
+        FAIL_MSG("blkdev_fstat: invalid params\n");
+        return 1;
+    }
+
+
+    if (fstat(fd, filestat) != 0) {
+        FAIL_ERR("blkdev_fstat: fstat() failed\n");
+        return 2;
+    }
+
+
+    if (!blkdev_is_dev(filestat)) {
+        return 0;
+    }
+
+#ifdef __linux__
+    if (ioctl(fd, BLKGETSIZE64, &size) != 0) {
+        FAIL_ERR("blkdev_fstat: BLKGETSIZE64 failed\n");
+        return 3;
+    }
+
+
+    if ((ioctl(fd, BLKSSZGET, &sectsize) != 0) || (sectsize <= 0)) {
+        sectsize = BLKDEV_ALIGN;
+    }
+
+    filestat->st_size = size;
+    filestat->st_blksize = sectsize;
+#endif
+#ifdef __APPLE__
+    if ((ioctl(fd, DKIOCGETBLOCKSIZE, &sectsize) != 0)
+        || (ioctl(fd, DKIOCGETBLOCKCOUNT, &count) != 0)) {
+        FAIL_ERR("blkdev_fstat: DKIOCGETBLOCKCOUNT failed\n");
+        return 3;
+    }
+
+
+    filestat->st_size = count * sectsize;
+    filestat->st_blksize = sectsize;
+#endif
+
+    return 0;
+}
+
+
+/* blkdev_stat is stat() that sizes block devices */
+int blkdev_stat(char *path, struct stat *filestat)
+{
+    int fd;
+    int ret;
+
+    if (!path || !filestat) {
+        FAIL_MSG("blkdev_stat: invalid params\n");
+        return 1;
+    }
+
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        FAIL_ERR("blkdev_stat: open() failed\n");
+        return 2;
+    }
+
+
+    ret = blkdev_fstat(fd, filestat);
+    close(fd);
+    if (ret != 0) {
+        FAIL_MSG("blkdev_stat: blkdev_fstat() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* blkdev_align returns what reads of fd should be aligned to: the logical
+ * block size for a device, or the preferred I/O size for a file */
+unsigned long blkdev_align(int fd)
+{
+    struct stat filestat;
+    unsigned long align;
+
+    if (blkdev_fstat(fd, &filestat) != 0) {
+        return BLKDEV_ALIGN;
+    }
+
+    align = filestat.st_blksize;
+
+    /* it has to be a power of two that buffers can be aligned to */
+    if ((align < sizeof(void *)) || (align & (align - 1))) {
+        align = BLKDEV_ALIGN;
+    }
+    if (align > BLKDEV_MAX_ALIGN) {
+        align = BLKDEV_MAX_ALIGN;
+    }
+
+    return align;
+}
+
+
+/* blkdev_pread fills buf with up to len bytes from offset, stopping early
+ * only at the end of the file */
+long blkdev_pread(int fd, uint8_t * buf, unsigned long len,
+                  unsigned long offset)
+{
+    unsigned long got;
+    ssize_t ret;
+
+    got = 0;
+    while (got < len) {
+        ret = pread(fd, buf + got, len - got, offset + got);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+        got += ret;
+    }
+
+    return got;
+}
+
+
+/* blkdev_pread_aligned reads len bytes from offset with the read's start
+ * and length rounded out to align.  buf must be aligned and hold len plus
+ * two align.  The bytes asked for start at buf + skip; the return is how
+ * many of them were read. */
+long blkdev_pread_aligned(int fd, uint8_t * buf, unsigned long len,
+                          unsigned long offset, unsigned long align,
+                          unsigned long *skip)
+{
+    unsigned long start;
+    unsigned long want;
+    long got;
+
+    if (!buf || !skip || !align || (align & (align - 1))) {
+        FAIL_MSG("blkdev_pread_aligned: invalid params\n");
+        return -1;
+    }
+
+    start = offset & ~(align - 1);
+    *skip = offset - start;
+    want = (*skip + len + align - 1) & ~(align - 1);
+
+    got = blkdev_pread(fd, buf, want, start);
+    if (got < 0) {
+        return -1;
+    }
+
+    if ((unsigned long) got <= *skip) {
+        return 0;
+    }
+    got -= *skip;
+    if ((unsigned long) got > len) {
+        got = len;
+    }
+
+    return got;
+}
@@ -0,0 +1,53 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-blkdev.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_BLKDEV_H
+#define _RB_BLKDEV_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#ifdef __APPLE__
+#include <sys/disk.h>
+#endif
+
+#include "macro.h"
+
+/* the alignment used when a device won't say */
+#define BLKDEV_ALIGN 512
+/* the most an aligned read is rounded to */
+#define BLKDEV_MAX_ALIGN (64 * 1024)
+
+int blkdev_is_dev(struct stat *filestat);
+int blkdev_fstat(int fd, struct stat *filestat);
+int blkdev_stat(char *path, struct stat *filestat);
+unsigned long blkdev_align(int fd);
+long blkdev_pread(int fd, uint8_t * buf, unsigned long len,
+                  unsigned long offset);
+long blkdev_pread_aligned(int fd, uint8_t * buf, unsigned long len,
+                          unsigned long offset, unsigned long align,
+                          unsigned long *skip);
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-budget.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to share one memory budget between rubbermarbles and
+ * its visualisers.  Each process has a slot in the shared memory with what
+ * it has reserved of each kind, and the big buffers are reserved before
+ * they are made: those that can make do with less (trigraph points, the
+ * hexdump's prefetch, the deep zoom tiles, the block index, the spool) ask
+ * for what fits.  A process run on its own has no budget.
+ */
+
+#include "rb-budget.h"
+
+static struct rb_shm *budget_shm = NULL;
+static struct shm_budget *budget_slot = NULL;
+
+static const char *budget_names[SHM_BUDGET_KINDS] = {
+    "mappings", "plots", "points", "caches", "spool", "snapshots"
+};
+
+
+/* budget_init sets the budget for the session, taking rubbermarbles' own
+ * slot the first time */
+int budget_init(struct rb_shm *shm, unsigned long bytes)
+{
+    if (!shm) {
+        FAIL_MSG("budget_init: invalid params\n");
+        return 1;
+    }
+
+
+    __atomic_store_n(&shm->budget, bytes, __ATOMIC_RELEASE);
+
+    if (!budget_slot && (budget_attach(shm, "rubbermarbles") != 0)) {
+        FAIL_MSG("budget_init: budget_attach() failed\n");
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* budget_attach takes a slot in the budget for this process */
+int budget_attach(struct rb_shm *shm, char *name)
+{
+    pid_t pid = getpid();
+    pid_t expected;
+    int i, k;
+
+    if (!shm || !name) {
+        FAIL_MSG("budget_attach: invalid params\n");
+        return 1;
+    }
+
+
+    for (i = 0; i < SHM_BUDGETS; i++) {
+        expected = 0;
+        if ((__atomic_load_n(&shm->budgets[i].pid, __ATOMIC_ACQUIRE) == pid)
+            || __atomic_compare_exchange_n(&shm->budgets[i].pid, &expected,
+                                           pid, 0, __ATOMIC_ACQ_REL,
+                                           __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+
+    if (i >= SHM_BUDGETS) {
+        FAIL_MSG("budget_attach: no free slots\n");
+        return 2;
+    }
+
+
+    for (k = 0; k < SHM_BUDGET_KINDS; k++) {
+        __atomic_store_n(&shm->budgets[i].used[k], 0, __ATOMIC_RELAXED);
+    }
+    strncpy(shm->budgets[i].name, name, sizeof(shm->budgets[i].name) - 1);
+
+    budget_shm = shm;
+    budget_slot = &shm->budgets[i];
+
+    return 0;
+}
+
+
+/* budget_clear frees the slot of a process that has ended; it is called
+ * from the SIGCHLD handler */
+int budget_clear(struct rb_shm *shm, pid_t pid)
+{
+    int i, k;
+
+    if (!shm || (pid <= 0)) {
+        return 1;
+    }
+
+    for (i = 0; i < SHM_BUDGETS; i++) {
+        if (__atomic_load_n(&shm->budgets[i].pid, __ATOMIC_ACQUIRE) == pid) {
+            for (k = 0; k < SHM_BUDGET_KINDS; k++) {
+                __atomic_store_n(&shm->budgets[i].used[k], 0,
+                                 __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&shm->budgets[i].pid, 0, __ATOMIC_RELEASE);
+        }
+    }
+
+    return 0;
+}
+
+
+/* budget_default is the budget when the config doesn't give one */
+unsigned long budget_default()
+{
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pagesize = sysconf(_SC_PAGE_SIZE);
+
+    if ((pages <= 0) || (pagesize <= 0)) {
+        return 0;
+    }
+
+    return ((unsigned long) pages * pagesize) / BUDGET_SHARE;
+}
+
+
+/* budget_used is what every process has reserved between them */
+static unsigned long budget_used(struct rb_shm *shm)
+{
+    unsigned long used = 0;
+    int i, k;
+
+    for (i = 0; i < SHM_BUDGETS; i++) {
+        if (!__atomic_load_n(&shm->budgets[i].pid, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        for (k = 0; k < SHM_BUDGET_KINDS; k++) {
+            used += __atomic_load_n(&shm->budgets[i].used[k],
+                                    __ATOMIC_RELAXED);
+        }
+    }
+
+    return used;
+}
+
+
+/* budget_reserve reserves bytes of kind, returning non-zero without
+ * reserving anything if they don't fit */
+int budget_reserve(int kind, unsigned long bytes)
+{
+    unsigned long limit;
+
+    if (!budget_slot || (kind < 0) || (kind >= SHM_BUDGET_KINDS)) {
+        return 0;
+    }
+
+    limit = __atomic_load_n(&budget_shm->budget, __ATOMIC_ACQUIRE);
+    if (limit && (budget_used(budget_shm) + bytes > limit)) {
+        return 1;
+    }
+
+    __atomic_add_fetch(&budget_slot->used[kind], bytes, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+
+/* budget_fit reserves as much of want as fits, but never less than least,
+ * and returns how much that was */
+unsigned long budget_fit(int kind, unsigned long want, unsigned long least)
+{
+    unsigned long limit, used, got;
+
+    if (!budget_slot || (kind < 0) || (kind >= SHM_BUDGET_KINDS)) {
+        return want;
+    }
+
+    got = want;
+    limit = __atomic_load_n(&budget_shm->budget, __ATOMIC_ACQUIRE);
+    if (limit) {
+        used = budget_used(budget_shm);
+        if (used + want > limit) {
+            got = (used < limit) ? limit - used : 0;
+        }
+        if (got < least) {
+            got = least;
+        }
+    }
+
+    __atomic_add_fetch(&budget_slot->used[kind], got, __ATOMIC_RELAXED);
+
+    return got;
+}
+
+
+/* budget_charge counts bytes of kind whether they fit or not */
+void budget_charge(int kind, unsigned long bytes)
+{
+    if (!budget_slot || (kind < 0) || (kind >= SHM_BUDGET_KINDS)) {
+        return;
+    }
+
+    __atomic_add_fetch(&budget_slot->used[kind], bytes, __ATOMIC_RELAXED);
+}
+
+
+/* budget_release gives back bytes of kind */
+void budget_release(int kind, unsigned long bytes)
+{
+    unsigned long used;
+
+    if (!budget_slot || (kind < 0) || (kind >= SHM_BUDGET_KINDS)) {
+        return;
+    }
+
+    used = __atomic_load_n(&budget_slot->used[kind], __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&budget_slot->used[kind], &used,
+                                        (used > bytes) ? used - bytes : 0,
+                                        0, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+}
+
+
+/* budget_set sets what is held of kind, for things that are easier to
+ * count than to follow */
+void budget_set(int kind, unsigned long bytes)
+{
+    if (!budget_slot || (kind < 0) || (kind >= SHM_BUDGET_KINDS)) {
+        return;
+    }
+
+    __atomic_store_n(&budget_slot->used[kind], bytes, __ATOMIC_RELAXED);
+}
+
+
+/* budget_pressure returns 1 if the session is close to its budget */
+int budget_pressure()
+{
+    unsigned long limit;
+
+    if (!budget_slot) {
+        return 0;
+    }
+
+    limit = __atomic_load_n(&budget_shm->budget, __ATOMIC_ACQUIRE);
+    if (!limit) {
+        return 0;
+    }
+
+    return (budget_used(budget_shm) >= limit / 100 * BUDGET_HIGH) ? 1 : 0;
+}
+
+
+/* budget_report writes what each process has reserved, by kind, into buf */
+int budget_report(struct rb_shm *shm, char *buf, int len)
+{
+    unsigned long total[SHM_BUDGET_KINDS];
+    unsigned long used, limit;
+    int i, k, n = 0;
+
+    if (!shm || !buf || (len < 1)) {
+        FAIL_MSG("budget_report: invalid params\n");
+        return 1;
+    }
+
+
+    memset(total, 0, sizeof(total));
+    limit = __atomic_load_n(&shm->budget, __ATOMIC_ACQUIRE);
+    used = budget_used(shm);
+    if (limit) {
+        n += snprintf(buf + n, len - n, "%luMB of %luMB reserved\n\n",
+                      used >> 20, limit >> 20);
+    } else {
+        n += snprintf(buf + n, len - n, "%luMB reserved, no limit\n\n",
+                      used >> 20);
+    }
+
+    for (i = 0; (i < SHM_BUDGETS) && (n < len); i++) {
+        if (!__atomic_load_n(&shm->budgets[i].pid, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        n += snprintf(buf + n, len - n, "%.15s (%d):",
+                      shm->budgets[i].name, (int) shm->budgets[i].pid);
+        for (k = 0; (k < SHM_BUDGET_KINDS) && (n < len); k++) {
+            used = __atomic_load_n(&shm->budgets[i].used[k],
+                                   __ATOMIC_RELAXED);
+            total[k] += used;
+            if (used) {
+                n += snprintf(buf + n, len - n, " %s %luKB", budget_names[k],
+                              used >> 10);
+            }
+        }
+        if (n < len) {
+            n += snprintf(buf + n, len - n, "\n");
+        }
+    }
+
+    if (n < len) {
+        n += snprintf(buf + n, len - n, "\nall:");
+    }
+    for (k = 0; (k < SHM_BUDGET_KINDS) && (n < len); k++) {
+        n += snprintf(buf + n, len - n, " %s %luKB", budget_names[k],
+                      total[k] >> 10);
+    }
+    if (n < len) {
+        snprintf(buf + n, len - n, "\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-budget.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_BUDGET_H
+#define _RB_BUDGET_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "rb-shm.h"
+#include "macro.h"
+
+/* what the memory is spent on; SHM_BUDGET_KINDS of them */
+#define BUDGET_MMAP 0           /* mappings of the file */
+#define BUDGET_PICS 1           /* the saved plots */
+#define BUDGET_POINTS 2         /* trigraph vertices */
+#define BUDGET_CACHE 3          /* tiles and indexes */
+#define BUDGET_SPOOL 4          /* piped input kept in memory */
+#define BUDGET_SNAPSHOT 5       /* process memory copied in */
+
+/* the config param, in MB; without it the session gets a share of the
+ * machine's memory */
+#define BUDGET_CONF "budget_mb"
+#define BUDGET_SHARE 2
+
+/* above this percentage of the budget, things that can shrink do */
+#define BUDGET_HIGH 90
+
+int budget_init(struct rb_shm *shm, unsigned long bytes);
+int budget_attach(struct rb_shm *shm, char *name);
+int budget_clear(struct rb_shm *shm, pid_t pid);
+unsigned long budget_default();
+int budget_reserve(int kind, unsigned long bytes);
+unsigned long budget_fit(int kind, unsigned long want, unsigned long least);
+void budget_charge(int kind, unsigned long bytes);
+void budget_release(int kind, unsigned long bytes);
+void budget_set(int kind, unsigned long bytes);
+int budget_pressure();
+int budget_report(struct rb_shm *shm, char *buf, int len);
+
+#endif
@@ -0,0 +1,402 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-change.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to find the parts of a file that have been changed in
+ * place, such as a disk image or memory snapshot that a VM is writing to.
+ * Each 64KB block is hashed with xxHash64, which runs much faster than the
+ * disk, and the file is streamed through rb_scan() so every CPU shares the
+ * hashing.  A rescan compares each block's hash with the last one and marks
+ * the blocks that differ as dirty.
+ */
+
+#include "rb-change.h"
+
+
+/* change_rotl rotates x left by r bits */
+static inline uint64_t change_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+/* change_read64 reads 8 bytes without caring about alignment */
+static inline uint64_t change_read64(const uint8_t * p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+
+/* change_read32 reads 4 bytes without caring about alignment */
+static inline uint32_t change_read32(const uint8_t * p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+
+/* change_round mixes 8 bytes of input into an accumulator */
+static inline uint64_t change_round(uint64_t acc, uint64_t input)
+{
+    acc += input * CHANGE_P2;
+    acc = change_rotl(acc, 31);
+
+    return acc * CHANGE_P1;
+}
+
+
+/* change_merge folds an accumulator into the hash */
+static inline uint64_t change_merge(uint64_t h, uint64_t acc)
+{
+    h ^= change_round(0, acc);
+
+    return (h * CHANGE_P1) + CHANGE_P4;
+}
+
+
+/* change_hash returns the xxHash64 of buf, with a seed of 0 */
+uint64_t change_hash(const uint8_t * buf, unsigned long len)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+    uint64_t v1, v2, v3, v4;
+    uint64_t h;
+
+    if (len >= 32) {
+        v1 = CHANGE_P1 + CHANGE_P2;
+        v2 = CHANGE_P2;
+        v3 = 0;
+        v4 = -CHANGE_P1;
+
+        /* four independent lanes, 32 bytes at a time */
+        do {
+            v1 = change_round(v1, change_read64(p));
+            v2 = change_round(v2, change_read64(p + 8));
+            v3 = change_round(v3, change_read64(p + 16));
+            v4 = change_round(v4, change_read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = change_rotl(v1, 1) + change_rotl(v2, 7) + change_rotl(v3, 12) +
+            change_rotl(v4, 18);
+        h = change_merge(h, v1);
+        h = change_merge(h, v2);
+        h = change_merge(h, v3);
+        h = change_merge(h, v4);
+    } else {
+        h = CHANGE_P5;
+    }
+
+    h += len;
+
+    /* the tail */
+    while (p + 8 <= end) {
+        h ^= change_round(0, change_read64(p));
+        h = (change_rotl(h, 27) * CHANGE_P1) + CHANGE_P4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) change_read32(p) * CHANGE_P1;
+        h = (change_rotl(h, 23) * CHANGE_P2) + CHANGE_P3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * CHANGE_P5;
+        h = change_rotl(h, 11) * CHANGE_P1;
+        p++;
+    }
+
+    /* avalanche */
+    h ^= h >> 33;
+    h *= CHANGE_P2;
+    h ^= h >> 29;
+    h *= CHANGE_P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+
+/* change_scan is the scan callback; it hashes each block in the chunk and
+ * compares it with the last hash */
+static int change_scan(void *arg, int thread, unsigned long block,
+                       unsigned long offset, const uint8_t * buf,
+                       unsigned long len, unsigned long total)
+{
+    struct change_ctx *ctx = (struct change_ctx *) arg;
+    unsigned long pos, size, b;
+    uint64_t hash;
+    uint8_t state;
+
+    for (pos = 0; pos < len; pos += CHANGE_BLOCK_SIZE) {
+        size = len - pos;
+        if (size > CHANGE_BLOCK_SIZE) {
+            size = CHANGE_BLOCK_SIZE;
+        }
+
+        b = (offset + pos) / CHANGE_BLOCK_SIZE;
+        hash = change_hash(buf + pos, size);
+
+        /* a block seen for the first time is the baseline */
+        state = CHANGE_SAME;
+        if ((ctx->state[b] != CHANGE_UNHASHED) && (ctx->hashes[b] != hash)) {
+            state = CHANGE_DIRTY;
+            __atomic_add_fetch(&ctx->dirty, 1, __ATOMIC_RELAXED);
+        }
+
+        ctx->hashes[b] = hash;
+        __atomic_store_n(&ctx->state[b], state, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+
+/* change_new creates an empty set of hashes for a file of size bytes */
+struct change_ctx *change_new(unsigned long size)
+{
+    struct change_ctx *ctx;
+
+    ctx = (struct change_ctx *) calloc(1, sizeof(struct change_ctx));
+    if (!ctx) {
+        FAIL_MSG("change_new: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->size = size;
+    ctx->nblocks = (size + CHANGE_BLOCK_SIZE - 1) / CHANGE_BLOCK_SIZE;
+    ctx->hashes = (uint64_t *) calloc(ctx->nblocks + 1, sizeof(uint64_t));
+    ctx->state = (uint8_t *) calloc(ctx->nblocks + 1, sizeof(uint8_t));
+    if (!ctx->hashes || !ctx->state) {
+        FAIL_MSG("change_new: calloc() failed\n");
+        free(ctx->hashes);
+        free(ctx->state);
+        free(ctx);
+        return NULL;
+    }
+
+
+    return ctx;
+}
+
+
+/* change_start rehashes the file, now size bytes, in the background.
+ * Blocks the file has grown into are hashed as a new baseline. */
+int change_start(struct change_ctx *ctx, int fd, unsigned long size)
+{
+    unsigned long nblocks;
+    uint64_t *hashes;
+    uint8_t *state;
+
+    if (!ctx || (fd < 0) || ctx->scan.running) {
+        FAIL_MSG("change_start: invalid params\n");
+        return 1;
+    }
+
+
+    nblocks = (size + CHANGE_BLOCK_SIZE - 1) / CHANGE_BLOCK_SIZE;
+    if (size < ctx->size) {
+        /* a truncated file starts again */
+        memset(ctx->state, CHANGE_UNHASHED, ctx->nblocks);
+    } else if (nblocks > ctx->nblocks) {
+        hashes = (uint64_t *) realloc(ctx->hashes,
+                                      (nblocks + 1) * sizeof(uint64_t));
+        if (!hashes) {
+            FAIL_MSG("change_start: realloc() failed\n");
+            return 2;
+        }
+
+        ctx->hashes = hashes;
+
+        state = (uint8_t *) realloc(ctx->state, nblocks + 1);
+        if (!state) {
+            FAIL_MSG("change_start: realloc() failed\n");
+            return 3;
+        }
+
+        ctx->state = state;
+        memset(ctx->state + ctx->nblocks, CHANGE_UNHASHED,
+               nblocks + 1 - ctx->nblocks);
+        ctx->nblocks = nblocks;
+    }
+
+    /* the last block was short, so its hash can't be compared */
+    if ((size != ctx->size) && (ctx->size % CHANGE_BLOCK_SIZE)) {
+        ctx->state[ctx->size / CHANGE_BLOCK_SIZE] = CHANGE_UNHASHED;
+    }
+
+    ctx->size = size;
+    ctx->dirty = 0;
+    ctx->scans++;
+
+    /* scan blocks are a multiple of the hashed blocks */
+    if (rb_scan_init(&ctx->scan, fd, 0, ctx->size, SCAN_BLOCK_SIZE, 0,
+                     change_scan, ctx) != 0) {
+        FAIL_MSG("change_start: rb_scan_init() failed\n");
+        return 4;
+    }
+
+
+    if (rb_scan_start(&ctx->scan) != 0) {
+        FAIL_MSG("change_start: rb_scan_start() failed\n");
+        return 5;
+    }
+
+
+    return 0;
+}
+
+
+/* change_finished returns whether the rescan has ended, or was never
+ * started */
+int change_finished(struct change_ctx *ctx)
+{
+    if (!ctx || !ctx->scan.running) {
+        return 1;
+    }
+
+    if (!__atomic_load_n(&ctx->scan.finished, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    rb_scan_wait(&ctx->scan);
+
+    return 1;
+}
+
+
+/* change_free stops the rescan if it is running and frees the hashes */
+int change_free(struct change_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("change_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->scan.running) {
+        __atomic_store_n(&ctx->scan.cancel, 1, __ATOMIC_RELAXED);
+        rb_scan_wait(&ctx->scan);
+    }
+
+    free(ctx->hashes);
+    free(ctx->state);
+    free(ctx);
+
+    return 0;
+}
+
+
+/* change_dirty returns whether the block holding offset changed at the
+ * last rescan */
+int change_dirty(struct change_ctx *ctx, unsigned long offset)
+{
+    if (!ctx || (offset >= ctx->size)) {
+        return 0;
+    }
+
+    return __atomic_load_n(&ctx->state[offset / CHANGE_BLOCK_SIZE],
+                           __ATOMIC_ACQUIRE) == CHANGE_DIRTY;
+}
+
+
+/* change_range finds the first run of dirty blocks at or after from and
+ * returns 1, with the run in start and end, or 0 if there are no more */
+int change_range(struct change_ctx *ctx, unsigned long from,
+                 unsigned long *start, unsigned long *end)
+{
+    unsigned long b;
+
+    if (!ctx || !start || !end) {
+        return 0;
+    }
+
+    for (b = from / CHANGE_BLOCK_SIZE; b < ctx->nblocks; b++) {
+        if (ctx->state[b] == CHANGE_DIRTY) {
+            break;
+        }
+    }
+
+    if (b >= ctx->nblocks) {
+        return 0;
+    }
+
+    *start = b * CHANGE_BLOCK_SIZE;
+    while ((b < ctx->nblocks) && (ctx->state[b] == CHANGE_DIRTY)) {
+        b++;
+    }
+
+    *end = b * CHANGE_BLOCK_SIZE;
+    if (*end > ctx->size) {
+        *end = ctx->size;
+    }
+    if (*start < from) {
+        *start = from;
+    }
+
+    return 1;
+}
+
+
+/* change_clear forgets which blocks changed, ready for change_mark() */
+int change_clear(struct change_ctx *ctx)
+{
+    unsigned long b;
+
+    if (!ctx || ctx->scan.running) {
+        FAIL_MSG("change_clear: invalid params\n");
+        return 1;
+    }
+
+
+    for (b = 0; b < ctx->nblocks; b++) {
+        if (ctx->state[b] == CHANGE_DIRTY) {
+            ctx->state[b] = CHANGE_SAME;
+        }
+    }
+    ctx->dirty = 0;
+
+    return 0;
+}
+
+
+/* change_mark marks the blocks from start to end as changed, for sources
+ * that know what changed without hashing the file.  The marked blocks'
+ * hashes are left stale, so a later rescan sees them change too. */
+int change_mark(struct change_ctx *ctx, unsigned long start,
+                unsigned long end)
+{
+    unsigned long b;
+
+    if (!ctx || ctx->scan.running || (end < start) || (end > ctx->size)) {
+        FAIL_MSG("change_mark: invalid params\n");
+        return 1;
+    }
+
+
+    for (b = start / CHANGE_BLOCK_SIZE;
+         b < (end + CHANGE_BLOCK_SIZE - 1) / CHANGE_BLOCK_SIZE; b++) {
+        if (ctx->state[b] != CHANGE_DIRTY) {
+            ctx->state[b] = CHANGE_DIRTY;
+            ctx->dirty++;
+        }
+    }
+
+    return 0;
+}
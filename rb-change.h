@@ -0,0 +1,66 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-change.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_CHANGE_H
+#define _RB_CHANGE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rb-scan.h"
+#include "macro.h"
+
+/* each block of this size gets a hash */
+#define CHANGE_BLOCK_SIZE (64 * 1024)
+
+/* block states */
+#define CHANGE_UNHASHED 0
+#define CHANGE_SAME 1
+#define CHANGE_DIRTY 2
+
+/* xxHash64 primes */
+#define CHANGE_P1 0x9E3779B185EBCA87ULL
+#define CHANGE_P2 0xC2B2AE3D27D4EB4FULL
+#define CHANGE_P3 0x165667B19E3779F9ULL
+#define CHANGE_P4 0x85EBCA77C2B2AE63ULL
+#define CHANGE_P5 0x27D4EB2F165667C5ULL
+
+/* the block hashes of a file */
+struct change_ctx {
+    unsigned long size;
+    unsigned long nblocks;
+    uint64_t *hashes;
+    uint8_t *state;
+    unsigned long dirty;        /* blocks that changed at the last rescan */
+    unsigned long scans;
+
+    struct scan_ctx scan;
+};
+
+uint64_t change_hash(const uint8_t * buf, unsigned long len);
+struct change_ctx *change_new(unsigned long size);
+int change_start(struct change_ctx *ctx, int fd, unsigned long size);
+int change_finished(struct change_ctx *ctx);
+int change_free(struct change_ctx *ctx);
+int change_dirty(struct change_ctx *ctx, unsigned long offset);
+int change_range(struct change_ctx *ctx, unsigned long from,
+                 unsigned long *start, unsigned long *end);
+int change_clear(struct change_ctx *ctx);
+int change_mark(struct change_ctx *ctx, unsigned long start,
+                unsigned long end);
+
+#endif
@@ -0,0 +1,507 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-classify.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to label the regions of a file by type, after Conti.
+ * Each 64KB block gets a byte histogram, entropy, chi-square, ascii and
+ * zero ratios, the number of distinct byte pairs and how alike bytes are at
+ * short strides; a few thresholds turn those into a label.  The file is
+ * streamed through rb_scan() so every CPU shares the work and only the
+ * small per-block features are kept.
+ */
+
+#include "rb-classify.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+static char *class_names[CLASS_LABELS] = {
+    "unclassified",
+    "padding",
+    "text",
+    "machine code",
+    "compressed/encrypted",
+    "image data",
+    "table",
+    "data"
+};
+
+
+/* class_ratio scales a count to a ratio out of 255 */
+static inline uint8_t class_ratio(unsigned long count, unsigned long len)
+{
+    return (uint8_t) ((count * 255) / len);
+}
+
+
+/* class_close returns whether two bytes are close enough to be pixels */
+static inline int class_close(uint8_t a, uint8_t b)
+{
+    return (uint8_t) (a - b + CLASS_IMAGE_DELTA) <= 2 * CLASS_IMAGE_DELTA;
+}
+
+
+/* class_strides_byte counts close and equal bytes one at a time */
+static void class_strides_byte(const uint8_t * buf, unsigned long from,
+                               unsigned long len, unsigned long *smooth,
+                               unsigned long *repeat)
+{
+    unsigned long i;
+    int s;
+
+    for (i = from; i < len; i++) {
+        for (s = 1; s <= 4; s++) {
+            if (i >= s) {
+                smooth[s - 1] += class_close(buf[i], buf[i - s]);
+            }
+        }
+        for (s = 0; s < 3; s++) {
+            if (i >= (4 << s)) {
+                repeat[s] += (buf[i] == buf[i - (4 << s)]);
+            }
+        }
+    }
+}
+
+
+#ifdef __SSE2__
+/* class_strides counts, for each stride, the bytes that are close to (for
+ * strides 1 to 4) or equal to (for strides 4, 8 and 16) the byte that far
+ * back, 16 at a time.  The per-lane byte counters are emptied through
+ * psadbw before they can wrap.
+ */
+static void class_strides(const uint8_t * buf, unsigned long len,
+                          unsigned long *smooth, unsigned long *repeat)
+{
+    __m128i v, w, d, delta, range, zero;
+    __m128i sacc[4], racc[3];
+    __m128i stot[4], rtot[3];
+    unsigned long i;
+    int s, run;
+
+    memset(smooth, 0, 4 * sizeof(unsigned long));
+    memset(repeat, 0, 3 * sizeof(unsigned long));
+    if (len < 32) {
+        class_strides_byte(buf, 0, len, smooth, repeat);
+        return;
+    }
+
+    delta = _mm_set1_epi8(CLASS_IMAGE_DELTA);
+    range = _mm_set1_epi8(2 * CLASS_IMAGE_DELTA);
+    zero = _mm_setzero_si128();
+    for (s = 0; s < 4; s++) {
+        stot[s] = zero;
+    }
+    for (s = 0; s < 3; s++) {
+        rtot[s] = zero;
+    }
+
+    /* the first 16 bytes don't have all of their history */
+    class_strides_byte(buf, 0, 16, smooth, repeat);
+
+    i = 16;
+    while (i + 16 <= len) {
+        for (s = 0; s < 4; s++) {
+            sacc[s] = zero;
+        }
+        for (s = 0; s < 3; s++) {
+            racc[s] = zero;
+        }
+
+        for (run = 0; (run < 255) && (i + 16 <= len); run++, i += 16) {
+            v = _mm_loadu_si128((const __m128i *) (buf + i));
+            for (s = 0; s < 4; s++) {
+                w = _mm_loadu_si128((const __m128i *) (buf + i - s - 1));
+                d = _mm_add_epi8(_mm_sub_epi8(v, w), delta);
+                /* compare results are -1, so subtracting counts them */
+                d = _mm_cmpeq_epi8(_mm_min_epu8(d, range), d);
+                sacc[s] = _mm_sub_epi8(sacc[s], d);
+            }
+            for (s = 0; s < 3; s++) {
+                w = _mm_loadu_si128((const __m128i *) (buf + i -
+                                                       (4 << s)));
+                racc[s] = _mm_sub_epi8(racc[s], _mm_cmpeq_epi8(v, w));
+            }
+        }
+
+        for (s = 0; s < 4; s++) {
+            stot[s] = _mm_add_epi64(stot[s], _mm_sad_epu8(sacc[s], zero));
+        }
+        for (s = 0; s < 3; s++) {
+            rtot[s] = _mm_add_epi64(rtot[s], _mm_sad_epu8(racc[s], zero));
+        }
+    }
+
+    for (s = 0; s < 4; s++) {
+        smooth[s] += _mm_cvtsi128_si32(stot[s]) +
+            _mm_cvtsi128_si32(_mm_srli_si128(stot[s], 8));
+    }
+    for (s = 0; s < 3; s++) {
+        repeat[s] += _mm_cvtsi128_si32(rtot[s]) +
+            _mm_cvtsi128_si32(_mm_srli_si128(rtot[s], 8));
+    }
+
+    class_strides_byte(buf, i, len, smooth, repeat);
+}
+#else
+/* class_strides counts, for each stride, the bytes that are close to (for
+ * strides 1 to 4) or equal to (for strides 4, 8 and 16) the byte that far
+ * back */
+static void class_strides(const uint8_t * buf, unsigned long len,
+                          unsigned long *smooth, unsigned long *repeat)
+{
+    memset(smooth, 0, 4 * sizeof(unsigned long));
+    memset(repeat, 0, 3 * sizeof(unsigned long));
+    class_strides_byte(buf, 0, len, smooth, repeat);
+}
+#endif
+
+
+/* class_features computes the features of a block */
+int class_features(const uint8_t * buf, unsigned long len,
+                   struct class_block *blk)
+{
+    uint32_t hist[4][256];
+    uint64_t pairs[1024];
+    unsigned long count[256];
+    unsigned long i, best, n, sample;
+    unsigned long smooth[4], repeat[3];
+    unsigned long printable, maxcount;
+    int s, c;
+    double p, expect;
+
+    if (!buf || !len || !blk) {
+        FAIL_MSG("class_features: invalid params\n");
+        return 1;
+    }
+
+
+    /* four histograms so that runs of one byte don't stall on a counter */
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i + 4 <= len; i += 4) {
+        hist[0][buf[i]]++;
+        hist[1][buf[i + 1]]++;
+        hist[2][buf[i + 2]]++;
+        hist[3][buf[i + 3]]++;
+    }
+    for (; i < len; i++) {
+        hist[0][buf[i]]++;
+    }
+
+    blk->entropy = 0.0;
+    blk->chisq = 0.0;
+    expect = (double) len / 256.0;
+    printable = 0;
+    maxcount = 0;
+    for (c = 0; c < 256; c++) {
+        count[c] = hist[0][c] + hist[1][c] + hist[2][c] + hist[3][c];
+        if (count[c]) {
+            p = (double) count[c] / (double) len;
+            blk->entropy -= p * log2(p);
+        }
+        blk->chisq += ((count[c] - expect) * (count[c] - expect)) / expect;
+        if (((c >= 0x20) && (c < 0x7f)) || (c == '\t') || (c == '\n')
+            || (c == '\r')) {
+            printable += count[c];
+        }
+        if (count[c] > maxcount) {
+            maxcount = count[c];
+        }
+    }
+    blk->ascii = class_ratio(printable, len);
+    blk->zero = class_ratio(count[0], len);
+    blk->fill = class_ratio(maxcount, len);
+
+    /* padding needs nothing else */
+    if (maxcount >= CLASS_PADDING_RATIO * len) {
+        blk->pairs = 0;
+        blk->smooth = 255;
+        blk->repeat = 255;
+        return 0;
+    }
+
+    /* distinct byte pairs, as a bitmap of all 65536, over a sample */
+    memset(pairs, 0, sizeof(pairs));
+    sample = (len < CLASS_PAIR_SAMPLE) ? len : CLASS_PAIR_SAMPLE;
+    for (i = 1; i < sample; i++) {
+        n = (buf[i - 1] << 8) | buf[i];
+        pairs[n >> 6] |= 1ULL << (n & 63);
+    }
+    n = 0;
+    for (i = 0; i < 1024; i++) {
+        n += __builtin_popcountll(pairs[i]);
+    }
+    blk->pairs = (sample > 1) ? class_ratio(n, sample - 1) : 0;
+
+    /* how alike bytes are at strides 1 to 4 and 4, 8 and 16 */
+    class_strides(buf, len, smooth, repeat);
+
+    best = 0;
+    for (s = 0; s < 4; s++) {
+        if (smooth[s] > best) {
+            best = smooth[s];
+        }
+    }
+    blk->smooth = class_ratio(best, len);
+
+    best = 0;
+    for (s = 0; s < 3; s++) {
+        if (repeat[s] > best) {
+            best = repeat[s];
+        }
+    }
+    blk->repeat = class_ratio(best, len);
+
+    return 0;
+}
+
+
+/* class_label_block labels a block from its features */
+int class_label_block(struct class_block *blk)
+{
+    if (!blk) {
+        FAIL_MSG("class_label_block: invalid params\n");
+        return CLASS_NONE;
+    }
+
+
+    if (blk->fill >= CLASS_PADDING_RATIO * 255) {
+        return CLASS_PADDING;
+    }
+    if (blk->ascii >= CLASS_TEXT_RATIO * 255) {
+        return CLASS_TEXT;
+    }
+    if (blk->repeat >= CLASS_TABLE_RATIO * 255) {
+        return CLASS_TABLE;
+    }
+    if ((blk->smooth >= CLASS_IMAGE_RATIO * 255)
+        && (blk->entropy >= CLASS_IMAGE_ENTROPY)) {
+        return CLASS_IMAGE;
+    }
+    /* random bytes are rarely close, so this is safe after the image test */
+    if (blk->entropy >= CLASS_COMPRESSED_ENTROPY) {
+        return CLASS_COMPRESSED;
+    }
+    if ((blk->entropy >= CLASS_CODE_ENTROPY)
+        && (blk->pairs >= CLASS_CODE_PAIRS * 255)) {
+        return CLASS_CODE;
+    }
+
+    return CLASS_DATA;
+}
+
+
+/* class_name returns the name of a label */
+char *class_name(int label)
+{
+    if ((label < 0) || (label >= CLASS_LABELS)) {
+        return class_names[CLASS_NONE];
+    }
+
+    return class_names[label];
+}
+
+
+/* class_scan is the scan callback; it classifies each block in the chunk */
+static int class_scan(void *arg, int thread, unsigned long block,
+                      unsigned long offset, const uint8_t * buf,
+                      unsigned long len, unsigned long total)
+{
+    struct class_ctx *ctx = (struct class_ctx *) arg;
+    struct class_block *blk;
+    unsigned long pos, size;
+
+    for (pos = 0; pos < len; pos += CLASS_BLOCK_SIZE) {
+        size = len - pos;
+        if (size > CLASS_BLOCK_SIZE) {
+            size = CLASS_BLOCK_SIZE;
+        }
+
+        blk = &ctx->blocks[(offset + pos) / CLASS_BLOCK_SIZE];
+        if (class_features(buf + pos, size, blk) != 0) {
+            FAIL_MSG("class_scan: class_features() failed\n");
+            return 1;
+        }
+
+        /* the label goes in last; the gui reads it while we run */
+        __atomic_store_n(&blk->label, class_label_block(blk),
+                         __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+
+/* class_new creates an empty classification for a file of size bytes */
+struct class_ctx *class_new(unsigned long size)
+{
+    struct class_ctx *ctx;
+
+    ctx = (struct class_ctx *) calloc(1, sizeof(struct class_ctx));
+    if (!ctx) {
+        FAIL_MSG("class_new: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->size = size;
+    ctx->nblocks = (size + CLASS_BLOCK_SIZE - 1) / CLASS_BLOCK_SIZE;
+    ctx->blocks = (struct class_block *) calloc(ctx->nblocks + 1,
+                                                sizeof(struct
+                                                       class_block));
+    if (!ctx->blocks) {
+        FAIL_MSG("class_new: calloc() failed\n");
+        free(ctx);
+        return NULL;
+    }
+
+
+    return ctx;
+}
+
+
+/* class_start classifies the file in the background */
+int class_start(struct class_ctx *ctx, int fd)
+{
+    if (!ctx || (fd < 0)) {
+        FAIL_MSG("class_start: invalid params\n");
+        return 1;
+    }
+
+
+    /* scan blocks are a multiple of the classifier blocks */
+    if (rb_scan_init(&ctx->scan, fd, 0, ctx->size, SCAN_BLOCK_SIZE, 0,
+                     class_scan, ctx) != 0) {
+        FAIL_MSG("class_start: rb_scan_init() failed\n");
+        return 2;
+    }
+
+
+    if (rb_scan_start(&ctx->scan) != 0) {
+        FAIL_MSG("class_start: rb_scan_start() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* class_finished returns whether the classification has ended */
+int class_finished(struct class_ctx *ctx)
+{
+    if (!ctx) {
+        return 1;
+    }
+
+    if (!__atomic_load_n(&ctx->scan.finished, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    rb_scan_wait(&ctx->scan);
+
+    return 1;
+}
+
+
+/* class_free stops the classification if it is running and frees it */
+int class_free(struct class_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("class_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->scan.running) {
+        __atomic_store_n(&ctx->scan.cancel, 1, __ATOMIC_RELAXED);
+        rb_scan_wait(&ctx->scan);
+    }
+
+    free(ctx->blocks);
+    free(ctx);
+
+    return 0;
+}
+
+
+/* class_label returns the label of the block holding offset */
+int class_label(struct class_ctx *ctx, unsigned long offset)
+{
+    if (!ctx || (offset >= ctx->size)) {
+        return CLASS_NONE;
+    }
+
+    return __atomic_load_n(&ctx->blocks[offset / CLASS_BLOCK_SIZE].label,
+                           __ATOMIC_ACQUIRE);
+}
+
+
+/* class_query summarises the blocks between start and end, weighting each
+ * by how much of it is in the range */
+int class_query(struct class_ctx *ctx, unsigned long start,
+                unsigned long end, struct class_summary *summary)
+{
+    struct class_block *blk;
+    unsigned long b, bstart, bend, weight;
+    int label;
+
+    if (!ctx || !summary || (end < start)) {
+        FAIL_MSG("class_query: invalid params\n");
+        return 1;
+    }
+
+
+    memset(summary, 0, sizeof(struct class_summary));
+    if (end > ctx->size) {
+        end = ctx->size;
+    }
+    if (start >= end) {
+        return 0;
+    }
+
+    summary->bytes = end - start;
+    for (b = start / CLASS_BLOCK_SIZE; b * CLASS_BLOCK_SIZE < end; b++) {
+        bstart = b * CLASS_BLOCK_SIZE;
+        bend = bstart + CLASS_BLOCK_SIZE;
+        if (bstart < start) {
+            bstart = start;
+        }
+        if (bend > end) {
+            bend = end;
+        }
+        weight = bend - bstart;
+
+        blk = &ctx->blocks[b];
+        label = __atomic_load_n(&blk->label, __ATOMIC_ACQUIRE);
+        summary->labels[label] += weight;
+        if (label == CLASS_NONE) {
+            continue;
+        }
+
+        summary->classified += weight;
+        summary->entropy += blk->entropy * weight;
+        summary->chisq += blk->chisq * weight;
+        summary->ascii += blk->ascii * weight;
+        summary->zero += blk->zero * weight;
+    }
+
+    if (summary->classified) {
+        summary->entropy /= summary->classified;
+        summary->chisq /= summary->classified;
+        summary->ascii /= 255.0 * summary->classified;
+        summary->zero /= 255.0 * summary->classified;
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-classify.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_CLASSIFY_H
+#define _RB_CLASSIFY_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "rb-scan.h"
+#include "macro.h"
+
+/* the classifier labels blocks of this size */
+#define CLASS_BLOCK_SIZE (64 * 1024)
+
+/* region labels */
+#define CLASS_NONE 0
+#define CLASS_PADDING 1
+#define CLASS_TEXT 2
+#define CLASS_CODE 3
+#define CLASS_COMPRESSED 4
+#define CLASS_IMAGE 5
+#define CLASS_TABLE 6
+#define CLASS_DATA 7
+#define CLASS_LABELS 8
+
+/* thresholds */
+#define CLASS_PADDING_RATIO 0.97
+#define CLASS_TEXT_RATIO 0.90
+#define CLASS_COMPRESSED_ENTROPY 7.5
+#define CLASS_TABLE_RATIO 0.5
+#define CLASS_IMAGE_RATIO 0.6
+#define CLASS_IMAGE_ENTROPY 3.0
+#define CLASS_IMAGE_DELTA 8
+#define CLASS_CODE_ENTROPY 4.5
+#define CLASS_CODE_PAIRS 0.05
+
+/* byte pairs are counted over the start of each block */
+#define CLASS_PAIR_SAMPLE (16 * 1024)
+
+/* the features of one block */
+struct class_block {
+    float entropy;              /* bits per byte */
+    float chisq;                /* against uniform bytes */
+    uint8_t ascii;              /* printable ratio, out of 255 */
+    uint8_t zero;               /* zero byte ratio, out of 255 */
+    uint8_t fill;               /* commonest byte ratio, out of 255 */
+    uint8_t pairs;              /* distinct byte pairs ratio, out of 255 */
+    uint8_t smooth;             /* small delta ratio at the best stride */
+    uint8_t repeat;             /* equal byte ratio at the best stride */
+    uint8_t label;
+};
+
+/* a summary of the blocks in a range */
+struct class_summary {
+    unsigned long bytes;
+    unsigned long classified;
+    unsigned long labels[CLASS_LABELS];
+    double entropy;
+    double chisq;
+    double ascii;
+    double zero;
+};
+
+/* a classification of a whole file */
+struct class_ctx {
+    unsigned long size;
+    unsigned long nblocks;
+    struct class_block *blocks;
+
+    struct scan_ctx scan;
+};
+
+int class_features(const uint8_t * buf, unsigned long len,
+                   struct class_block *blk);
+int class_label_block(struct class_block *blk);
+char *class_name(int label);
+struct class_ctx *class_new(unsigned long size);
+int class_start(struct class_ctx *ctx, int fd);
+int class_finished(struct class_ctx *ctx);
+int class_free(struct class_ctx *ctx);
+int class_label(struct class_ctx *ctx, unsigned long offset);
+int class_query(struct class_ctx *ctx, unsigned long start,
+                unsigned long end, struct class_summary *summary);
+
+#endif
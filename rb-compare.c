@@ -0,0 +1,690 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-compare.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to compare two files.  The first file is streamed
+ * through rb_scan() and each worker reads the same range of the second, so
+ * both are read once, in large sequential chunks, on every CPU.  The bytes
+ * that differ are counted 64 at a time with SSE2 compares and a popcount of
+ * the mask, and only the count for each 4KB block is kept.  Bytes that only
+ * one file has count as different.
+ * A lined up comparison finds where the bytes of the first file are in the
+ * second with rb-align first, on another thread, and then compares each
+ * block with the bytes it lines up with, marking the blocks that were moved,
+ * inserted, or that have bytes of the second file missing.
+ */
+
+#include "rb-compare.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/* cmp_count returns the number of bytes that differ between a and b */
+unsigned long cmp_count(const uint8_t * a, const uint8_t * b,
+                        unsigned long len)
+{
+    unsigned long n, i;
+    uint64_t x;
+
+    n = 0;
+    i = 0;
+
+#ifdef __SSE2__
+    /* a set bit in the mask is a byte that is the same */
+    for (; i + 64 <= len; i += 64) {
+        x = (uint64_t) (uint16_t)
+            _mm_movemask_epi8(_mm_cmpeq_epi8
+                              (_mm_loadu_si128((const __m128i *) (a + i)),
+                               _mm_loadu_si128((const __m128i *) (b + i))));
+        x |= (uint64_t) (uint16_t)
+            _mm_movemask_epi8(_mm_cmpeq_epi8
+                              (_mm_loadu_si128
+                               ((const __m128i *) (a + i + 16)),
+                               _mm_loadu_si128((const __m128i *) (b + i +
+                                                                  16)))) <<
+            16;
+        x |= (uint64_t) (uint16_t)
+            _mm_movemask_epi8(_mm_cmpeq_epi8
+                              (_mm_loadu_si128
+                               ((const __m128i *) (a + i + 32)),
+                               _mm_loadu_si128((const __m128i *) (b + i +
+                                                                  32)))) <<
+            32;
+        x |= (uint64_t) (uint16_t)
+            _mm_movemask_epi8(_mm_cmpeq_epi8
+                              (_mm_loadu_si128
+                               ((const __m128i *) (a + i + 48)),
+                               _mm_loadu_si128((const __m128i *) (b + i +
+                                                                  48)))) <<
+            48;
+        n += 64 - __builtin_popcountll(x);
+    }
+#endif
+
+    /* otherwise xor a word at a time and fold each byte down to a bit */
+    for (; i + 8 <= len; i += 8) {
+        uint64_t wa, wb;
+
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+        x = wa ^ wb;
+        x |= x >> 4;
+        x |= x >> 2;
+        x |= x >> 1;
+        n += __builtin_popcountll(x & 0x0101010101010101ULL);
+    }
+
+    for (; i < len; i++) {
+        n += (a[i] != b[i]);
+    }
+
+    return n;
+}
+
+
+/* cmp_scan is the scan callback; it reads the same range of the second
+ * file and counts the differences in each block */
+static int cmp_scan(void *arg, int thread, unsigned long block,
+                    unsigned long offset, const uint8_t * buf,
+                    unsigned long len, unsigned long total)
+{
+    struct cmp_ctx *ctx = (struct cmp_ctx *) arg;
+    unsigned long pos, size, n, end, dblocks, sum;
+    uint8_t *other;
+
+    if (!ctx->bufs[thread]) {
+        ctx->bufs[thread] = (uint8_t *) malloc(SCAN_BLOCK_SIZE);
+        if (!ctx->bufs[thread]) {
+            FAIL_MSG("cmp_scan: malloc() failed\n");
+            return 1;
+        }
+    }
+    other = ctx->bufs[thread];
+
+    if (blkdev_pread(ctx->fd, other, len, offset) != (long) len) {
+        FAIL_ERR("cmp_scan: cannot read the second file\n");
+        return 2;
+    }
+
+
+    dblocks = 0;
+    sum = 0;
+    for (pos = 0; pos < len; pos += CMP_BLOCK_SIZE) {
+        size = len - pos;
+        if (size > CMP_BLOCK_SIZE) {
+            size = CMP_BLOCK_SIZE;
+        }
+
+        n = cmp_count(buf + pos, other + pos, size);
+
+        /* the rest of the last block is only in the longer file */
+        if (offset + pos + size == ctx->common) {
+            end = offset + pos + CMP_BLOCK_SIZE;
+            if (end > ctx->span) {
+                end = ctx->span;
+            }
+            n += end - ctx->common;
+        }
+
+        sum += n;
+        dblocks += (n != 0);
+        __atomic_store_n(&ctx->diffs[(offset + pos) / CMP_BLOCK_SIZE], n,
+                         __ATOMIC_RELEASE);
+    }
+
+    __atomic_fetch_add(&ctx->total, sum, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->dblocks, dblocks, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+
+/* cmp_count_range adds the differences between the first file's bytes in
+ * buf, at offset, and the second's in other, to the counts of each block */
+static unsigned long cmp_count_range(unsigned int *counts,
+                                     unsigned long offset,
+                                     const uint8_t * buf,
+                                     const uint8_t * other,
+                                     unsigned long len)
+{
+    unsigned long pos, size, n, total;
+
+    total = 0;
+    for (pos = 0; pos < len; pos += size) {
+        size = CMP_BLOCK_SIZE - ((offset + pos) % CMP_BLOCK_SIZE);
+        if (size > len - pos) {
+            size = len - pos;
+        }
+        n = other ? cmp_count(buf + pos, other + pos, size) : size;
+        counts[((offset + pos) / CMP_BLOCK_SIZE) % (SCAN_BLOCK_SIZE /
+                                                    CMP_BLOCK_SIZE)] += n;
+        total += n;
+    }
+
+    return total;
+}
+
+
+/* cmp_align_scan is the scan callback for a lined up comparison; each
+ * piece of the block is compared with where it is in the second file */
+static int cmp_align_scan(void *arg, int thread, unsigned long block,
+                          unsigned long offset, const uint8_t * buf,
+                          unsigned long len, unsigned long total)
+{
+    struct cmp_ctx *ctx = (struct cmp_ctx *) arg;
+    struct align_ctx *align = ctx->align;
+    struct align_seg *seg;
+    unsigned int counts[SCAN_BLOCK_SIZE / CMP_BLOCK_SIZE];
+    uint16_t flags[SCAN_BLOCK_SIZE / CMP_BLOCK_SIZE];
+    unsigned long pos, piece, o, b, n, next, dblocks, sum;
+    uint8_t *other;
+    long k;
+
+    if (!ctx->bufs[thread]) {
+        ctx->bufs[thread] = (uint8_t *) malloc(SCAN_BLOCK_SIZE);
+        if (!ctx->bufs[thread]) {
+            FAIL_MSG("cmp_align_scan: malloc() failed\n");
+            return 1;
+        }
+    }
+    other = ctx->bufs[thread];
+
+    memset(counts, 0, sizeof(counts));
+    memset(flags, 0, sizeof(flags));
+
+    k = align_find(align, offset);
+    sum = 0;
+    for (pos = 0; pos < len; pos += piece) {
+        o = offset + pos;
+        while ((k + 1 < (long) align->nsegs)
+               && (align->segs[k + 1].start <= o)) {
+            k++;
+        }
+        seg = (k >= 0) ? &align->segs[k] : NULL;
+        b = (pos / CMP_BLOCK_SIZE) % (SCAN_BLOCK_SIZE / CMP_BLOCK_SIZE);
+
+        if (seg && (o < seg->end)) {
+            /* lined up, so compare with where it is in the second file */
+            piece = seg->end - o;
+            if (piece > len - pos) {
+                piece = len - pos;
+            }
+            if (blkdev_pread(ctx->fd, other, piece, o + seg->delta) !=
+                (long) piece) {
+                FAIL_ERR("cmp_align_scan: cannot read the second file\n");
+                return 2;
+            }
+
+            sum += cmp_count_range(counts, o, buf + pos, other, piece);
+            if (seg->moved) {
+                for (n = b; n <= (pos + piece - 1) / CMP_BLOCK_SIZE; n++) {
+                    flags[n] |= CMP_MOVED;
+                }
+            }
+            if ((o == seg->start) && seg->deleted) {
+                flags[b] |= CMP_DELETED;
+            }
+        } else {
+            /* not in the second file at all */
+            next = (k + 1 < (long) align->nsegs)
+                ? align->segs[k + 1].start : offset + len;
+            piece = next - o;
+            if (piece > len - pos) {
+                piece = len - pos;
+            }
+            sum += cmp_count_range(counts, o, buf + pos, NULL, piece);
+            for (n = b; n <= (pos + piece - 1) / CMP_BLOCK_SIZE; n++) {
+                flags[n] |= CMP_INSERTED;
+            }
+        }
+    }
+
+    dblocks = 0;
+    for (pos = 0; pos < len; pos += CMP_BLOCK_SIZE) {
+        b = pos / CMP_BLOCK_SIZE;
+        n = counts[b] | flags[b];
+        dblocks += (n != 0);
+        __atomic_store_n(&ctx->diffs[(offset + pos) / CMP_BLOCK_SIZE], n,
+                         __ATOMIC_RELEASE);
+    }
+
+    __atomic_fetch_add(&ctx->total, sum, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->dblocks, dblocks, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+
+/* cmp_align_thread lines the files up and then compares them */
+static void *cmp_align_thread(void *arg)
+{
+    struct cmp_ctx *ctx = (struct cmp_ctx *) arg;
+
+    if (align_anchors(ctx->align, ALIGN_FIRST, &ctx->scan, ctx->first_fd,
+                      ctx->first) != 0) {
+        FAIL_MSG("cmp_align_thread: align_anchors() failed\n");
+        goto done;
+    }
+
+
+    __atomic_store_n(&ctx->phase, CMP_PHASE_SECOND, __ATOMIC_RELAXED);
+    if (align_anchors(ctx->align, ALIGN_SECOND, &ctx->scan, ctx->fd,
+                      ctx->size) != 0) {
+        FAIL_MSG("cmp_align_thread: align_anchors() failed\n");
+        goto done;
+    }
+
+
+    __atomic_store_n(&ctx->phase, CMP_PHASE_MATCH, __ATOMIC_RELAXED);
+    if (align_match(ctx->align, ctx->first_fd, ctx->first, ctx->fd,
+                    ctx->size) != 0) {
+        FAIL_MSG("cmp_align_thread: align_match() failed\n");
+        goto done;
+    }
+
+
+    __atomic_store_n(&ctx->phase, CMP_PHASE_COMPARE, __ATOMIC_RELAXED);
+    if (rb_scan_init(&ctx->scan, ctx->first_fd, 0, ctx->first,
+                     SCAN_BLOCK_SIZE, 0, cmp_align_scan, ctx) != 0) {
+        FAIL_MSG("cmp_align_thread: rb_scan_init() failed\n");
+        goto done;
+    }
+
+
+    if (!__atomic_load_n(&ctx->align->cancel, __ATOMIC_SEQ_CST)
+        && (rb_scan(&ctx->scan) != 0)) {
+        FAIL_MSG("cmp_align_thread: rb_scan() failed\n");
+    }
+
+  done:
+    __atomic_store_n(&ctx->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+
+/* cmp_open opens the file to compare with */
+struct cmp_ctx *cmp_open(char *fname)
+{
+    struct cmp_ctx *ctx;
+    struct stat filestat;
+
+    if (!fname) {
+        FAIL_MSG("cmp_open: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct cmp_ctx *) calloc(1, sizeof(struct cmp_ctx));
+    if (!ctx) {
+        FAIL_MSG("cmp_open: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->fd = open(fname, O_RDONLY);
+    if (ctx->fd == -1) {
+        FAIL_ERR("cmp_open: cannot open file\n");
+        free(ctx);
+        return NULL;
+    }
+
+
+    /* block devices are sized by their driver */
+    if (blkdev_fstat(ctx->fd, &filestat) != 0) {
+        FAIL_MSG("cmp_open: cannot stat file\n");
+        close(ctx->fd);
+        free(ctx);
+        return NULL;
+    }
+
+
+    strncpy(ctx->name, fname, PATH_MAX);
+    ctx->name[PATH_MAX - 1] = 0x00;
+    ctx->size = filestat.st_size;
+
+    return ctx;
+}
+
+
+/* cmp_start compares the first file, fd of size bytes, with the second in
+ * the background */
+int cmp_start(struct cmp_ctx *ctx, int fd, unsigned long size)
+{
+    unsigned long b;
+
+    if (!ctx || (fd < 0) || ctx->diffs) {
+        FAIL_MSG("cmp_start: invalid params\n");
+        return 1;
+    }
+
+
+    ctx->first = size;
+    ctx->common = size < ctx->size ? size : ctx->size;
+    ctx->span = size > ctx->size ? size : ctx->size;
+    ctx->nblocks = (ctx->span + CMP_BLOCK_SIZE - 1) / CMP_BLOCK_SIZE;
+    ctx->diffs = (uint16_t *) malloc((ctx->nblocks + 1) * sizeof(uint16_t));
+    if (!ctx->diffs) {
+        FAIL_MSG("cmp_start: malloc() failed\n");
+        return 2;
+    }
+
+
+    /* the blocks past the end of the shorter file differ completely */
+    for (b = 0; b < ctx->nblocks; b++) {
+        if (b * CMP_BLOCK_SIZE >= ctx->common) {
+            ctx->diffs[b] = (b + 1) * CMP_BLOCK_SIZE <= ctx->span
+                ? CMP_BLOCK_SIZE : ctx->span - (b * CMP_BLOCK_SIZE);
+            ctx->total += ctx->diffs[b];
+            ctx->dblocks++;
+        } else {
+            ctx->diffs[b] = CMP_UNSCANNED;
+        }
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(ctx->fd, 0, ctx->common, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (rb_scan_init(&ctx->scan, fd, 0, ctx->common, SCAN_BLOCK_SIZE, 0,
+                     cmp_scan, ctx) != 0) {
+        FAIL_MSG("cmp_start: rb_scan_init() failed\n");
+        return 3;
+    }
+
+
+    if (rb_scan_start(&ctx->scan) != 0) {
+        FAIL_MSG("cmp_start: rb_scan_start() failed\n");
+        return 4;
+    }
+
+
+    return 0;
+}
+
+
+/* cmp_start_aligned compares the first file, fd of size bytes, with the
+ * second in the background, lining them up first */
+int cmp_start_aligned(struct cmp_ctx *ctx, int fd, unsigned long size)
+{
+    if (!ctx || (fd < 0) || ctx->diffs) {
+        FAIL_MSG("cmp_start_aligned: invalid params\n");
+        return 1;
+    }
+
+
+    /* only the blocks of the first file are coloured */
+    ctx->first = size;
+    ctx->common = size;
+    ctx->span = size;
+    ctx->first_fd = fd;
+    ctx->nblocks = (size + CMP_BLOCK_SIZE - 1) / CMP_BLOCK_SIZE;
+    ctx->diffs = (uint16_t *) malloc((ctx->nblocks + 1) * sizeof(uint16_t));
+    if (!ctx->diffs) {
+        FAIL_MSG("cmp_start_aligned: malloc() failed\n");
+        return 2;
+    }
+
+    memset(ctx->diffs, 0xff, (ctx->nblocks + 1) * sizeof(uint16_t));
+
+    ctx->align = align_init();
+    if (!ctx->align) {
+        FAIL_MSG("cmp_start_aligned: align_init() failed\n");
+        return 3;
+    }
+
+
+    ctx->phase = CMP_PHASE_FIRST;
+    if (pthread_create(&ctx->controller, NULL, cmp_align_thread, ctx) != 0) {
+        FAIL_MSG("cmp_start_aligned: pthread_create() failed\n");
+        return 4;
+    }
+
+
+    return 0;
+}
+
+
+/* cmp_finished returns whether the comparison has ended */
+int cmp_finished(struct cmp_ctx *ctx)
+{
+    if (ctx && ctx->align) {
+        if (!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+
+        if (!ctx->joined) {
+            pthread_join(ctx->controller, NULL);
+            ctx->joined = 1;
+        }
+        return 1;
+    }
+
+    if (!ctx || !ctx->scan.running) {
+        return 1;
+    }
+
+    if (!__atomic_load_n(&ctx->scan.finished, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    rb_scan_wait(&ctx->scan);
+
+    return 1;
+}
+
+
+/* cmp_progress returns how far through the comparison is, in percent */
+int cmp_progress(struct cmp_ctx *ctx)
+{
+    int phase;
+
+    if (!ctx) {
+        return 100;
+    }
+
+    /* each part of a lined up comparison is a share of it */
+    if (ctx->align) {
+        if (__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+            return 100;
+        }
+        phase = __atomic_load_n(&ctx->phase, __ATOMIC_RELAXED);
+        return ((phase * 100) + ((phase == CMP_PHASE_MATCH) ? 50 :
+                                 rb_scan_progress(&ctx->scan))) /
+            CMP_PHASES;
+    }
+
+    return rb_scan_progress(&ctx->scan);
+}
+
+
+/* cmp_free stops the comparison if it is running and closes the file */
+int cmp_free(struct cmp_ctx *ctx)
+{
+    int i;
+
+    if (!ctx) {
+        FAIL_MSG("cmp_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->align) {
+        /* the controller checks its flag after starting each scan */
+        __atomic_store_n(&ctx->align->cancel, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&ctx->scan.cancel, 1, __ATOMIC_SEQ_CST);
+        if (!ctx->joined) {
+            pthread_join(ctx->controller, NULL);
+        }
+        align_free(ctx->align);
+    } else if (ctx->scan.running) {
+        __atomic_store_n(&ctx->scan.cancel, 1, __ATOMIC_RELAXED);
+        rb_scan_wait(&ctx->scan);
+    }
+
+    for (i = 0; i < SCAN_MAX_THREADS; i++) {
+        free(ctx->bufs[i]);
+    }
+
+    close(ctx->fd);
+    free(ctx->diffs);
+    free(ctx);
+
+    return 0;
+}
+
+
+/* cmp_diffs returns the differing bytes in block b, or CMP_UNSCANNED */
+static inline unsigned int cmp_diffs(struct cmp_ctx *ctx, unsigned long b)
+{
+    return __atomic_load_n(&ctx->diffs[b], __ATOMIC_ACQUIRE);
+}
+
+
+/* cmp_level returns how much of the block holding offset differs, from
+ * CMP_LEVEL_SAME to CMP_LEVEL_ALL, or CMP_LEVEL_UNKNOWN */
+int cmp_level(struct cmp_ctx *ctx, unsigned long offset)
+{
+    unsigned int n;
+
+    if (!ctx || !ctx->diffs || (offset >= ctx->span)) {
+        return CMP_LEVEL_UNKNOWN;
+    }
+
+    n = cmp_diffs(ctx, offset / CMP_BLOCK_SIZE);
+    if (n == CMP_UNSCANNED) {
+        return CMP_LEVEL_UNKNOWN;
+    }
+    if (n & CMP_DELETED) {
+        return CMP_LEVEL_DELETED;
+    }
+    if (n & CMP_INSERTED) {
+        return CMP_LEVEL_INSERTED;
+    }
+    if (n & CMP_MOVED) {
+        return CMP_LEVEL_MOVED;
+    }
+    if (!n) {
+        return CMP_LEVEL_SAME;
+    }
+
+    /* a single byte still stands out */
+    return CMP_LEVEL_DIFF +
+        ((n - 1) * (CMP_LEVEL_ALL - CMP_LEVEL_DIFF)) / (CMP_BLOCK_SIZE - 1);
+}
+
+
+/* cmp_jump finds the start of the next or previous run of blocks that
+ * differ, from offset from */
+int cmp_jump(struct cmp_ctx *ctx, unsigned long from, int dir,
+             unsigned long *hit)
+{
+    unsigned long b;
+    unsigned int n;
+
+    if (!ctx || !ctx->diffs || !hit
+        || ((dir != CMP_NEXT) && (dir != CMP_PREV))) {
+        FAIL_MSG("cmp_jump: invalid params\n");
+        return 1;
+    }
+
+
+    b = from / CMP_BLOCK_SIZE;
+    if (b >= ctx->nblocks) {
+        b = ctx->nblocks - 1;
+    }
+
+    if (dir == CMP_NEXT) {
+        /* past the run we are in, then past the blocks that are the same */
+        while ((b < ctx->nblocks) && (n = cmp_diffs(ctx, b))
+               && (n != CMP_UNSCANNED)) {
+            b++;
+        }
+        while ((b < ctx->nblocks)
+               && (!(n = cmp_diffs(ctx, b)) || (n == CMP_UNSCANNED))) {
+            b++;
+        }
+        if (b >= ctx->nblocks) {
+            return 2;
+        }
+
+    } else {
+        /* back past the blocks that are the same, then to the run's start */
+        do {
+            if (!b) {
+                return 2;
+            }
+            b--;
+            n = cmp_diffs(ctx, b);
+        } while (!n || (n == CMP_UNSCANNED));
+
+        while (b && (n = cmp_diffs(ctx, b - 1)) && (n != CMP_UNSCANNED)) {
+            b--;
+        }
+    }
+
+    *hit = b * CMP_BLOCK_SIZE;
+
+    return 0;
+}
+
+
+/* cmp_query returns about how many bytes differ between start and end,
+ * weighting each block by how much of it is in the range */
+unsigned long cmp_query(struct cmp_ctx *ctx, unsigned long start,
+                        unsigned long end)
+{
+    unsigned long b, bstart, bend, total;
+    unsigned int n;
+
+    if (!ctx || !ctx->diffs || (end < start)) {
+        return 0;
+    }
+
+    if (end > ctx->span) {
+        end = ctx->span;
+    }
+
+    total = 0;
+    for (b = start / CMP_BLOCK_SIZE; b * CMP_BLOCK_SIZE < end; b++) {
+        n = cmp_diffs(ctx, b);
+        if (!n || (n == CMP_UNSCANNED)) {
+            continue;
+        }
+
+        bstart = b * CMP_BLOCK_SIZE;
+        bend = bstart + CMP_BLOCK_SIZE;
+        if (bstart < start) {
+            bstart = start;
+        }
+        if (bend > end) {
+            bend = end;
+        }
+        total += ((n & CMP_COUNT_MASK) * (bend - bstart)) / CMP_BLOCK_SIZE;
+    }
+
+    return total;
+}
+
+
+/* cmp_delta returns how far the bytes at offset in the first file have
+ * moved in the second, which is none unless the files were lined up */
+long cmp_delta(struct cmp_ctx *ctx, unsigned long offset)
+{
+    if (!ctx || !ctx->align
+        || !__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    return align_delta(ctx->align, offset);
+}
@@ -0,0 +1,115 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-compare.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_COMPARE_H
+#define _RB_COMPARE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#elif __APPLE__
+#include <sys/syslimits.h>
+#endif
+
+#include "rb-scan.h"
+#include "rb-blkdev.h"
+#include "rb-align.h"
+#include "macro.h"
+
+/* the differing bytes are counted for each block of this size */
+#define CMP_BLOCK_SIZE 4096
+/* a block that hasn't been compared yet */
+#define CMP_UNSCANNED 0xffff
+/* when the files are lined up, a block's count can have these added */
+#define CMP_COUNT_MASK 0x1fff
+#define CMP_DELETED 0x2000      /* bytes of the second file are missing */
+#define CMP_INSERTED 0x4000     /* bytes that aren't in the second file */
+#define CMP_MOVED 0x8000        /* bytes that are elsewhere in it */
+
+/* difference levels, for colouring */
+#define CMP_LEVEL_UNKNOWN 0
+#define CMP_LEVEL_SAME 1
+#define CMP_LEVEL_MOVED 2
+#define CMP_LEVEL_INSERTED 3
+#define CMP_LEVEL_DELETED 4
+#define CMP_LEVEL_DIFF 5
+#define CMP_LEVEL_ALL 255
+
+/* what a lined up comparison is doing */
+#define CMP_PHASE_FIRST 0
+#define CMP_PHASE_SECOND 1
+#define CMP_PHASE_MATCH 2
+#define CMP_PHASE_COMPARE 3
+#define CMP_PHASES 4
+
+/* how the files are compared */
+#define CMP_POSITIONAL 0
+#define CMP_ALIGNED 1
+
+/* directions for cmp_jump() */
+#define CMP_NEXT 0
+#define CMP_PREV 1
+
+/* a second file and how it differs from the first, block by block */
+struct cmp_ctx {
+    int fd;
+    char name[PATH_MAX];        /* the second file, for the visualisers */
+    unsigned long size;         /* of the second file */
+    unsigned long first;        /* the size of the first file */
+    unsigned long common;       /* bytes both files have */
+    unsigned long span;         /* bytes either file has */
+    unsigned long nblocks;
+    uint16_t *diffs;            /* differing bytes in each block */
+    unsigned long total;        /* differing bytes so far */
+    unsigned long dblocks;      /* blocks with any */
+
+    /* each thread's read of the second file */
+    uint8_t *bufs[SCAN_MAX_THREADS];
+    struct scan_ctx scan;
+
+    /* or line them up first, from another thread */
+    struct align_ctx *align;
+    int first_fd;
+    int phase;
+    int done;
+    int joined;
+    pthread_t controller;
+};
+
+unsigned long cmp_count(const uint8_t * a, const uint8_t * b,
+                        unsigned long len);
+struct cmp_ctx *cmp_open(char *fname);
+int cmp_start(struct cmp_ctx *ctx, int fd, unsigned long size);
+int cmp_start_aligned(struct cmp_ctx *ctx, int fd, unsigned long size);
+int cmp_finished(struct cmp_ctx *ctx);
+int cmp_progress(struct cmp_ctx *ctx);
+int cmp_free(struct cmp_ctx *ctx);
+int cmp_level(struct cmp_ctx *ctx, unsigned long offset);
+int cmp_jump(struct cmp_ctx *ctx, unsigned long from, int dir,
+             unsigned long *hit);
+unsigned long cmp_query(struct cmp_ctx *ctx, unsigned long start,
+                        unsigned long end);
+long cmp_delta(struct cmp_ctx *ctx, unsigned long offset);
+
+#endif
@@ -11,10 +11,24 @@
  * http://www.wtfpl.net/for more details.
  * 
  * Provides functions to load visualisers.
+ *
+ * rubbermarbles reads the config files once into a table in the shared
+ * memory, and again whenever they change; its visualisers look params up
+ * there without locking, a sequence count telling them to look again if
+ * the table was being rewritten.  Run on their own, they read the files.
  */
 
 #include "rb-conf.h"
 
+/* the table to look in, once a visualiser has the shared memory */
+static struct rb_shm *conf_shm = NULL;
+
+/* what is watched for changes */
+static int conf_fd = -1;
+static int conf_wd[2] = { -1, -1 };
+static char conf_userpath[PATH_MAX];
+static time_t conf_mtime[2];
+
 
 /* get_conf finds the value for the param from the named config file. */
 int get_conf(char *confpath, char *param, char *value)
@@ -53,7 +67,9 @@ int get_conf(char *confpath, char *param, char *value)
 				value[dlen-1] = 0x00;
 				dlen--;
 			}
-			
+
+			fclose(fp);
+			free(line);
 			return 0;
 		}
     }
@@ -80,9 +96,20 @@ int configuration(char *homepath, char *param, char *value)
     }
 
 	value[0] = 0x00;
+
+    /* rubbermarbles has already read them */
+    if (conf_shm) {
+        ret = conf_lookup(conf_shm, param, value);
+        if (ret == 0) {
+            return 0;
+        } else if (ret == -2) {
+            FAIL_MSG("configuration: param not found\n");
+            return 4;
+        }
+    }
 	
     /* attempt to read system wide config file first */
-    ret = get_conf("/etc/rb-vis.conf", param, value);
+    ret = get_conf(CONF_SYSTEM, param, value);
 
     if (ret > 0) {
         fprintf(stderr, "configuration: get_conf() failed: %d\n",
@@ -91,7 +118,7 @@ int configuration(char *homepath, char *param, char *value)
     }
 
     /* attempt to read user's own config file */
-    snprintf(userconf, PATH_MAX, "%s/.rb-vis.conf", homepath);
+    snprintf(userconf, PATH_MAX, "%s/%s", homepath, CONF_USER);
     ret = get_conf(userconf, param, value);
 
     if (ret > 0) {
@@ -107,3 +134,279 @@ int configuration(char *homepath, char *param, char *value)
 
     return 0;
 }
+
+
+/* conf_parse adds the param: value lines from the named config file to
+ * the table of nconf, replacing any already there */
+int conf_parse(char *confpath, struct shm_conf *conf, int *nconf)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    char *colon;
+    int klen, vlen, i;
+
+    if (!confpath || !conf || !nconf) {
+        FAIL_MSG("conf_parse: invalid params\n");
+        return 1;
+    }
+
+
+    fp = fopen(confpath, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    while (getline(&line, &len, fp) != -1) {
+        colon = strchr(line, ':');
+        if (!colon || (line[0] == '#')) {
+            continue;
+        }
+
+        /* the visualisers are in a list of their own */
+        klen = colon - line;
+        if ((klen == 3) && (strncmp(line, "vis", 3) == 0)) {
+            continue;
+        }
+
+        vlen = strlen(colon + 1);
+        while ((vlen > 0) && ((colon[vlen] == 0x0a) || (colon[vlen] == 0x0d)
+                              || (colon[vlen] == 0x20)
+                              || (colon[vlen] == 0x09))) {
+            vlen--;
+        }
+
+        if (!klen || (klen >= SHM_CONF_KEY) || (vlen >= SHM_CONF_VALUE)) {
+            fprintf(stderr, "conf_parse: %s: line too long: %s", confpath,
+                    line);
+            continue;
+        }
+
+        for (i = 0; i < *nconf; i++) {
+            if ((strncmp(conf[i].key, line, klen) == 0)
+                && (conf[i].key[klen] == 0x00)) {
+                break;
+            }
+        }
+
+        if (i >= SHM_CONF) {
+            FAIL_MSG("conf_parse: too many params\n");
+            break;
+        }
+
+        memcpy(conf[i].key, line, klen);
+        conf[i].key[klen] = 0x00;
+        memcpy(conf[i].value, colon + 1, vlen);
+        conf[i].value[vlen] = 0x00;
+        if (i == *nconf) {
+            (*nconf)++;
+        }
+    }
+
+    fclose(fp);
+    free(line);
+
+    return 0;
+}
+
+
+/* conf_publish reads the config files into the shared memory for the
+ * visualisers */
+int conf_publish(struct rb_shm *shm, char *homepath)
+{
+    static struct shm_conf conf[SHM_CONF];
+    char userconf[PATH_MAX];
+    unsigned long seq;
+    int nconf = 0;
+
+    if (!shm || !homepath) {
+        FAIL_MSG("conf_publish: invalid params\n");
+        return 1;
+    }
+
+
+    /* the user's own config file is read last so it wins */
+    snprintf(userconf, PATH_MAX, "%s/%s", homepath, CONF_USER);
+    if ((conf_parse(CONF_SYSTEM, conf, &nconf) > 0)
+        || (conf_parse(userconf, conf, &nconf) > 0)) {
+        FAIL_MSG("conf_publish: conf_parse() failed\n");
+        return 2;
+    }
+
+
+    /* only rubbermarbles writes it, so the count just needs to be odd
+     * while it does */
+    seq = shm->conf_seq;
+    __atomic_store_n(&shm->conf_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(shm->conf, conf, nconf * sizeof(struct shm_conf));
+    shm->nconf = nconf;
+
+    __atomic_store_n(&shm->conf_seq, seq + 2, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+/* conf_attach has configuration() look in the table in the shared memory
+ * rather than read the files */
+int conf_attach(struct rb_shm *shm)
+{
+    if (!shm) {
+        FAIL_MSG("conf_attach: invalid params\n");
+        return 1;
+    }
+
+
+    conf_shm = shm;
+
+    return 0;
+}
+
+
+/* conf_lookup finds the value for the param in the shared memory.  It
+ * returns -1 if nothing has been published and -2 if the param isn't
+ * there */
+int conf_lookup(struct rb_shm *shm, char *param, char *value)
+{
+    unsigned long seq;
+    int i, nconf, found;
+
+    if (!shm || !param || !value) {
+        FAIL_MSG("conf_lookup: invalid params\n");
+        return 1;
+    }
+
+
+    do {
+        seq = __atomic_load_n(&shm->conf_seq, __ATOMIC_ACQUIRE);
+        if (!seq) {
+            return -1;
+        }
+        if (seq & 1) {
+            continue;
+        }
+
+        found = 0;
+        nconf = shm->nconf;
+        for (i = 0; (i < nconf) && (i < SHM_CONF); i++) {
+            if (strncmp(shm->conf[i].key, param, SHM_CONF_KEY) == 0) {
+                memcpy(value, shm->conf[i].value, SHM_CONF_VALUE);
+                value[SHM_CONF_VALUE - 1] = 0x00;
+                found = 1;
+                break;
+            }
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1)
+             || (__atomic_load_n(&shm->conf_seq, __ATOMIC_RELAXED) != seq));
+
+    if (!found) {
+        value[0] = 0x00;
+        return -2;
+    }
+
+    return 0;
+}
+
+
+/* conf_mtimes notes when the config files last changed */
+static void conf_mtimes(time_t *mtime)
+{
+    struct stat st;
+
+    mtime[0] = (stat(CONF_SYSTEM, &st) == 0) ? st.st_mtime : 0;
+    mtime[1] = (stat(conf_userpath, &st) == 0) ? st.st_mtime : 0;
+}
+
+
+/* conf_watch starts watching the config files for changes; if it can't,
+ * conf_changed() compares their mtimes instead */
+int conf_watch(char *homepath)
+{
+    if (!homepath) {
+        FAIL_MSG("conf_watch: invalid params\n");
+        return 1;
+    }
+
+
+    snprintf(conf_userpath, PATH_MAX, "%s/%s", homepath, CONF_USER);
+    conf_mtimes(conf_mtime);
+
+#ifdef __linux__
+    /* the directories, as editors replace files rather than write them */
+    conf_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (conf_fd < 0) {
+        FAIL_ERR("conf_watch: inotify_init1() failed\n");
+        conf_fd = -1;
+        return 2;
+    }
+
+
+    conf_wd[0] = inotify_add_watch(conf_fd, "/etc",
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE
+                                   | IN_DELETE);
+    conf_wd[1] = inotify_add_watch(conf_fd, homepath,
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE
+                                   | IN_DELETE);
+    if ((conf_wd[0] < 0) && (conf_wd[1] < 0)) {
+        FAIL_ERR("conf_watch: inotify_add_watch() failed\n");
+        close(conf_fd);
+        conf_fd = -1;
+        return 3;
+    }
+#endif
+
+    return 0;
+}
+
+
+/* conf_changed returns 1 if a config file has changed since it was last
+ * called, without waiting */
+int conf_changed()
+{
+    time_t mtime[2];
+    int changed = 0;
+#ifdef __linux__
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    ssize_t len;
+    char *p;
+
+    if (conf_fd >= 0) {
+        while ((len = read(conf_fd, buf, sizeof(buf))) > 0) {
+            for (p = buf; p < buf + len;
+                 p += sizeof(struct inotify_event) + ev->len) {
+                ev = (struct inotify_event *) p;
+                if (!ev->len) {
+                    continue;
+                }
+                if (((ev->wd == conf_wd[0])
+                     && (strcmp(ev->name, "rb-vis.conf") == 0))
+                    || ((ev->wd == conf_wd[1])
+                        && (strcmp(ev->name, CONF_USER) == 0))) {
+                    changed = 1;
+                }
+            }
+        }
+
+        return changed;
+    }
+#endif
+
+    /* without inotify, look at the times */
+    if (!conf_userpath[0]) {
+        return 0;
+    }
+
+    conf_mtimes(mtime);
+    if ((mtime[0] != conf_mtime[0]) || (mtime[1] != conf_mtime[1])) {
+        conf_mtime[0] = mtime[0];
+        conf_mtime[1] = mtime[1];
+        changed = 1;
+    }
+
+    return changed;
+}
@@ -18,11 +18,27 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#ifdef __linux__
 #include <linux/limits.h>
+#include <sys/inotify.h>
+#elif __APPLE__
+#include <sys/syslimits.h>
+#endif
 //#include "rb-data.h"
+#include "rb-shm.h"
 #include "macro.h"
 
+#define CONF_SYSTEM "/etc/rb-vis.conf"
+#define CONF_USER ".rb-vis.conf"
+
 int get_conf(char *confpath, char *param, char *value);
 int configuration(char *homepath, char *param, char *value);
+int conf_parse(char *confpath, struct shm_conf *conf, int *nconf);
+int conf_publish(struct rb_shm *shm, char *homepath);
+int conf_attach(struct rb_shm *shm);
+int conf_lookup(struct rb_shm *shm, char *param, char *value);
+int conf_watch(char *homepath);
+int conf_changed();
 
 #endif
@@ -20,7 +20,9 @@
 #include <gtk/gtk.h>
 
 /* help dialog text */
-#define HELPTEXT "\nRubber Marbles is an implementation of the ideas presented by Greg\nConti, Aldo Cortesi and Christopher Domas. It visualises binary files\nwith an extendable set of visualisers.\n\nColours:\nCortesi uses 0x00 black, 0xff white, ascii blue, green low and other red.\nGreyscale and colour scale are obvious.\n\nHilbert:\nHilbertFlipped (default) is Hilbert curve that goes clockwise.\nHilbert is standard anti-clockwise Hilbert curve.\n\nZigzag:\nLinear is simple scan lines.\nZigzag go back and forth.\n\nLeft mouse button sets start of selection; right button sets end.\nUse left button to drag selection windows.\n\nGo:\nMove selection windows to start and end.\n\nVisualise:\nRun a visualiser on the zoomed selection window.\n\nWindow:\nEnable or disable the left hand views.\n\n\nHAVE FUN :)\n\n"
+#define HELPTEXT "\nRubber Marbles is an implementation of the ideas presented by Greg\nConti, Aldo Cortesi and Christopher Domas. It visualises binary files\nwith an extendable set of visualisers.\n\nColours:\nCortesi uses 0x00 black, 0xff white, ascii blue, green low and other red.\nGreyscale and colour scale are obvious.\nRegions colours each 64KB block by its type: text blue, code green,\ncompressed red, image purple, table brown, padding dark and other grey.\n\nHilbert:\nHilbertFlipped (default) is Hilbert curve that goes clockwise.\nHilbert is standard anti-clockwise Hilbert curve.\n\nZigzag:\nLinear is simple scan lines.\nZigzag go back and forth.\n\nLeft mouse button sets start of selection; right button sets end.\nUse left button to drag selection windows.\n\nGo:\nMove selection windows to start and end.\n\nVisualise:\nRun a visualiser on the zoomed selection window.\n\nSearch:\nFind hex, ascii or utf-16 patterns; F3 and shift F3 go to the next and\nprevious hit.\n\nWindow:\nEnable or disable the left hand views and the drawing statistics.\nDeep zoom (z) opens the whole file in a window that the mouse wheel zooms\nand the left button drags, down to the bytes.\n\n\nHAVE FUN :)\n\n"
+
+#define SEARCHHELP "One pattern per line:\n  4d 5a 90 00      hex bytes, ? matches any nibble (e.g. 4d ?? 9?)\n  \"text\"           ascii, with \\\\ \\\" \\n \\r \\t \\0 and \\xHH escapes\n  u\"text\"          utf-16 little endian\n  ub\"text\"         utf-16 big endian"
 
 /* total number of concurrent visualisers */
 #define MAX_VIS 16
@@ -31,11 +33,14 @@
 #define COL_GREYSCALE 2
 #define COL_COLSCALE 3
 #define COL_COLSCALE2 4
+#define COL_REGIONS 5
+#define COL_DIFF 6
 
 #define DISP_HILBERTFLIPPED 1
 #define DISP_HILBERT 2
 #define DISP_LINEAR 3
 #define DISP_ZIGZAG 4
+#define DISP_MORTON 5
 
 #define HEX_PER_ROW 16
 
@@ -74,13 +79,27 @@ struct widgets {
     GtkWidget *zigzag_zoom;
     GtkWidget *hilbert_zoom;
     GtkWidget *help_dialog;
+    GtkWidget *stats;
+    GtkWidget *selstats;
+    GtkWidget *deep_window;
+    GtkWidget *deep_area;
 };
 
-/* an rgb value. Used in an array to make an rgb bitmap */
+/* an rgb value. Used in an array to make an rgb bitmap, laid out as
+ * CAIRO_FORMAT_RGB24 has it (a native 32 bit 0x00rrggbb) so that the
+ * bitmap can be a cairo surface's own pixels */
 struct rgb {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    guchar blue;
+    guchar green;
+    guchar red;
+    guchar unused;
+#else
+    guchar unused;
     guchar red;
     guchar green;
     guchar blue;
+#endif
 };
 
 /* display settings */
@@ -91,6 +110,10 @@ struct displayset {
     int drag;
     int dragy;
     int whole_hide;
+    int stats_show;
+    int selstats_show;
+    int follow;
+    int watch;
 };
 
 /* mmap context */
@@ -108,7 +131,7 @@ struct filemmap {
 struct pixbuf {
     int width;
     int height;
-    GdkPixbuf *buf;
+    cairo_surface_t *surface;
 };
 
 /* a selection window */
@@ -127,6 +150,9 @@ struct savepic {
 	int disp_zigzag;
     long start;
     long end;
+    float step;
+    long points;
+    off_t size;
 };
 
 /* a running visualiser */
@@ -139,6 +165,8 @@ struct vis {
 struct visualiser {
     char name[256];
 	char exe[PATH_MAX];
+    int plugin;                 /* exe is a shared library to load */
+    int zygote;                 /* exe can be started ahead of time */
 };
 
 
@@ -22,6 +22,12 @@ extern struct pixbuf displays[5];
 extern struct window zoom[2];
 extern struct savepic save[5];
 extern struct displayset disp;
+extern struct search_ctx *search;
+extern struct class_ctx *classify;
+extern struct change_ctx *changes;
+extern struct zsrc_ctx *zsrc;
+extern struct cmp_ctx *compare;
+extern struct dup_ctx *dupes;
 
 
 /* colscalecolbyte sets the colour values based on the byte b */
@@ -107,6 +113,104 @@ int cortesicolbyte(int b, guchar * red, guchar * green, guchar * blue)
 }
 
 
+/* regioncolbyte sets the colour values based on the region label b */
+int regioncolbyte(int b, guchar * red, guchar * green, guchar * blue)
+{
+    if (!red || !green || !blue) {
+        FAIL_MSG("regioncolbyte: invalid params\n");
+        return 1;
+    }
+
+
+    switch (b) {
+    case CLASS_PADDING:
+        *red = REGIONPADDINGR;
+        *green = REGIONPADDINGG;
+        *blue = REGIONPADDINGB;
+        break;
+    case CLASS_TEXT:
+        *red = REGIONTEXTR;
+        *green = REGIONTEXTG;
+        *blue = REGIONTEXTB;
+        break;
+    case CLASS_CODE:
+        *red = REGIONCODER;
+        *green = REGIONCODEG;
+        *blue = REGIONCODEB;
+        break;
+    case CLASS_COMPRESSED:
+        *red = REGIONCOMPRESSEDR;
+        *green = REGIONCOMPRESSEDG;
+        *blue = REGIONCOMPRESSEDB;
+        break;
+    case CLASS_IMAGE:
+        *red = REGIONIMAGER;
+        *green = REGIONIMAGEG;
+        *blue = REGIONIMAGEB;
+        break;
+    case CLASS_TABLE:
+        *red = REGIONTABLER;
+        *green = REGIONTABLEG;
+        *blue = REGIONTABLEB;
+        break;
+    case CLASS_DATA:
+        *red = REGIONDATAR;
+        *green = REGIONDATAG;
+        *blue = REGIONDATAB;
+        break;
+    default:
+        /* not classified yet */
+        *red = REGIONNONER;
+        *green = REGIONNONEG;
+        *blue = REGIONNONEB;
+    }
+
+    return 0;
+}
+
+
+/* diffcolbyte sets the colour values based on the difference level b */
+int diffcolbyte(int b, guchar * red, guchar * green, guchar * blue)
+{
+    if (!red || !green || !blue) {
+        FAIL_MSG("diffcolbyte: invalid params\n");
+        return 1;
+    }
+
+
+    if (b == CMP_LEVEL_UNKNOWN) {
+        *red = REGIONNONER;
+        *green = REGIONNONEG;
+        *blue = REGIONNONEB;
+    } else if (b == CMP_LEVEL_SAME) {
+        *red = DIFFSAMER;
+        *green = DIFFSAMEG;
+        *blue = DIFFSAMEB;
+    } else if (b == CMP_LEVEL_MOVED) {
+        *red = DIFFMOVEDR;
+        *green = DIFFMOVEDG;
+        *blue = DIFFMOVEDB;
+    } else if (b == CMP_LEVEL_INSERTED) {
+        *red = DIFFINSR;
+        *green = DIFFINSG;
+        *blue = DIFFINSB;
+    } else if (b == CMP_LEVEL_DELETED) {
+        *red = DIFFDELR;
+        *green = DIFFDELG;
+        *blue = DIFFDELB;
+    } else {
+        b -= CMP_LEVEL_DIFF;
+        *red = DIFFLOWR + ((b * (DIFFHIGHR - DIFFLOWR)) /
+                           (CMP_LEVEL_ALL - CMP_LEVEL_DIFF));
+        *green = DIFFLOWG + ((b * (DIFFHIGHG - DIFFLOWG)) /
+                             (CMP_LEVEL_ALL - CMP_LEVEL_DIFF));
+        *blue = DIFFB;
+    }
+
+    return 0;
+}
+
+
 /* plot_point draws a point onto the rgb bitmap */
 int
 plot_point(struct rgb *pic, int width, int height, int x, int y,
@@ -143,10 +247,24 @@ plot_point(struct rgb *pic, int width, int height, int x, int y,
             return 4;
         }
 
+        break;
+    case COL_REGIONS:
+        if (regioncolbyte(col, &colred, &colgreen, &colblue) != 0) {
+            FAIL_MSG("plot_point: regioncolbyte() failed\n");
+            return 5;
+        }
+
+        break;
+    case COL_DIFF:
+        if (diffcolbyte(col, &colred, &colgreen, &colblue) != 0) {
+            FAIL_MSG("plot_point: diffcolbyte() failed\n");
+            return 6;
+        }
+
         break;
     default:
         fprintf(stderr, "plot_point: invalid col_set");
-        return 5;
+        return 7;
     }
 
     pic[(width * y) + x].red = colred;
@@ -256,17 +374,43 @@ plot_markers(struct rgb *pic, int width, int height, int pixbufnum,
 }
 
 
-/* freepic is a callback that frees the data when the pixbuf is destroyed.
- * It has to be void to meet the fn spec */
-void freepic(guchar * pixels, gpointer data)
+/* draw_surface returns the pixels of a surface width by height, making it
+ * again if it is another size.  They are written directly, so the caller
+ * marks it dirty when it is done. */
+struct rgb *draw_surface(cairo_surface_t ** surface, int width, int height)
 {
-    if (!pixels) {
-        FAIL_MSG("freepic: pixels is NULL\n");
-        return;
+    if (!surface || (width < 1) || (height < 1)) {
+        FAIL_MSG("draw_surface: invalid params\n");
+        return NULL;
+    }
+
+
+    if (*surface
+        && ((cairo_image_surface_get_width(*surface) != width)
+            || (cairo_image_surface_get_height(*surface) != height))) {
+        cairo_surface_destroy(*surface);
+        *surface = NULL;
+    }
+
+    if (!*surface) {
+        *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width,
+                                              height);
+
+        /* the pixels are indexed as (width * y) + x */
+        if ((cairo_surface_status(*surface) != CAIRO_STATUS_SUCCESS)
+            || (cairo_image_surface_get_stride(*surface) !=
+                width * (int) sizeof(struct rgb))) {
+            FAIL_MSG("draw_surface: cairo_image_surface_create() failed\n");
+            cairo_surface_destroy(*surface);
+            *surface = NULL;
+            return NULL;
+        }
+
     }
 
+    cairo_surface_flush(*surface);
 
-    free(pixels);
+    return (struct rgb *) cairo_image_surface_get_data(*surface);
 }
 
 
@@ -283,7 +427,13 @@ int getxy(int pixbufnum, int width, int point_index, int *x, int *y)
     switch (pixbufnum) {
     case PIXBUF_WHOLE_HILBERT:
     case PIXBUF_ZOOM_HILBERT:
-        if (disp.disp_hilbert == DISP_HILBERTFLIPPED) {
+        if (disp.disp_hilbert == DISP_MORTON) {
+            if (morton_d2xy(point_index, x, y) != 0) {
+                FAIL_MSG("getxy: morton_d2xy() failed\n");
+                return 5;
+            }
+
+        } else if (disp.disp_hilbert == DISP_HILBERTFLIPPED) {
             if (d2xy(width, point_index, y, x) != 0) {
                 FAIL_MSG("getxy: d2xy() failed\n");
                 return 2;
@@ -365,6 +515,8 @@ int highlight_point(struct rgb *pic, int width, int x, int y)
         break;
     case COL_GREYSCALE:
     case COL_COLSCALE:
+    case COL_REGIONS:
+    case COL_DIFF:
         /* bias the blue to distinguish colour from unhighlighted pixels */
         if (pic[(width * y) + x].blue > COLSCALETHRESHOLD) {
             pic[(width * y) + x].blue = 0;
@@ -390,9 +542,12 @@ add_highlight(int pixbufnum, int windownum, struct rgb *pic,
     int point_start;
     int point_end;
     int x, y;
+    int i, j;
+    int block, side;
     int drawsize;
     long winstart, winend;
     unsigned long wholestart, wholeend, zoomstart, zoomend;
+    struct stats_mark mark;
 
     if (!pic || !width || !height || (step == 0.0)) {
         FAIL_MSG("add_highlight: invalid params\n");
@@ -439,6 +594,48 @@ add_highlight(int pixbufnum, int windownum, struct rgb *pic,
         point_end = drawsize;
     }
 
+    stats_begin(&mark);
+
+    /* in a Z-order plot, a block of 4^k points that starts on a multiple
+     * of 4^k is a square 2^k a side, so the selection is a few squares */
+    if (((pixbufnum == PIXBUF_WHOLE_HILBERT)
+         || (pixbufnum == PIXBUF_ZOOM_HILBERT))
+        && (disp.disp_hilbert == DISP_MORTON)) {
+        point_index = point_start;
+        while (point_index < point_end) {
+            block = 1;
+            side = 1;
+            while (!(point_index & ((block << 2) - 1))
+                   && (point_index + (block << 2) <= point_end)) {
+                block <<= 2;
+                side <<= 1;
+            }
+
+            if (morton_d2xy(point_index, &x, &y) != 0) {
+                FAIL_MSG("add_highlight: morton_d2xy() failed\n");
+                return 3;
+            }
+
+
+            for (j = y; j < y + side; j++) {
+                for (i = x; i < x + side; i++) {
+                    if (highlight_point(pic, width, i, j) != 0) {
+                        FAIL_MSG
+                            ("add_highlight: highlight_point() failed\n");
+                        return 4;
+                    }
+
+                }
+            }
+            point_index += block;
+        }
+
+        stats_add(STATS_ADD_HIGHLIGHT, 0, point_end - point_start);
+        stats_end(STATS_ADD_HIGHLIGHT, &mark);
+
+        return 0;
+    }
+
     /* loop over the selection */
     for (point_index = point_start; point_index < point_end; point_index++) {
         /* find the location */
@@ -455,6 +652,221 @@ add_highlight(int pixbufnum, int windownum, struct rgb *pic,
         }
 
     }
+    stats_add(STATS_ADD_HIGHLIGHT, 0, point_end - point_start);
+    stats_end(STATS_ADD_HIGHLIGHT, &mark);
+
+    return 0;
+}
+
+
+/* add_search_hits marks the points that contain search hits; the more hits
+ * a point holds, the brighter it is */
+int
+add_search_hits(int pixbufnum, struct rgb *pic, int width, int height,
+                long data_start, float step)
+{
+    struct search_index *idx;
+    unsigned long i, next;
+    long point_index, point_last;
+    long drawsize;
+    uint64_t end;
+    int x, y;
+    int green;
+
+    if (!pic || !width || !height || (step == 0.0)) {
+        FAIL_MSG("add_search_hits: invalid params\n");
+        return 1;
+    }
+
+
+    if (!search || !search->index.count) {
+        return 0;
+    }
+
+    idx = &search->index;
+    drawsize = width * height;
+    end = data_start + (uint64_t) ceil(drawsize * step);
+
+    /* hits are sorted, so each point is one run of the index */
+    i = search_lower_bound(idx, data_start);
+    while ((i < idx->count) && (idx->offsets[i] < end)) {
+        point_index = (idx->offsets[i] - data_start) / step;
+        if (point_index >= drawsize) {
+            break;
+        }
+
+        /* skip the rest of the hits in this point */
+        next =
+            search_lower_bound(idx,
+                               data_start +
+                               (uint64_t) ceil((point_index + 1) * step));
+        if (next <= i) {
+            next = i + 1;
+        }
+
+        /* when zoomed in, a hit covers more than one point */
+        point_last =
+            ceil((idx->offsets[i] +
+                  search->patterns[idx->pattern[i]].len -
+                  data_start) / step) - 1;
+        if (point_last < point_index) {
+            point_last = point_index;
+        }
+        if (point_last >= drawsize) {
+            point_last = drawsize - 1;
+        }
+
+        green = SEARCHHLG + ((next - i - 1) * SEARCHHLGSTEP);
+        if ((green > 0xff) || (next - i > 8)) {
+            green = 0xff;
+        }
+
+        for (; point_index <= point_last; point_index++) {
+            if (getxy(pixbufnum, width, point_index, &x, &y) != 0) {
+                FAIL_MSG("add_search_hits: getxy() failed\n");
+                return 2;
+            }
+
+
+            pic[(width * y) + x].red = SEARCHHLR;
+            pic[(width * y) + x].green = green;
+            pic[(width * y) + x].blue = SEARCHHLB;
+        }
+
+        i = next;
+    }
+
+    return 0;
+}
+
+
+/* add_changes marks the points on the hilbert plots whose blocks changed
+ * at the last rescan */
+int
+add_changes(int pixbufnum, struct rgb *pic, int width, int height,
+            long data_start, float step)
+{
+    unsigned long start, end, from;
+    long point_index, point_last;
+    long drawsize;
+    int x, y;
+
+    if (!pic || !width || !height || (step == 0.0)) {
+        FAIL_MSG("add_changes: invalid params\n");
+        return 1;
+    }
+
+
+    if (!changes || !changes->dirty
+        || ((pixbufnum != PIXBUF_WHOLE_HILBERT)
+            && (pixbufnum != PIXBUF_ZOOM_HILBERT))) {
+        return 0;
+    }
+
+    drawsize = width * height;
+    from = data_start;
+    while (change_range(changes, from, &start, &end)) {
+        point_index = (start - data_start) / step;
+        if (point_index >= drawsize) {
+            break;
+        }
+
+        /* a point is marked if it shows a changed byte or, when zoomed
+         * out, covers one */
+        point_last = ceil((end - data_start) / step) - 1;
+        if (point_last < point_index) {
+            point_last = point_index;
+        }
+        if (point_last >= drawsize) {
+            point_last = drawsize - 1;
+        }
+
+        for (; point_index <= point_last; point_index++) {
+            if (getxy(pixbufnum, width, point_index, &x, &y) != 0) {
+                FAIL_MSG("add_changes: getxy() failed\n");
+                return 2;
+            }
+
+
+            pic[(width * y) + x].red = CHANGEHLR;
+            pic[(width * y) + x].green = CHANGEHLG;
+            pic[(width * y) + x].blue = CHANGEHLB;
+        }
+
+        from = end;
+    }
+
+    return 0;
+}
+
+
+/* add_dupes marks the points that show blocks the same as, or like, the
+ * block last asked about */
+int
+add_dupes(int pixbufnum, struct rgb *pic, int width, int height,
+          long data_start, float step)
+{
+    unsigned long i, next, start, end;
+    long point_index, point_last;
+    long drawsize;
+    int x, y;
+    int near;
+
+    if (!pic || !width || !height || (step == 0.0)) {
+        FAIL_MSG("add_dupes: invalid params\n");
+        return 1;
+    }
+
+
+    if (!dupes || !dupes->nmatches) {
+        return 0;
+    }
+
+    drawsize = width * height;
+
+    /* matches are sorted, so only the first in each point is drawn */
+    i = dup_lower_bound(dupes, data_start);
+    while (i < dupes->nmatches) {
+        near = dupes->matches[i] & DUP_NEAR;
+        start = (dupes->matches[i] & ~DUP_NEAR) * dupes->blocksize;
+        end = start + dupes->blocksize;
+
+        point_index =
+            start > (unsigned long) data_start ? (start - data_start) / step : 0;
+        if (point_index >= drawsize) {
+            break;
+        }
+
+        point_last = ceil((end - data_start) / step) - 1;
+        if (point_last < point_index) {
+            point_last = point_index;
+        }
+        if (point_last >= drawsize) {
+            point_last = drawsize - 1;
+        }
+
+        next =
+            dup_lower_bound(dupes,
+                            data_start +
+                            (uint64_t) ceil((point_last + 1) * step));
+        if (next <= i) {
+            next = i + 1;
+        }
+
+        for (; point_index <= point_last; point_index++) {
+            if (getxy(pixbufnum, width, point_index, &x, &y) != 0) {
+                FAIL_MSG("add_dupes: getxy() failed\n");
+                return 2;
+            }
+
+
+            pic[(width * y) + x].red = near ? DUPNEARHLR : DUPHLR;
+            pic[(width * y) + x].green = near ? DUPNEARHLG : DUPHLG;
+            pic[(width * y) + x].blue = near ? DUPNEARHLB : DUPHLB;
+        }
+
+        i = next;
+    }
 
     return 0;
 }
@@ -471,6 +883,9 @@ int draw_img(int pixbufnum)
     int windownum;
     float step;
     unsigned long wholestart;
+    int colraw;
+    int redraw, extend;
+    struct stats_mark mark, mapmark;
 
     if ((pixbufnum != PIXBUF_WHOLE_HILBERT) &&
         (pixbufnum != PIXBUF_WHOLE_ZIGZAG) &&
@@ -485,6 +900,8 @@ int draw_img(int pixbufnum)
     int width = displays[pixbufnum].width;
     int height = displays[pixbufnum].height;
 
+    stats_begin(&mark);
+
     /* find the start of the whole window selection */
     if (zoom[ZOOM_WHOLE].start != -1) {
         wholestart = zoom[ZOOM_WHOLE].start;
@@ -492,10 +909,10 @@ int draw_img(int pixbufnum)
         wholestart = 0;
     }
 
-    /* create a rgb bitmap */
-    pic = (struct rgb *) malloc(sizeof(struct rgb) * width * height);
+    /* draw straight into the surface the display is painted from */
+    pic = draw_surface(&displays[pixbufnum].surface, width, height);
     if (!pic) {
-        FAIL_MSG("draw_img: malloc() failed\n");
+        FAIL_MSG("draw_img: draw_surface() failed\n");
         return 2;
     }
 
@@ -542,11 +959,13 @@ int draw_img(int pixbufnum)
      * if the pixbuf is a hilbert or zigzag and there isn't a saved bitmap
      * or something has changed that invalidates the bitmap, then redraw
      * it and highlight it;
+     * if the file has grown since the saved bitmap was drawn, draw the new
+     * points onto a copy of it and highlight that;
      * otherwise if it's a hilbert or zigzag and there is a saved bitmap,
      * draw that and highlight it;
      * otherwise if PIXBUF_WIN, draw the selection window markers.
      */
-    if ((pixbufnum != PIXBUF_WIN)
+    redraw = (pixbufnum != PIXBUF_WIN)
         && ((disp.col_set != save[pixbufnum].col_set)
             ||
             (((pixbufnum == PIXBUF_WHOLE_HILBERT)
@@ -557,18 +976,37 @@ int draw_img(int pixbufnum)
               || (pixbufnum == PIXBUF_ZOOM_ZIGZAG))
              && (disp.disp_zigzag != save[pixbufnum].disp_zigzag))
             || !(save[pixbufnum].pic)
+            || (save[pixbufnum].step != step)
             || ((windownum == ZOOM_ZOOM)
                 && ((save[pixbufnum].start != zoom[ZOOM_WHOLE].start)
-                    || (save[pixbufnum].end != zoom[ZOOM_WHOLE].end))))) {
+                    || (save[pixbufnum].end != zoom[ZOOM_WHOLE].end))));
+    extend = !redraw && (pixbufnum != PIXBUF_WIN)
+        && (save[pixbufnum].size != shm->filestat.st_size);
+
+    if (redraw || extend) {
+        /* carry on from the last point of the saved bitmap */
+        if (extend) {
+            memcpy(pic, save[pixbufnum].pic,
+                   sizeof(struct rgb) * width * height);
+            point_index = save[pixbufnum].points;
+        }
+
+        /* a compressed file's view is only filled in where points fall */
+        if (zsrc
+            && (zsrc_sample(zsrc, data_start, step, point_index,
+                            drawsize - point_index) != 0)) {
+            FAIL_MSG("draw_img: zsrc_sample() failed\n");
+        }
+
+        /* initialise the data index */
+        data_index = data_start + (point_index * step);
+
         /* check if the current mmap chunk is at least before our target */
-        if (data_start < mmap_ctx.mmap_offset) {
+        if (data_index < mmap_ctx.mmap_offset) {
             /* invalidate the chunk */
             mmap_ctx.mmap_offset = -(mmap_ctx.mmap_size);
         }
 
-        /* initialise the data index */
-        data_index = data_start;
-
         /* this is the draw loop - it runs until we run out of input or we fill
            the box */
         while ((data_index < shm->filestat.st_size)
@@ -577,6 +1015,8 @@ int draw_img(int pixbufnum)
             /* see if we need to mmap */
             while (data_index >=
                    (mmap_ctx.mmap_offset + mmap_ctx.mmap_size)) {
+                stats_begin(&mapmark);
+
                 /* if we already have a chunk, then unmap it */
                 if (mmap_ctx.filedata) {
                     if (munmap(mmap_ctx.filedata, mmap_ctx.mmap_size) != 0) {
@@ -584,12 +1024,17 @@ int draw_img(int pixbufnum)
                         return 4;
                     }
 
+                    stats_munmap(STATS_MMAP);
+                    budget_release(BUDGET_MMAP, mmap_ctx.mmap_size);
+                    mmap_ctx.filedata = NULL;
                 }
 
-                /* calculate new chunk params */
+                /* calculate new chunk params, with smaller chunks when the
+                 * session is near its memory budget */
                 mmap_ctx.mmap_offset =
                     mmap_ctx.mmap_offset + mmap_ctx.mmap_size;
-                mmap_ctx.mmap_size = (MMAP_CHUNK_SIZE);
+                mmap_ctx.mmap_size = budget_pressure() ? (MMAP_CHUNK_LOW) :
+                    (MMAP_CHUNK_SIZE);
                 if ((mmap_ctx.mmap_offset + mmap_ctx.mmap_size) >
                     shm->filestat.st_size) {
                     mmap_ctx.mmap_size =
@@ -602,9 +1047,14 @@ int draw_img(int pixbufnum)
                          MAP_SHARED, shm->fd, mmap_ctx.mmap_offset);
                 if (mmap_ctx.filedata == MAP_FAILED) {
                     FAIL_MSG("draw_img: mmap() failed\n");
+                    mmap_ctx.filedata = NULL;
                     return 5;
                 }
 
+                stats_mmap(STATS_MMAP);
+                stats_add(STATS_MMAP, mmap_ctx.mmap_size, 0);
+                stats_end(STATS_MMAP, &mapmark);
+                budget_charge(BUDGET_MMAP, mmap_ctx.mmap_size);
             }
 
             /* find the location */
@@ -614,12 +1064,19 @@ int draw_img(int pixbufnum)
             }
 
 
+            /* the regions scheme plots the label of the byte's block */
+            if (disp.col_set == COL_REGIONS) {
+                colraw = class_label(classify, data_index);
+            } else if (disp.col_set == COL_DIFF) {
+                colraw = cmp_level(compare, data_index);
+            } else {
+                colraw =
+                    mmap_ctx.filedata[(long)
+                                      (data_index - mmap_ctx.mmap_offset)];
+            }
+
             /* and plot it */
-            if (plot_point(pic, width, height, x, y,
-                           mmap_ctx.filedata[(long)
-                                             (data_index -
-                                              mmap_ctx.mmap_offset)]) !=
-                0) {
+            if (plot_point(pic, width, height, x, y, colraw) != 0) {
                 FAIL_MSG("draw_img: plot_point() failed\n");
                 return 6;
             }
@@ -630,6 +1087,14 @@ int draw_img(int pixbufnum)
             data_index = data_start + (point_index * step);
         }
 
+        /* a byte is read for each pixel */
+        if (extend) {
+            stats_add(STATS_DRAW_IMG, point_index - save[pixbufnum].points,
+                      width * height);
+        } else {
+            stats_add(STATS_DRAW_IMG, point_index, point_index);
+        }
+
         /* save a copy of the pic for future use */
 
         /* free the old one */
@@ -658,6 +1123,10 @@ int draw_img(int pixbufnum)
         save[pixbufnum].col_set = disp.col_set;
         save[pixbufnum].disp_hilbert = disp.disp_hilbert;
         save[pixbufnum].disp_zigzag = disp.disp_zigzag;
+        save[pixbufnum].step = step;
+        save[pixbufnum].points = point_index;
+        save[pixbufnum].size = shm->filestat.st_size;
+        draw_budget();
 
         /* and highlight it */
         if (add_highlight
@@ -667,11 +1136,30 @@ int draw_img(int pixbufnum)
             return 8;
         }
 
+        if (add_search_hits
+            (pixbufnum, pic, width, height, data_start, step) != 0) {
+            FAIL_MSG("draw_img: add_search_hits() failed\n");
+            return 12;
+        }
+
+        if (add_changes(pixbufnum, pic, width, height, data_start, step) !=
+            0) {
+            FAIL_MSG("draw_img: add_changes() failed\n");
+            return 14;
+        }
+
+        if (add_dupes(pixbufnum, pic, width, height, data_start, step) !=
+            0) {
+            FAIL_MSG("draw_img: add_dupes() failed\n");
+            return 16;
+        }
+
 
     } else if (pixbufnum != PIXBUF_WIN) {
         /* window dimensions haven't changed, so just copy the old one and highlight it */
         memcpy(pic, save[pixbufnum].pic,
                sizeof(struct rgb) * width * height);
+        stats_add(STATS_DRAW_IMG, 0, width * height);
         if (add_highlight
             (pixbufnum, windownum, pic, width, height, data_start,
              step) != 0) {
@@ -679,6 +1167,24 @@ int draw_img(int pixbufnum)
             return 9;
         }
 
+        if (add_search_hits
+            (pixbufnum, pic, width, height, data_start, step) != 0) {
+            FAIL_MSG("draw_img: add_search_hits() failed\n");
+            return 13;
+        }
+
+        if (add_changes(pixbufnum, pic, width, height, data_start, step) !=
+            0) {
+            FAIL_MSG("draw_img: add_changes() failed\n");
+            return 15;
+        }
+
+        if (add_dupes(pixbufnum, pic, width, height, data_start, step) !=
+            0) {
+            FAIL_MSG("draw_img: add_dupes() failed\n");
+            return 17;
+        }
+
 
     } else {
         /* this is the PIXBUF_WIN between the two zigzags */
@@ -697,19 +1203,295 @@ int draw_img(int pixbufnum)
 
     }
 
-    /* copy the bitmap to the pixbuf */
-    if (displays[pixbufnum].buf)
-        g_object_unref(displays[pixbufnum].buf);
+    /* the surface is painted as it is */
+    cairo_surface_mark_dirty(displays[pixbufnum].surface);
+
+    stats_end(STATS_DRAW_IMG, &mark);
+
+    return 0;
+}
+
+
+/* rescale_saved shrinks a saved bitmap for a step that has been doubled
+ * shift times.  With the longer step, point i shows the byte that point
+ * i << shift showed before, so the points are moved rather than read
+ * from the file again. */
+int rescale_saved(int pixbufnum, int shift, float step)
+{
+    struct rgb *pic;
+    int width = displays[pixbufnum].width;
+    int height = displays[pixbufnum].height;
+    long point_index, points;
+    int x, y, oldx, oldy;
+
+    if ((pixbufnum == PIXBUF_WIN) || (pixbufnum < PIXBUF_WHOLE_HILBERT)
+        || (pixbufnum > PIXBUF_ZOOM_HILBERT) || (shift < 1)) {
+        FAIL_MSG("rescale_saved: invalid params\n");
+        return 1;
+    }
+
+
+    if (!save[pixbufnum].pic) {
+        return 0;
+    }
+
+    /* a bitmap drawn with other settings is drawn again from scratch */
+    if ((save[pixbufnum].col_set != disp.col_set)
+        || (save[pixbufnum].disp_hilbert != disp.disp_hilbert)
+        || (save[pixbufnum].disp_zigzag != disp.disp_zigzag)
+        || (shift >= 32)) {
+        free(save[pixbufnum].pic);
+        save[pixbufnum].pic = NULL;
+        return 0;
+    }
+
+    pic = (struct rgb *) malloc(sizeof(struct rgb) * width * height);
+    if (!pic) {
+        FAIL_MSG("rescale_saved: malloc() failed\n");
+        return 2;
+    }
+
+
+    memset(pic, 0, sizeof(struct rgb) * width * height);
+
+    points = (save[pixbufnum].points + (1L << shift) - 1) >> shift;
+    for (point_index = 0; point_index < points; point_index++) {
+        if ((getxy(pixbufnum, width, point_index, &x, &y) != 0)
+            || (getxy(pixbufnum, width, point_index << shift, &oldx, &oldy)
+                != 0)) {
+            FAIL_MSG("rescale_saved: getxy() failed\n");
+            free(pic);
+            return 3;
+        }
+
+
+        pic[(width * y) + x] = save[pixbufnum].pic[(width * oldy) + oldx];
+    }
+
+    free(save[pixbufnum].pic);
+    save[pixbufnum].pic = pic;
+    save[pixbufnum].points = points;
+    save[pixbufnum].step = step;
+    draw_budget();
+
+    return 0;
+}
+
+
+/* draw_budget counts the saved bitmaps against the memory budget */
+void draw_budget()
+{
+    unsigned long bytes = 0;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        if (save[i].pic) {
+            bytes += sizeof(struct rgb) * displays[i].width *
+                displays[i].height;
+        }
+    }
+
+    budget_set(BUDGET_PICS, bytes);
+}
+
+
+/* draw_grow prepares the displays for a file that has grown from oldsize.
+ * The views that run to the end of the file keep their step until the
+ * file outgrows them, and then double it, so the saved bitmaps only ever
+ * need the new points drawn on; draw_img() does that when it sees the
+ * saved bitmap is for the old size. */
+int draw_grow(unsigned long oldsize, unsigned long newsize)
+{
+    unsigned long start;
+    long double capacity;
+    int shift;
+    int w;
+
+    if (newsize < oldsize) {
+        FAIL_MSG("draw_grow: invalid params\n");
+        return 1;
+    }
+
 
-    displays[pixbufnum].buf = gdk_pixbuf_new_from_data((const guchar *) pic,        /* the data */
-                                                       GDK_COLORSPACE_RGB,        /* colorspace */
-                                                       FALSE,        /* has alpha */
-                                                       8,        /* bits per sample */
-                                                       width,        /* width */
-                                                       height,        /* height */
-                                                       width * 3,        /* rowstride */
-                                                       &freepic,        /* destroy fn */
-                                                       NULL);        /* destroy data */
+    /* the last chunk was cut short at the old size, so drop it and map
+     * it again in full when it's next needed */
+    if (mmap_ctx.filedata
+        && (mmap_ctx.mmap_offset + mmap_ctx.mmap_size >= oldsize)) {
+        if (munmap(mmap_ctx.filedata, mmap_ctx.mmap_size) != 0) {
+            FAIL_ERR("draw_grow: munmap() failed\n");
+            return 2;
+        }
+
+        stats_munmap(STATS_MMAP);
+        budget_release(BUDGET_MMAP, mmap_ctx.mmap_size);
+        mmap_ctx.filedata = NULL;
+        mmap_ctx.mmap_offset -= MMAP_CHUNK_SIZE;
+        mmap_ctx.mmap_size = MMAP_CHUNK_SIZE;
+    }
+
+    for (w = ZOOM_WHOLE; w <= ZOOM_ZOOM; w++) {
+        /* the zoom views only grow when the whole selection is open */
+        if ((w == ZOOM_ZOOM) && (zoom[ZOOM_WHOLE].end != -1)) {
+            continue;
+        }
+
+        start = 0;
+        if ((w == ZOOM_ZOOM) && (zoom[ZOOM_WHOLE].start != -1)) {
+            start = zoom[ZOOM_WHOLE].start;
+        }
+
+        /* a file that was empty has no scale to keep */
+        if (zoom[w].step_hilbert == 0.0) {
+            zoom[w].step_hilbert =
+                (long double) (newsize - start) / (512 * 512);
+            zoom[w].step_zigzag =
+                (long double) (newsize - start) / (128 * 512);
+            continue;
+        }
+
+        capacity = (long double) zoom[w].step_hilbert * 512 * 512;
+        for (shift = 0; capacity < newsize - start; shift++) {
+            capacity *= 2;
+        }
+
+        if (!shift) {
+            continue;
+        }
+
+        zoom[w].step_hilbert *= (1L << shift);
+        zoom[w].step_zigzag *= (1L << shift);
+
+        if (w == ZOOM_WHOLE) {
+            if ((rescale_saved(PIXBUF_WHOLE_HILBERT, shift,
+                               zoom[w].step_hilbert) != 0)
+                || (rescale_saved(PIXBUF_WHOLE_ZIGZAG, shift,
+                                  zoom[w].step_zigzag) != 0)) {
+                FAIL_MSG("draw_grow: rescale_saved() failed\n");
+                return 3;
+            }
+
+        } else {
+            if ((rescale_saved(PIXBUF_ZOOM_HILBERT, shift,
+                               zoom[w].step_hilbert) != 0)
+                || (rescale_saved(PIXBUF_ZOOM_ZIGZAG, shift,
+                                  zoom[w].step_zigzag) != 0)) {
+                FAIL_MSG("draw_grow: rescale_saved() failed\n");
+                return 4;
+            }
+
+        }
+    }
+
+    return 0;
+}
+
+
+/* draw_range draws the points of a saved bitmap that show bytes from start
+ * to end again, after they have changed in place.  Only the bytes the
+ * points show are read, so the work follows the size of the change rather
+ * than the size of the file. */
+int draw_range(int pixbufnum, unsigned long start, unsigned long end)
+{
+    uint8_t buf[CHANGE_BLOCK_SIZE];
+    unsigned long offset, bufstart, buflen;
+    long data_start, point_index;
+    float data_index, step;
+    ssize_t got;
+    int width, height;
+    int x, y;
+    int colraw;
+
+    if ((pixbufnum == PIXBUF_WIN) || (pixbufnum < PIXBUF_WHOLE_HILBERT)
+        || (pixbufnum > PIXBUF_ZOOM_HILBERT) || (end < start)) {
+        FAIL_MSG("draw_range: invalid params\n");
+        return 1;
+    }
+
+
+    if (!save[pixbufnum].pic || (save[pixbufnum].step == 0.0)) {
+        return 0;
+    }
+
+    width = displays[pixbufnum].width;
+    height = displays[pixbufnum].height;
+    step = save[pixbufnum].step;
+
+    /* find the first point as draw_img() does */
+    data_start = 0;
+    if (((pixbufnum == PIXBUF_ZOOM_HILBERT)
+         || (pixbufnum == PIXBUF_ZOOM_ZIGZAG))
+        && (zoom[ZOOM_WHOLE].start != -1)) {
+        data_start = zoom[ZOOM_WHOLE].start;
+    }
+
+    if (end <= data_start) {
+        return 0;
+    }
+    if (start < data_start) {
+        start = data_start;
+    }
+
+    point_index = (start - data_start) / step;
+    if (point_index > 0) {
+        point_index--;
+    }
+
+    bufstart = 0;
+    buflen = 0;
+    for (; point_index < save[pixbufnum].points; point_index++) {
+        data_index = data_start + (point_index * step);
+        offset = (unsigned long) data_index;
+        if (offset >= end) {
+            break;
+        }
+        if (offset < start) {
+            continue;
+        }
+
+        /* read the next piece of the range, or just the byte if the
+         * points are far apart */
+        if ((offset < bufstart) || (offset >= bufstart + buflen)) {
+            bufstart = offset;
+            buflen = end - offset;
+            if (buflen > sizeof(buf)) {
+                buflen = sizeof(buf);
+            }
+            if (step >= sizeof(buf)) {
+                buflen = 1;
+            }
+
+            got = pread(shm->fd, buf, buflen, bufstart);
+            if (got <= 0) {
+                FAIL_ERR("draw_range: pread() failed\n");
+                return 2;
+            }
+
+            buflen = got;
+            stats_add(STATS_DRAW_IMG, got, 0);
+        }
+
+        if (getxy(pixbufnum, width, point_index, &x, &y) != 0) {
+            FAIL_MSG("draw_range: getxy() failed\n");
+            return 3;
+        }
+
+
+        if (disp.col_set == COL_REGIONS) {
+            colraw = class_label(classify, offset);
+        } else if (disp.col_set == COL_DIFF) {
+            colraw = cmp_level(compare, offset);
+        } else {
+            colraw = buf[offset - bufstart];
+        }
+
+        if (plot_point(save[pixbufnum].pic, width, height, x, y, colraw) !=
+            0) {
+            FAIL_MSG("draw_range: plot_point() failed\n");
+            return 4;
+        }
+
+        stats_add(STATS_DRAW_IMG, 0, 1);
+    }
 
     return 0;
 }
@@ -33,6 +33,13 @@
 #include "rb-hilbert.h"
 #include "rb-shm.h"
 #include "rb-mmap.h"
+#include "rb-search.h"
+#include "rb-classify.h"
+#include "rb-change.h"
+#include "rb-zsrc.h"
+#include "rb-compare.h"
+#include "rb-dupes.h"
+#include "rb-stats.h"
 #include "macro.h"
 
 
@@ -68,16 +75,95 @@
 #define COLSCALETHRESHOLD 50
 #define COLSCALEHL 100
 
+/* region colours */
+#define REGIONNONER 0x30
+#define REGIONNONEG 0x30
+#define REGIONNONEB 0x30
+#define REGIONPADDINGR 0x10
+#define REGIONPADDINGG 0x10
+#define REGIONPADDINGB 0x28
+#define REGIONTEXTR 0x10
+#define REGIONTEXTG 0x72
+#define REGIONTEXTB 0xb8
+#define REGIONCODER 0x4d
+#define REGIONCODEG 0xaf
+#define REGIONCODEB 0x4a
+#define REGIONCOMPRESSEDR 0xe4
+#define REGIONCOMPRESSEDG 0x1a
+#define REGIONCOMPRESSEDB 0x1c
+#define REGIONIMAGER 0x98
+#define REGIONIMAGEG 0x4e
+#define REGIONIMAGEB 0xa3
+#define REGIONTABLER 0xa6
+#define REGIONTABLEG 0x56
+#define REGIONTABLEB 0x28
+#define REGIONDATAR 0x90
+#define REGIONDATAG 0x90
+#define REGIONDATAB 0x90
+
+/* differences go from dark red to yellow as more of the block differs;
+ * blocks that are the same are black, and ones not compared yet grey */
+#define DIFFSAMER 0x00
+#define DIFFSAMEG 0x00
+#define DIFFSAMEB 0x00
+#define DIFFLOWR 0x80
+#define DIFFLOWG 0x00
+#define DIFFHIGHR 0xff
+#define DIFFHIGHG 0xff
+#define DIFFB 0x00
+/* when the files are lined up: moved is blue, inserted green and where
+ * bytes of the second file are missing magenta */
+#define DIFFMOVEDR 0x30
+#define DIFFMOVEDG 0x60
+#define DIFFMOVEDB 0xff
+#define DIFFINSR 0x00
+#define DIFFINSG 0xc0
+#define DIFFINSB 0x00
+#define DIFFDELR 0xff
+#define DIFFDELG 0x00
+#define DIFFDELB 0xff
+
+/* search hits are orange, going to yellow as the hits per point increase */
+#define SEARCHHLR 0xff
+#define SEARCHHLG 0x60
+#define SEARCHHLGSTEP 0x20
+#define SEARCHHLB 0x00
+
+/* blocks that changed at the last rescan are cyan */
+#define CHANGEHLR 0x00
+#define CHANGEHLG 0xff
+#define CHANGEHLB 0xff
+
+/* blocks the same as the one asked about are pink, similar ones violet */
+#define DUPHLR 0xff
+#define DUPHLG 0x40
+#define DUPHLB 0xc0
+#define DUPNEARHLR 0xa0
+#define DUPNEARHLG 0x40
+#define DUPNEARHLB 0xff
+
 
 
 int colscalecolbyte(int b, guchar * red, guchar * green, guchar * blue);
 int greyscalecolbyte(int b, guchar * red, guchar * green, guchar * blue);
 int cortesicolbyte(int b, guchar * red, guchar * green, guchar * blue);
+int regioncolbyte(int b, guchar * red, guchar * green, guchar * blue);
+int diffcolbyte(int b, guchar * red, guchar * green, guchar * blue);
 int plot_point(struct rgb *pic, int width, int height, int x, int y,
                int colraw);
 int calcwindows(unsigned long *wholestart, unsigned long *wholeend,
                 unsigned long *zoomstart, unsigned long *zoomend);
-void freepic(guchar * pixels, gpointer data);
+struct rgb *draw_surface(cairo_surface_t ** surface, int width, int height);
+int add_search_hits(int pixbufnum, struct rgb *pic, int width, int height,
+                    long data_start, float step);
+int add_changes(int pixbufnum, struct rgb *pic, int width, int height,
+                long data_start, float step);
+int add_dupes(int pixbufnum, struct rgb *pic, int width, int height,
+              long data_start, float step);
 int draw_img(int pixbufnum);
+int draw_range(int pixbufnum, unsigned long start, unsigned long end);
+int rescale_saved(int pixbufnum, int shift, float step);
+int draw_grow(unsigned long oldsize, unsigned long newsize);
+void draw_budget();
 
 #endif
@@ -0,0 +1,351 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-dupes.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to find the blocks of a file that are the same as, or
+ * like, a given one.  The file is read once through rb_scan() on all CPUs
+ * and each aligned block gets a hash of its bytes and a one permutation
+ * MinHash of its 4 byte shingles, folded into bands.  Blocks with the same
+ * hash and bands are the same; blocks that share a band are alike.  Only 20
+ * bytes are kept for each block, and blocks are made bigger for big files,
+ * so the index is never more than 160MB.  Asking about a block is a pass
+ * over the index, which is quick enough for a click.
+ */
+
+#include "rb-dupes.h"
+
+#define DUP_MUL 0x9e3779b97f4a7c15ULL
+
+
+/* dup_sign hashes a block and works out its MinHash bands */
+static void dup_sign(const uint8_t * p, unsigned long len, uint32_t * exact,
+                     uint32_t * bands)
+{
+    uint32_t mins[DUP_BINS];
+    uint32_t x, v;
+    uint64_t h, w;
+    unsigned long i;
+    int k, j;
+
+    /* the bytes themselves, a word at a time */
+    h = len;
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&w, p + i, 8);
+        h ^= w;
+        h = ((h << 29) | (h >> 35)) * DUP_MUL;
+    }
+    for (; i < len; i++) {
+        h = (h ^ p[i]) * DUP_MUL;
+    }
+    *exact = (uint32_t) (h ^ (h >> 32));
+
+    /* each shingle's hash picks a bin by its top bits and the smallest of
+     * the rest is kept for each bin */
+    for (k = 0; k < DUP_BINS; k++) {
+        mins[k] = UINT32_MAX;
+    }
+    for (i = 0; i + DUP_SHINGLE <= len; i++) {
+        memcpy(&x, p + i, DUP_SHINGLE);
+        h = (uint64_t) (x ^ 0x5bd1e995) * DUP_MUL;
+        k = h >> (64 - DUP_BIN_BITS);
+        v = (uint32_t) (h >> (32 - DUP_BIN_BITS));
+        if (v < mins[k]) {
+            mins[k] = v;
+        }
+    }
+
+    /* a bin with nothing in it borrows from the next one that has */
+    for (k = 0; k < DUP_BINS; k++) {
+        if (mins[k] != UINT32_MAX) {
+            continue;
+        }
+        for (j = 1; j < DUP_BINS; j++) {
+            if (mins[(k + j) % DUP_BINS] != UINT32_MAX) {
+                mins[k] = mins[(k + j) % DUP_BINS] + (j * 0x9e3779b9U);
+                break;
+            }
+        }
+    }
+
+    for (k = 0; k < DUP_BANDS; k++) {
+        h = ((uint64_t) mins[k * DUP_ROWS] << 32) | mins[(k * DUP_ROWS) + 1];
+        h = (h ^ (h >> 31)) * DUP_MUL;
+        bands[k] = (uint32_t) (h >> 32);
+    }
+}
+
+
+/* dup_scan is the scan callback; it indexes each block in the range */
+static int dup_scan(void *arg, int thread, unsigned long block,
+                    unsigned long offset, const uint8_t * buf,
+                    unsigned long len, unsigned long total)
+{
+    struct dup_ctx *ctx = (struct dup_ctx *) arg;
+    unsigned long pos, size, b;
+
+    for (pos = 0; pos < len; pos += ctx->blocksize) {
+        size = len - pos;
+        if (size > ctx->blocksize) {
+            size = ctx->blocksize;
+        }
+
+        b = (offset + pos) / ctx->blocksize;
+        dup_sign(buf + pos, size, &ctx->exact[b],
+                 ctx->bands + (b * DUP_BANDS));
+    }
+
+    return 0;
+}
+
+
+/* dup_new makes an empty index for a file of size bytes */
+struct dup_ctx *dup_new(unsigned long size)
+{
+    struct dup_ctx *ctx;
+
+    if (!size) {
+        FAIL_MSG("dup_new: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct dup_ctx *) calloc(1, sizeof(struct dup_ctx));
+    if (!ctx) {
+        FAIL_MSG("dup_new: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->size = size;
+    ctx->blocksize = DUP_MIN_BLOCK;
+    while (size / ctx->blocksize >= DUP_MAX_BLOCKS) {
+        ctx->blocksize *= 2;
+    }
+    ctx->nblocks = (size + ctx->blocksize - 1) / ctx->blocksize;
+
+    /* bigger blocks, and so a smaller index, if the memory budget is
+     * short; one block of the whole file is always allowed */
+    ctx->reserved = ctx->nblocks * (DUP_BANDS + 1) * sizeof(uint32_t);
+    while (budget_reserve(BUDGET_CACHE, ctx->reserved) != 0) {
+        if (ctx->nblocks == 1) {
+            budget_charge(BUDGET_CACHE, ctx->reserved);
+            break;
+        }
+        ctx->blocksize *= 2;
+        ctx->nblocks = (size + ctx->blocksize - 1) / ctx->blocksize;
+        ctx->reserved = ctx->nblocks * (DUP_BANDS + 1) * sizeof(uint32_t);
+    }
+
+    ctx->exact = (uint32_t *) malloc(ctx->nblocks * sizeof(uint32_t));
+    ctx->bands = (uint32_t *) malloc(ctx->nblocks * DUP_BANDS *
+                                     sizeof(uint32_t));
+    if (!ctx->exact || !ctx->bands) {
+        FAIL_MSG("dup_new: malloc() failed\n");
+        dup_free(ctx);
+        return NULL;
+    }
+
+
+    return ctx;
+}
+
+
+/* dup_start indexes the file in the background */
+int dup_start(struct dup_ctx *ctx, int fd)
+{
+    unsigned long scanblock;
+
+    if (!ctx || (fd < 0)) {
+        FAIL_MSG("dup_start: invalid params\n");
+        return 1;
+    }
+
+
+    /* the scan blocks are whole index blocks */
+    scanblock = ctx->blocksize > SCAN_BLOCK_SIZE
+        ? ctx->blocksize : SCAN_BLOCK_SIZE;
+
+    if (rb_scan_init(&ctx->scan, fd, 0, ctx->size, scanblock, 0, dup_scan,
+                     ctx) != 0) {
+        FAIL_MSG("dup_start: rb_scan_init() failed\n");
+        return 2;
+    }
+
+
+    if (rb_scan_start(&ctx->scan) != 0) {
+        FAIL_MSG("dup_start: rb_scan_start() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* dup_finished returns whether the index has been made */
+int dup_finished(struct dup_ctx *ctx)
+{
+    if (!ctx || !ctx->scan.running) {
+        return 1;
+    }
+
+    if (!__atomic_load_n(&ctx->scan.finished, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    rb_scan_wait(&ctx->scan);
+
+    return 1;
+}
+
+
+/* dup_progress returns how much of the index has been made, in percent */
+int dup_progress(struct dup_ctx *ctx)
+{
+    if (!ctx) {
+        return 100;
+    }
+
+    return rb_scan_progress(&ctx->scan);
+}
+
+
+/* dup_query finds the other blocks that are the same as, or like, the one
+ * holding offset */
+int dup_query(struct dup_ctx *ctx, unsigned long offset)
+{
+    const uint32_t *qbands, *bands;
+    unsigned long q, i, n, pass;
+    uint32_t ex;
+    int k, same, near;
+
+    if (!ctx || (offset >= ctx->size) || !dup_finished(ctx)
+        || ctx->scan.error) {
+        FAIL_MSG("dup_query: invalid params\n");
+        return 1;
+    }
+
+
+    dup_clear(ctx);
+
+    q = offset / ctx->blocksize;
+    ex = ctx->exact[q];
+    qbands = ctx->bands + (q * DUP_BANDS);
+    ctx->query = q;
+
+    /* count them, then keep them */
+    for (pass = 0; pass < 2; pass++) {
+        n = 0;
+        ctx->nexact = 0;
+        for (i = 0; i < ctx->nblocks; i++) {
+            if (i == q) {
+                continue;
+            }
+
+            bands = ctx->bands + (i * DUP_BANDS);
+            same = 0;
+            near = 0;
+            for (k = 0; k < DUP_BANDS; k++) {
+                if (bands[k] == qbands[k]) {
+                    same++;
+                }
+            }
+            if (!same) {
+                continue;
+            }
+            if ((same == DUP_BANDS) && (ctx->exact[i] == ex)) {
+                ctx->nexact++;
+            } else {
+                near = 1;
+            }
+
+            if (pass) {
+                ctx->matches[n] = i | (near ? DUP_NEAR : 0);
+            }
+            n++;
+        }
+
+        if (!pass) {
+            ctx->matches = (uint32_t *) malloc((n + 1) * sizeof(uint32_t));
+            if (!ctx->matches) {
+                FAIL_MSG("dup_query: malloc() failed\n");
+                return 2;
+            }
+
+        }
+    }
+
+    ctx->nmatches = n;
+
+    return 0;
+}
+
+
+/* dup_lower_bound returns the first match that ends after offset */
+unsigned long dup_lower_bound(struct dup_ctx *ctx, unsigned long offset)
+{
+    unsigned long lo, hi, mid;
+
+    lo = 0;
+    hi = ctx->nmatches;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (((ctx->matches[mid] & ~DUP_NEAR) + 1) * ctx->blocksize <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+/* dup_clear forgets the last query */
+int dup_clear(struct dup_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("dup_clear: invalid params\n");
+        return 1;
+    }
+
+
+    free(ctx->matches);
+    ctx->matches = NULL;
+    ctx->nmatches = 0;
+    ctx->nexact = 0;
+
+    return 0;
+}
+
+
+/* dup_free stops indexing if it is running and frees the index */
+int dup_free(struct dup_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("dup_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->scan.running) {
+        __atomic_store_n(&ctx->scan.cancel, 1, __ATOMIC_RELAXED);
+        rb_scan_wait(&ctx->scan);
+    }
+
+    free(ctx->exact);
+    free(ctx->bands);
+    free(ctx->matches);
+    budget_release(BUDGET_CACHE, ctx->reserved);
+    free(ctx);
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-dupes.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_DUPES_H
+#define _RB_DUPES_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "rb-scan.h"
+#include "rb-budget.h"
+#include "macro.h"
+
+/* blocks are at least this big, and bigger for big files so that the
+ * index never has more than DUP_MAX_BLOCKS of them */
+#define DUP_MIN_BLOCK 4096
+#define DUP_MAX_BLOCKS (1UL << 23)
+
+/* near-duplicates share a band of MinHash values; DUP_BANDS bands of
+ * DUP_ROWS values find blocks about half alike or more */
+#define DUP_BANDS 4
+#define DUP_ROWS 2
+#define DUP_BINS (DUP_BANDS * DUP_ROWS)
+#define DUP_BIN_BITS 3
+/* the shingles are this many bytes */
+#define DUP_SHINGLE 4
+
+/* a match in the last query is a block number, with this set if it is only
+ * similar */
+#define DUP_NEAR 0x80000000U
+
+/* a hash of each block and of its bands, for the whole file */
+struct dup_ctx {
+    unsigned long size;
+    unsigned long blocksize;
+    unsigned long nblocks;
+    uint32_t *exact;
+    uint32_t *bands;            /* DUP_BANDS for each block */
+    unsigned long reserved;     /* from the memory budget */
+    struct scan_ctx scan;
+
+    /* the blocks like the one last asked about, in order */
+    unsigned long query;
+    uint32_t *matches;
+    unsigned long nmatches;
+    unsigned long nexact;
+};
+
+struct dup_ctx *dup_new(unsigned long size);
+int dup_start(struct dup_ctx *ctx, int fd);
+int dup_finished(struct dup_ctx *ctx);
+int dup_progress(struct dup_ctx *ctx);
+int dup_query(struct dup_ctx *ctx, unsigned long offset);
+unsigned long dup_lower_bound(struct dup_ctx *ctx, unsigned long offset);
+int dup_clear(struct dup_ctx *ctx);
+int dup_free(struct dup_ctx *ctx);
+
+#endif
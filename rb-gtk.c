@@ -32,9 +32,54 @@ struct pixbuf displays[5];
 struct window zoom[2];
 /* stored bitmaps */
 struct savepic save[5];
+/* the current search, if any */
+struct search_ctx *search = NULL;
+static unsigned int search_gen = 0;
+/* the region classification, if any */
+struct class_ctx *classify = NULL;
+static unsigned int classify_gen = 0;
+/* the byte counts for the selection statistics */
+struct hist_ctx *histidx = NULL;
+static unsigned int hist_gen = 0;
+/* the timer watching a followed file */
+static unsigned int follow_gen = 0;
+/* the block hashes for finding changes made in place, if any */
+struct change_ctx *changes = NULL;
+static unsigned int change_gen = 0;
+static unsigned int watch_gen = 0;
+/* the process whose memory is being looked at, if any */
+struct proc_ctx *procmem = NULL;
+static unsigned int proc_gen = 0;
+static unsigned long proc_seen = 0;
+/* stdin as it is read, if that is what is being looked at */
+struct spool_ctx *spool = NULL;
+static unsigned int spool_gen = 0;
+static int spool_moved = 0;
+static int spool_follow = 0;
+/* the compressed file being looked at, if any */
+struct zsrc_ctx *zsrc = NULL;
+/* the compressed file whose index is being made, if any */
+static struct zsrc_ctx *zsrc_pending = NULL;
+static unsigned int zsrc_gen = 0;
+/* the file being compared with, if any */
+struct cmp_ctx *compare = NULL;
+static unsigned int compare_gen = 0;
+/* the index of duplicate blocks, once something has asked for it */
+struct dup_ctx *dupes = NULL;
+static unsigned int dupes_gen = 0;
+static unsigned long dupes_pending = 0;
+/* the tiles of the deep zoom window, while it is open */
+struct tile_ctx *tiles = NULL;
+static unsigned int tiles_gen = 0;
+static struct deepview deep;
 
 /* running visualisers */
 struct vis child[MAX_VIS];
+/* and those loaded as plugins */
+static struct plugvis plugvis[MAX_VIS];
+static int plugvis_polling = 0;
+/* whether the waiting visualisers are due to be topped up */
+static int zygote_refilling = 0;
 /* all visualisers */
 extern struct visualiser *visualisers;
 extern unsigned int visualiser_count;
@@ -52,6 +97,15 @@ void child_reap(int signo)
 
     pid_t pid = wait(&status);
 
+    /* whatever it had of the memory budget is free again */
+    budget_clear(shm, pid);
+
+    /* one waiting to be opened isn't in the table */
+    if (zygote_reaped(pid)) {
+        errno = saved_errno;
+        return;
+    }
+
     if (pid > 0) {
         /* find pid slot */
         i = 0;
@@ -63,6 +117,7 @@ void child_reap(int signo)
         if (i < MAX_VIS) {
             child[i].visid = -1;
             child[i].pid = 0;
+            shm_ack_clear(shm, pid);
         } else {
             fprintf(stderr, "child_reap: invalid pid\n");
         }
@@ -83,6 +138,10 @@ int init_arrays()
     disp.drag = 0;
     disp.dragy = -1;
     disp.whole_hide = 0;
+    disp.stats_show = 0;
+    disp.selstats_show = 0;
+    disp.follow = 0;
+    disp.watch = 0;
 
     /* clear the savepic array */
     for (i = 0; i < 5; i++) {
@@ -92,6 +151,9 @@ int init_arrays()
         save[i].disp_zigzag = -1;
         save[i].start = -2;
         save[i].end = -2;
+        save[i].step = 0.0;
+        save[i].points = 0;
+        save[i].size = 0;
     }
 
     /* clear the vis array */
@@ -110,6 +172,7 @@ int make_main_window()
     GtkWidget *vbox;
     GtkWidget *hbox;
     GtkWidget *menubar;
+    PangoFontDescription *pfd;
 
     char title_buf[1024];
     char *tmpptr;
@@ -128,6 +191,15 @@ int make_main_window()
     } else {
         tmpptr++;
     }
+    if (procmem) {
+        tmpptr = procmem->name;
+    }
+    if (spool) {
+        tmpptr = "stdin";
+    }
+    if (zsrc) {
+        tmpptr = zsrc->name;
+    }
 
     snprintf(title_buf, 1024, "Rubber Marbles - %s\n", tmpptr);
     gtk_window_set_title(GTK_WINDOW(wx.main_window), title_buf);
@@ -171,7 +243,7 @@ int make_main_window()
     /* whole file hilbert */
     displays[PIXBUF_WHOLE_HILBERT].width = 512;
     displays[PIXBUF_WHOLE_HILBERT].height = 512;
-    displays[PIXBUF_WHOLE_HILBERT].buf = NULL;
+    displays[PIXBUF_WHOLE_HILBERT].surface = NULL;
 
     wx.hilbert_whole = gtk_drawing_area_new();
     if (!wx.hilbert_whole) {
@@ -187,7 +259,7 @@ int make_main_window()
     /* whole file zigzag */
     displays[PIXBUF_WHOLE_ZIGZAG].width = 128;
     displays[PIXBUF_WHOLE_ZIGZAG].height = 512;
-    displays[PIXBUF_WHOLE_ZIGZAG].buf = NULL;
+    displays[PIXBUF_WHOLE_ZIGZAG].surface = NULL;
 
     wx.zigzag_whole = gtk_drawing_area_new();
     if (!wx.zigzag_whole) {
@@ -203,7 +275,7 @@ int make_main_window()
     /* zigzag window markers */
     displays[PIXBUF_WIN].width = 8;
     displays[PIXBUF_WIN].height = 512;
-    displays[PIXBUF_WIN].buf = NULL;
+    displays[PIXBUF_WIN].surface = NULL;
 
     wx.zigzag_win = gtk_drawing_area_new();
     if (!wx.zigzag_win) {
@@ -219,7 +291,7 @@ int make_main_window()
     /* zoom file zigzag */
     displays[PIXBUF_ZOOM_ZIGZAG].width = 128;
     displays[PIXBUF_ZOOM_ZIGZAG].height = 512;
-    displays[PIXBUF_ZOOM_ZIGZAG].buf = NULL;
+    displays[PIXBUF_ZOOM_ZIGZAG].surface = NULL;
 
     wx.zigzag_zoom = gtk_drawing_area_new();
     if (!wx.zigzag_zoom) {
@@ -235,7 +307,7 @@ int make_main_window()
     /* zoom file hilbert */
     displays[PIXBUF_ZOOM_HILBERT].width = 512;
     displays[PIXBUF_ZOOM_HILBERT].height = 512;
-    displays[PIXBUF_ZOOM_HILBERT].buf = NULL;
+    displays[PIXBUF_ZOOM_HILBERT].surface = NULL;
 
     wx.hilbert_zoom = gtk_drawing_area_new();
     if (!wx.hilbert_zoom) {
@@ -433,6 +505,40 @@ int make_main_window()
                           | GDK_POINTER_MOTION_HINT_MASK);
 
 
+    /* the selection's statistics, hidden until asked for */
+    wx.selstats = gtk_label_new("");
+    if (!wx.selstats) {
+        FAIL_MSG("RubberMarbles: gtk_label_new() failed\n");
+        return 36;
+    }
+
+    gtk_misc_set_alignment(GTK_MISC(wx.selstats), 0, 0);
+    pfd = pango_font_description_from_string("Monospace 8");
+    if (pfd) {
+        gtk_widget_modify_font(wx.selstats, pfd);
+        pango_font_description_free(pfd);
+    }
+    gtk_box_pack_start(GTK_BOX(vbox), wx.selstats, FALSE, FALSE, 0);
+
+
+    /* drawing statistics, hidden until asked for */
+    wx.stats = gtk_label_new("");
+    if (!wx.stats) {
+        FAIL_MSG("RubberMarbles: gtk_label_new() failed\n");
+        return 37;
+    }
+
+    gtk_misc_set_alignment(GTK_MISC(wx.stats), 0, 0);
+    pfd = pango_font_description_from_string("Monospace 8");
+    if (pfd) {
+        gtk_widget_modify_font(wx.stats, pfd);
+        pango_font_description_free(pfd);
+    }
+    gtk_box_pack_start(GTK_BOX(vbox), wx.stats, FALSE, FALSE, 0);
+
+    gdk_threads_add_timeout(STATS_HUD_MS, stats_timer, NULL);
+
+
     gtk_widget_show(wx.main_window);
 
     return 0;
@@ -507,8 +613,25 @@ change_col(gpointer callback_data, guint callback_action,
 
 
     if (GTK_CHECK_MENU_ITEM(menu_item)->active) {
-        if ((callback_action >= COL_CORTESI)
-            && (callback_action <= COL_COLSCALE)) {
+        replay_record_menu(menu_item);
+        if (((callback_action >= COL_CORTESI)
+             && (callback_action <= COL_COLSCALE))
+            || (callback_action == COL_REGIONS)
+            || (callback_action == COL_DIFF)) {
+            /* the regions come from a background classification */
+            if ((callback_action == COL_REGIONS) && (classify_file() != 0)) {
+                FAIL_MSG("change_col: classify_file() failed\n");
+                return;
+            }
+
+            /* and the differences need a file to compare with */
+            if ((callback_action == COL_DIFF) && !compare) {
+                compare_file(NULL, CMP_POSITIONAL, NULL);
+                if (!compare) {
+                    return;
+                }
+            }
+
             disp.col_set = callback_action;
             if (auto_draw(wx.hilbert_whole, PIXBUF_WHOLE_HILBERT) != 0) {
                 FAIL_MSG("change_col: auto_draw(hilbert_whole) failed\n");
@@ -530,6 +653,11 @@ change_col(gpointer callback_data, guint callback_action,
                 return;
             }
 
+            if (deep_recolour() != 0) {
+                FAIL_MSG("change_col: deep_recolour() failed\n");
+                return;
+            }
+
         }
     }
 }
@@ -547,8 +675,10 @@ change_display(gpointer callback_data, guint callback_action,
 
 
     if (GTK_CHECK_MENU_ITEM(menu_item)->active) {
-        if ((callback_action >= DISP_HILBERTFLIPPED)
-            && (callback_action <= DISP_HILBERT)) {
+        replay_record_menu(menu_item);
+        if (((callback_action >= DISP_HILBERTFLIPPED)
+             && (callback_action <= DISP_HILBERT))
+            || (callback_action == DISP_MORTON)) {
             disp.disp_hilbert = callback_action;
             if (auto_draw(wx.hilbert_whole, PIXBUF_WHOLE_HILBERT) != 0) {
                 FAIL_MSG
@@ -562,6 +692,11 @@ change_display(gpointer callback_data, guint callback_action,
                 return;
             }
 
+            if (deep_recolour() != 0) {
+                FAIL_MSG("change_display: deep_recolour() failed\n");
+                return;
+            }
+
         } else if ((callback_action >= DISP_LINEAR)
                    && (callback_action <= DISP_ZIGZAG)) {
             disp.disp_zigzag = callback_action;
@@ -602,6 +737,159 @@ hide_whole(gpointer callback_data, guint callback_action,
 }
 
 
+/* hide_stats is a menu callback for hiding/showing the drawing statistics */
+void
+hide_stats(gpointer callback_data, guint callback_action,
+           GtkWidget * menu_item)
+{
+
+    disp.stats_show = !disp.stats_show;
+
+    if (disp.stats_show) {
+        stats_timer(NULL);
+        gtk_widget_show(wx.stats);
+    } else {
+        gtk_widget_hide(wx.stats);
+        gtk_window_resize(GTK_WINDOW(wx.main_window),
+                          disp.whole_hide ? 649 : 1291, 533);
+    }
+}
+
+
+/* hide_selstats is a menu callback for hiding/showing the selection
+ * statistics */
+void
+hide_selstats(gpointer callback_data, guint callback_action,
+              GtkWidget * menu_item)
+{
+
+    disp.selstats_show = !disp.selstats_show;
+
+    if (disp.selstats_show) {
+        if (selstats_update() != 0) {
+            FAIL_MSG("hide_selstats: selstats_update() failed\n");
+        }
+        gtk_widget_show(wx.selstats);
+    } else {
+        gtk_widget_hide(wx.selstats);
+        gtk_window_resize(GTK_WINDOW(wx.main_window),
+                          disp.whole_hide ? 649 : 1291, 533);
+    }
+}
+
+
+/* selstats_update shows the byte statistics of the zoom selection, from
+ * the counts so that it is quick enough for every mouse move */
+int selstats_update()
+{
+    struct hist_summary summary;
+    unsigned long wholestart, wholeend, zoomstart, zoomend;
+    int common[SELSTATS_COMMON];
+    char text[512];
+    int len;
+    int i, j, c;
+
+    if (!disp.selstats_show) {
+        return 0;
+    }
+
+    if (calcwindows(&wholestart, &wholeend, &zoomstart, &zoomend) != 0) {
+        FAIL_MSG("selstats_update: calcwindows() failed\n");
+        return 1;
+    }
+
+
+    len = snprintf(text, sizeof(text), "Selection 0x%lx - 0x%lx\n",
+                   zoomstart, zoomend);
+
+    /* nothing to show until the bytes have been counted */
+    if (histidx && !hist_finished(histidx)) {
+        snprintf(text + len, sizeof(text) - len, "counting bytes %d%%",
+                 hist_progress(histidx));
+        gtk_label_set_text(GTK_LABEL(wx.selstats), text);
+        return 0;
+    }
+
+    if (!histidx || (histidx->summed != 1)) {
+        snprintf(text + len, sizeof(text) - len, "the bytes aren't counted");
+        gtk_label_set_text(GTK_LABEL(wx.selstats), text);
+        return 0;
+    }
+
+    if (hist_query(histidx, zoomstart, zoomend, &summary) != 0) {
+        FAIL_MSG("selstats_update: hist_query() failed\n");
+        return 2;
+    }
+
+
+    len += snprintf(text + len, sizeof(text) - len,
+                    "%lu bytes  entropy %.2f  ascii %.1f%%  zero %.1f%%  "
+                    "high %.1f%%\n", summary.bytes, summary.entropy,
+                    100.0 * summary.ascii, 100.0 * summary.zero,
+                    100.0 * summary.high);
+
+    /* the commonest byte values, most first */
+    for (i = 0; i < SELSTATS_COMMON; i++) {
+        common[i] = -1;
+        for (c = 0; c < 256; c++) {
+            for (j = 0; (j < i) && (common[j] != c); j++) {
+            }
+            if ((j == i) && summary.counts[c]
+                && ((common[i] < 0)
+                    || (summary.counts[c] > summary.counts[common[i]]))) {
+                common[i] = c;
+            }
+        }
+    }
+
+    for (i = 0; (i < SELSTATS_COMMON) && (common[i] >= 0)
+         && (len < sizeof(text)); i++) {
+        len += snprintf(text + len, sizeof(text) - len, "%s%02x %.1f%%",
+                        i ? "  " : "commonest ", common[i],
+                        (100.0 * summary.counts[common[i]]) /
+                        summary.bytes);
+    }
+
+    gtk_label_set_text(GTK_LABEL(wx.selstats), text);
+
+    return 0;
+}
+
+
+/* stats_timer refreshes the drawing statistics and dumps them if asked */
+gboolean stats_timer(gpointer data)
+{
+    char buf[STATS_DUMPSIZE];
+
+    if (stats_poll() != 0) {
+        FAIL_MSG("stats_timer: stats_poll() failed\n");
+    }
+
+    if (disp.stats_show) {
+        if (stats_format(buf, sizeof(buf)) != 0) {
+            FAIL_MSG("stats_timer: stats_format() failed\n");
+            return TRUE;
+        }
+
+        gtk_label_set_text(GTK_LABEL(wx.stats), buf);
+    }
+
+    return TRUE;
+}
+
+
+/* write_trace is a menu callback that has every process write out its
+ * trace */
+void
+write_trace(gpointer callback_data, guint callback_action,
+            GtkWidget * menu_item)
+{
+    if (trace_request(shm) != 0) {
+        FAIL_MSG("write_trace: trace_request() failed\n");
+    }
+}
+
+
 /* go_window is a menu callback for moving the selection windows to the start and end */
 void
 go_window(gpointer callback_data, guint callback_action,
@@ -616,6 +904,7 @@ go_window(gpointer callback_data, guint callback_action,
     }
 
 
+    replay_record_menu(menu_item);
 
     switch (callback_action) {
     case GO_WHOLE_TOP:
@@ -747,6 +1036,10 @@ int update_children()
     int i;
     unsigned long wholestart, wholeend, start, end;
     unsigned long size;
+    unsigned long seq;
+    struct stats_mark mark;
+
+    stats_begin(&mark);
 
     /* find the zoomed window start and size */
     if (calcwindows(&wholestart, &wholeend, &start, &end) != 0) {
@@ -756,6 +1049,17 @@ int update_children()
 
     size = end - start;
 
+    /* the visualisers read the view of a compressed file, so decompress
+     * the selection into it first */
+    for (i = 0; zsrc && (i < MAX_VIS); i++) {
+        if (child[i].pid) {
+            if (zsrc_need(zsrc, start, end) != 0) {
+                FAIL_MSG("update_children: zsrc_need() failed\n");
+            }
+            break;
+        }
+    }
+
     /* set the values in the shared memory */
     if (sem_wait(shm_ctx->sem) != 0) {
         FAIL_ERR("update_children: sem_wait() failed\n");
@@ -764,12 +1068,17 @@ int update_children()
 
     shm->offset = start;
     shm->bufsize = size;
+    shm->compare_delta = cmp_delta(compare, start);
+    seq = shm_update(shm);
     if (sem_post(shm_ctx->sem) != 0) {
         FAIL_ERR("update_children: sem_post() failed\n");
         return 3;
     }
 
 
+    /* the trace joins this update to each visualiser's reload */
+    trace_flow("update", TRACE_FLOW_START, seq);
+
     /* send SIGUSR1 to all children OR call VIS_redraw() */
     for (i = 0; i < MAX_VIS; i++) {
         if (child[i].pid) {
@@ -781,6 +1090,19 @@ int update_children()
         }
     }
 
+    /* the plugins are told on their own threads */
+    for (i = 0; i < MAX_VIS; i++) {
+        if (plugvis[i].ctx
+            && (plugin_update(plugvis[i].ctx, start, size) != 0)) {
+            FAIL_MSG("update_children: plugin_update() failed\n");
+        }
+    }
+
+    /* a replay waits for each of them to redraw */
+    replay_children(seq);
+
+    stats_end(STATS_UPDATE_CHILDREN, &mark);
+
     return 0;
 }
 
@@ -803,150 +1125,2744 @@ int kill_children()
          * the SIGCHLD handler will do that for us. */
     }
 
+    if (stop_plugins() != 0) {
+        FAIL_MSG("kill_children: stop_plugins() failed\n");
+    }
+
     return 0;
 }
 
 
-/* visualise is a menu callback that launches a visualiser */
-void
-visualise(gpointer callback_data, guint callback_action,
-          GtkWidget * menu_item)
+/* stop_plugin stops a plugin visualiser and closes its window */
+int stop_plugin(int slot)
 {
-    int newvis;
-
-    if (callback_action < visualiser_count) {
-        /* find empty visualiser slot */
-        newvis = 0;
-        while ((newvis < MAX_VIS) && (child[newvis].pid)) {
-            newvis++;
-        }
-
-        if (newvis >= MAX_VIS) {
-            FAIL_MSG("Too many visualisers already\n");
-            return;
-        }
-
-
-        /* set the visualiser id */
-        child[newvis].visid = callback_action;
-
-        /* fork it */
-        child[newvis].pid = fork();
-        if (child[newvis].pid < 0) {
-            perror("visualise: fork() failed\n");
-            return;
-        } else if (child[newvis].pid == 0) {
-            /* child */
+    if ((slot < 0) || (slot >= MAX_VIS) || !plugvis[slot].ctx) {
+        FAIL_MSG("stop_plugin: invalid params\n");
+        return 1;
+    }
 
-            if (execlp
-                (visualisers[callback_action].exe,
-                 visualisers[callback_action].exe, shm_ctx->buf_name,
-                 NULL) != 0) {
-                FAIL_ERR("visualise: execlp() failed\n");
-                return;
-            }
 
-            exit(1);
+    if (plugin_stop(plugvis[slot].ctx) != 0) {
+        FAIL_MSG("stop_plugin: plugin_stop() failed\n");
+    }
 
-        } else {
-            /* parent */
-        }
+    if (plugvis[slot].window) {
+        gtk_widget_destroy(plugvis[slot].window);
     }
+    if (plugvis[slot].surface) {
+        cairo_surface_destroy(plugvis[slot].surface);
+    }
+    memset(&plugvis[slot], 0, sizeof(struct plugvis));
+
+    return 0;
 }
 
 
-/* help is a menu callback for launching the help dialog */
-void help(GtkWidget * w, gpointer data)
+/* stop_plugins stops all of the plugin visualisers */
+int stop_plugins()
 {
-    gtk_widget_show(wx.help_dialog);
-}
+    int i;
 
+    for (i = 0; i < MAX_VIS; i++) {
+        if (plugvis[i].ctx && (stop_plugin(i) != 0)) {
+            FAIL_MSG("stop_plugins: stop_plugin() failed\n");
+            return 1;
+        }
+    }
 
-/* delete_help is a delete event callback that hides rather than destroys the window */
-gboolean delete_help(GtkWidget * widget, gpointer data)
-{
-    gtk_widget_hide(wx.help_dialog);
-    return TRUE;
+    return 0;
 }
 
 
-/* file_open is a menu callback for launching the file open dialog */
-void file_open(GtkWidget * w, gpointer data)
+/* plugin_poll is a timeout callback that shows the plugins' pictures as
+ * they are drawn */
+gboolean plugin_poll(gpointer data)
 {
+    uint8_t *picture;
+    struct rgb *pixels;
+    int i, j, width, height, running = 0;
 
-    GtkWidget *dialog;
-    char *tmpfilename = NULL;
-    char title_buf[1024];
-    char *tmpptr;
-
-    dialog = gtk_file_chooser_dialog_new("Open File",
-                                         GTK_WINDOW(wx.main_window),
-                                         GTK_FILE_CHOOSER_ACTION_OPEN,
-                                         GTK_STOCK_CANCEL,
-                                         GTK_RESPONSE_CANCEL,
-                                         GTK_STOCK_OPEN,
-                                         GTK_RESPONSE_ACCEPT, NULL);
-    if (!dialog) {
-        FAIL_MSG("file_open: gtk_file_chooser_dialog_new() failed\n");
-        return;
-    }
-
+    for (i = 0; i < MAX_VIS; i++) {
+        if (!plugvis[i].ctx) {
+            continue;
+        }
 
-    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        if (plugin_failed(plugvis[i].ctx)) {
+            stop_plugin(i);
+            continue;
+        }
 
-        tmpfilename =
-            gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        running++;
+        picture = plugin_picture(plugvis[i].ctx, &width, &height);
+        if (!picture) {
+            continue;
+        }
 
-        if (load_file(tmpfilename)) {
-            fprintf(stderr, "file open: cannot open file\n");
-            g_free(tmpfilename);
-            gtk_widget_destroy(dialog);
-            return;
+        /* the surface is kept for the exposes until the next picture */
+        pixels = draw_surface(&plugvis[i].surface, width, height);
+        if (!pixels) {
+            FAIL_MSG("plugin_poll: draw_surface() failed\n");
+            free(picture);
+            continue;
         }
 
-        tmpptr = strrchr(tmpfilename, '/');
-        if (!tmpptr) {
-            tmpptr = tmpfilename;
-        } else {
-            tmpptr++;
+        for (j = 0; j < width * height; j++) {
+            pixels[j].red = picture[j * 3];
+            pixels[j].green = picture[(j * 3) + 1];
+            pixels[j].blue = picture[(j * 3) + 2];
         }
+        cairo_surface_mark_dirty(plugvis[i].surface);
+        free(picture);
 
-        snprintf(title_buf, 1024, "Rubber Marbles - %s\n", tmpptr);
-        gtk_window_set_title(GTK_WINDOW(wx.main_window), title_buf);
+        gtk_widget_queue_draw(plugvis[i].area);
+    }
 
-        g_free(tmpfilename);
-        gtk_widget_destroy(dialog);
+    if (!running) {
+        plugvis_polling = 0;
+    }
 
-        if (auto_draw(wx.hilbert_whole, PIXBUF_WHOLE_HILBERT) != 0) {
-            FAIL_MSG("file_open: auto_draw(hilbert_whole) failed\n");
-            return;
-        }
+    return running ? TRUE : FALSE;
+}
 
-        if (auto_draw(wx.zigzag_whole, PIXBUF_WHOLE_ZIGZAG) != 0) {
-            FAIL_MSG("file_open: auto_draw(zigzag_whole) failed\n");
-            return;
-        }
 
-        if (auto_draw(wx.zigzag_win, PIXBUF_WIN) != 0) {
-            FAIL_MSG("file_open: auto_draw(zigzag_win) failed\n");
-            return;
-        }
+/* plugin_expose puts a plugin's picture on its window */
+gboolean
+plugin_expose(GtkWidget * widget, GdkEventExpose * event, gpointer data)
+{
+    cairo_t *cr;
+    int slot = (int) (long) data;
 
-        if (auto_draw(wx.zigzag_zoom, PIXBUF_ZOOM_ZIGZAG) != 0) {
-            FAIL_MSG("file_open: auto_draw(zigzag_zoom) failed\n");
-            return;
-        }
+    if (!widget || !event || !plugvis[slot].surface) {
+        return FALSE;
+    }
 
-        if (auto_draw(wx.hilbert_zoom, PIXBUF_ZOOM_HILBERT) != 0) {
-            FAIL_MSG("file_open: auto_draw(hilbert_zoom) failed\n");
-            return;
-        }
+    cr = gdk_cairo_create(gtk_widget_get_window(widget));
+    if (!cr) {
+        FAIL_MSG("plugin_expose: gdk_cairo_create() failed\n");
+        return FALSE;
+    }
 
 
-    } else {
-        gtk_widget_destroy(dialog);
-    }
+    gdk_cairo_region(cr, event->region);
+    cairo_clip(cr);
+    cairo_set_source_surface(cr, plugvis[slot].surface, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
 
+    return FALSE;
+}
+
+
+/* plugin_configure asks a plugin to draw itself at its window's new size */
+gboolean
+plugin_configure(GtkWidget * widget, GdkEventConfigure * event,
+                 gpointer data)
+{
+    int slot = (int) (long) data;
+
+    if (!widget || !event || !plugvis[slot].ctx) {
+        return TRUE;
+    }
+
+    if (plugin_resize(plugvis[slot].ctx, event->width, event->height) !=
+        0) {
+        FAIL_MSG("plugin_configure: plugin_resize() failed\n");
+    }
+
+    return TRUE;
+}
+
+
+/* delete_plugin is a delete event callback that stops the plugin whose
+ * window is being closed */
+gboolean delete_plugin(GtkWidget * widget, gpointer data)
+{
+    int slot = (int) (long) data;
+
+    if (plugvis[slot].ctx && (stop_plugin(slot) != 0)) {
+        FAIL_MSG("delete_plugin: stop_plugin() failed\n");
+    }
+
+    return TRUE;
+}
+
+
+/* start_plugin loads a plugin visualiser and opens a window for it */
+int start_plugin(int visid)
+{
+    struct plugvis *pv;
+    int slot;
+
+    /* plugins map shm->fd, which for a process or stdin is the copy in
+     * memory; a compressed file's view is only filled in where looked at */
+    if (zsrc || !shm->filestat.st_size) {
+        set_title("plugins can't read compressed files");
+        return 0;
+    }
+
+    slot = 0;
+    while ((slot < MAX_VIS) && plugvis[slot].ctx) {
+        slot++;
+    }
+
+    if (slot >= MAX_VIS) {
+        FAIL_MSG("start_plugin: too many plugins already\n");
+        return 1;
+    }
+
+
+    pv = &plugvis[slot];
+    pv->ctx = plugin_start(visualisers[visid].exe, shm->fd,
+                           shm->filestat.st_size, shm->filename);
+    if (!pv->ctx) {
+        FAIL_MSG("start_plugin: plugin_start() failed\n");
+        set_title("cannot load plugin");
+        return 2;
+    }
+
+
+    pv->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    if (!pv->window) {
+        FAIL_MSG("start_plugin: gtk_window_new() failed\n");
+        stop_plugin(slot);
+        return 3;
+    }
+
+    gtk_window_set_title(GTK_WINDOW(pv->window), visualisers[visid].name);
+
+    pv->area = gtk_drawing_area_new();
+    if (!pv->area) {
+        FAIL_MSG("start_plugin: gtk_drawing_area_new() failed\n");
+        stop_plugin(slot);
+        return 4;
+    }
+
+    gtk_widget_set_size_request(GTK_WIDGET(pv->area), PLUGIN_WIDTH,
+                                PLUGIN_HEIGHT);
+    gtk_container_add(GTK_CONTAINER(pv->window), pv->area);
+    gtk_widget_set_events(pv->area, GDK_EXPOSURE_MASK);
+
+    if (!g_signal_connect(pv->area, "expose_event",
+                          G_CALLBACK(plugin_expose), (void *) (long) slot)
+        || !g_signal_connect(pv->area, "configure_event",
+                             G_CALLBACK(plugin_configure),
+                             (void *) (long) slot)
+        || !g_signal_connect(pv->window, "delete_event",
+                             G_CALLBACK(delete_plugin),
+                             (void *) (long) slot)) {
+        FAIL_MSG("start_plugin: g_signal_connect() failed\n");
+        stop_plugin(slot);
+        return 5;
+    }
+
+
+    gtk_widget_show_all(pv->window);
+
+    if (plugin_update(pv->ctx, shm->offset, shm->bufsize) != 0) {
+        FAIL_MSG("start_plugin: plugin_update() failed\n");
+    }
+
+    if (!plugvis_polling) {
+        plugvis_polling = 1;
+        gdk_threads_add_timeout(PLUGIN_POLL_MS, plugin_poll, NULL);
+    }
+
+    return 0;
+}
+
+
+/* start_zygotes starts waiting each visualiser that can be */
+int start_zygotes()
+{
+    unsigned int i;
+
+    for (i = 0; i < visualiser_count; i++) {
+        if (visualisers[i].zygote
+            && (zygote_spawn(i, visualisers[i].exe) != 0)) {
+            FAIL_MSG("start_zygotes: zygote_spawn() failed\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* zygote_refill is a timeout callback that replaces the visualisers that
+ * have been opened */
+gboolean zygote_refill(gpointer data)
+{
+    zygote_refilling = 0;
+
+    if (start_zygotes() != 0) {
+        FAIL_MSG("zygote_refill: start_zygotes() failed\n");
+    }
+
+    return FALSE;
+}
+
+
+/* conf_poll is a timeout callback that republishes the config when the
+ * files change, and restarts the visualisers waiting with the old one */
+gboolean conf_poll(gpointer data)
+{
+    char *homepath;
+
+    if (!conf_changed()) {
+        return TRUE;
+    }
+
+    homepath = getenv("HOME");
+    if (!homepath || (conf_publish(shm, homepath) != 0)) {
+        FAIL_MSG("conf_poll: conf_publish() failed\n");
+        return TRUE;
+    }
+
+
+    if (budget_configure() != 0) {
+        FAIL_MSG("conf_poll: budget_configure() failed\n");
+    }
+
+    if ((zygote_retire() != 0) || (start_zygotes() != 0)) {
+        FAIL_MSG("conf_poll: cannot restart the visualisers\n");
+    }
+
+    return TRUE;
+}
+
+
+/* budget_configure sets the session's memory budget from the published
+ * config, or a share of the machine's memory if it doesn't give one */
+int budget_configure()
+{
+    char value[SHM_CONF_VALUE];
+    unsigned long bytes;
+
+    bytes = budget_default();
+    if (conf_lookup(shm, BUDGET_CONF, value) == 0) {
+        bytes = strtoul(value, NULL, 10) * 1024 * 1024;
+    }
+
+    if (budget_init(shm, bytes) != 0) {
+        FAIL_MSG("budget_configure: budget_init() failed\n");
+        return 1;
+    }
+
+
+    return 0;
+}
+
+
+/* budget_show is a menu callback that shows what each process has of the
+ * memory budget */
+void
+budget_show(gpointer callback_data, guint callback_action,
+            GtkWidget * menu_item)
+{
+    GtkWidget *msg;
+    char text[4096];
+
+    if (budget_report(shm, text, sizeof(text)) != 0) {
+        FAIL_MSG("budget_show: budget_report() failed\n");
+        return;
+    }
+
+
+    msg = gtk_message_dialog_new(GTK_WINDOW(wx.main_window),
+                                 GTK_DIALOG_DESTROY_WITH_PARENT,
+                                 GTK_MESSAGE_INFO, GTK_BUTTONS_CLOSE,
+                                 "%s", text);
+    if (!msg) {
+        FAIL_MSG("budget_show: gtk_message_dialog_new() failed\n");
+        return;
+    }
+
+
+    gtk_dialog_run(GTK_DIALOG(msg));
+    gtk_widget_destroy(msg);
+}
+
+
+/* visualise is a menu callback that launches a visualiser */
+void
+visualise(gpointer callback_data, guint callback_action,
+          GtkWidget * menu_item)
+{
+    int newvis;
+
+    if (callback_action < visualiser_count) {
+        replay_record_menu(menu_item);
+
+        if (visualisers[callback_action].plugin) {
+            if (start_plugin(callback_action) != 0) {
+                FAIL_MSG("visualise: start_plugin() failed\n");
+            }
+            return;
+        }
+
+        /* find empty visualiser slot */
+        newvis = 0;
+        while ((newvis < MAX_VIS) && (child[newvis].pid)) {
+            newvis++;
+        }
+
+        if (newvis >= MAX_VIS) {
+            FAIL_MSG("Too many visualisers already\n");
+            return;
+        }
+
+
+        /* set the visualiser id */
+        child[newvis].visid = callback_action;
+
+        if (zsrc
+            && (zsrc_need(zsrc, shm->offset, shm->offset + shm->bufsize) !=
+                0)) {
+            FAIL_MSG("visualise: zsrc_need() failed\n");
+        }
+
+        /* one started ahead of time only needs the shm name */
+        if (visualisers[callback_action].zygote) {
+            child[newvis].pid =
+                zygote_take(callback_action, shm_ctx->buf_name);
+            if (!zygote_refilling) {
+                zygote_refilling = 1;
+                gdk_threads_add_timeout(ZYGOTE_REFILL_MS, zygote_refill,
+                                        NULL);
+            }
+            if (child[newvis].pid > 0) {
+                return;
+            }
+        }
+
+        /* fork it */
+        child[newvis].pid = fork();
+        if (child[newvis].pid < 0) {
+            perror("visualise: fork() failed\n");
+            return;
+        } else if (child[newvis].pid == 0) {
+            /* child */
+
+            if (execlp
+                (visualisers[callback_action].exe,
+                 visualisers[callback_action].exe, shm_ctx->buf_name,
+                 NULL) != 0) {
+                FAIL_ERR("visualise: execlp() failed\n");
+                return;
+            }
+
+            exit(1);
+
+        } else {
+            /* parent */
+        }
+    }
+}
+
+
+/* help is a menu callback for launching the help dialog */
+void help(GtkWidget * w, gpointer data)
+{
+    gtk_widget_show(wx.help_dialog);
+}
+
+
+/* delete_help is a delete event callback that hides rather than destroys the window */
+gboolean delete_help(GtkWidget * widget, gpointer data)
+{
+    gtk_widget_hide(wx.help_dialog);
+    return TRUE;
+}
+
+
+/* file_open is a menu callback for launching the file open dialog */
+void file_open(GtkWidget * w, gpointer data)
+{
+
+    GtkWidget *dialog;
+    char *tmpfilename = NULL;
+    char title_buf[1024];
+    char *tmpptr;
+
+    dialog = gtk_file_chooser_dialog_new("Open File",
+                                         GTK_WINDOW(wx.main_window),
+                                         GTK_FILE_CHOOSER_ACTION_OPEN,
+                                         GTK_STOCK_CANCEL,
+                                         GTK_RESPONSE_CANCEL,
+                                         GTK_STOCK_OPEN,
+                                         GTK_RESPONSE_ACCEPT, NULL);
+    if (!dialog) {
+        FAIL_MSG("file_open: gtk_file_chooser_dialog_new() failed\n");
+        return;
+    }
+
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+
+        tmpfilename =
+            gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+
+        if (load_path(tmpfilename)) {
+            fprintf(stderr, "file open: cannot open file\n");
+            g_free(tmpfilename);
+            gtk_widget_destroy(dialog);
+            return;
+        }
+
+        /* stop looking at a process or stdin */
+        if (clear_process() != 0) {
+            FAIL_MSG("file_open: clear_process() failed\n");
+        }
+
+        if (clear_spool() != 0) {
+            FAIL_MSG("file_open: clear_spool() failed\n");
+        }
+
+        tmpptr = strrchr(tmpfilename, '/');
+        if (!tmpptr) {
+            tmpptr = tmpfilename;
+        } else {
+            tmpptr++;
+        }
+
+        snprintf(title_buf, 1024, "Rubber Marbles - %s\n", tmpptr);
+        gtk_window_set_title(GTK_WINDOW(wx.main_window), title_buf);
+
+        g_free(tmpfilename);
+        gtk_widget_destroy(dialog);
+
+        if (auto_draw(wx.hilbert_whole, PIXBUF_WHOLE_HILBERT) != 0) {
+            FAIL_MSG("file_open: auto_draw(hilbert_whole) failed\n");
+            return;
+        }
+
+        if (auto_draw(wx.zigzag_whole, PIXBUF_WHOLE_ZIGZAG) != 0) {
+            FAIL_MSG("file_open: auto_draw(zigzag_whole) failed\n");
+            return;
+        }
+
+        if (auto_draw(wx.zigzag_win, PIXBUF_WIN) != 0) {
+            FAIL_MSG("file_open: auto_draw(zigzag_win) failed\n");
+            return;
+        }
+
+        if (auto_draw(wx.zigzag_zoom, PIXBUF_ZOOM_ZIGZAG) != 0) {
+            FAIL_MSG("file_open: auto_draw(zigzag_zoom) failed\n");
+            return;
+        }
+
+        if (auto_draw(wx.hilbert_zoom, PIXBUF_ZOOM_HILBERT) != 0) {
+            FAIL_MSG("file_open: auto_draw(hilbert_zoom) failed\n");
+            return;
+        }
+
+
+    } else {
+        gtk_widget_destroy(dialog);
+    }
+
+}
+
+
+/* redraw_all redraws all of the pixbufs */
+int redraw_all()
+{
+    if (auto_draw(wx.hilbert_whole, PIXBUF_WHOLE_HILBERT) != 0) {
+        FAIL_MSG("redraw_all: auto_draw(hilbert_whole) failed\n");
+        return 1;
+    }
+
+    if (auto_draw(wx.zigzag_whole, PIXBUF_WHOLE_ZIGZAG) != 0) {
+        FAIL_MSG("redraw_all: auto_draw(zigzag_whole) failed\n");
+        return 2;
+    }
+
+    if (auto_draw(wx.zigzag_win, PIXBUF_WIN) != 0) {
+        FAIL_MSG("redraw_all: auto_draw(zigzag_win) failed\n");
+        return 3;
+    }
+
+    if (auto_draw(wx.zigzag_zoom, PIXBUF_ZOOM_ZIGZAG) != 0) {
+        FAIL_MSG("redraw_all: auto_draw(zigzag_zoom) failed\n");
+        return 4;
+    }
+
+    if (auto_draw(wx.hilbert_zoom, PIXBUF_ZOOM_HILBERT) != 0) {
+        FAIL_MSG("redraw_all: auto_draw(hilbert_zoom) failed\n");
+        return 5;
+    }
+
+    return 0;
+}
+
+
+/* set_title sets the main window title to the filename and a status */
+int set_title(char *status)
+{
+    char title_buf[1024];
+    char *tmpptr;
+
+    tmpptr = strrchr(shm->filename, '/');
+    if (!tmpptr) {
+        tmpptr = shm->filename;
+    } else {
+        tmpptr++;
+    }
+    if (procmem) {
+        tmpptr = procmem->name;
+    }
+    if (spool) {
+        tmpptr = "stdin";
+    }
+    if (zsrc) {
+        tmpptr = zsrc->name;
+    }
+
+    if (status) {
+        snprintf(title_buf, 1024, "Rubber Marbles - %s [%s]\n", tmpptr,
+                 status);
+    } else {
+        snprintf(title_buf, 1024, "Rubber Marbles - %s\n", tmpptr);
+    }
+    gtk_window_set_title(GTK_WINDOW(wx.main_window), title_buf);
+
+    return 0;
+}
+
+
+/* clear_search stops and frees the current search */
+int clear_search()
+{
+    if (search) {
+        search_gen++;
+        if (search_free(search) != 0) {
+            FAIL_MSG("clear_search: search_free() failed\n");
+            search = NULL;
+            return 1;
+        }
+
+        search = NULL;
+    }
+
+    return 0;
+}
+
+
+/* search_poll is a timeout callback that waits for the search to finish */
+gboolean search_poll(gpointer data)
+{
+    char status[128];
+
+    /* a newer search or a clear has replaced this one */
+    if (!search || (GPOINTER_TO_UINT(data) != search_gen)) {
+        return FALSE;
+    }
+
+    if (!search_finished(search)) {
+        snprintf(status, sizeof(status), "searching %d%%",
+                 rb_scan_progress(&search->scan));
+        set_title(status);
+        return TRUE;
+    }
+
+    if (search_finish(search) != 0) {
+        FAIL_MSG("search_poll: search_finish() failed\n");
+        set_title("search failed");
+        clear_search();
+        return FALSE;
+    }
+
+
+    /* too many hits keeps only those up to a point, and says where */
+    if (search->index.truncated) {
+        snprintf(status, sizeof(status),
+                 "%lu hits before 0x%lx, none kept after",
+                 search->index.count, (unsigned long) search->index.end);
+    } else {
+        snprintf(status, sizeof(status), "%lu hits", search->index.count);
+    }
+    set_title(status);
+
+    if (redraw_all() != 0) {
+        FAIL_MSG("search_poll: redraw_all() failed\n");
+    }
+
+    return FALSE;
+}
+
+
+/* search_find is a menu callback for the search dialog */
+void
+search_find(gpointer callback_data, guint callback_action,
+            GtkWidget * menu_item)
+{
+    static char *lastspec = NULL;
+    GtkWidget *dialog;
+    GtkWidget *label;
+    GtkWidget *view;
+    GtkWidget *msg;
+    GtkTextBuffer *buffer;
+    GtkTextIter start, end;
+    char *spec;
+
+    dialog = gtk_dialog_new_with_buttons("Search",
+                                         GTK_WINDOW(wx.main_window),
+                                         GTK_DIALOG_MODAL |
+                                         GTK_DIALOG_DESTROY_WITH_PARENT,
+                                         GTK_STOCK_CANCEL,
+                                         GTK_RESPONSE_CANCEL,
+                                         GTK_STOCK_FIND,
+                                         GTK_RESPONSE_ACCEPT, NULL);
+    if (!dialog) {
+        FAIL_MSG("search_find: gtk_dialog_new_with_buttons() failed\n");
+        return;
+    }
+
+
+    label = gtk_label_new(SEARCHHELP);
+    view = gtk_text_view_new();
+    if (!label || !view) {
+        FAIL_MSG("search_find: gtk widget creation failed\n");
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+
+    buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(view));
+    if (lastspec) {
+        gtk_text_buffer_set_text(buffer, lastspec, -1);
+    }
+    gtk_widget_set_size_request(view, 400, 150);
+    gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), label, FALSE,
+                       FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), view, TRUE,
+                       TRUE, 0);
+    gtk_widget_show_all(dialog);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) != GTK_RESPONSE_ACCEPT) {
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+
+    gtk_text_buffer_get_bounds(buffer, &start, &end);
+    spec = gtk_text_buffer_get_text(buffer, &start, &end, FALSE);
+    gtk_widget_destroy(dialog);
+    if (!spec) {
+        FAIL_MSG("search_find: gtk_text_buffer_get_text() failed\n");
+        return;
+    }
+
+
+    g_free(lastspec);
+    lastspec = spec;
+
+    /* replace any previous search */
+    clear_search();
+
+    search = search_new(spec);
+    if (!search) {
+        msg = gtk_message_dialog_new(GTK_WINDOW(wx.main_window),
+                                     GTK_DIALOG_DESTROY_WITH_PARENT,
+                                     GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                     "Cannot parse the search patterns");
+        if (msg) {
+            gtk_dialog_run(GTK_DIALOG(msg));
+            gtk_widget_destroy(msg);
+        }
+        redraw_all();
+        return;
+    }
+
+
+    if (search_start(search, shm->fd, shm->filestat.st_size) != 0) {
+        FAIL_MSG("search_find: search_start() failed\n");
+        clear_search();
+        return;
+    }
+
+
+    set_title("searching");
+    gdk_threads_add_timeout(SEARCH_POLL_MS, search_poll,
+                            GUINT_TO_POINTER(search_gen));
+}
+
+
+/* search_goto is a menu callback that moves the zoom selection to the next
+ * or previous search hit, moving the whole selection too if it has to */
+void
+search_goto(gpointer callback_data, guint callback_action,
+            GtkWidget * menu_item)
+{
+    uint64_t hit;
+    unsigned long wholestart, wholeend, zoomstart, zoomend;
+    unsigned long size;
+
+    if (!search || !search->index.count) {
+        return;
+    }
+
+    if (calcwindows(&wholestart, &wholeend, &zoomstart, &zoomend) != 0) {
+        FAIL_MSG("search_goto: calcwindows() failed\n");
+        return;
+    }
+
+
+    if (search_jump(&search->index, zoomstart, callback_action, &hit) != 0) {
+        gdk_beep();
+        return;
+    }
+
+    /* keep the whole selection the same size */
+    if ((hit < wholestart) || (hit >= wholeend)) {
+        size = wholeend - wholestart;
+        wholestart = hit;
+        if (wholestart + size > shm->filestat.st_size) {
+            wholestart = shm->filestat.st_size - size;
+        }
+        wholeend = wholestart + size;
+        zoom[ZOOM_WHOLE].start = wholestart;
+        zoom[ZOOM_WHOLE].end = wholeend;
+    }
+
+    /* and the zoom selection too, as far as it fits */
+    size = zoomend - zoomstart;
+    zoom[ZOOM_ZOOM].start = hit;
+    zoom[ZOOM_ZOOM].end = hit + size;
+    if (zoom[ZOOM_ZOOM].end > wholeend) {
+        zoom[ZOOM_ZOOM].end = wholeend;
+    }
+
+    if (redraw_all() != 0) {
+        FAIL_MSG("search_goto: redraw_all() failed\n");
+        return;
+    }
+
+    if (update_children() != 0) {
+        FAIL_MSG("search_goto: update_children() failed\n");
+        return;
+    }
+
+}
+
+
+/* search_clear is a menu callback that removes the search hits */
+void
+search_clear(gpointer callback_data, guint callback_action,
+             GtkWidget * menu_item)
+{
+    if (clear_search() != 0) {
+        FAIL_MSG("search_clear: clear_search() failed\n");
+    }
+
+    set_title(NULL);
+
+    if (redraw_all() != 0) {
+        FAIL_MSG("search_clear: redraw_all() failed\n");
+    }
+}
+
+
+/* publish_summaries gives the plugins the region labels, byte counts and
+ * change map as they are now; they have to be paused, and only what
+ * nothing is still writing is given */
+void publish_summaries()
+{
+    struct vis_summaries found;
+
+    memset(&found, 0, sizeof(found));
+
+    /* the labels are filled in as the classification runs, but each is
+     * only written once */
+    if (classify && classify->blocks) {
+        found.label = &classify->blocks[0].label;
+        found.label_stride = sizeof(struct class_block);
+        found.label_blocks = classify->nblocks;
+        found.label_blocksize = CLASS_BLOCK_SIZE;
+    }
+
+    if (histidx && (histidx->summed == 1)) {
+        found.counts = histidx->counts;
+        found.count_spans = histidx->spans;
+        found.count_blocks = histidx->nblocks;
+        found.count_blocksize = histidx->blocksize;
+        found.count_span = histidx->span;
+    }
+
+    if (changes && change_finished(changes)) {
+        found.change = changes->state;
+        found.change_blocks = changes->nblocks;
+        found.change_blocksize = CHANGE_BLOCK_SIZE;
+    }
+
+    plugin_publish(&found);
+}
+
+
+/* clear_classify stops and frees the region classification */
+int clear_classify()
+{
+    int ret = 0;
+
+    if (classify) {
+        classify_gen++;
+        plugin_pause();
+        if (class_free(classify) != 0) {
+            FAIL_MSG("clear_classify: class_free() failed\n");
+            ret = 1;
+        }
+
+        classify = NULL;
+        publish_summaries();
+        plugin_resume();
+    }
+
+    return ret;
+}
+
+
+/* classify_poll is a timeout callback that redraws the regions as the
+ * classification fills them in */
+gboolean classify_poll(gpointer data)
+{
+    int finished;
+    int i;
+
+    if (!classify || (GPOINTER_TO_UINT(data) != classify_gen)) {
+        return FALSE;
+    }
+
+    finished = class_finished(classify);
+
+    if (disp.col_set == COL_REGIONS) {
+        /* the saved bitmaps have out of date labels */
+        for (i = 0; i < 5; i++) {
+            if (save[i].pic) {
+                free(save[i].pic);
+                save[i].pic = NULL;
+            }
+        }
+
+        if (redraw_all() != 0) {
+            FAIL_MSG("classify_poll: redraw_all() failed\n");
+        }
+    }
+
+    return !finished;
+}
+
+
+/* classify_file starts classifying the regions of the file, unless it
+ * already has been */
+int classify_file()
+{
+    if (classify) {
+        return 0;
+    }
+
+    classify = class_new(shm->filestat.st_size);
+    if (!classify) {
+        FAIL_MSG("classify_file: class_new() failed\n");
+        return 1;
+    }
+
+
+    if (class_start(classify, shm->fd) != 0) {
+        FAIL_MSG("classify_file: class_start() failed\n");
+        clear_classify();
+        return 2;
+    }
+
+
+    plugin_pause();
+    publish_summaries();
+    plugin_resume();
+
+    gdk_threads_add_timeout(CLASSIFY_POLL_MS, classify_poll,
+                            GUINT_TO_POINTER(classify_gen));
+
+    return 0;
+}
+
+
+/* clear_hist stops and frees the byte counts */
+int clear_hist()
+{
+    int ret = 0;
+
+    if (histidx) {
+        hist_gen++;
+        plugin_pause();
+        if (hist_free(histidx) != 0) {
+            FAIL_MSG("clear_hist: hist_free() failed\n");
+            ret = 1;
+        }
+
+        histidx = NULL;
+        publish_summaries();
+        plugin_resume();
+    }
+
+    return ret;
+}
+
+
+/* hist_poll is a timeout callback that shows how far the counting has got,
+ * and then the selection statistics */
+gboolean hist_poll(gpointer data)
+{
+    int finished;
+
+    if (!histidx || (GPOINTER_TO_UINT(data) != hist_gen)) {
+        return FALSE;
+    }
+
+    finished = hist_finished(histidx);
+    if (finished) {
+        plugin_pause();
+        publish_summaries();
+        plugin_resume();
+    }
+
+    if (selstats_update() != 0) {
+        FAIL_MSG("hist_poll: selstats_update() failed\n");
+    }
+
+    return !finished;
+}
+
+
+/* hist_file starts counting the bytes of the file, in each block, for the
+ * selection statistics */
+int hist_file()
+{
+    if (histidx || !shm->filestat.st_size) {
+        return 0;
+    }
+
+    histidx = hist_new(shm->filestat.st_size);
+    if (!histidx) {
+        FAIL_MSG("hist_file: hist_new() failed\n");
+        return 1;
+    }
+
+
+    if (hist_start(histidx, shm->fd) != 0) {
+        FAIL_MSG("hist_file: hist_start() failed\n");
+        clear_hist();
+        return 2;
+    }
+
+
+    gdk_threads_add_timeout(HIST_POLL_MS, hist_poll,
+                            GUINT_TO_POINTER(hist_gen));
+
+    return 0;
+}
+
+
+/* hist_again starts counting the file's bytes from the start */
+static int hist_again()
+{
+    if ((clear_hist() != 0) || (hist_file() != 0)) {
+        FAIL_MSG("hist_again: hist_file() failed\n");
+        return 1;
+    }
+
+
+    return 0;
+}
+
+
+/* hist_grown counts the bytes the file has grown by, or all of it again
+ * if the counting hadn't finished */
+int hist_grown()
+{
+    int ret;
+
+    if (!histidx) {
+        return hist_file();
+    }
+
+    /* the plugins read the counts in place */
+    plugin_pause();
+    ret = hist_grow(histidx, shm->filestat.st_size);
+    publish_summaries();
+    plugin_resume();
+
+    if (ret != 0) {
+        return hist_again();
+    }
+
+    return selstats_update();
+}
+
+
+/* hist_changed counts the blocks that changed in place again, or all of
+ * the file if the counting hadn't finished */
+int hist_changed()
+{
+    unsigned long start, end, from, rstart, rend;
+    int ret;
+
+    if (!histidx || !changes) {
+        return 0;
+    }
+
+    /* the plugins read the counts in place */
+    plugin_pause();
+    ret = 0;
+    from = rstart = rend = 0;
+    while (!ret && change_range(changes, from, &start, &end)) {
+        from = end;
+
+        /* runs that share a block of the counts are read once */
+        if ((rend > rstart)
+            && (start / histidx->blocksize <= rend / histidx->blocksize)) {
+            rend = end;
+            continue;
+        }
+
+        if (rend > rstart) {
+            ret = hist_recount(histidx, rstart, rend);
+        }
+        rstart = start;
+        rend = end;
+    }
+
+    if (!ret && (rend > rstart)) {
+        ret = hist_recount(histidx, rstart, rend);
+    }
+    publish_summaries();
+    plugin_resume();
+
+    if (ret != 0) {
+        return hist_again();
+    }
+
+    return selstats_update();
+}
+
+
+/* follow_poll is a timeout callback that checks whether the followed file
+ * has grown.  Only the new bytes are drawn, and the visualisers are told
+ * the new size. */
+gboolean follow_poll(gpointer data)
+{
+    struct stat filestat;
+    unsigned long oldsize;
+    char fname[PATH_MAX];
+
+    if (!disp.follow || (GPOINTER_TO_UINT(data) != follow_gen)) {
+        return FALSE;
+    }
+
+    if (!shm->fd) {
+        return TRUE;
+    }
+
+    if (blkdev_fstat(shm->fd, &filestat) != 0) {
+        FAIL_MSG("follow_poll: blkdev_fstat() failed\n");
+        return TRUE;
+    }
+
+
+    oldsize = shm->filestat.st_size;
+    if (filestat.st_size == oldsize) {
+        return TRUE;
+    }
+
+    /* a file that has been truncated is loaded again from the start */
+    if (filestat.st_size < oldsize) {
+        fprintf(stderr, "follow_poll: %s has shrunk, reloading it\n",
+                shm->filename);
+        strncpy(fname, shm->filename, PATH_MAX);
+        fname[PATH_MAX - 1] = 0x00;
+        if (load_file(fname) != 0) {
+            FAIL_MSG("follow_poll: load_file() failed\n");
+            disp.follow = 0;
+            return FALSE;
+        }
+
+        if (redraw_all() != 0) {
+            FAIL_MSG("follow_poll: redraw_all() failed\n");
+        }
+
+        return TRUE;
+    }
+
+    trace_instant("grow");
+
+    if (draw_grow(oldsize, filestat.st_size) != 0) {
+        FAIL_MSG("follow_poll: draw_grow() failed\n");
+        return TRUE;
+    }
+
+
+    if (sem_wait(shm_ctx->sem) != 0) {
+        FAIL_ERR("follow_poll: sem_wait() failed\n");
+        return TRUE;
+    }
+
+    memcpy(&(shm->filestat), &filestat, sizeof(filestat));
+    if (sem_post(shm_ctx->sem) != 0) {
+        FAIL_ERR("follow_poll: sem_post() failed\n");
+        return TRUE;
+    }
+
+
+    if (hist_grown() != 0) {
+        FAIL_MSG("follow_poll: hist_grown() failed\n");
+    }
+
+    if (redraw_all() != 0) {
+        FAIL_MSG("follow_poll: redraw_all() failed\n");
+        return TRUE;
+    }
+
+
+    /* this sets the new size in the shm and prods the visualisers */
+    if (update_children() != 0) {
+        FAIL_MSG("follow_poll: update_children() failed\n");
+    }
+
+    return TRUE;
+}
+
+
+/* follow_file is a menu callback that turns following the file's growth
+ * on and off */
+void
+follow_file(gpointer callback_data, guint callback_action,
+            GtkWidget * menu_item)
+{
+    disp.follow = !disp.follow;
+
+    if (disp.follow) {
+        follow_gen++;
+        gdk_threads_add_timeout(FOLLOW_POLL_MS, follow_poll,
+                                GUINT_TO_POINTER(follow_gen));
+    }
+}
+
+
+/* clear_changes stops any rescan and forgets the block hashes */
+int clear_changes()
+{
+    int ret = 0;
+
+    if (changes) {
+        change_gen++;
+        plugin_pause();
+        if (change_free(changes) != 0) {
+            FAIL_MSG("clear_changes: change_free() failed\n");
+            ret = 1;
+        }
+
+        changes = NULL;
+        publish_summaries();
+        plugin_resume();
+    }
+
+    return ret;
+}
+
+
+/* update_dirty puts the ranges that changed into the shm and prods the
+ * visualisers, if any of them are in the zoom selection */
+int update_dirty()
+{
+    unsigned long wholestart, wholeend, zoomstart, zoomend;
+    unsigned long start, end, from;
+    int overlap = 0;
+    int n = 0;
+
+    if (!changes) {
+        FAIL_MSG("update_dirty: invalid params\n");
+        return 1;
+    }
+
+
+    if (calcwindows(&wholestart, &wholeend, &zoomstart, &zoomend) != 0) {
+        FAIL_MSG("update_dirty: calcwindows() failed\n");
+        return 2;
+    }
+
+
+    if (sem_wait(shm_ctx->sem) != 0) {
+        FAIL_ERR("update_dirty: sem_wait() failed\n");
+        return 3;
+    }
+
+    from = 0;
+    while (change_range(changes, from, &start, &end)) {
+        /* when there are too many, the last range covers the rest */
+        if (n < SHM_DIRTY) {
+            shm->dirty[n].start = start;
+            n++;
+        }
+        shm->dirty[n - 1].end = end;
+
+        if ((start < zoomend) && (end > zoomstart)) {
+            overlap = 1;
+        }
+        from = end;
+    }
+    shm->ndirty = n;
+
+    /* the ranges go with the next update */
+    shm->dirty_seq = overlap ? shm->update_seq + 1 : 0;
+    if (sem_post(shm_ctx->sem) != 0) {
+        FAIL_ERR("update_dirty: sem_post() failed\n");
+        return 4;
+    }
+
+
+    if (overlap && (update_children() != 0)) {
+        FAIL_MSG("update_dirty: update_children() failed\n");
+        return 5;
+    }
+
+
+    return 0;
+}
+
+
+/* draw_changes draws again just the points whose blocks changed, and
+ * tells the visualisers */
+int draw_changes()
+{
+    static int pixbufs[] = { PIXBUF_WHOLE_HILBERT, PIXBUF_WHOLE_ZIGZAG,
+        PIXBUF_ZOOM_ZIGZAG, PIXBUF_ZOOM_HILBERT
+    };
+    unsigned long start, end, from;
+    int i;
+
+    if (!changes) {
+        FAIL_MSG("draw_changes: invalid params\n");
+        return 1;
+    }
+
+
+    if (changes->dirty) {
+        for (i = 0; i < 4; i++) {
+            from = 0;
+            while (change_range(changes, from, &start, &end)) {
+                if (draw_range(pixbufs[i], start, end) != 0) {
+                    FAIL_MSG("draw_changes: draw_range() failed\n");
+                    return 2;
+                }
+
+                from = end;
+            }
+        }
+
+        if (update_dirty() != 0) {
+            FAIL_MSG("draw_changes: update_dirty() failed\n");
+            return 3;
+        }
+
+
+        if (hist_changed() != 0) {
+            FAIL_MSG("draw_changes: hist_changed() failed\n");
+            return 5;
+        }
+
+    }
+
+    /* the last highlights go even if nothing has changed */
+    if (redraw_all() != 0) {
+        FAIL_MSG("draw_changes: redraw_all() failed\n");
+        return 4;
+    }
+
+
+    return 0;
+}
+
+
+/* change_poll is a timeout callback that waits for a rescan to finish and
+ * then draws again just the points whose blocks changed */
+gboolean change_poll(gpointer data)
+{
+    char status[64];
+
+    if (!changes || (GPOINTER_TO_UINT(data) != change_gen)) {
+        return FALSE;
+    }
+
+    if (!change_finished(changes)) {
+        snprintf(status, 64, "rescanning %d%%",
+                 rb_scan_progress(&changes->scan));
+        set_title(status);
+        return TRUE;
+    }
+
+    plugin_pause();
+    publish_summaries();
+    plugin_resume();
+
+    if (changes->scans == 1) {
+        snprintf(status, 64, "hashed %lu blocks", changes->nblocks);
+    } else {
+        snprintf(status, 64, "%lu blocks changed", changes->dirty);
+    }
+    set_title(status);
+
+    if (draw_changes() != 0) {
+        FAIL_MSG("change_poll: draw_changes() failed\n");
+    }
+
+    return FALSE;
+}
+
+
+/* rescan_file hashes the file's blocks in the background; the first time
+ * makes the baseline and each time after finds the blocks that changed */
+int rescan_file()
+{
+    int ret;
+
+    if (changes && !change_finished(changes)) {
+        return 0;
+    }
+
+    if (!changes) {
+        changes = change_new(shm->filestat.st_size);
+        if (!changes) {
+            FAIL_MSG("rescan_file: change_new() failed\n");
+            return 1;
+        }
+
+    }
+
+    /* the rescan writes the change map, so the plugins lose it until it
+     * is done */
+    plugin_pause();
+    ret = change_start(changes, shm->fd, shm->filestat.st_size);
+    publish_summaries();
+    plugin_resume();
+
+    if (ret != 0) {
+        FAIL_MSG("rescan_file: change_start() failed\n");
+        clear_changes();
+        return 2;
+    }
+
+
+    change_gen++;
+    gdk_threads_add_timeout(CHANGE_POLL_MS, change_poll,
+                            GUINT_TO_POINTER(change_gen));
+
+    return 0;
+}
+
+
+/* rescan is a menu callback that looks for changes made in place */
+void
+rescan(gpointer callback_data, guint callback_action,
+       GtkWidget * menu_item)
+{
+    if (rescan_file() != 0) {
+        FAIL_MSG("rescan: rescan_file() failed\n");
+    }
+}
+
+
+/* watch_poll is a timeout callback that rescans the file while it is
+ * watched */
+gboolean watch_poll(gpointer data)
+{
+    if (!disp.watch || (GPOINTER_TO_UINT(data) != watch_gen)) {
+        return FALSE;
+    }
+
+    if (rescan_file() != 0) {
+        FAIL_MSG("watch_poll: rescan_file() failed\n");
+    }
+
+    return TRUE;
+}
+
+
+/* watch_changes is a menu callback that turns rescanning the file every
+ * CHANGE_WATCH_MS on and off */
+void
+watch_changes(gpointer callback_data, guint callback_action,
+              GtkWidget * menu_item)
+{
+    disp.watch = !disp.watch;
+
+    if (disp.watch) {
+        watch_gen++;
+        if (rescan_file() != 0) {
+            FAIL_MSG("watch_changes: rescan_file() failed\n");
+        }
+
+        gdk_threads_add_timeout(CHANGE_WATCH_MS, watch_poll,
+                                GUINT_TO_POINTER(watch_gen));
+    }
+}
+
+
+/* clear_process stops looking at a process's memory */
+int clear_process()
+{
+    if (procmem) {
+        proc_gen++;
+        if (proc_free(procmem) != 0) {
+            FAIL_MSG("clear_process: proc_free() failed\n");
+            procmem = NULL;
+            return 1;
+        }
+
+        procmem = NULL;
+    }
+
+    return 0;
+}
+
+
+/* proc_poll is a timeout callback that reads the process's memory again
+ * in the background and draws the points in the pages that changed */
+gboolean proc_poll(gpointer data)
+{
+    char status[64];
+    int i;
+
+    if (!procmem || (GPOINTER_TO_UINT(data) != proc_gen)) {
+        return FALSE;
+    }
+
+    if (!proc_refresh_finished(procmem)) {
+        return TRUE;
+    }
+
+    if (procmem->refreshes != proc_seen) {
+        if (procmem->error) {
+            set_title("process has gone");
+            return FALSE;
+        }
+
+        /* the marks can't be changed under a rescan */
+        if (changes && !change_finished(changes)) {
+            return TRUE;
+        }
+
+        proc_seen = procmem->refreshes;
+
+        if (procmem->nchanged || (changes && changes->dirty)) {
+            if (!changes) {
+                changes = change_new(shm->filestat.st_size);
+                if (!changes) {
+                    FAIL_MSG("proc_poll: change_new() failed\n");
+                    return FALSE;
+                }
+
+            }
+
+            /* the plugins read the change map in place */
+            plugin_pause();
+            change_clear(changes);
+            for (i = 0; i < procmem->nchanged; i++) {
+                change_mark(changes, procmem->changed[i].start,
+                            procmem->changed[i].end);
+            }
+            publish_summaries();
+            plugin_resume();
+
+            if (draw_changes() != 0) {
+                FAIL_MSG("proc_poll: draw_changes() failed\n");
+            }
+
+        }
+
+        snprintf(status, 64, "%d ranges changed%s", procmem->nchanged,
+                 procmem->remapped ? ", mappings changed" : "");
+        set_title(status);
+    }
+
+    if (proc_refresh_start(procmem) != 0) {
+        FAIL_MSG("proc_poll: proc_refresh_start() failed\n");
+        return FALSE;
+    }
+
+
+    return TRUE;
+}
+
+
+/* watch_process starts reading the process's memory every PROC_POLL_MS */
+int watch_process()
+{
+    if (!procmem) {
+        FAIL_MSG("watch_process: invalid params\n");
+        return 1;
+    }
+
+
+    proc_gen++;
+    proc_seen = 0;
+    gdk_threads_add_timeout(PROC_POLL_MS, proc_poll,
+                            GUINT_TO_POINTER(proc_gen));
+
+    return 0;
+}
+
+
+/* reattach is a menu callback that snapshots the process again, picking up
+ * mappings made since */
+void
+reattach(gpointer callback_data, guint callback_action,
+         GtkWidget * menu_item)
+{
+    if (!procmem) {
+        return;
+    }
+
+    if (load_process(procmem->pid) != 0) {
+        FAIL_MSG("reattach: load_process() failed\n");
+        return;
+    }
+
+
+    set_title(NULL);
+    if (redraw_all() != 0) {
+        FAIL_MSG("reattach: redraw_all() failed\n");
+    }
+
+}
+
+
+/* clear_spool stops reading stdin */
+int clear_spool()
+{
+    if (spool) {
+        spool_gen++;
+        if (spool_free(spool) != 0) {
+            FAIL_MSG("clear_spool: spool_free() failed\n");
+            spool = NULL;
+            return 1;
+        }
+
+        spool = NULL;
+    }
+
+    return 0;
+}
+
+
+/* spool_poll is a timeout callback that shows how much of stdin has been
+ * read, and loads it again if it has moved out of memory */
+gboolean spool_poll(gpointer data)
+{
+    char fname[PATH_MAX];
+    char status[64];
+    int moved;
+
+    if (!spool || (GPOINTER_TO_UINT(data) != spool_gen)) {
+        return FALSE;
+    }
+
+    /* draw the rest as it arrives */
+    if (spool_follow) {
+        spool_follow = 0;
+        if (!disp.follow) {
+            disp.follow = 1;
+            follow_gen++;
+            gdk_threads_add_timeout(FOLLOW_POLL_MS, follow_poll,
+                                    GUINT_TO_POINTER(follow_gen));
+        }
+    }
+
+    moved = __atomic_load_n(&spool->moved, __ATOMIC_ACQUIRE);
+    if (moved != spool_moved) {
+        spool_moved = moved;
+        strncpy(fname, spool->path, PATH_MAX);
+        fname[PATH_MAX - 1] = 0x00;
+        if (load_file(fname) != 0) {
+            FAIL_MSG("spool_poll: load_file() failed\n");
+            return FALSE;
+        }
+
+        if (redraw_all() != 0) {
+            FAIL_MSG("spool_poll: redraw_all() failed\n");
+        }
+
+    }
+
+    if (__atomic_load_n(&spool->done, __ATOMIC_ACQUIRE)) {
+        snprintf(status, 64, "%s %lu bytes",
+                 spool->error ? "failed after" : "read",
+                 __atomic_load_n(&spool->size, __ATOMIC_ACQUIRE));
+        set_title(status);
+        return FALSE;
+    }
+
+    snprintf(status, 64, "reading, %lu MB",
+             __atomic_load_n(&spool->size, __ATOMIC_ACQUIRE) >> 20);
+    set_title(status);
+
+    return TRUE;
+}
+
+
+/* watch_spool starts following stdin as it is read */
+int watch_spool()
+{
+    if (!spool) {
+        FAIL_MSG("watch_spool: invalid params\n");
+        return 1;
+    }
+
+
+    spool_gen++;
+    spool_moved = __atomic_load_n(&spool->moved, __ATOMIC_ACQUIRE);
+    spool_follow = 1;
+    gdk_threads_add_timeout(SPOOL_POLL_MS, spool_poll,
+                            GUINT_TO_POINTER(spool_gen));
+
+    return 0;
+}
+
+
+/* clear_compressed stops looking at a compressed file, or making its
+ * index */
+int clear_compressed()
+{
+    if (zsrc_pending) {
+        zsrc_gen++;
+        if (zsrc_free(zsrc_pending) != 0) {
+            FAIL_MSG("clear_compressed: zsrc_free() failed\n");
+        }
+        zsrc_pending = NULL;
+    }
+
+    if (zsrc) {
+        rb_scan_source(-1, NULL, NULL);
+        if (zsrc_free(zsrc) != 0) {
+            FAIL_MSG("clear_compressed: zsrc_free() failed\n");
+            zsrc = NULL;
+            return 1;
+        }
+
+        zsrc = NULL;
+    }
+
+    return 0;
+}
+
+
+/* zsrc_poll is a timeout callback that shows how much of a compressed
+ * file has been indexed, and loads its view once it all has */
+gboolean zsrc_poll(gpointer data)
+{
+    struct zsrc_ctx *ctx;
+    char status[64];
+
+    if (!zsrc_pending || (GPOINTER_TO_UINT(data) != zsrc_gen)) {
+        return FALSE;
+    }
+
+    if (!zsrc_index_done(zsrc_pending)) {
+        snprintf(status, 64, "indexing, %d%%",
+                 zsrc_index_progress(zsrc_pending));
+        set_title(status);
+        return TRUE;
+    }
+
+    /* load_file() would free it as the old file's */
+    ctx = zsrc_pending;
+    zsrc_pending = NULL;
+    zsrc_gen++;
+
+    if (load_indexed(ctx) != 0) {
+        FAIL_MSG("zsrc_poll: load_indexed() failed\n");
+        set_title("cannot index the file");
+        return FALSE;
+    }
+
+    set_title(NULL);
+    if (redraw_all() != 0) {
+        FAIL_MSG("zsrc_poll: redraw_all() failed\n");
+    }
+
+    return FALSE;
+}
+
+
+/* watch_compressed waits for the index of ctx to be made, showing the
+ * compressed data until it is */
+int watch_compressed(struct zsrc_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("watch_compressed: invalid params\n");
+        return 1;
+    }
+
+
+    zsrc_pending = ctx;
+    zsrc_gen++;
+    gdk_threads_add_timeout(ZSRC_POLL_MS, zsrc_poll,
+                            GUINT_TO_POINTER(zsrc_gen));
+
+    return 0;
+}
+
+
+/* publish_compare tells the visualisers which file is being compared
+ * with, or that none is when name is NULL */
+static int publish_compare(char *name)
+{
+    if (sem_wait(shm_ctx->sem) != 0) {
+        FAIL_ERR("publish_compare: sem_wait() failed\n");
+        return 1;
+    }
+
+    if (name) {
+        strncpy(shm->compare, name, PATH_MAX);
+        shm->compare[PATH_MAX - 1] = 0x00;
+    } else {
+        shm->compare[0] = 0x00;
+    }
+    shm->compare_seq++;
+    if (sem_post(shm_ctx->sem) != 0) {
+        FAIL_ERR("publish_compare: sem_post() failed\n");
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* clear_compare stops comparing with a second file */
+int clear_compare()
+{
+    if (compare) {
+        compare_gen++;
+        if (cmp_free(compare) != 0) {
+            FAIL_MSG("clear_compare: cmp_free() failed\n");
+            compare = NULL;
+            return 1;
+        }
+
+        compare = NULL;
+
+        if (publish_compare(NULL) != 0) {
+            FAIL_MSG("clear_compare: publish_compare() failed\n");
+            return 2;
+        }
+
+    }
+
+    return 0;
+}
+
+
+/* compare_poll is a timeout callback that redraws the differences as the
+ * comparison fills them in */
+gboolean compare_poll(gpointer data)
+{
+    char status[64];
+    int finished;
+    int i;
+
+    if (!compare || (GPOINTER_TO_UINT(data) != compare_gen)) {
+        return FALSE;
+    }
+
+    finished = cmp_finished(compare);
+
+    if (disp.col_set == COL_DIFF) {
+        /* the saved bitmaps have out of date differences */
+        for (i = 0; i < 5; i++) {
+            if (save[i].pic) {
+                free(save[i].pic);
+                save[i].pic = NULL;
+            }
+        }
+
+        if (redraw_all() != 0) {
+            FAIL_MSG("compare_poll: redraw_all() failed\n");
+        }
+    }
+
+    /* the hexdump follows the line up once it is known */
+    if (finished && compare->align && (update_children() != 0)) {
+        FAIL_MSG("compare_poll: update_children() failed\n");
+    }
+
+    if (finished && compare->align) {
+        snprintf(status, 64, "%lu moved, %lu inserted, %lu deleted",
+                 compare->align->moved, compare->align->inserted,
+                 compare->align->deleted);
+    } else if (finished) {
+        snprintf(status, 64, "%lu bytes differ in %lu blocks",
+                 compare->total, compare->dblocks);
+    } else {
+        snprintf(status, 64, "comparing, %d%%", cmp_progress(compare));
+    }
+    set_title(status);
+
+    return !finished;
+}
+
+
+/* compare_with starts comparing the file with fname in the background,
+ * lining the files up first if how is CMP_ALIGNED */
+int compare_with(char *fname, int how)
+{
+    struct cmp_ctx *ctx;
+
+    if (!fname || !shm->fd) {
+        FAIL_MSG("compare_with: invalid params\n");
+        return 1;
+    }
+
+
+    ctx = cmp_open(fname);
+    if (!ctx) {
+        FAIL_MSG("compare_with: cmp_open() failed\n");
+        return 2;
+    }
+
+
+    if (clear_compare() != 0) {
+        FAIL_MSG("compare_with: clear_compare() failed\n");
+    }
+
+    if (((how == CMP_ALIGNED)
+         ? cmp_start_aligned(ctx, shm->fd, shm->filestat.st_size)
+         : cmp_start(ctx, shm->fd, shm->filestat.st_size)) != 0) {
+        FAIL_MSG("compare_with: cmp_start() failed\n");
+        cmp_free(ctx);
+        return 3;
+    }
+
+
+    compare = ctx;
+
+    /* the visualisers show both files */
+    if (publish_compare(fname) != 0) {
+        FAIL_MSG("compare_with: publish_compare() failed\n");
+        return 4;
+    }
+
+
+    if (update_children() != 0) {
+        FAIL_MSG("compare_with: update_children() failed\n");
+        return 5;
+    }
+
+
+    compare_gen++;
+    gdk_threads_add_timeout(COMPARE_POLL_MS, compare_poll,
+                            GUINT_TO_POINTER(compare_gen));
+
+    return 0;
+}
+
+
+/* show_differences switches the colours to the differences */
+int show_differences()
+{
+    GtkItemFactory *factory;
+    GtkWidget *item;
+
+    factory = gtk_item_factory_from_path("<main>/Colours/Differences");
+    item = factory ? gtk_item_factory_get_item(factory,
+                                               "<main>/Colours/Differences")
+        : NULL;
+    if (!item) {
+        FAIL_MSG("show_differences: no Differences menu item\n");
+        return 1;
+    }
+
+
+    /* the radio item calls change_col() as it becomes active */
+    gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item), TRUE);
+
+    return 0;
+}
+
+
+/* compare_file is a menu callback that asks for a file to compare with,
+ * and how */
+void
+compare_file(gpointer callback_data, guint callback_action,
+             GtkWidget * menu_item)
+{
+    GtkWidget *dialog;
+    char *tmpfilename = NULL;
+
+    dialog = gtk_file_chooser_dialog_new("Compare With",
+                                         GTK_WINDOW(wx.main_window),
+                                         GTK_FILE_CHOOSER_ACTION_OPEN,
+                                         GTK_STOCK_CANCEL,
+                                         GTK_RESPONSE_CANCEL,
+                                         GTK_STOCK_OPEN,
+                                         GTK_RESPONSE_ACCEPT, NULL);
+    if (!dialog) {
+        FAIL_MSG("compare_file: gtk_file_chooser_dialog_new() failed\n");
+        return;
+    }
+
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        tmpfilename =
+            gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+
+        if (compare_with(tmpfilename, callback_action) != 0) {
+            fprintf(stderr, "compare_file: cannot compare with file\n");
+        } else if ((disp.col_set != COL_DIFF) && (show_differences() != 0)) {
+            FAIL_MSG("compare_file: show_differences() failed\n");
+        }
+
+        g_free(tmpfilename);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+
+/* compare_goto is a menu callback that moves the zoom selection to the
+ * next or previous run of blocks that differ */
+void
+compare_goto(gpointer callback_data, guint callback_action,
+             GtkWidget * menu_item)
+{
+    unsigned long hit;
+    unsigned long wholestart, wholeend, zoomstart, zoomend;
+    unsigned long size;
+
+    if (!compare) {
+        return;
+    }
+
+    if (calcwindows(&wholestart, &wholeend, &zoomstart, &zoomend) != 0) {
+        FAIL_MSG("compare_goto: calcwindows() failed\n");
+        return;
+    }
+
+
+    if ((cmp_jump(compare, zoomstart, callback_action, &hit) != 0)
+        || (hit >= shm->filestat.st_size)) {
+        gdk_beep();
+        return;
+    }
+
+    /* keep the whole selection the same size */
+    if ((hit < wholestart) || (hit >= wholeend)) {
+        size = wholeend - wholestart;
+        wholestart = hit;
+        if (wholestart + size > shm->filestat.st_size) {
+            wholestart = shm->filestat.st_size - size;
+        }
+        wholeend = wholestart + size;
+        zoom[ZOOM_WHOLE].start = wholestart;
+        zoom[ZOOM_WHOLE].end = wholeend;
+    }
+
+    /* and the zoom selection too, as far as it fits */
+    size = zoomend - zoomstart;
+    zoom[ZOOM_ZOOM].start = hit;
+    zoom[ZOOM_ZOOM].end = hit + size;
+    if (zoom[ZOOM_ZOOM].end > wholeend) {
+        zoom[ZOOM_ZOOM].end = wholeend;
+    }
+
+    if (redraw_all() != 0) {
+        FAIL_MSG("compare_goto: redraw_all() failed\n");
+        return;
+    }
+
+    if (update_children() != 0) {
+        FAIL_MSG("compare_goto: update_children() failed\n");
+        return;
+    }
+
+}
+
+
+/* clear_dupes stops any indexing and frees the duplicate block index */
+int clear_dupes()
+{
+    if (dupes) {
+        dupes_gen++;
+        if (dup_free(dupes) != 0) {
+            FAIL_MSG("clear_dupes: dup_free() failed\n");
+            dupes = NULL;
+            return 1;
+        }
+
+        dupes = NULL;
+    }
+
+    return 0;
+}
+
+
+/* show_dupes asks the index about the block at location and draws the
+ * blocks like it */
+static int show_dupes(unsigned long location)
+{
+    char status[64];
+
+    if (dup_query(dupes, location) != 0) {
+        FAIL_MSG("show_dupes: dup_query() failed\n");
+        return 1;
+    }
+
+
+    if (redraw_all() != 0) {
+        FAIL_MSG("show_dupes: redraw_all() failed\n");
+        return 2;
+    }
+
+
+    snprintf(status, 64, "%lu identical, %lu similar blocks of %luKB",
+             dupes->nexact, dupes->nmatches - dupes->nexact,
+             dupes->blocksize / 1024);
+    set_title(status);
+
+    return 0;
+}
+
+
+/* dupes_poll is a timeout callback that waits for the index to be made and
+ * then answers the question that started it */
+gboolean dupes_poll(gpointer data)
+{
+    char status[64];
+
+    if (!dupes || (GPOINTER_TO_UINT(data) != dupes_gen)) {
+        return FALSE;
+    }
+
+    if (!dup_finished(dupes)) {
+        snprintf(status, 64, "indexing blocks, %d%%",
+                 dup_progress(dupes));
+        set_title(status);
+        return TRUE;
+    }
+
+    if (dupes->scan.error) {
+        set_title("indexing failed");
+        clear_dupes();
+        return FALSE;
+    }
+
+    if (show_dupes(dupes_pending) != 0) {
+        FAIL_MSG("dupes_poll: show_dupes() failed\n");
+    }
+
+    return FALSE;
+}
+
+
+/* find_similar marks the blocks the same as, or like, the one at location,
+ * indexing the file first if it has not been or has since grown */
+int find_similar(unsigned long location)
+{
+    if (location >= shm->filestat.st_size) {
+        return 0;
+    }
+
+    if (dupes && (dupes->size != shm->filestat.st_size)) {
+        clear_dupes();
+    }
+
+    if (dupes && dup_finished(dupes)) {
+        if (show_dupes(location) != 0) {
+            FAIL_MSG("find_similar: show_dupes() failed\n");
+            return 1;
+        }
+
+        return 0;
+    }
+
+    /* the index is being made; the answer comes when it has been */
+    dupes_pending = location;
+    if (dupes) {
+        return 0;
+    }
+
+    dupes = dup_new(shm->filestat.st_size);
+    if (!dupes) {
+        FAIL_MSG("find_similar: dup_new() failed\n");
+        return 2;
+    }
+
+
+    if (dup_start(dupes, shm->fd) != 0) {
+        FAIL_MSG("find_similar: dup_start() failed\n");
+        clear_dupes();
+        return 3;
+    }
+
+
+    dupes_gen++;
+    gdk_threads_add_timeout(DUPES_POLL_MS, dupes_poll,
+                            GUINT_TO_POINTER(dupes_gen));
+
+    return 0;
+}
+
+
+/* similar_blocks is a menu callback that marks the blocks like the one at
+ * the start of the zoom selection, or forgets them */
+void
+similar_blocks(gpointer callback_data, guint callback_action,
+               GtkWidget * menu_item)
+{
+    unsigned long wholestart, wholeend, zoomstart, zoomend;
+
+    if (callback_action) {
+        if (calcwindows(&wholestart, &wholeend, &zoomstart, &zoomend) != 0) {
+            FAIL_MSG("similar_blocks: calcwindows() failed\n");
+            return;
+        }
+
+
+        if (find_similar(zoomstart) != 0) {
+            FAIL_MSG("similar_blocks: find_similar() failed\n");
+        }
+        return;
+    }
+
+    if (dupes) {
+        dup_clear(dupes);
+    }
+
+    set_title(NULL);
+
+    if (redraw_all() != 0) {
+        FAIL_MSG("similar_blocks: redraw_all() failed\n");
+    }
+}
+
+
+/* deep_colours gives the tiles the byte colours of the plots */
+static int deep_colours()
+{
+    uint8_t palette[256][3];
+    guchar red, green, blue;
+    int i, ret;
+
+    for (i = 0; i < 256; i++) {
+        switch (disp.col_set) {
+        case COL_GREYSCALE:
+            ret = greyscalecolbyte(i, &red, &green, &blue);
+            break;
+        case COL_COLSCALE:
+            ret = colscalecolbyte(i, &red, &green, &blue);
+            break;
+        default:
+            /* the regions and differences aren't bytes, so these get
+             * Cortesi's colours */
+            ret = cortesicolbyte(i, &red, &green, &blue);
+            break;
+        }
+        if (ret != 0) {
+            FAIL_MSG("deep_colours: colbyte() failed\n");
+            return 1;
+        }
+
+        palette[i][0] = red;
+        palette[i][1] = green;
+        palette[i][2] = blue;
+    }
+
+    if (tile_colours(tiles, palette,
+                     disp.disp_hilbert == DISP_HILBERTFLIPPED) != 0) {
+        FAIL_MSG("deep_colours: tile_colours() failed\n");
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* deep_recolour draws the deep zoom window again after the colours or the
+ * way round the curve goes have changed */
+int deep_recolour()
+{
+    if (!tiles) {
+        return 0;
+    }
+
+    if (deep_colours() != 0) {
+        FAIL_MSG("deep_recolour: deep_colours() failed\n");
+        return 1;
+    }
+
+
+    gtk_widget_queue_draw(wx.deep_area);
+
+    return 0;
+}
+
+
+/* clear_tiles closes the deep zoom window and frees its tiles */
+int clear_tiles()
+{
+    if (tiles) {
+        tiles_gen++;
+        if (tile_free(tiles) != 0) {
+            FAIL_MSG("clear_tiles: tile_free() failed\n");
+            tiles = NULL;
+            return 1;
+        }
+
+        tiles = NULL;
+    }
+
+    if (wx.deep_window) {
+        gtk_widget_hide(wx.deep_window);
+    }
+
+    return 0;
+}
+
+
+/* deep_poll is a timeout callback that shows tiles as they are drawn */
+gboolean deep_poll(gpointer data)
+{
+    if (!tiles || (GPOINTER_TO_UINT(data) != tiles_gen)) {
+        return FALSE;
+    }
+
+    if (tile_drawn(tiles)) {
+        gtk_widget_queue_draw(wx.deep_area);
+    }
+
+    return TRUE;
+}
+
+
+/* deep_paint puts a square of a tile on the window, scale times as big */
+static void
+deep_paint(cairo_t * cr, struct tile *t, int sx, int sy, int side,
+           int scale, long x, long y)
+{
+    GdkPixbuf *pb;
+
+    pb = gdk_pixbuf_new_from_data(t->rgb + (((sy * TILE_SIZE) + sx) * 3),
+                                  GDK_COLORSPACE_RGB, FALSE, 8, side, side,
+                                  TILE_SIZE * 3, NULL, NULL);
+    if (!pb) {
+        FAIL_MSG("deep_paint: gdk_pixbuf_new_from_data() failed\n");
+        return;
+    }
+
+    cairo_save(cr);
+    cairo_translate(cr, x, y);
+    cairo_scale(cr, scale, scale);
+    gdk_cairo_set_source_pixbuf(cr, pb, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    cairo_rectangle(cr, 0, 0, side, side);
+    cairo_fill(cr);
+    cairo_restore(cr);
+
+    g_object_unref(pb);
+}
+
+
+/* deep_expose draws the tiles on the deep zoom window.  A tile not drawn
+ * yet is asked for, and a piece of the nearest ancestor that has been is
+ * shown blown up in its place.  Once all of them are there, the tiles
+ * around them, and above and below them, are asked for as well. */
+gboolean
+deep_expose(GtkWidget * widget, GdkEventExpose * event, gpointer data)
+{
+    cairo_t *cr;
+    struct tile *t;
+    long left, top, last, tx0, ty0, tx1, ty1, tx, ty;
+    int width, height, waiting, k;
+
+    if (!widget || !tiles) {
+        return FALSE;
+    }
+
+    width = widget->allocation.width;
+    height = widget->allocation.height;
+    left = deep.cx - (width / 2);
+    top = deep.cy - (height / 2);
+    last = (1L << deep.level) - 1;
+
+    tx0 = MAX(left, 0) / TILE_SIZE;
+    ty0 = MAX(top, 0) / TILE_SIZE;
+    tx1 = MIN((left + width - 1) / TILE_SIZE, last);
+    ty1 = MIN((top + height - 1) / TILE_SIZE, last);
+
+    cr = gdk_cairo_create(gtk_widget_get_window(widget));
+    if (!cr) {
+        FAIL_MSG("deep_expose: gdk_cairo_create() failed\n");
+        return FALSE;
+    }
+
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+
+    /* what was asked for before is not wanted if it is not here now */
+    tile_drop_queued(tiles);
+
+    waiting = 0;
+    for (ty = ty0; ty <= ty1; ty++) {
+        for (tx = tx0; tx <= tx1; tx++) {
+            t = tile_get(tiles, deep.level, tx, ty, 0);
+            if (t) {
+                deep_paint(cr, t, 0, 0, TILE_SIZE, 1,
+                           (tx * TILE_SIZE) - left, (ty * TILE_SIZE) - top);
+                continue;
+            }
+
+            waiting++;
+            for (k = 1; (k <= deep.level) && (k <= TILE_SHIFT); k++) {
+                t = tile_peek(tiles, deep.level - k, tx >> k, ty >> k);
+                if (t) {
+                    deep_paint(cr, t,
+                               (tx & ((1L << k) - 1)) * (TILE_SIZE >> k),
+                               (ty & ((1L << k) - 1)) * (TILE_SIZE >> k),
+                               TILE_SIZE >> k, 1 << k,
+                               (tx * TILE_SIZE) - left,
+                               (ty * TILE_SIZE) - top);
+                    break;
+                }
+            }
+        }
+    }
+
+    cairo_destroy(cr);
+
+    if (waiting) {
+        return FALSE;
+    }
+
+    /* the window is drawn, so get ready for where it might go next */
+    for (ty = ty0 - 1; ty <= ty1 + 1; ty++) {
+        for (tx = tx0 - 1; tx <= tx1 + 1; tx++) {
+            if ((tx >= 0) && (ty >= 0)) {
+                tile_get(tiles, deep.level, tx, ty, 1);
+            }
+        }
+    }
+    for (ty = ty0 * 2; ty <= (ty1 * 2) + 1; ty++) {
+        for (tx = tx0 * 2; tx <= (tx1 * 2) + 1; tx++) {
+            tile_get(tiles, deep.level + 1, tx, ty, 1);
+        }
+    }
+    for (ty = ty0 / 2; ty <= ty1 / 2; ty++) {
+        for (tx = tx0 / 2; tx <= tx1 / 2; tx++) {
+            tile_get(tiles, deep.level - 1, tx, ty, 1);
+        }
+    }
+
+    return FALSE;
+}
+
+
+/* deep_move keeps the middle of the deep zoom window on the file */
+static void deep_move(long cx, long cy)
+{
+    long world = (long) TILE_SIZE << deep.level;
+
+    deep.cx = MAX(0, MIN(cx, world));
+    deep.cy = MAX(0, MIN(cy, world));
+    gtk_widget_queue_draw(wx.deep_area);
+}
+
+
+/* deep_scroll is a mouse wheel callback that zooms in or out of the deep
+ * zoom window, keeping the point under the pointer where it is */
+gboolean
+deep_scroll(GtkWidget * widget, GdkEventScroll * event, gpointer data)
+{
+    long px, py, ox, oy;
+
+    if (!widget || !event || !tiles) {
+        return TRUE;
+    }
+
+    ox = (long) event->x - (widget->allocation.width / 2);
+    oy = (long) event->y - (widget->allocation.height / 2);
+    px = deep.cx + ox;
+    py = deep.cy + oy;
+
+    if ((event->direction == GDK_SCROLL_UP)
+        && (deep.level < tiles->levels - 1)) {
+        deep.level++;
+        deep_move((px * 2) - ox, (py * 2) - oy);
+    } else if ((event->direction == GDK_SCROLL_DOWN) && (deep.level > 0)) {
+        deep.level--;
+        deep_move((px / 2) - ox, (py / 2) - oy);
+    }
+
+    return TRUE;
+}
+
+
+/* deep_button is a mouse click callback; the left button drags the view */
+gboolean
+deep_button(GtkWidget * widget, GdkEventButton * event, gpointer data)
+{
+    if (!widget || !event) {
+        return TRUE;
+    }
+
+    if ((event->type == GDK_BUTTON_PRESS) && (event->button == 1)) {
+        deep.dragx = (int) event->x;
+        deep.dragy = (int) event->y;
+    } else if (event->type == GDK_BUTTON_RELEASE) {
+        deep.dragx = -1;
+    }
+
+    return TRUE;
+}
+
+
+/* deep_motion is a mouse move callback that drags the view and shows the
+ * offset under the pointer */
+gboolean
+deep_motion(GtkWidget * widget, GdkEventMotion * event, gpointer data)
+{
+    char title[64];
+    unsigned long offset;
+    long px, py;
+
+    if (!widget || !event || !tiles) {
+        return TRUE;
+    }
+
+    if ((event->state & GDK_BUTTON1_MASK) && (deep.dragx >= 0)) {
+        deep_move(deep.cx - ((int) event->x - deep.dragx),
+                  deep.cy - ((int) event->y - deep.dragy));
+        deep.dragx = (int) event->x;
+        deep.dragy = (int) event->y;
+    }
+
+    px = deep.cx + (long) event->x - (widget->allocation.width / 2);
+    py = deep.cy + (long) event->y - (widget->allocation.height / 2);
+    offset = tiles->size;
+    if ((px >= 0) && (py >= 0)) {
+        offset = tile_offset(tiles, deep.level, px, py);
+    }
+
+    if (offset < tiles->size) {
+        snprintf(title, 64, "Deep zoom - 0x%lx, level %d", offset,
+                 deep.level);
+    } else {
+        snprintf(title, 64, "Deep zoom - level %d", deep.level);
+    }
+    gtk_window_set_title(GTK_WINDOW(wx.deep_window), title);
+
+    return TRUE;
+}
+
+
+/* delete_deep is a delete event callback that hides the deep zoom window
+ * and frees its tiles */
+gboolean delete_deep(GtkWidget * widget, gpointer data)
+{
+    if (clear_tiles() != 0) {
+        FAIL_MSG("delete_deep: clear_tiles() failed\n");
+    }
+
+    return TRUE;
+}
+
+
+/* make_deep_window builds the deep zoom window */
+int make_deep_window()
+{
+    wx.deep_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    if (!wx.deep_window) {
+        FAIL_MSG("make_deep_window: gtk_window_new() failed\n");
+        return 1;
+    }
+
+    gtk_widget_set_name(wx.deep_window, "Rubber Marbles Deep Zoom");
+    gtk_window_set_title(GTK_WINDOW(wx.deep_window), "Deep zoom");
+    gtk_window_set_default_size(GTK_WINDOW(wx.deep_window), 768, 768);
+
+    wx.deep_area = gtk_drawing_area_new();
+    if (!wx.deep_area) {
+        FAIL_MSG("make_deep_window: gtk_drawing_area_new() failed\n");
+        return 2;
+    }
+
+    gtk_container_add(GTK_CONTAINER(wx.deep_window), wx.deep_area);
+    gtk_widget_show(wx.deep_area);
+
+    gtk_widget_set_events(wx.deep_area, GDK_EXPOSURE_MASK
+                          | GDK_BUTTON_PRESS_MASK
+                          | GDK_BUTTON_RELEASE_MASK
+                          | GDK_POINTER_MOTION_MASK | GDK_SCROLL_MASK);
+
+    if (!g_signal_connect(wx.deep_area, "expose_event",
+                          G_CALLBACK(deep_expose), NULL)
+        || !g_signal_connect(wx.deep_area, "scroll_event",
+                             G_CALLBACK(deep_scroll), NULL)
+        || !g_signal_connect(wx.deep_area, "button_press_event",
+                             G_CALLBACK(deep_button), NULL)
+        || !g_signal_connect(wx.deep_area, "button_release_event",
+                             G_CALLBACK(deep_button), NULL)
+        || !g_signal_connect(wx.deep_area, "motion_notify_event",
+                             G_CALLBACK(deep_motion), NULL)
+        || !g_signal_connect(wx.deep_window, "delete_event",
+                             G_CALLBACK(delete_deep), NULL)) {
+        FAIL_MSG("make_deep_window: g_signal_connect() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* deep_zoom is a menu callback that opens the deep zoom window on the
+ * whole file */
+void
+deep_zoom(gpointer callback_data, guint callback_action,
+          GtkWidget * menu_item)
+{
+    /* the tiles are read straight from the file */
+    if (procmem || spool || zsrc || !shm->filestat.st_size) {
+        set_title("deep zoom needs a file");
+        return;
+    }
+
+    if (tiles && (tiles->size != shm->filestat.st_size)) {
+        clear_tiles();
+    }
+
+    if (!wx.deep_window && (make_deep_window() != 0)) {
+        FAIL_MSG("deep_zoom: make_deep_window() failed\n");
+        return;
+    }
+
+
+    if (!tiles) {
+        tiles = tile_new(shm->fd, shm->filestat.st_size);
+        if (!tiles) {
+            FAIL_MSG("deep_zoom: tile_new() failed\n");
+            return;
+        }
+
+        if (deep_colours() != 0) {
+            FAIL_MSG("deep_zoom: deep_colours() failed\n");
+            clear_tiles();
+            return;
+        }
+
+
+        deep.level = 0;
+        deep.cx = TILE_SIZE / 2;
+        deep.cy = TILE_SIZE / 2;
+        deep.dragx = -1;
+
+        tiles_gen++;
+        gdk_threads_add_timeout(DEEP_POLL_MS, deep_poll,
+                                GUINT_TO_POINTER(tiles_gen));
+    }
+
+    gtk_widget_show(wx.deep_window);
+    gtk_window_present(GTK_WINDOW(wx.deep_window));
+}
+
+
+/* region_stats is a menu callback that shows the statistics of the zoom
+ * selection */
+void
+region_stats(gpointer callback_data, guint callback_action,
+             GtkWidget * menu_item)
+{
+    struct class_summary summary;
+    struct proc_region *region;
+    unsigned long wholestart, wholeend, zoomstart, zoomend;
+    GtkWidget *msg;
+    char text[1024];
+    int len;
+    int i;
+
+    if (classify_file() != 0) {
+        FAIL_MSG("region_stats: classify_file() failed\n");
+        return;
+    }
+
+
+    if (calcwindows(&wholestart, &wholeend, &zoomstart, &zoomend) != 0) {
+        FAIL_MSG("region_stats: calcwindows() failed\n");
+        return;
+    }
+
+
+    if (class_query(classify, zoomstart, zoomend, &summary) != 0) {
+        FAIL_MSG("region_stats: class_query() failed\n");
+        return;
+    }
+
+
+    len = snprintf(text, sizeof(text),
+                   "Selection 0x%lx - 0x%lx (%lu bytes)\n"
+                   "%.0f%% classified\n\n"
+                   "Entropy %.2f bits per byte\n"
+                   "Chi-square %.0f\n"
+                   "Ascii %.1f%%\n"
+                   "Zero %.1f%%\n\n",
+                   zoomstart, zoomend, summary.bytes,
+                   summary.bytes ? (100.0 * summary.classified) /
+                   summary.bytes : 0.0, summary.entropy, summary.chisq,
+                   100.0 * summary.ascii, 100.0 * summary.zero);
+
+    /* a process's memory is shown by address too */
+    region = proc_region(procmem, zoomstart);
+    if (region && (len < sizeof(text))) {
+        len += snprintf(text + len, sizeof(text) - len,
+                        "Address 0x%lx %s %s\n\n",
+                        region->addr + zoomstart - region->offset,
+                        region->perms,
+                        region->name[0] ? region->name : "[anon]");
+    }
+
+    /* and how much of it differs from the file being compared with */
+    if (compare && (len < sizeof(text))) {
+        len += snprintf(text + len, sizeof(text) - len,
+                        "%lu bytes differ%s\n\n",
+                        cmp_query(compare, zoomstart, zoomend),
+                        cmp_finished(compare) ? "" : " so far");
+        if (compare->align && cmp_finished(compare)
+            && (len < sizeof(text))) {
+            len += snprintf(text + len, sizeof(text) - len,
+                            "It starts at 0x%lx in the other file\n\n",
+                            zoomstart + cmp_delta(compare, zoomstart));
+        }
+    }
+
+    for (i = CLASS_NONE + 1; (i < CLASS_LABELS) && (len < sizeof(text));
+         i++) {
+        if (summary.labels[i]) {
+            len += snprintf(text + len, sizeof(text) - len,
+                            "%s %.1f%%\n", class_name(i),
+                            (100.0 * summary.labels[i]) / summary.bytes);
+        }
+    }
+
+    msg = gtk_message_dialog_new(GTK_WINDOW(wx.main_window),
+                                 GTK_DIALOG_DESTROY_WITH_PARENT,
+                                 GTK_MESSAGE_INFO, GTK_BUTTONS_CLOSE,
+                                 "%s", text);
+    if (!msg) {
+        FAIL_MSG("region_stats: gtk_message_dialog_new() failed\n");
+        return;
+    }
+
+
+    gtk_dialog_run(GTK_DIALOG(msg));
+    gtk_widget_destroy(msg);
 }
 
 
@@ -957,6 +3873,20 @@ GtkItemFactoryEntry menu_items[] = {
     {"/File/_Open", "<control>O", file_open, 0, "<StockItem>",
      GTK_STOCK_OPEN}
     ,
+    {"/File/Follow on-off", "<control>L", follow_file, 0, "<Item>"}
+    ,
+    {"/File/Rescan changes", "<control>R", rescan, 0, "<Item>"}
+    ,
+    {"/File/Watch changes on-off", NULL, watch_changes, 0, "<Item>"}
+    ,
+    {"/File/Reattach process", NULL, reattach, 0, "<Item>"}
+    ,
+    {"/File/Compare with...", "<control>D", compare_file, CMP_POSITIONAL,
+     "<Item>"}
+    ,
+    {"/File/Compare aligned with...", "<control><shift>D", compare_file,
+     CMP_ALIGNED, "<Item>"}
+    ,
     {"/File/sep1", NULL, NULL, 0, "<Separator>"}
     ,
     {"/File/_Quit", "<CTRL>Q", quit, 0, "<StockItem>",
@@ -972,6 +3902,12 @@ GtkItemFactoryEntry menu_items[] = {
     {"/Colours/ColScale", NULL, change_col, COL_COLSCALE,
      "/Colours/Cortesi"}
     ,
+    {"/Colours/Regions", NULL, change_col, COL_REGIONS,
+     "/Colours/Cortesi"}
+    ,
+    {"/Colours/Differences", NULL, change_col, COL_DIFF,
+     "/Colours/Cortesi"}
+    ,
     {"/_Hilbert", NULL, NULL, 0, "<Branch>"}
     ,
     {"/Hilbert/HilbertFlipped", NULL, change_display, DISP_HILBERTFLIPPED,
@@ -980,6 +3916,9 @@ GtkItemFactoryEntry menu_items[] = {
     {"/Hilbert/Hilbert", NULL, change_display, DISP_HILBERT,
      "/Hilbert/HilbertFlipped"}
     ,
+    {"/Hilbert/Morton", NULL, change_display, DISP_MORTON,
+     "/Hilbert/HilbertFlipped"}
+    ,
     {"/_Zigzag", NULL, NULL, 0, "<Branch>"}
     ,
     {"/Zigzag/Linear", NULL, change_display, DISP_LINEAR, "<RadioItem>"}
@@ -996,6 +3935,32 @@ GtkItemFactoryEntry menu_items[] = {
     ,
     {"/Go/Zoom bottom", "<shift>b", go_window, GO_ZOOM_BOTTOM, "<Item>"}
     ,
+    {"/Go/Next difference", "d", compare_goto, CMP_NEXT, "<Item>"}
+    ,
+    {"/Go/Previous difference", "<shift>d", compare_goto, CMP_PREV,
+     "<Item>"}
+    ,
+    {"/_Search", NULL, NULL, 0, "<Branch>"}
+    ,
+    {"/Search/_Find...", "<control>F", search_find, 0, "<StockItem>",
+     GTK_STOCK_FIND}
+    ,
+    {"/Search/Next hit", "F3", search_goto, SEARCH_NEXT, "<Item>"}
+    ,
+    {"/Search/Previous hit", "<shift>F3", search_goto, SEARCH_PREV,
+     "<Item>"}
+    ,
+    {"/Search/Clear", NULL, search_clear, 0, "<Item>"}
+    ,
+    {"/Search/Similar blocks", "<control>M", similar_blocks, 1, "<Item>"}
+    ,
+    {"/Search/Clear similar", NULL, similar_blocks, 0, "<Item>"}
+    ,
+    {"/Search/sep1", NULL, NULL, 0, "<Separator>"}
+    ,
+    {"/Search/Selection statistics", "<control>I", region_stats, 0,
+     "<Item>"}
+    ,
     {"/_Visualise", NULL, NULL, 0, "<Branch>"}
     ,
 };
@@ -1010,6 +3975,17 @@ GtkItemFactoryEntry help_menu_items[] = {
     ,
     {"/Window/Whole Display on-off", NULL, hide_whole, 0, "<Item>"}
     ,
+    {"/Window/Statistics on-off", NULL, hide_stats, 0, "<Item>"}
+    ,
+    {"/Window/Selection statistics on-off", NULL, hide_selstats, 0,
+     "<Item>"}
+    ,
+    {"/Window/Deep zoom", "z", deep_zoom, 0, "<Item>"}
+    ,
+    {"/Window/Write trace", NULL, write_trace, 0, "<Item>"}
+    ,
+    {"/Window/Memory budget", NULL, budget_show, 0, "<Item>"}
+    ,
     {"/_Help", NULL, NULL, 0, "<LastBranch>"}
     ,
     {"/_Help/About", NULL, help, 0, "<Item>"}
@@ -1148,6 +4124,16 @@ configure_event(GtkWidget * widget, GdkEventConfigure * event,
         }
     }
 
+    /* the surface is still right if the size is; the expose that follows
+     * paints it */
+    if (displays[pixbufnum].surface
+        && (cairo_image_surface_get_width(displays[pixbufnum].surface) ==
+            displays[pixbufnum].width)
+        && (cairo_image_surface_get_height(displays[pixbufnum].surface) ==
+            displays[pixbufnum].height)) {
+        return TRUE;
+    }
+
     if (draw_img(pixbufnum) != 0) {
         FAIL_MSG("configure_event: draw_img() failed\n");
         return TRUE;
@@ -1158,21 +4144,28 @@ configure_event(GtkWidget * widget, GdkEventConfigure * event,
 }
 
 
-/* expose_event redraws the screen from the backing pixbuf */
+/* expose_event repaints the damaged part of the screen from the backing
+ * surface */
 gboolean
 expose_event(GtkWidget * widget, GdkEventExpose * event, gpointer data)
 {
     cairo_t *cr;
-    GdkPixbuf *pb;
+    cairo_surface_t *surface;
     int pixbufnum = (int) (long) data;
+    uint64_t start;
 
-    if (!widget) {
+    if (!widget || !event) {
         FAIL_MSG("expose_event: invalid params\n");
         return FALSE;
     }
 
 
-    pb = displays[pixbufnum].buf;
+    surface = displays[pixbufnum].surface;
+    if (!surface) {
+        return FALSE;
+    }
+
+    start = trace_now();
 
     cr = gdk_cairo_create(gtk_widget_get_window(widget));
     if (!cr) {
@@ -1181,10 +4174,15 @@ expose_event(GtkWidget * widget, GdkEventExpose * event, gpointer data)
     }
 
 
-    gdk_cairo_set_source_pixbuf(cr, pb, 0, 0);
+    gdk_cairo_region(cr, event->region);
+    cairo_clip(cr);
+    cairo_set_source_surface(cr, surface, 0, 0);
     cairo_paint(cr);
     cairo_destroy(cr);
 
+    trace_span("paint", start);
+    replay_exposed(pixbufnum);
+
     return FALSE;
 }
 
@@ -1203,7 +4201,9 @@ unsigned long get_location(int pixbufnum, int width, int x, int y)
 
     switch (pixbufnum) {
     case PIXBUF_WHOLE_HILBERT:
-        if (disp.disp_hilbert == DISP_HILBERTFLIPPED) {
+        if (disp.disp_hilbert == DISP_MORTON) {
+            location = morton_xy2d(x, y);
+        } else if (disp.disp_hilbert == DISP_HILBERTFLIPPED) {
             location = xy2d(width, y, x);
         } else {
             location = xy2d(width, x, y);
@@ -1212,7 +4212,9 @@ unsigned long get_location(int pixbufnum, int width, int x, int y)
         location = location * step;
         break;
     case PIXBUF_ZOOM_HILBERT:
-        if (disp.disp_hilbert == DISP_HILBERTFLIPPED) {
+        if (disp.disp_hilbert == DISP_MORTON) {
+            location = morton_xy2d(x, y);
+        } else if (disp.disp_hilbert == DISP_HILBERTFLIPPED) {
             location = xy2d(width, y, x);
         } else {
             location = xy2d(width, x, y);
@@ -1289,6 +4291,17 @@ button_event(GtkWidget * widget, int x, int y, int button,
     }
 
 
+    /* the middle button asks which blocks are like the one under it */
+    if ((button == 2) && (state == BUTTON_DOWN)) {
+        width = widget->allocation.width;
+        if (find_similar(get_location(pixbufnum, width, x, y)) != 0) {
+            FAIL_MSG("button_event: find_similar() failed\n");
+            return 12;
+        }
+
+        return 0;
+    }
+
     if (((button == 1) || (button == 3)) && widget != NULL) {
         width = widget->allocation.width;
 
@@ -1482,6 +4495,10 @@ button_press_event(GtkWidget * widget, GdkEventButton * event,
 
     disp.dragy = (int) (event->y);
 
+    trace_instant("press");
+    replay_record_button(REPLAY_PRESS, (int) (long) data, (int) (event->x),
+                         (int) (event->y), event->button);
+
     if (button_event
         (widget, (int) (event->x), (int) (event->y), event->button, data,
          BUTTON_DOWN) != 0) {
@@ -1505,6 +4522,10 @@ button_release_event(GtkWidget * widget, GdkEventButton * event,
     }
 
 
+    trace_instant("release");
+    replay_record_button(REPLAY_RELEASE, (int) (long) data, (int) (event->x),
+                         (int) (event->y), event->button);
+
     if (!disp.drag) {
         if (button_event(widget, (int) (event->x), (int) (event->y),
                          event->button, data, BUTTON_UP) != 0) {
@@ -1512,6 +4533,10 @@ button_release_event(GtkWidget * widget, GdkEventButton * event,
             return TRUE;
         }
 
+        if (selstats_update() != 0) {
+            FAIL_MSG("button_release_event: selstats_update() failed\n");
+        }
+
     }
 
     disp.dragy = -1;
@@ -1544,6 +4569,10 @@ motion_notify_event(GtkWidget * widget, GdkEventMotion * event,
     }
 
     if (disp.drag) {
+        trace_instant("drag");
+        replay_record_button(REPLAY_MOTION, (int) (long) data,
+                             (int) (event->x), (int) (event->y), button);
+
         if (button_event
             (widget, (int) (event->x), (int) (event->y), button, data,
              BUTTON_DRAG) != 0) {
@@ -1551,6 +4580,10 @@ motion_notify_event(GtkWidget * widget, GdkEventMotion * event,
             return TRUE;
         }
 
+        if (selstats_update() != 0) {
+            FAIL_MSG("motion_notify_event: selstats_update() failed\n");
+        }
+
     }
 
     return TRUE;
@@ -1560,9 +4593,17 @@ motion_notify_event(GtkWidget * widget, GdkEventMotion * event,
 /* quit is a window destroy callback */
 void quit()
 {
+    if (trace_flush() != 0) {
+        FAIL_MSG("quit: trace_flush() failed\n");
+    }
+
     if (kill_children() != 0)
         FAIL_MSG("quit: kill_children() failed\n");
 
+    if (zygote_free() != 0) {
+        FAIL_MSG("quit: zygote_free() failed\n");
+    }
+
 
     /* close semaphore and shared memory */
 
@@ -1603,6 +4644,7 @@ int auto_draw(GtkWidget * widget, int pixbufnum)
 
     /* and update it */
     gtk_widget_queue_draw_area(widget, 0, 0, width, height);
+    replay_queued(pixbufnum);
 
     return 0;
 }
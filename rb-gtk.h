@@ -37,11 +37,81 @@
 #include "rb-draw.h"
 //#include "trigraph.h"
 #include "rb-vis.h"
+#include "rb-search.h"
+#include "rb-classify.h"
+#include "rb-procmem.h"
+#include "rb-spool.h"
+#include "rb-zsrc.h"
+#include "rb-compare.h"
+#include "rb-dupes.h"
+#include "rb-hist.h"
+#include "rb-tiles.h"
+#include "rb-replay.h"
+#include "rb-conf.h"
+#include "rb-budget.h"
+#include "rb-stats.h"
+#include "rb-trace.h"
 #include "macro.h"
 
+/* how often to check on a background search, in ms */
+#define SEARCH_POLL_MS 200
+/* how often to redraw the regions while classifying, in ms */
+#define CLASSIFY_POLL_MS 500
+/* how often to check whether a followed file has grown, in ms */
+#define FOLLOW_POLL_MS 500
+/* how often to check on a rescan, and to start one while watching, in ms */
+#define CHANGE_POLL_MS 200
+#define CHANGE_WATCH_MS 2000
+/* how often to read a process's memory again, in ms */
+#define PROC_POLL_MS 1000
+/* how often to check on reading stdin, in ms */
+#define SPOOL_POLL_MS 500
+/* how often to check on indexing a compressed file, in ms */
+#define ZSRC_POLL_MS 500
+/* how often to redraw the differences while comparing, in ms */
+#define COMPARE_POLL_MS 200
+/* how often to check on indexing the blocks, in ms */
+#define DUPES_POLL_MS 200
+/* how often to check on counting the bytes, in ms */
+#define HIST_POLL_MS 200
+/* the selection statistics show the commonest this many byte values */
+#define SELSTATS_COMMON 4
+/* how often to look for new pictures from the plugins, in ms */
+#define PLUGIN_POLL_MS 50
+/* how often to look for newly drawn deep zoom tiles, in ms */
+#define DEEP_POLL_MS 50
+/* how long after opening a visualiser to start another waiting, in ms */
+#define ZYGOTE_REFILL_MS 1000
+/* how often to look for changes to the config files, in ms */
+#define CONF_POLL_MS 1000
+
+/* a plugin visualiser and its window */
+struct plugvis {
+    struct plugin_ctx *ctx;
+    GtkWidget *window;
+    GtkWidget *area;
+    /* the last picture, made again only when another arrives */
+    cairo_surface_t *surface;
+};
+
+/* where the deep zoom window is looking; cx and cy are the point at its
+ * middle, counted in points of the level */
+struct deepview {
+    int level;
+    long cx;
+    long cy;
+    int dragx;
+    int dragy;
+};
+
 
 void child_reap(int signo);
 int load_file(char *fname);
+int load_process(pid_t pid);
+int load_stream();
+int load_compressed(char *fname);
+int load_indexed(struct zsrc_ctx *ctx);
+int load_path(char *fname);
 int init_arrays();
 int make_main_window();
 int make_help_dialog();
@@ -51,12 +121,108 @@ void change_display(gpointer callback_data, guint callback_action,
                     GtkWidget * menu_item);
 int update_children();
 int kill_children();
+int stop_plugin(int slot);
+int stop_plugins();
+gboolean plugin_poll(gpointer data);
+gboolean plugin_expose(GtkWidget * widget, GdkEventExpose * event,
+                       gpointer data);
+gboolean plugin_configure(GtkWidget * widget, GdkEventConfigure * event,
+                          gpointer data);
+gboolean delete_plugin(GtkWidget * widget, gpointer data);
+int start_plugin(int visid);
+int start_zygotes();
+gboolean zygote_refill(gpointer data);
+gboolean conf_poll(gpointer data);
+int budget_configure();
+void budget_show(gpointer callback_data, guint callback_action,
+                 GtkWidget * menu_item);
 int visualise_end(void *ctx);
 void visualise(gpointer callback_data, guint callback_action,
                GtkWidget * menu_item);
+void hide_stats(gpointer callback_data, guint callback_action,
+                GtkWidget * menu_item);
+gboolean stats_timer(gpointer data);
+void hide_selstats(gpointer callback_data, guint callback_action,
+                   GtkWidget * menu_item);
+int selstats_update();
+void write_trace(gpointer callback_data, guint callback_action,
+                 GtkWidget * menu_item);
 void help(GtkWidget * w, gpointer data);
 gboolean delete_help(GtkWidget * widget, gpointer data);
 void file_open(GtkWidget * w, gpointer data);
+int redraw_all();
+int set_title(char *status);
+int clear_search();
+gboolean search_poll(gpointer data);
+void search_find(gpointer callback_data, guint callback_action,
+                 GtkWidget * menu_item);
+void search_goto(gpointer callback_data, guint callback_action,
+                 GtkWidget * menu_item);
+void search_clear(gpointer callback_data, guint callback_action,
+                  GtkWidget * menu_item);
+void publish_summaries();
+int clear_classify();
+gboolean classify_poll(gpointer data);
+int classify_file();
+int clear_hist();
+gboolean hist_poll(gpointer data);
+int hist_file();
+int hist_grown();
+int hist_changed();
+gboolean follow_poll(gpointer data);
+void follow_file(gpointer callback_data, guint callback_action,
+                 GtkWidget * menu_item);
+int clear_changes();
+int update_dirty();
+int draw_changes();
+gboolean change_poll(gpointer data);
+int rescan_file();
+void rescan(gpointer callback_data, guint callback_action,
+            GtkWidget * menu_item);
+gboolean watch_poll(gpointer data);
+void watch_changes(gpointer callback_data, guint callback_action,
+                   GtkWidget * menu_item);
+int clear_process();
+gboolean proc_poll(gpointer data);
+int watch_process();
+void reattach(gpointer callback_data, guint callback_action,
+              GtkWidget * menu_item);
+int clear_spool();
+gboolean spool_poll(gpointer data);
+int watch_spool();
+int clear_compressed();
+gboolean zsrc_poll(gpointer data);
+int watch_compressed(struct zsrc_ctx *ctx);
+int clear_compare();
+gboolean compare_poll(gpointer data);
+int compare_with(char *fname, int how);
+int show_differences();
+void compare_file(gpointer callback_data, guint callback_action,
+                  GtkWidget * menu_item);
+void compare_goto(gpointer callback_data, guint callback_action,
+                  GtkWidget * menu_item);
+int clear_dupes();
+gboolean dupes_poll(gpointer data);
+int find_similar(unsigned long location);
+void similar_blocks(gpointer callback_data, guint callback_action,
+                    GtkWidget * menu_item);
+int deep_recolour();
+int clear_tiles();
+gboolean deep_poll(gpointer data);
+gboolean deep_expose(GtkWidget * widget, GdkEventExpose * event,
+                     gpointer data);
+gboolean deep_scroll(GtkWidget * widget, GdkEventScroll * event,
+                     gpointer data);
+gboolean deep_button(GtkWidget * widget, GdkEventButton * event,
+                     gpointer data);
+gboolean deep_motion(GtkWidget * widget, GdkEventMotion * event,
+                     gpointer data);
+gboolean delete_deep(GtkWidget * widget, gpointer data);
+int make_deep_window();
+void deep_zoom(gpointer callback_data, guint callback_action,
+               GtkWidget * menu_item);
+void region_stats(gpointer callback_data, guint callback_action,
+                  GtkWidget * menu_item);
 GtkWidget *get_menubar_menu(GtkWidget * window);
 gboolean configure_event(GtkWidget * widget, GdkEventConfigure * event,
                          gpointer data);
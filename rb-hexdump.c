@@ -57,6 +57,7 @@ void sig_handler(int signo)
             return;
         }
 
+        trace_instant("sigusr1");
         gctx->reload = 1;
     } else if (signo == SIGHUP) {
         if (disable_usr1() != 0) {
@@ -71,18 +72,28 @@ void sig_handler(int signo)
 
 
 /* onIdle is run whenever there is time.  It monitors ctx->reload and
- * calls hexdump_redraw() and enable_usr1() when it is set.
+ * calls hexdump_redraw() and enable_usr1() when it is set, and then
+ * acknowledges the update it drew.  It also writes out the trace when
+ * the main window asks.
  */
 gboolean onIdle(gpointer data)
 {
     struct hd_ctx *ctx = (struct hd_ctx *) data;
+    unsigned long seq;
+    uint64_t start;
 
     if (ctx->reload) {
+        start = trace_now();
+        seq = shm_update_seq(shm);
+        trace_flow("update", TRACE_FLOW_END, seq);
         if (hexdump_redraw(gctx) != 0) {
             FAIL_MSG("onIdle: hexdump_redraw() failed\n");
             return TRUE;
         }
 
+        trace_span("reload", start);
+        shm_ack(shm, seq);
+
         ctx->reload = 0;
         if (enable_usr1() != 0) {
             FAIL_MSG("onIdle: enable_usr1() failed\n");
@@ -91,6 +102,10 @@ gboolean onIdle(gpointer data)
 
     }
 
+    if (trace_poll(shm) != 0) {
+        FAIL_MSG("onIdle: trace_poll() failed\n");
+    }
+
     return TRUE;
 }
 
@@ -264,6 +279,55 @@ void set_nudge(gpointer data, guint action, GtkWidget * widget)
 }
 
 
+/* hide_stats is a menu callback.  It shows/hides the drawing statistics
+ * under the table */
+void hide_stats(gpointer data, guint action, GtkWidget * widget)
+{
+    struct hd_ctx *ctx = (struct hd_ctx *) data;
+
+    if (!ctx) {
+        FAIL_MSG("hide_stats: invalid params\n");
+        return;
+    }
+
+
+    ctx->stats_show = !ctx->stats_show;
+    if (ctx->stats_show) {
+        stats_timer(ctx);
+        gtk_widget_show(ctx->stats);
+    } else {
+        gtk_widget_hide(ctx->stats);
+    }
+
+    /* make room for them in the table */
+    ctx->xsize = -1;
+    resize_table(ctx);
+}
+
+
+/* stats_timer refreshes the drawing statistics and dumps them if asked */
+gboolean stats_timer(gpointer data)
+{
+    struct hd_ctx *ctx = (struct hd_ctx *) data;
+    char buf[STATS_DUMPSIZE];
+
+    if (stats_poll() != 0) {
+        FAIL_MSG("stats_timer: stats_poll() failed\n");
+    }
+
+    if (ctx && ctx->stats_show) {
+        if (stats_format(buf, sizeof(buf)) != 0) {
+            FAIL_MSG("stats_timer: stats_format() failed\n");
+            return TRUE;
+        }
+
+        gtk_label_set_text(GTK_LABEL(ctx->stats), buf);
+    }
+
+    return TRUE;
+}
+
+
 /* set_update is a menu callback.  It holds/unholds the updating of the
  * display */
 void set_update(gpointer data, guint action, GtkWidget * widget)
@@ -300,10 +364,133 @@ void set_update(gpointer data, guint action, GtkWidget * widget)
 }
 
 
+/* export_text is a menu callback.  It writes the whole selection to a file
+ * as hexdump text, using the current word size, endianness and row width.
+ */
+void export_text(gpointer data, guint action, GtkWidget * widget)
+{
+    struct hd_ctx *ctx = (struct hd_ctx *) data;
+    GtkWidget *dialog;
+    char *tmpfilename = NULL;
+    FILE *fp;
+
+    if (!ctx || (ctx->type != BUF_TYPE_FD) || !ctx->cols) {
+        FAIL_MSG("export_text: invalid params\n");
+        return;
+    }
+
+
+    dialog = gtk_file_chooser_dialog_new("Export as text",
+                                         GTK_WINDOW(ctx->window),
+                                         GTK_FILE_CHOOSER_ACTION_SAVE,
+                                         GTK_STOCK_CANCEL,
+                                         GTK_RESPONSE_CANCEL,
+                                         GTK_STOCK_SAVE,
+                                         GTK_RESPONSE_ACCEPT, NULL);
+    if (!dialog) {
+        FAIL_MSG("export_text: gtk_file_chooser_dialog_new() failed\n");
+        return;
+    }
+
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER
+                                                   (dialog), TRUE);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+
+        tmpfilename =
+            gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+
+        fp = fopen(tmpfilename, "w");
+        if (!fp) {
+            FAIL_ERR("export_text: fopen() failed\n");
+        } else {
+            if (hexfmt_export(fp, ctx->fd, ctx->offset, ctx->bufsize,
+                              ctx->cols * ctx->dsize, ctx->dsize,
+                              ctx->endian) != 0) {
+                FAIL_MSG("export_text: hexfmt_export() failed\n");
+            }
+            fclose(fp);
+        }
+
+        g_free(tmpfilename);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+
+/* set_hd_title names the window after the file whose bytes are shown */
+int set_hd_title(struct hd_ctx *ctx)
+{
+    char title[PATH_MAX + 32];
+
+    if (!ctx) {
+        FAIL_MSG("set_hd_title: invalid params\n");
+        return 1;
+    }
+
+
+    if (!ctx->window) {
+        return 0;
+    }
+
+    if (!ctx->fd2) {
+        gtk_window_set_title(GTK_WINDOW(ctx->window), "Hexdump");
+    } else if (ctx->side && ctx->delta) {
+        snprintf(title, sizeof(title), "Hexdump - %s (lined up %+ld)",
+                 ctx->othername, ctx->delta);
+        gtk_window_set_title(GTK_WINDOW(ctx->window), title);
+    } else if (ctx->side) {
+        snprintf(title, sizeof(title), "Hexdump - %s", ctx->othername);
+        gtk_window_set_title(GTK_WINDOW(ctx->window), title);
+    } else {
+        gtk_window_set_title(GTK_WINDOW(ctx->window),
+                             "Hexdump - first file");
+    }
+
+    return 0;
+}
+
+
+/* show_other is a menu callback.  It swaps between showing the bytes of
+ * the file and of the file being compared with */
+void show_other(gpointer data, guint action, GtkWidget * widget)
+{
+    struct hd_ctx *ctx = (struct hd_ctx *) data;
+
+    if (!ctx) {
+        FAIL_MSG("show_other: invalid params\n");
+        return;
+    }
+
+
+    if (!ctx->fd2) {
+        gdk_beep();
+        return;
+    }
+
+    ctx->side = !ctx->side;
+
+    if (set_hd_title(ctx) != 0) {
+        FAIL_MSG("show_other: set_hd_title() failed\n");
+        return;
+    }
+
+    if (populate(ctx) != 0) {
+        FAIL_MSG("show_other: populate() failed\n");
+        return;
+    }
+
+}
+
+
 /* Our menu, an array of GtkItemFactoryEntry structures that defines each menu item */
 GtkItemFactoryEntry hd_menu_items[] = {
     {"/_File", NULL, NULL, 0, "<Branch>"}
     ,
+    {"/File/_Export as text...", "<CTRL>E", export_text, 0, "<StockItem>",
+     GTK_STOCK_SAVE_AS}
+    ,
     {"/File/_Quit", "<CTRL>Q", quit_local, 0, "<StockItem>", GTK_STOCK_QUIT}
     ,
     {"/_Word size", NULL, NULL, 0, "<Branch>"}
@@ -338,6 +525,14 @@ GtkItemFactoryEntry hd_menu_items[] = {
     ,
     {"/Update/Hold", "h", set_update, UPDATE_HOLD, "/Update/Continuous"}
     ,
+    {"/_Window", NULL, NULL, 0, "<Branch>"}
+    ,
+    {"/Window/Statistics on-off", NULL, hide_stats, 0, "<Item>"}
+    ,
+    {"/_View", NULL, NULL, 0, "<Branch>"}
+    ,
+    {"/View/Second file on-off", "s", show_other, 0, "<Item>"}
+    ,
 };
 
 
@@ -604,6 +799,19 @@ int hexdump_free(void *rawctx)
         return 2;
     }
 
+    if (ctx->mmap_ptr) {
+        if (unmapmem(ctx) != 0) {
+            FAIL_MSG("hexdump_free: unmapmem() failed\n");
+            return 3;
+        }
+
+    }
+
+    if (ctx->fd2) {
+        close(ctx->fd2);
+    }
+    free(ctx->other);
+
     gtk_widget_destroy(ctx->scroll);
     gtk_widget_destroy(ctx->hexevent);
     gtk_widget_destroy(ctx->hbox);
@@ -803,6 +1011,11 @@ int destroy_table(struct hd_ctx *ctx)
     free(ctx->table_widgets);
     ctx->table_widgets = NULL;
 
+    /* and the colours of the labels */
+    free(ctx->marked);
+    ctx->marked = NULL;
+    ctx->nmarked = 0;
+
     return 0;
 }
 
@@ -832,7 +1045,8 @@ int set_dims(struct hd_ctx *ctx)
     }
 
     /* calc rows */
-    ctx->rows = (ctx->ysize - MENUHEIGHT) / ctx->eleysize;
+    ctx->rows = (ctx->ysize - MENUHEIGHT -
+                 (ctx->stats_show ? STATSHEIGHT : 0)) / ctx->eleysize;
 
     /* also calc the total rows at this width for scrolling
      * and fix for a final partial row */
@@ -1092,6 +1306,8 @@ int enlarge_table(struct hd_ctx *ctx, int pcols, int prows)
 /* copyshm copies values from the shared memory via a semaphore */
 int copyshm(struct hd_ctx *ctx)
 {
+    int reopen = 0;
+
     if (!ctx) {
         FAIL_MSG("copyshm: invalid params\n");
         return 1;
@@ -1109,47 +1325,273 @@ int copyshm(struct hd_ctx *ctx)
     ctx->offset = shm->offset;
     ctx->type = shm->buf_type;
 
+    /* a followed file may have grown */
+    if (shm->filestat.st_size > ctx->filestat.st_size) {
+        ctx->filestat.st_size = shm->filestat.st_size;
+    }
+
+    /* the main window may have started or stopped comparing */
+    if (shm->compare_seq != ctx->compare_seq) {
+        ctx->compare_seq = shm->compare_seq;
+        strncpy(ctx->othername, shm->compare, PATH_MAX);
+        ctx->othername[PATH_MAX - 1] = 0x00;
+        reopen = 1;
+    }
+
+    /* the files may have been lined up */
+    if (shm->compare_delta != ctx->delta) {
+        ctx->delta = shm->compare_delta;
+        reopen |= 2;
+    }
+
     /* unlock the shared memory */
     if (sem_post(sem) != 0) {
         FAIL_ERR("copyshm: sem_post() failed\n");
         return 3;
     }
 
+    if ((reopen & 1) && (open_other(ctx) != 0)) {
+        FAIL_MSG("copyshm: open_other() failed\n");
+        return 4;
+    }
+
+    if ((reopen == 2) && (set_hd_title(ctx) != 0)) {
+        FAIL_MSG("copyshm: set_hd_title() failed\n");
+        return 5;
+    }
+
+
     return 0;
 }
 
 
-/* mapmem mmap()s the visualised area of the file descriptor */
-int mapmem(struct hd_ctx *ctx)
+/* open_other opens the file being compared with, closing the last one */
+int open_other(struct hd_ctx *ctx)
 {
     if (!ctx) {
+        FAIL_MSG("open_other: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->fd2) {
+        close(ctx->fd2);
+        ctx->fd2 = 0;
+        ctx->otherlen = 0;
+    }
+
+    if (ctx->othername[0]) {
+        ctx->fd2 = open(ctx->othername, O_RDONLY);
+        if (ctx->fd2 == -1) {
+            FAIL_ERR("open_other: cannot open file being compared with\n");
+            ctx->fd2 = 0;
+            ctx->side = 0;
+            set_hd_title(ctx);
+            return 2;
+        }
+
+    } else {
+        ctx->side = 0;
+    }
+
+    if (set_hd_title(ctx) != 0) {
+        FAIL_MSG("open_other: set_hd_title() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* readother reads the file being compared with from the start of the
+ * mapped window to end, so its bytes line up with ctx->buf, shifted by
+ * delta if the files were lined up.  It can be shorter than the file, so
+ * otherlen says how much was there */
+int readother(struct hd_ctx *ctx, unsigned long end)
+{
+    uint8_t *tmpbuf;
+    long len;
+
+    if (!ctx || !ctx->fd2) {
+        FAIL_MSG("readother: invalid params\n");
+        return 1;
+    }
+
+
+    if (end > ctx->bufsize) {
+        end = ctx->bufsize;
+    }
+    ctx->otherlen = 0;
+    if ((end <= ctx->buf_start)
+        || ((long) (ctx->offset + ctx->buf_start) + ctx->delta < 0)) {
+        return 0;
+    }
+
+    if (end - ctx->buf_start > ctx->othersize) {
+        tmpbuf = (uint8_t *) realloc(ctx->other, end - ctx->buf_start);
+        if (!tmpbuf) {
+            FAIL_MSG("readother: realloc() failed\n");
+            return 2;
+        }
+
+        ctx->other = tmpbuf;
+        ctx->othersize = end - ctx->buf_start;
+    }
+
+    len = blkdev_pread(ctx->fd2, ctx->other, end - ctx->buf_start,
+                       ctx->offset + ctx->buf_start + ctx->delta);
+    if (len < 0) {
+        FAIL_MSG("readother: blkdev_pread() failed\n");
+        return 3;
+    }
+
+    ctx->otherlen = len;
+
+    return 0;
+}
+
+
+/* mark_value colours a value label red if it differs from the file being
+ * compared with, and back to normal if not.  Labels are only touched when
+ * their mark changes */
+int mark_value(struct hd_ctx *ctx, int i, int j, int mark)
+{
+    GdkColor red;
+    int idx;
+
+    if (!ctx || !ctx->marked || (i < 1) || (i > ctx->tablecols)
+        || (j < 0) || (j >= ctx->tablerows)) {
+        FAIL_MSG("mark_value: invalid params\n");
+        return 1;
+    }
+
+
+    idx = (j * (ctx->tablecols + 2)) + i;
+    if (ctx->marked[idx] == mark) {
+        return 0;
+    }
+
+    ctx->marked[idx] = mark;
+
+    if (mark == MARK_DIFF) {
+        if (!gdk_color_parse("red", &red)) {
+            FAIL_MSG("mark_value: gdk_color_parse() failed\n");
+            return 2;
+        }
+
+        gtk_widget_modify_fg(ctx->table_widgets[idx], GTK_STATE_NORMAL,
+                             &red);
+    } else if (set_col_and_font(ctx->table_widgets, ctx->tablecols,
+                                ctx->dsize, i, j, 1, 0) != 0) {
+        FAIL_MSG("mark_value: set_col_and_font() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* mapmem makes sure the bytes from start to end of the selection are
+ * mmap()ed.  Only the visible window plus a prefetch margin either side is
+ * mapped, and the current mapping is reused while it still covers the window.
+ */
+int mapmem(struct hd_ctx *ctx, unsigned long start, unsigned long end)
+{
+    unsigned long pagesize;
+    unsigned long filesize;
+    unsigned long mapstart;
+    unsigned long mapend;
+    unsigned long prefetch;
+    struct stats_mark mark;
+
+    if (!ctx || (end < start)) {
         FAIL_MSG("mapmem: invalid params\n");
         return 1;
     }
 
 
-    /* shift the values to align with a page */
-    ctx->mmap_offset = ctx->offset & ~(sysconf(_SC_PAGE_SIZE) - 1);
-    ctx->mmap_size = ctx->bufsize + (ctx->offset - ctx->mmap_offset);
+    /* clip the window to the selection */
+    if (end > ctx->bufsize) {
+        end = ctx->bufsize;
+    }
+    if (start > end) {
+        start = end;
+    }
+    if (start == end) {
+        return 0;
+    }
+
+    /* remap if the current mapping doesn't cover the window */
+    if (!ctx->mmap_ptr || (ctx->offset + start < ctx->mmap_offset) ||
+        (ctx->offset + end > ctx->mmap_offset + ctx->mmap_size)) {
+
+        stats_begin(&mark);
 
-    /* mmap() it */
-    ctx->mmap_ptr =
-        mmap((caddr_t) 0, ctx->mmap_size, PROT_READ, MAP_SHARED, ctx->fd,
-             ctx->mmap_offset);
-//	fprintf(stderr, "mmap_offset = 0x%lx\n", ctx->mmap_offset);
-//	fprintf(stderr, "mmap_size = 0x%lx\n", ctx->mmap_size);
+        if (ctx->mmap_ptr) {
+            if (unmapmem(ctx) != 0) {
+                FAIL_MSG("mapmem: unmapmem() failed\n");
+                return 2;
+            }
 
-    if (ctx->mmap_ptr == MAP_FAILED) {
-        perror("mapmem: mmap() failed\n");
-        fprintf(stderr, "mmap_offset = 0x%lx\n", ctx->mmap_offset);
-        fprintf(stderr, "mmap_size = 0x%lx\n", ctx->mmap_size);
-        fprintf(stderr, "fd = %d\n", ctx->fd);
+        }
 
-        return 2;
+        /* add the prefetch margin, less of it if the memory budget is
+         * short, and align with a page */
+        pagesize = sysconf(_SC_PAGE_SIZE);
+        filesize = ctx->filestat.st_size;
+
+        ctx->mmap_reserved = budget_fit(BUDGET_MMAP,
+                                        (end - start) + (2 * HD_PREFETCH),
+                                        end - start);
+        prefetch = (ctx->mmap_reserved - (end - start)) / 2;
+
+        mapstart = ctx->offset + start;
+        if (mapstart > prefetch) {
+            mapstart -= prefetch;
+        } else {
+            mapstart = 0;
+        }
+        mapstart &= ~(pagesize - 1);
+
+        mapend = ctx->offset + end + prefetch;
+        if (filesize && (mapend > filesize)) {
+            mapend = filesize;
+        }
+        if (mapend < ctx->offset + end) {
+            mapend = ctx->offset + end;
+        }
+
+        ctx->mmap_offset = mapstart;
+        ctx->mmap_size = mapend - mapstart;
+
+        /* mmap() it */
+        ctx->mmap_ptr =
+            mmap((caddr_t) 0, ctx->mmap_size, PROT_READ, MAP_SHARED,
+                 ctx->fd, ctx->mmap_offset);
+
+        if (ctx->mmap_ptr == MAP_FAILED) {
+            perror("mapmem: mmap() failed\n");
+            fprintf(stderr, "mmap_offset = 0x%lx\n", ctx->mmap_offset);
+            fprintf(stderr, "mmap_size = 0x%lx\n", ctx->mmap_size);
+            fprintf(stderr, "fd = %d\n", ctx->fd);
+
+            budget_release(BUDGET_MMAP, ctx->mmap_reserved);
+            ctx->mmap_reserved = 0;
+            ctx->mmap_ptr = NULL;
+            ctx->mmap_size = 0;
+            return 3;
+        }
+
+        stats_mmap(STATS_MMAP);
+        stats_add(STATS_MMAP, ctx->mmap_size, 0);
+        stats_end(STATS_MMAP, &mark);
     }
 
-    /* set buffer pointer */
-    ctx->buf = ctx->mmap_ptr + (ctx->offset - ctx->mmap_offset);
+    /* set buffer pointer to the start of the window */
+    ctx->buf_start = start;
+    ctx->buf = ctx->mmap_ptr + (ctx->offset + start - ctx->mmap_offset);
 
     return 0;
 }
@@ -1158,7 +1600,7 @@ int mapmem(struct hd_ctx *ctx)
 /* unmapmem munmap()s a mmap()ed segment */
 int unmapmem(struct hd_ctx *ctx)
 {
-    if (!ctx) {
+    if (!ctx || !ctx->mmap_ptr) {
         FAIL_MSG("unmapmem: invalid params\n");
         return 1;
     }
@@ -1169,6 +1611,12 @@ int unmapmem(struct hd_ctx *ctx)
         return 2;
     }
 
+    stats_munmap(STATS_MMAP);
+    budget_release(BUDGET_MMAP, ctx->mmap_reserved);
+
+    ctx->mmap_reserved = 0;
+    ctx->mmap_ptr = NULL;
+    ctx->mmap_size = 0;
 
     return 0;
 }
@@ -1203,6 +1651,16 @@ int set_col_cols(struct hd_ctx *ctx)
 
         }
     }
+
+    /* the values that differ need colouring again */
+    if (ctx->marked) {
+        memset(ctx->marked, MARK_UNKNOWN, ctx->nmarked);
+        if (ctx->fd2 && (populate(ctx) != 0)) {
+            FAIL_MSG("set_col_cols: populate() failed\n");
+            return 4;
+        }
+
+    }
     return 0;
 }
 
@@ -1211,8 +1669,10 @@ int set_col_cols(struct hd_ctx *ctx)
 int create_and_populate_table(struct hd_ctx *ctx)
 {
     int i, j;
-    char addrstr[ADDRSIZE + 4];
-    char bytestr[ADDRSIZE + 4];
+    int count;
+    char addrstr[HEXFMT_ADDRSIZE];
+    char valuestr[(ASCIISIZE - 2) * HEXFMT_STRIDE];
+    char *bytestr;
     char asciistr[ASCIISIZE];
 
     if (!ctx) {
@@ -1246,9 +1706,11 @@ int create_and_populate_table(struct hd_ctx *ctx)
     gtk_widget_show(ctx->hextable);
 
 
-    /* map the memory */
+    /* map the visible window */
     if (ctx->type == BUF_TYPE_FD) {
-        if (mapmem(ctx) != 0) {
+        if (mapmem(ctx, ctx->scroll_offset,
+                   ctx->scroll_offset +
+                   (ctx->rows * ctx->cols * ctx->dsize)) != 0) {
             FAIL_MSG("create_and_populate_table: mapmem() failed\n");
             return 4;
         }
@@ -1259,9 +1721,9 @@ int create_and_populate_table(struct hd_ctx *ctx)
     for (j = 0; j < ctx->rows; j++) {
         /* make address string */
         if (j < ctx->totalrows) {
-            snprintf(addrstr, ADDRSIZE + 4, "%016lx:",
-                     (long) (ctx->scroll_offset +
-                             (j * ctx->cols * ctx->dsize) + ctx->offset));
+            hexfmt_addr(addrstr,
+                        ctx->scroll_offset + (j * ctx->cols * ctx->dsize) +
+                        ctx->offset);
         } else {
             memset(addrstr, ' ', ADDRSIZE + 1);
             addrstr[ADDRSIZE + 1] = 0x00;
@@ -1274,21 +1736,20 @@ int create_and_populate_table(struct hd_ctx *ctx)
             return 5;
         }
 
+        /* format the whole row */
+        if (makerow(ctx, j, 0, valuestr, asciistr, &count) != 0) {
+            FAIL_MSG("create_and_populate_table: makerow() failed\n");
+            return 6;
+        }
+
         /* loop for all columns */
         for (i = 1; i <= ctx->tablecols; i++) {
-            /* if location is in range, make the value string, otherwise
+            /* if location is in range, use the value string, otherwise
              * set it to "" */
-            if ((i <= ctx->cols)
-                && (ctx->scroll_offset + (j * ctx->cols * ctx->dsize) +
-                    ((i - 1) * ctx->dsize) + ctx->dsize <= ctx->bufsize)) {
-                if (makevalue(ctx, bytestr, i, j) != 0) {
-                    FAIL_MSG
-                        ("create_and_populate_table: makevalue() failed\n");
-                    return 6;
-                }
-
+            if (i <= count) {
+                bytestr = valuestr + ((i - 1) * HEXFMT_STRIDE);
             } else {
-                bytestr[0] = 0x00;
+                bytestr = "";
             }
             /* make the label */
             if (make_label
@@ -1302,148 +1763,77 @@ int create_and_populate_table(struct hd_ctx *ctx)
 
         }
 
-        /* make the ascii string */
-        if (makeascii(asciistr,
-                      ctx->buf + ctx->scroll_offset +
-                      (j * ctx->cols * ctx->dsize),
-                      ctx->bufsize - ctx->scroll_offset -
-                      (j * ctx->cols * ctx->dsize),
-                      ctx->cols * ctx->dsize) != 0) {
-            FAIL_MSG("create_and_populate_table: makeascii() failed\n");
-            return 8;
-        }
-
-
         if (make_label
             (ctx->table_widgets, ctx->hextable, ctx->tablecols, ctx->dsize,
              asciistr, ctx->tablecols + 1, j, 0, 1) != 0) {
             FAIL_MSG("create_and_populate_table: make_label() failed\n");
-            return 9;
-        }
-
-    }
-
-    /* unmap the memory */
-    if (ctx->type == BUF_TYPE_FD) {
-        if (unmapmem(ctx) != 0) {
-            FAIL_MSG("create_and_populate_table: unmapmem() failed\n");
-            return 10;
+            return 8;
         }
 
     }
 
-
     return 0;
 }
 
 
-/* makevalue makes a hexstring from the given index */
-int makevalue(struct hd_ctx *ctx, char *bytestr, int i, int j)
+/* makerow formats row j of the table in one pass: the values go into
+ * valuestr, HEXFMT_STRIDE apart, and the ascii column into asciistr.  The
+ * number of whole values in the row is returned through count.
+ */
+int makerow(struct hd_ctx *ctx, int j, int nudge, char *valuestr,
+            char *asciistr, int *count)
 {
-    int k;
-    unsigned long value;
     unsigned long loc;
-    int numbytes;
-    int nudge;
+    int avail;
+    uint8_t *data;
 
-    if (!ctx || !bytestr) {
-        FAIL_MSG("makevalue: invalid params\n");
+    if (!ctx || !valuestr || !asciistr || !count
+        || (ctx->cols * ctx->dsize > ASCIISIZE - 2)) {
+        FAIL_MSG("makerow: invalid params\n");
         return 1;
     }
 
 
-    value = 0;
-    nudge = (ctx->colnudge * ctx->dsize) + ctx->nudge;
-
-    /* calculate the location */
-    loc =
-        ctx->scroll_offset + nudge + (j * ctx->cols * ctx->dsize) +
-        ((i - 1) * ctx->dsize);
-    numbytes = ctx->dsize;
-
-    /* if there aren't enough bytes available, shorten the request */
-    if ((loc + numbytes) > ctx->bufsize) {
-        numbytes = ctx->bufsize - loc;
-    }
-    /* shift the bytes into the value */
-    if (ctx->endian == HD_BIG_ENDIAN) {
-        for (k = 0; k < numbytes; k++) {
-            value = (value << 8) | ctx->buf[loc + k];
-        }
-    } else {
-        for (k = numbytes - 1; k >= 0; k--) {
-            value = (value << 8) | ctx->buf[loc + k];
+    /* calculate the location and how much of the row is in range */
+    loc = ctx->scroll_offset + nudge + (j * ctx->cols * ctx->dsize);
+    avail = 0;
+    if (loc < ctx->bufsize) {
+        if (ctx->bufsize - loc > ctx->cols * ctx->dsize) {
+            avail = ctx->cols * ctx->dsize;
+        } else {
+            avail = ctx->bufsize - loc;
         }
     }
 
-    /* convert the value to a hexstring */
-    switch (ctx->dsize) {
-    case 1:
-        snprintf(bytestr, 4, " %02x", (uint8_t) value);
-        break;
-    case 2:
-        snprintf(bytestr, 6, " %04x", (uint16_t) value);
-        break;
-    case 4:
-        snprintf(bytestr, 10, " %08x", (uint32_t) value);
-        break;
-    case 8:
-#ifdef __linux__
-        snprintf(bytestr, 18, " %016lx", (uint64_t) value);
-#elif __APPLE__
-        snprintf(bytestr, 18, " %016llx", (uint64_t) value);
-#endif
-        break;
-    default:
-        fprintf(stderr, "makevalue: invalid dsize\n");
-        return 2;
-    }
-
-    return 0;
-}
-
-
-/* makeascii creates a printable ascii string from a buffer */
-int makeascii(char *asciistr, uint8_t * buf, int bufsize, int size)
-{
-    int i;
-    int max;
-
-    if (!asciistr || !buf || !size || (size > ASCIISIZE - 2)) {
-        FAIL_MSG("makeascii: invalid params\n");
-        return 1;
+    /* show the file being compared with if asked, which can be shorter */
+    data = ctx->buf;
+    if (ctx->side && ctx->fd2) {
+        data = ctx->other;
+        if (loc - ctx->buf_start >= ctx->otherlen) {
+            avail = 0;
+        } else if (loc - ctx->buf_start + avail > ctx->otherlen) {
+            avail = ctx->otherlen - (loc - ctx->buf_start);
+        }
     }
 
+    *count = 0;
+    if (avail > 0) {
+        if (hexfmt_row(valuestr, HEXFMT_STRIDE,
+                       data + (loc - ctx->buf_start), avail,
+                       ctx->dsize, ctx->endian) != 0) {
+            FAIL_MSG("makerow: hexfmt_row() failed\n");
+            return 2;
+        }
 
-    if (bufsize <= 0) {
-        memset(asciistr, ' ', size + 1);
-        asciistr[size + 1] = 0x00;
-        return 0;
-    }
-
-    /* calc buffer size */
-    if (bufsize > size) {
-        max = size;
-    } else {
-        max = bufsize;
-        /* clear remaining buffer */
-        memset(asciistr + max + 1, ' ', size - max);
+        *count = avail / ctx->dsize;
     }
 
-    /* insert a space before the ascii string */
-    asciistr[0] = ' ';
-
-    /* create printable ascii string */
-    for (i = 0; i < max; i++) {
-        if ((buf[i] >= 0x20) && (buf[i] < 0x7f)) {
-            asciistr[i + 1] = buf[i];
-        } else {
-            asciistr[i + 1] = '.';
-        }
+    if (hexfmt_ascii(asciistr, data + (loc - ctx->buf_start), avail,
+                     ctx->cols * ctx->dsize) != 0) {
+        FAIL_MSG("makerow: hexfmt_ascii() failed\n");
+        return 3;
     }
 
-    /* terminate it */
-    asciistr[size + 1] = 0x00;
 
     return 0;
 }
@@ -1478,10 +1868,16 @@ int constrain_nudge(struct hd_ctx *ctx)
 int populate(struct hd_ctx *ctx)
 {
     int i, j;
-    char addrstr[ADDRSIZE + 4];
-    char bytestr[ADDRSIZE + 4];
+    int count;
+    char addrstr[HEXFMT_ADDRSIZE];
+    char valuestr[(ASCIISIZE - 2) * HEXFMT_STRIDE];
+    char *bytestr;
     char asciistr[ASCIISIZE];
     int nudge;
+    unsigned long bytes = 0;
+    unsigned long loc;
+    int differ;
+    struct stats_mark mark;
     if (!ctx) {
         FAIL_MSG("populate: invalid params\n");
         return 1;
@@ -1498,23 +1894,62 @@ int populate(struct hd_ctx *ctx)
     /* calc nudge */
     nudge = (ctx->colnudge * ctx->dsize) + ctx->nudge;
 
-    /* map the memory */
+    stats_begin(&mark);
+
+    /* map the visible window */
     if (ctx->type == BUF_TYPE_FD) {
-        if (mapmem(ctx) != 0) {
+        if (mapmem(ctx, ctx->scroll_offset + nudge,
+                   ctx->scroll_offset + nudge +
+                   (ctx->rows * ctx->cols * ctx->dsize)) != 0) {
             FAIL_MSG("populate: mapmem() failed\n");
             return 2;
         }
 
+        /* and the same bytes of the file being compared with */
+        if (ctx->fd2
+            && (readother(ctx, ctx->scroll_offset + nudge +
+                          (ctx->rows * ctx->cols * ctx->dsize)) != 0)) {
+            FAIL_MSG("populate: readother() failed\n");
+            return 4;
+        }
+
     }
+
+    /* keep a mark for each label, to colour the values that differ */
+    if ((ctx->fd2 || ctx->marked)
+        && (ctx->nmarked != ctx->tablerows * (ctx->tablecols + 2))) {
+        free(ctx->marked);
+        ctx->nmarked = ctx->tablerows * (ctx->tablecols + 2);
+        ctx->marked = (uint8_t *) malloc(ctx->nmarked);
+        if (!ctx->marked) {
+            FAIL_MSG("populate: malloc() failed\n");
+            ctx->nmarked = 0;
+            return 5;
+        }
+
+        memset(ctx->marked, MARK_UNKNOWN, ctx->nmarked);
+    }
+
     /* loop for all rows */
     for (j = 0; j < ctx->rows; j++) {
+        count = 0;
         if (j < ctx->totalrows) {
             /* create address string */
-            snprintf(addrstr, ADDRSIZE + 4, "%016lx:",
-                     (long) (ctx->scroll_offset + nudge +
-                             (j * ctx->cols * ctx->dsize) + ctx->offset));
+            hexfmt_addr(addrstr,
+                        ctx->scroll_offset + nudge +
+                        (j * ctx->cols * ctx->dsize) + ctx->offset);
+
+            /* format the whole row */
+            if (makerow(ctx, j, nudge, valuestr, asciistr, &count) != 0) {
+                FAIL_MSG("populate: makerow() failed\n");
+                return 3;
+            }
+
+            bytes += count * ctx->dsize;
+
         } else {
             addrstr[0] = 0x00;
+            asciistr[0] = 0x00;
         }
         /* set the address label */
         gtk_label_set_text(GTK_LABEL
@@ -1523,44 +1958,42 @@ int populate(struct hd_ctx *ctx)
 
         /* loop for all columns */
         for (i = 1; i <= ctx->tablecols; i++) {
-            /* if location in range make value or empty string */
-            if ((i <= ctx->cols)
-                && (ctx->scroll_offset + nudge +
-                    (j * ctx->cols * ctx->dsize) + ((i - 1) * ctx->dsize) +
-                    ctx->dsize <= ctx->bufsize)) {
-                if (makevalue(ctx, bytestr, i, j) != 0) {
-                    FAIL_MSG("populate: makevalue() failed\n");
-                    return 3;
-                }
-
+            /* if location in range use the value, otherwise empty string */
+            if (i <= count) {
+                bytestr = valuestr + ((i - 1) * HEXFMT_STRIDE);
             } else {
-                bytestr[0] = 0x00;
+                bytestr = "";
             }
             /* set the label */
             gtk_label_set_text(GTK_LABEL
                                (ctx->table_widgets
                                 [(j * (ctx->tablecols + 2)) + i]),
                                bytestr);
-        }
-        /* add the ascii string */
 
-        if (j < ctx->totalrows) {
-            if (makeascii(asciistr,
-                          ctx->buf + ctx->scroll_offset + nudge +
-                          (j * ctx->cols * ctx->dsize),
-                          ctx->bufsize - ctx->scroll_offset - nudge -
-                          (j * ctx->cols * ctx->dsize),
-                          ctx->cols * ctx->dsize) != 0) {
-                FAIL_MSG("populate: makeascii() failed\n");
-                return 4;
+            if (!ctx->marked) {
+                continue;
             }
 
-        } else {
-            asciistr[0] = 0x00;
-        }
+            /* values past the end of the other file differ too */
+            differ = MARK_SAME;
+            if (ctx->fd2 && (ctx->type == BUF_TYPE_FD) && (i <= count)) {
+                loc = ctx->scroll_offset + nudge +
+                    (j * ctx->cols * ctx->dsize) + ((i - 1) * ctx->dsize) -
+                    ctx->buf_start;
+                if ((loc + ctx->dsize > ctx->otherlen)
+                    || memcmp(ctx->buf + loc, ctx->other + loc,
+                              ctx->dsize)) {
+                    differ = MARK_DIFF;
+                }
+            }
+            if (mark_value(ctx, i, j, differ) != 0) {
+                FAIL_MSG("populate: mark_value() failed\n");
+                return 6;
+            }
 
-        /* set the label */
+        }
 
+        /* set the ascii label */
         gtk_label_set_text(GTK_LABEL
                            (ctx->table_widgets[(j * (ctx->tablecols + 2)) +
                                                ctx->tablecols + 1]),
@@ -1568,24 +2001,18 @@ int populate(struct hd_ctx *ctx)
 
     }
     /* fill in the hidden labels for nicer redraws */
-    bytestr[0] = 0x00;
     for (j = ctx->rows; j < ctx->tablerows; j++) {
         for (i = 0; i < ctx->tablecols + 2; i++) {
             gtk_label_set_text(GTK_LABEL
                                (ctx->table_widgets
-                                [(j * (ctx->tablecols + 2)) + i]),
-                               bytestr);
+                                [(j * (ctx->tablecols + 2)) + i]), "");
         }
     }
 
-    /* unmap the memory */
-    if (ctx->type == BUF_TYPE_FD) {
-        if (unmapmem(ctx) != 0) {
-            FAIL_MSG("populate: unmapmem() failed\n");
-            return 5;
-        }
+    /* the labels stand in for pixels */
+    stats_add(STATS_POPULATE, bytes, ctx->tablerows * (ctx->tablecols + 2));
+    stats_end(STATS_POPULATE, &mark);
 
-    }
     return 0;
 }
 
@@ -1595,6 +2022,7 @@ int hexdump_display(void *rawctx)
 {
     struct hd_ctx *ctx = (struct hd_ctx *) rawctx;
     GtkWidget *menubar;
+    PangoFontDescription *pfd;
 
     if (!ctx) {
         FAIL_MSG("hexdump_display: invalid params\n");
@@ -1614,7 +2042,10 @@ int hexdump_display(void *rawctx)
         return 2;
     }
 
-    gtk_window_set_title(GTK_WINDOW(ctx->window), "Hexdump");
+    if (set_hd_title(ctx) != 0) {
+        FAIL_MSG("hexdump_display: set_hd_title() failed\n");
+        return 2;
+    }
 
     /* catch the destroy event */
     if (!g_signal_connect
@@ -1715,6 +2146,21 @@ int hexdump_display(void *rawctx)
     }
 
 
+    /* drawing statistics, hidden until asked for */
+    ctx->stats = gtk_label_new("");
+    if (!ctx->stats) {
+        FAIL_MSG("hexdump_display: gtk_label_new() failed\n");
+        return 15;
+    }
+
+    gtk_misc_set_alignment(GTK_MISC(ctx->stats), 0, 0);
+    pfd = pango_font_description_from_string("Monospace 8");
+    if (pfd) {
+        gtk_widget_modify_font(ctx->stats, pfd);
+        pango_font_description_free(pfd);
+    }
+    gtk_box_pack_start(GTK_BOX(ctx->vbox), ctx->stats, FALSE, FALSE, 0);
+
     /* make the initial table */
     if (create_and_populate_table(ctx) != 0) {
         FAIL_MSG("hexdump_display: create_and_populate_table() failed\n");
@@ -1746,6 +2192,8 @@ int main(int argc, char *argv[])
 {
     struct hd_ctx *ctx = NULL;
     struct stat stattmp;
+    char shmpath[256];
+    char *arg;
 
     if (argc != 2) {
         printf
@@ -1755,15 +2203,35 @@ int main(int argc, char *argv[])
 
     gtk_init(&argc, &argv);
 
-    if (!strncmp(argv[1], "/rb_shm.", 8)) {
+    /* a zygote gets GTK and the font ready and then waits to be given the
+     * shm name */
+    arg = argv[1];
+    if (strcmp(argv[1], SHM_ZYGOTE_ARG) == 0) {
+        ctx = hexdump_init(600, 600, 200, 200);
+        if (!ctx) {
+            FAIL_MSG("main: hexdump_init() failed\n");
+            return 5;
+        }
+
+        if (shm_zygote_wait(shmpath, sizeof(shmpath)) != 0) {
+            exit(0);
+        }
+        arg = shmpath;
+    }
+
+    if (!strncmp(arg, "/rb_shm.", 8)) {
 
         /* argument is named shared memory buffer */
 		shm_destroy = 0;
-        if (shm_open_buffer(argv[1], &shm, &sem) != 0) {
+        if (shm_open_buffer(arg, &shm, &sem) != 0) {
             FAIL_MSG("main: shm_open_buffer() failed\n");
             return 2;
         }
 
+        /* with the config rubbermarbles has read, and its memory budget */
+        conf_attach(shm);
+        budget_attach(shm, "rb-hexdump");
+
     } else {
 
         /* argument is a file */
@@ -1773,12 +2241,12 @@ int main(int argc, char *argv[])
             return 3;
         }
 
-        if (stat(argv[1], &stattmp) != 0) {
-            FAIL_ERR("main: stat() failed\n");
+        if (blkdev_stat(arg, &stattmp) != 0) {
+            FAIL_MSG("main: blkdev_stat() failed\n");
             return 4;
         }
 
-        strncpy(shm->filename, argv[1], PATH_MAX - 1);
+        strncpy(shm->filename, arg, PATH_MAX - 1);
         shm->filename[PATH_MAX - 1] = 0x00;
         shm->offset = 0;
         shm->bufsize = stattmp.st_size;
@@ -1788,13 +2256,14 @@ int main(int argc, char *argv[])
     }
 
 
-
-    ctx = hexdump_init(600, 600, 200, 200);
     if (!ctx) {
-        FAIL_MSG("main: hexdump_init() failed\n");
-        return 5;
-    }
+        ctx = hexdump_init(600, 600, 200, 200);
+        if (!ctx) {
+            FAIL_MSG("main: hexdump_init() failed\n");
+            return 5;
+        }
 
+    }
 
     gctx = ctx;
 
@@ -1806,9 +2275,9 @@ int main(int argc, char *argv[])
     }
 
 
-    /* stat it */
-    if (fstat(ctx->fd, &(ctx->filestat)) != 0) {
-        FAIL_ERR("main: cannot stat file\n");
+    /* stat it, sizing block devices */
+    if (blkdev_fstat(ctx->fd, &(ctx->filestat)) != 0) {
+        FAIL_MSG("main: cannot stat file\n");
         return 7;
     }
 
@@ -1845,6 +2314,26 @@ int main(int argc, char *argv[])
     }
 
 
+    /* count where the drawing time goes; RB_STATS dumps it */
+    if (stats_init("rb-hexdump") != 0) {
+        FAIL_MSG("main: stats_init() failed\n");
+        return 13;
+    }
+
+
+    if (g_timeout_add(STATS_HUD_MS, stats_timer, ctx) <= 0) {
+        FAIL_ERR("main: g_timeout_add() failed\n");
+        return 14;
+    }
+
+
+    /* RB_TRACE adds this process to the main window's trace */
+    if (trace_init("rb-hexdump", 0) != 0) {
+        FAIL_MSG("main: trace_init() failed\n");
+        return 15;
+    }
+
+
     gtk_main();
 
 	cleanup();
@@ -24,6 +24,11 @@
 #include "rb-shm.h"
 #include "macro.h"
 #include "rb-conf.h"
+#include "rb-hexfmt.h"
+#include "rb-blkdev.h"
+#include "rb-stats.h"
+#include "rb-trace.h"
+#include "rb-budget.h"
 
 /* size of a character */
 #ifdef __linux__
@@ -38,7 +43,10 @@
 #define SCROLLWIDTH 18
 #define BYTECOLWIDTH 3
 #define MENUHEIGHT 21
+/* room for the drawing statistics under the table */
+#define STATSHEIGHT 30
 #define ASCIISIZE 258
+#define HD_PREFETCH (256 * 1024)       /* bytes mapped either side of the view */
 
 #define NUDGE_LEFT 0
 #define NUDGE_RIGHT 1
@@ -52,6 +60,11 @@
 #define HD_LITTLE_ENDIAN 0
 #define HD_BIG_ENDIAN 1
 
+/* how a value compares with the file being compared with */
+#define MARK_SAME 0
+#define MARK_DIFF 1
+#define MARK_UNKNOWN 2
+
 struct hd_ctx {
     /* window dims */
     int xsize;
@@ -81,6 +94,8 @@ struct hd_ctx {
     GtkWidget **table_widgets;
     GtkObject *adj;
     GtkWidget *scroll;
+    GtkWidget *stats;
+    int stats_show;
 
     /* data buffer */
 	int fd;
@@ -88,11 +103,24 @@ struct hd_ctx {
     uint8_t *buf;
     unsigned long bufsize;
     unsigned long offset;
+    unsigned long buf_start;
     unsigned int type;
     unsigned int dsize;
     unsigned int endian;
 	char shmname[256];
 	
+    /* the file being compared with, if any */
+    int fd2;
+    unsigned long compare_seq;
+    char othername[PATH_MAX];
+    long delta;                 /* where the selection is in it */
+    int side;                   /* show its bytes instead */
+    uint8_t *other;             /* its bytes in the visible window */
+    unsigned long otherlen;
+    unsigned long othersize;
+    uint8_t *marked;            /* how each value label is coloured */
+    int nmarked;
+
     /* scroll */
     unsigned long scroll_offset;
     int nudge;
@@ -101,6 +129,7 @@ struct hd_ctx {
     /* mmap section */
     unsigned long mmap_offset;
     unsigned long mmap_size;
+    unsigned long mmap_reserved;        /* from the memory budget */
     uint8_t *mmap_ptr;
 
 	int reload;
@@ -121,6 +150,11 @@ void change_dsize(gpointer data, guint action, GtkWidget * widget);
 void change_endian(gpointer data, guint action, GtkWidget * widget);
 void set_nudge(gpointer data, guint action, GtkWidget * widget);
 void set_update(gpointer data, guint action, GtkWidget * widget);
+void hide_stats(gpointer data, guint action, GtkWidget * widget);
+gboolean stats_timer(gpointer data);
+void export_text(gpointer data, guint action, GtkWidget * widget);
+void show_other(gpointer data, guint action, GtkWidget * widget);
+int set_hd_title(struct hd_ctx *ctx);
 GtkWidget *hd_menubar_menu(struct hd_ctx *ctx);
 void quit_local(gpointer data, guint action, GtkWidget * widget);
 gboolean destroy_local(GtkWidget * widget, gpointer data);
@@ -143,12 +177,15 @@ int make_label(GtkWidget ** table, GtkWidget * hextable, int cols,
                int setfont);
 int enlarge_table(struct hd_ctx *ctx, int pcols, int prows);
 int copyshm(struct hd_ctx *ctx);
-int mapmem(struct hd_ctx *ctx);
+int open_other(struct hd_ctx *ctx);
+int readother(struct hd_ctx *ctx, unsigned long end);
+int mark_value(struct hd_ctx *ctx, int i, int j, int mark);
+int mapmem(struct hd_ctx *ctx, unsigned long start, unsigned long end);
 int unmapmem(struct hd_ctx *ctx);
 int set_col_cols(struct hd_ctx *ctx);
 int create_table(struct hd_ctx *ctx);
-int makevalue(struct hd_ctx *ctx, char *bytestr, int i, int j);
-int makeascii(char *asciistr, uint8_t * buf, int bufsize, int size);
+int makerow(struct hd_ctx *ctx, int j, int nudge, char *valuestr,
+            char *asciistr, int *count);
 int constrain_nudge(struct hd_ctx *ctx);
 int populate(struct hd_ctx *ctx);
 int cleanup();
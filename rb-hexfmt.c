@@ -0,0 +1,475 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-hexfmt.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to format rows of data as hex values, printable
+ * ascii and addresses, a whole row at a time.  Uses a pshufb nibble to
+ * hex conversion on x86 processors that support SSSE3 and lookup tables
+ * everywhere else.
+ */
+
+#include "rb-hexfmt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEXFMT_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+
+static const char hexfmt_digits[16] = "0123456789abcdef";
+
+/* byte order of each element, by log2(dsize), for little endian values */
+static const uint8_t hexfmt_rev[4][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}
+};
+
+static char hexfmt_pairs[256][2];
+static char hexfmt_print[256];
+static int hexfmt_ready = 0;
+static int hexfmt_simd = 0;
+
+
+/* hexfmt_init builds the lookup tables and picks the fastest row formatter */
+void hexfmt_init()
+{
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        hexfmt_pairs[i][0] = hexfmt_digits[i >> 4];
+        hexfmt_pairs[i][1] = hexfmt_digits[i & 0x0f];
+        if ((i >= 0x20) && (i < 0x7f)) {
+            hexfmt_print[i] = i;
+        } else {
+            hexfmt_print[i] = '.';
+        }
+    }
+
+#ifdef HEXFMT_X86
+    __builtin_cpu_init();
+    hexfmt_simd = __builtin_cpu_supports("ssse3");
+#endif
+
+    hexfmt_ready = 1;
+}
+
+
+/* hexfmt_log2 returns log2 of a valid dsize, or -1 */
+static int hexfmt_log2(int dsize)
+{
+    switch (dsize) {
+    case 1:
+        return 0;
+    case 2:
+        return 1;
+    case 4:
+        return 2;
+    case 8:
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+
+/* hexfmt_scatter copies hex digit pairs into per-value strings */
+static inline void hexfmt_scatter(char *out, int stride, const char *hex,
+                                  int elements, int dsize)
+{
+    int e;
+
+    for (e = 0; e < elements; e++) {
+        out[0] = ' ';
+        memcpy(out + 1, hex, 2 * dsize);
+        out[1 + (2 * dsize)] = 0x00;
+        out += stride;
+        hex += 2 * dsize;
+    }
+}
+
+
+#ifdef HEXFMT_X86
+/* hexfmt_block_ssse3 formats 16 bytes with shuffles; each nibble indexes
+ * the digit table through pshufb and the pairs are interleaved back into
+ * byte order.
+ */
+__attribute__ ((target("ssse3")))
+static void hexfmt_block_ssse3(char *out, int stride, const uint8_t * buf,
+                               int dsize, int order)
+{
+    __m128i v, hi, lo, mask, digits;
+    char hex[32];
+
+    v = _mm_loadu_si128((const __m128i *) buf);
+    if (order) {
+        v = _mm_shuffle_epi8(v,
+                             _mm_loadu_si128((const __m128i *)
+                                             hexfmt_rev[order]));
+    }
+
+    mask = _mm_set1_epi8(0x0f);
+    digits = _mm_loadu_si128((const __m128i *) hexfmt_digits);
+    lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, mask));
+    hi = _mm_shuffle_epi8(digits,
+                          _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+
+    _mm_storeu_si128((__m128i *) hex, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *) (hex + 16), _mm_unpackhi_epi8(hi, lo));
+
+    hexfmt_scatter(out, stride, hex, 16 / dsize, dsize);
+}
+#endif
+
+
+/* hexfmt_block_table formats whole values using the pair table */
+static void hexfmt_block_table(char *out, int stride, const uint8_t * buf,
+                               int elements, int dsize, int endian)
+{
+    int e, k;
+    char *p;
+
+    for (e = 0; e < elements; e++) {
+        p = out + 1;
+        out[0] = ' ';
+        if (endian == HEXFMT_BIG_ENDIAN) {
+            for (k = 0; k < dsize; k++) {
+                memcpy(p, hexfmt_pairs[buf[k]], 2);
+                p += 2;
+            }
+        } else {
+            for (k = dsize - 1; k >= 0; k--) {
+                memcpy(p, hexfmt_pairs[buf[k]], 2);
+                p += 2;
+            }
+        }
+        *p = 0x00;
+        out += stride;
+        buf += dsize;
+    }
+}
+
+
+/* hexfmt_addr writes a 16 digit address followed by a colon */
+int hexfmt_addr(char *out, uint64_t addr)
+{
+    int i;
+
+    if (!out) {
+        FAIL_MSG("hexfmt_addr: invalid params\n");
+        return 1;
+    }
+
+
+    if (!hexfmt_ready) {
+        hexfmt_init();
+    }
+
+    for (i = 0; i < 8; i++) {
+        memcpy(out + (i * 2), hexfmt_pairs[(addr >> (56 - (i * 8))) & 0xff],
+               2);
+    }
+    out[16] = ':';
+    out[17] = 0x00;
+
+    return 0;
+}
+
+
+/* hexfmt_row formats count bytes as count / dsize values of dsize bytes.
+ * Value k is written as " %0*x" to out + (k * stride); stride must be at
+ * least (2 * dsize) + 2.  Trailing bytes that don't make a whole value are
+ * ignored.
+ */
+int hexfmt_row(char *out, int stride, const uint8_t * buf, int count,
+               int dsize, int endian)
+{
+    int order;
+    int elements;
+    int done;
+
+    order = hexfmt_log2(dsize);
+    if (!out || !buf || (count < 0) || (order < 0)
+        || (stride < (2 * dsize) + 2)
+        || ((endian != HEXFMT_LITTLE_ENDIAN)
+            && (endian != HEXFMT_BIG_ENDIAN))) {
+        FAIL_MSG("hexfmt_row: invalid params\n");
+        return 1;
+    }
+
+
+    if (!hexfmt_ready) {
+        hexfmt_init();
+    }
+
+    elements = count / dsize;
+    done = 0;
+
+#ifdef HEXFMT_X86
+    if (hexfmt_simd) {
+        if (endian == HEXFMT_BIG_ENDIAN) {
+            order = 0;
+        }
+        /* 16 bytes at a time */
+        while ((elements - done) * dsize >= 16) {
+            hexfmt_block_ssse3(out + (done * stride), stride,
+                               buf + (done * dsize), dsize, order);
+            done += 16 / dsize;
+        }
+    }
+#endif
+
+    /* whatever is left */
+    hexfmt_block_table(out + (done * stride), stride, buf + (done * dsize),
+                       elements - done, dsize, endian);
+
+    return 0;
+}
+
+
+/* hexfmt_ascii creates a printable ascii string from count bytes of the
+ * buffer.  The string starts with a space and is padded with spaces to
+ * size characters, as the hexdump ascii column expects.
+ */
+int hexfmt_ascii(char *out, const uint8_t * buf, int count, int size)
+{
+    int i;
+
+    if (!out || (!buf && (count > 0)) || (size <= 0)) {
+        FAIL_MSG("hexfmt_ascii: invalid params\n");
+        return 1;
+    }
+
+
+    if (!hexfmt_ready) {
+        hexfmt_init();
+    }
+
+    if (count < 0) {
+        count = 0;
+    }
+    if (count > size) {
+        count = size;
+    }
+
+    out[0] = ' ';
+    i = 0;
+
+#ifdef __SSE2__
+    {
+        __m128i v, printable, lower, upper, dots;
+
+        lower = _mm_set1_epi8(0x1f);
+        upper = _mm_set1_epi8(0x7f);
+        dots = _mm_set1_epi8('.');
+
+        /* bytes above 0x7f are negative when compared as signed */
+        for (; i + 16 <= count; i += 16) {
+            v = _mm_loadu_si128((const __m128i *) (buf + i));
+            printable = _mm_and_si128(_mm_cmpgt_epi8(v, lower),
+                                      _mm_cmplt_epi8(v, upper));
+            v = _mm_or_si128(_mm_and_si128(printable, v),
+                             _mm_andnot_si128(printable, dots));
+            _mm_storeu_si128((__m128i *) (out + 1 + i), v);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i + 1] = hexfmt_print[buf[i]];
+    }
+
+    /* pad and terminate */
+    memset(out + 1 + count, ' ', size - count);
+    out[size + 1] = 0x00;
+
+    return 0;
+}
+
+
+/* hexfmt_line formats a whole text line, as shown in the hexdump window:
+ * address, values and ascii, terminated with a newline.  rowbytes is the
+ * width of a full row so that short rows keep the ascii column aligned.
+ * Bytes at the end that don't make a whole value are shown in file order,
+ * with a dot for each missing digit.
+ */
+int hexfmt_line(char *out, uint64_t addr, const uint8_t * buf, int count,
+                int rowbytes, int dsize, int endian)
+{
+    char values[HEXFMT_MAXROW * 4];
+    int elements;
+    int vallen;
+    int rest;
+    int e;
+    char *p;
+
+    if (!out || !buf || (count < 0) || (rowbytes <= 0)
+        || (rowbytes > HEXFMT_MAXROW) || (count > rowbytes)
+        || (hexfmt_log2(dsize) < 0) || (rowbytes % dsize)) {
+        FAIL_MSG("hexfmt_line: invalid params\n");
+        return -1;
+    }
+
+
+    if (hexfmt_addr(out, addr) != 0) {
+        FAIL_MSG("hexfmt_line: hexfmt_addr() failed\n");
+        return -1;
+    }
+
+    p = out + 17;
+
+    /* values are packed without their NULs */
+    vallen = (2 * dsize) + 1;
+    elements = count / dsize;
+    if (hexfmt_row(values, vallen + 1, buf, count, dsize, endian) != 0) {
+        FAIL_MSG("hexfmt_line: hexfmt_row() failed\n");
+        return -1;
+    }
+
+    for (e = 0; e < elements; e++) {
+        memcpy(p, values + (e * (vallen + 1)), vallen);
+        p += vallen;
+    }
+
+    /* the end of the file may not be a whole value */
+    rest = count - (elements * dsize);
+    if (rest) {
+        *p++ = ' ';
+        for (e = 0; e < rest; e++) {
+            memcpy(p, hexfmt_pairs[buf[(elements * dsize) + e]], 2);
+            p += 2;
+        }
+        memset(p, '.', 2 * (dsize - rest));
+        p += 2 * (dsize - rest);
+        elements++;
+    }
+
+    memset(p, ' ', ((rowbytes / dsize) - elements) * vallen);
+    p += ((rowbytes / dsize) - elements) * vallen;
+
+    if (hexfmt_ascii(p, buf, count, count) != 0) {
+        FAIL_MSG("hexfmt_line: hexfmt_ascii() failed\n");
+        return -1;
+    }
+
+    p += count + 1;
+    *p++ = '\n';
+    *p = 0x00;
+
+    return p - out;
+}
+
+
+/* hexfmt_export streams size bytes of the file from offset as hexdump text */
+int hexfmt_export(FILE * out, int fd, unsigned long offset,
+                  unsigned long size, int rowbytes, int dsize, int endian)
+{
+    uint8_t *inbuf;
+    char *outbuf;
+    unsigned long chunk;
+    unsigned long done;
+    unsigned long want;
+    unsigned long got;
+    unsigned long outsize;
+    unsigned long outlen;
+    unsigned long pos;
+    ssize_t ret;
+    int count;
+    int len;
+
+    if (!out || (fd < 0) || (rowbytes <= 0) || (rowbytes > HEXFMT_MAXROW)
+        || (hexfmt_log2(dsize) < 0) || (rowbytes % dsize)) {
+        FAIL_MSG("hexfmt_export: invalid params\n");
+        return 1;
+    }
+
+
+    /* whole rows per read so lines never straddle chunks */
+    chunk = (HEXFMT_EXPORT_CHUNK / rowbytes) * rowbytes;
+    outsize = (chunk / rowbytes) * HEXFMT_LINESIZE;
+
+    inbuf = (uint8_t *) malloc(chunk);
+    if (!inbuf) {
+        FAIL_MSG("hexfmt_export: malloc() failed\n");
+        return 2;
+    }
+
+
+    outbuf = (char *) malloc(outsize);
+    if (!outbuf) {
+        FAIL_MSG("hexfmt_export: malloc() failed\n");
+        free(inbuf);
+        return 3;
+    }
+
+
+    done = 0;
+    while (done < size) {
+        want = size - done;
+        if (want > chunk) {
+            want = chunk;
+        }
+
+        /* fill the chunk */
+        got = 0;
+        while (got < want) {
+            ret = pread(fd, inbuf + got, want - got, offset + done + got);
+            if (ret < 0) {
+                FAIL_ERR("hexfmt_export: pread() failed\n");
+                free(inbuf);
+                free(outbuf);
+                return 4;
+            }
+            if (ret == 0) {
+                break;
+            }
+            got += ret;
+        }
+
+        /* format it */
+        outlen = 0;
+        for (pos = 0; pos < got; pos += rowbytes) {
+            count = rowbytes;
+            if (got - pos < rowbytes) {
+                count = got - pos;
+            }
+            len = hexfmt_line(outbuf + outlen, offset + done + pos,
+                              inbuf + pos, count, rowbytes, dsize, endian);
+            if (len < 0) {
+                FAIL_MSG("hexfmt_export: hexfmt_line() failed\n");
+                free(inbuf);
+                free(outbuf);
+                return 5;
+            }
+            outlen += len;
+        }
+
+        if (fwrite(outbuf, 1, outlen, out) != outlen) {
+            FAIL_ERR("hexfmt_export: fwrite() failed\n");
+            free(inbuf);
+            free(outbuf);
+            return 6;
+        }
+
+
+        done += got;
+        if (got < want) {
+            break;
+        }
+    }
+
+    free(inbuf);
+    free(outbuf);
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-hexfmt.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_HEXFMT_H
+#define _RB_HEXFMT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "macro.h"
+
+#define HEXFMT_LITTLE_ENDIAN 0
+#define HEXFMT_BIG_ENDIAN 1
+
+/* room for one formatted value: space, 16 hex digits and a NUL */
+#define HEXFMT_STRIDE 18
+/* room for an address: 16 hex digits, colon and a NUL */
+#define HEXFMT_ADDRSIZE 18
+/* largest row, in bytes, that hexfmt_line() will format */
+#define HEXFMT_MAXROW 256
+/* room for a whole line from hexfmt_line() */
+#define HEXFMT_LINESIZE (HEXFMT_ADDRSIZE + (4 * HEXFMT_MAXROW) + 4)
+/* size of the read buffer used by hexfmt_export() */
+#define HEXFMT_EXPORT_CHUNK (4 * 1024 * 1024)
+
+void hexfmt_init();
+int hexfmt_addr(char *out, uint64_t addr);
+int hexfmt_row(char *out, int stride, const uint8_t * buf, int count,
+               int dsize, int endian);
+int hexfmt_ascii(char *out, const uint8_t * buf, int count, int size);
+int hexfmt_line(char *out, uint64_t addr, const uint8_t * buf, int count,
+                int rowbytes, int dsize, int endian);
+int hexfmt_export(FILE * out, int fd, unsigned long offset,
+                  unsigned long size, int rowbytes, int dsize, int endian);
+
+#endif
@@ -13,6 +13,8 @@
  * Provides functions to map between linear locations and two
  * dimensional co-ordinates in a Hilbert plot.
  * Code taken from Wikipedia.
+ * And in a Z-order (Morton) plot, where the mapping is pdep/pext when
+ * built for BMI2 (-mbmi2) and a few shifts and masks otherwise.
  */
 
 #include "rb-hilbert.h"
@@ -87,3 +89,86 @@ int d2xy(int n, int d, int *x, int *y)
 
     return 0;
 }
+
+
+/* xy2d_long is xy2d for curves of more than 2^31 points, for the deep zoom
+ * tiles of big files */
+unsigned long xy2d_long(unsigned long n, unsigned long x, unsigned long y)
+{
+    unsigned long rx, ry, s, t, d = 0;
+
+    for (s = n / 2; s > 0; s /= 2) {
+        rx = (x & s) > 0;
+        ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+
+#ifndef __BMI2__
+/* morton_compact gathers the even bits of v into the low half */
+static uint32_t morton_compact(uint32_t v)
+{
+    v &= MORTON_X;
+    v = (v | (v >> 1)) & 0x33333333U;
+    v = (v | (v >> 2)) & 0x0f0f0f0fU;
+    v = (v | (v >> 4)) & 0x00ff00ffU;
+    v = (v | (v >> 8)) & 0x0000ffffU;
+    return v;
+}
+
+
+/* morton_spread spreads the low half of v into the even bits */
+static uint32_t morton_spread(uint32_t v)
+{
+    v &= 0x0000ffffU;
+    v = (v | (v << 8)) & 0x00ff00ffU;
+    v = (v | (v << 4)) & 0x0f0f0f0fU;
+    v = (v | (v << 2)) & 0x33333333U;
+    v = (v | (v << 1)) & MORTON_X;
+    return v;
+}
+#endif
+
+
+/* morton_d2xy finds the co-ordinates of point d in a Z-order plot */
+int morton_d2xy(int d, int *x, int *y)
+{
+    if (!x || !y || (d < 0)) {
+        FAIL_MSG("morton_d2xy: invalid params\n");
+        return 1;
+    }
+
+
+#ifdef __BMI2__
+    *x = _pext_u32((uint32_t) d, MORTON_X);
+    *y = _pext_u32((uint32_t) d, MORTON_Y);
+#else
+    *x = morton_compact((uint32_t) d);
+    *y = morton_compact((uint32_t) d >> 1);
+#endif
+
+    return 0;
+}
+
+
+/* morton_xy2d finds the point at x, y in a Z-order plot */
+int morton_xy2d(int x, int y)
+{
+#ifdef __BMI2__
+    return _pdep_u32((uint32_t) x, MORTON_X) |
+        _pdep_u32((uint32_t) y, MORTON_Y);
+#else
+    return morton_spread((uint32_t) x) | (morton_spread((uint32_t) y) << 1);
+#endif
+}
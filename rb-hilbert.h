@@ -17,10 +17,22 @@
 #define _RB_HILBERT_H
 
 #include <stdio.h>
+#include <stdint.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 #include "macro.h"
 
+/* in a Z-order (Morton) plot, x is in the even bits of a point's index
+ * and y in the odd ones */
+#define MORTON_X 0x55555555U
+#define MORTON_Y 0xaaaaaaaaU
+
 int rot(int n, int *x, int *y, int rx, int ry);
 int xy2d(int n, int x, int y);
 int d2xy(int n, int d, int *x, int *y);
+unsigned long xy2d_long(unsigned long n, unsigned long x, unsigned long y);
+int morton_d2xy(int d, int *x, int *y);
+int morton_xy2d(int x, int y);
 
 #endif
@@ -0,0 +1,619 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-hist.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to count the bytes of any range of the file without
+ * reading it.  The file is streamed through rb_scan() once, counting each
+ * byte value in each block, and the counts are then summed in file order
+ * so that each block holds the counts of everything before it.  A range's
+ * counts are the difference of the counts at its two ends, and an end in
+ * the middle of a block is found by reading whichever side of it is
+ * nearer the block's edge: no query reads more than one block, however
+ * big the range.  When the file grows or changes in place only the blocks
+ * affected are read again, and the counts after them moved along.
+ */
+
+#include "rb-hist.h"
+
+
+/* hist_count adds the byte counts of buf to counts */
+static void hist_count(const uint8_t * buf, unsigned long len,
+                       uint64_t * counts)
+{
+    uint32_t hist[4][256];
+    unsigned long i;
+    int c;
+
+    /* four histograms so that runs of one byte don't stall on a counter */
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i + 4 <= len; i += 4) {
+        hist[0][buf[i]]++;
+        hist[1][buf[i + 1]]++;
+        hist[2][buf[i + 2]]++;
+        hist[3][buf[i + 3]]++;
+    }
+    for (; i < len; i++) {
+        hist[0][buf[i]]++;
+    }
+
+    for (c = 0; c < 256; c++) {
+        counts[c] += (uint64_t) hist[0][c] + hist[1][c] + hist[2][c] +
+            hist[3][c];
+    }
+}
+
+
+/* hist_scan is the scan callback; it counts the bytes of each block in the
+ * chunk.  A block bigger than a chunk is added to by several threads. */
+static int hist_scan(void *arg, int thread, unsigned long block,
+                     unsigned long offset, const uint8_t * buf,
+                     unsigned long len, unsigned long total)
+{
+    struct hist_ctx *ctx = (struct hist_ctx *) arg;
+    uint64_t counts[256];
+    unsigned long pos, size, b;
+    int c;
+
+    for (pos = 0; pos < len; pos += size) {
+        b = (offset + pos) / ctx->blocksize;
+        size = ((b + 1) * ctx->blocksize) - (offset + pos);
+        if (size > len - pos) {
+            size = len - pos;
+        }
+
+        memset(counts, 0, sizeof(counts));
+        hist_count(buf + pos, size, counts);
+
+        for (c = 0; c < 256; c++) {
+            if (counts[c]) {
+                __atomic_add_fetch(&ctx->counts[(b * 256) + c],
+                                   (uint32_t) counts[c], __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/* hist_layout works out the number of blocks and spans for the block size,
+ * and what they take */
+static void hist_layout(struct hist_ctx *ctx)
+{
+    ctx->nblocks = (ctx->size + ctx->blocksize - 1) / ctx->blocksize;
+    ctx->span = HIST_SPAN / ctx->blocksize;
+    ctx->reserved = ((ctx->nblocks + 1) * 256 * sizeof(uint32_t)) +
+        (((ctx->nblocks / ctx->span) + 1) * 256 * sizeof(uint64_t)) +
+        HIST_READ_SIZE;
+}
+
+
+/* hist_new makes an empty index for a file of size bytes */
+struct hist_ctx *hist_new(unsigned long size)
+{
+    struct hist_ctx *ctx;
+
+    if (!size) {
+        FAIL_MSG("hist_new: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct hist_ctx *) calloc(1, sizeof(struct hist_ctx));
+    if (!ctx) {
+        FAIL_MSG("hist_new: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->size = size;
+    ctx->blocksize = HIST_BLOCK_SIZE;
+    hist_layout(ctx);
+
+    /* bigger blocks, and so a smaller index and slower edges, if the
+     * memory budget is short */
+    while (budget_reserve(BUDGET_CACHE, ctx->reserved) != 0) {
+        if (ctx->blocksize >= HIST_MAX_BLOCK) {
+            budget_charge(BUDGET_CACHE, ctx->reserved);
+            break;
+        }
+        ctx->blocksize *= 2;
+        hist_layout(ctx);
+    }
+
+    /* the end of the file has counts too, of nothing until summed */
+    ctx->counts = (uint32_t *) calloc((ctx->nblocks + 1) * 256,
+                                      sizeof(uint32_t));
+    ctx->spans = (uint64_t *) malloc(((ctx->nblocks / ctx->span) + 1) *
+                                     256 * sizeof(uint64_t));
+    ctx->edge = (uint8_t *) malloc(HIST_READ_SIZE);
+    if (!ctx->counts || !ctx->spans || !ctx->edge) {
+        FAIL_MSG("hist_new: malloc() failed\n");
+        free(ctx->counts);
+        free(ctx->spans);
+        free(ctx->edge);
+        budget_release(BUDGET_CACHE, ctx->reserved);
+        free(ctx);
+        return NULL;
+    }
+
+
+    return ctx;
+}
+
+
+/* hist_start counts the file's bytes in the background */
+int hist_start(struct hist_ctx *ctx, int fd)
+{
+    if (!ctx || (fd < 0)) {
+        FAIL_MSG("hist_start: invalid params\n");
+        return 1;
+    }
+
+
+    if (rb_scan_init(&ctx->scan, fd, 0, ctx->size, SCAN_BLOCK_SIZE, 0,
+                     hist_scan, ctx) != 0) {
+        FAIL_MSG("hist_start: rb_scan_init() failed\n");
+        return 2;
+    }
+
+
+    if (rb_scan_start(&ctx->scan) != 0) {
+        FAIL_MSG("hist_start: rb_scan_start() failed\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* hist_sum turns each block's counts into the counts before it */
+static void hist_sum(struct hist_ctx *ctx)
+{
+    uint64_t total[256];
+    uint32_t run[256];
+    uint32_t *counts;
+    unsigned long b;
+    int c;
+
+    memset(total, 0, sizeof(total));
+    for (b = 0; b <= ctx->nblocks; b++) {
+        if (!(b % ctx->span)) {
+            memcpy(ctx->spans + ((b / ctx->span) * 256), total,
+                   sizeof(total));
+            memset(run, 0, sizeof(run));
+        }
+
+        counts = ctx->counts + (b * 256);
+        for (c = 0; c < 256; c++) {
+            total[c] += counts[c];
+            run[c] += counts[c];
+            counts[c] = run[c] - counts[c];
+        }
+    }
+}
+
+
+/* hist_finished returns whether the counting has ended, and sums the
+ * counts the first time it has */
+int hist_finished(struct hist_ctx *ctx)
+{
+    if (!ctx || ctx->summed) {
+        return 1;
+    }
+
+    if (!__atomic_load_n(&ctx->scan.finished, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    /* a scan that failed leaves the index unusable */
+    if (rb_scan_wait(&ctx->scan) != 0) {
+        FAIL_MSG("hist_finished: rb_scan_wait() failed\n");
+        ctx->summed = -1;
+        return 1;
+    }
+
+
+    hist_sum(ctx);
+    ctx->summed = 1;
+
+    return 1;
+}
+
+
+/* hist_progress returns how far through the counting is, in percent */
+int hist_progress(struct hist_ctx *ctx)
+{
+    if (!ctx) {
+        return 100;
+    }
+
+    return rb_scan_progress(&ctx->scan);
+}
+
+
+/* hist_at sets counts to the counts before block b */
+static void hist_at(struct hist_ctx *ctx, unsigned long b, uint64_t * counts)
+{
+    uint64_t *span = ctx->spans + ((b / ctx->span) * 256);
+    uint32_t *block = ctx->counts + (b * 256);
+    int c;
+
+    for (c = 0; c < 256; c++) {
+        counts[c] = span[c] + block[c];
+    }
+}
+
+
+/* hist_read adds the counts of len bytes at offset, read from the file, to
+ * counts */
+static int hist_read(struct hist_ctx *ctx, unsigned long offset,
+                     unsigned long len, uint64_t * counts)
+{
+    unsigned long piece;
+    long got;
+
+    while (len) {
+        piece = (len > HIST_READ_SIZE) ? HIST_READ_SIZE : len;
+
+        /* the same way the scan read it */
+        if (ctx->scan.read) {
+            got = ctx->scan.read(ctx->scan.read_arg, ctx->edge, piece,
+                                 offset);
+        } else {
+            got = blkdev_pread(ctx->scan.fd, ctx->edge, piece, offset);
+        }
+        if (got != (long) piece) {
+            FAIL_ERR("hist_read: pread() failed\n");
+            return 1;
+        }
+
+        hist_count(ctx->edge, piece, counts);
+        offset += piece;
+        len -= piece;
+    }
+
+    return 0;
+}
+
+
+/* hist_prefix sets counts to the counts before offset, reading the nearer
+ * side of its block */
+static int hist_prefix(struct hist_ctx *ctx, unsigned long offset,
+                       uint64_t * counts)
+{
+    uint64_t part[256];
+    unsigned long b, bstart, bend;
+    int c;
+
+    b = offset / ctx->blocksize;
+    bstart = b * ctx->blocksize;
+    if (offset == bstart) {
+        hist_at(ctx, b, counts);
+        return 0;
+    }
+
+    bend = bstart + ctx->blocksize;
+    if (bend > ctx->size) {
+        bend = ctx->size;
+    }
+
+    memset(part, 0, sizeof(part));
+    if (offset - bstart <= (bend - bstart) / 2) {
+        if (hist_read(ctx, bstart, offset - bstart, part) != 0) {
+            FAIL_MSG("hist_prefix: hist_read() failed\n");
+            return 1;
+        }
+
+        hist_at(ctx, b, counts);
+        for (c = 0; c < 256; c++) {
+            counts[c] += part[c];
+        }
+    } else {
+        if (hist_read(ctx, offset, bend - offset, part) != 0) {
+            FAIL_MSG("hist_prefix: hist_read() failed\n");
+            return 2;
+        }
+
+        hist_at(ctx, b + 1, counts);
+        for (c = 0; c < 256; c++) {
+            counts[c] -= part[c];
+        }
+    }
+
+    return 0;
+}
+
+
+/* hist_query counts the bytes between start and end, which reads at most
+ * a block of the file */
+int hist_query(struct hist_ctx *ctx, unsigned long start, unsigned long end,
+               struct hist_summary *summary)
+{
+    uint64_t before[256];
+    unsigned long printable;
+    double p;
+    int c;
+
+    if (!ctx || !summary || (end < start)) {
+        FAIL_MSG("hist_query: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->summed != 1) {
+        FAIL_MSG("hist_query: the file has not been counted\n");
+        return 2;
+    }
+
+
+    memset(summary, 0, sizeof(struct hist_summary));
+    if (end > ctx->size) {
+        end = ctx->size;
+    }
+    if (start >= end) {
+        return 0;
+    }
+
+    summary->bytes = end - start;
+
+    /* a range within a block or so is quicker to read */
+    if (summary->bytes <= ctx->blocksize) {
+        if (hist_read(ctx, start, summary->bytes, summary->counts) != 0) {
+            FAIL_MSG("hist_query: hist_read() failed\n");
+            return 3;
+        }
+
+    } else {
+        if ((hist_prefix(ctx, end, summary->counts) != 0)
+            || (hist_prefix(ctx, start, before) != 0)) {
+            FAIL_MSG("hist_query: hist_prefix() failed\n");
+            return 4;
+        }
+
+        for (c = 0; c < 256; c++) {
+            summary->counts[c] -= before[c];
+        }
+    }
+
+    printable = 0;
+    for (c = 0; c < 256; c++) {
+        if (!summary->counts[c]) {
+            continue;
+        }
+
+        p = (double) summary->counts[c] / (double) summary->bytes;
+        summary->entropy -= p * log2(p);
+        if (((c >= 0x20) && (c < 0x7f)) || (c == '\t') || (c == '\n')
+            || (c == '\r')) {
+            printable += summary->counts[c];
+        }
+        if (c >= 0x80) {
+            summary->high += summary->counts[c];
+        }
+    }
+    summary->ascii = (double) printable / summary->bytes;
+    summary->zero = (double) summary->counts[0] / summary->bytes;
+    summary->high /= summary->bytes;
+
+    return 0;
+}
+
+
+/* hist_sweep counts blocks first to last again from the file, and moves
+ * the counts after them by however much theirs changed */
+static int hist_sweep(struct hist_ctx *ctx, unsigned long first,
+                      unsigned long last)
+{
+    uint64_t prev[256], next[256], fresh[256];
+    uint64_t run[256], srun[256], shift[256];
+    unsigned long b, bstart, len;
+    int c, moved;
+
+    hist_at(ctx, first, prev);
+    memset(run, 0, sizeof(run));
+    memset(srun, 0, sizeof(srun));
+    memset(shift, 0, sizeof(shift));
+    moved = 0;
+
+    for (b = first + 1; b <= ctx->nblocks; b++) {
+        if (b - 1 <= last) {
+            /* the counts before b as they were, without what has already
+             * been added to its span's total */
+            hist_at(ctx, b, next);
+            if (b % ctx->span) {
+                for (c = 0; c < 256; c++) {
+                    next[c] -= shift[c];
+                }
+            }
+
+            bstart = (b - 1) * ctx->blocksize;
+            len = ctx->size - bstart;
+            if (len > ctx->blocksize) {
+                len = ctx->blocksize;
+            }
+
+            memset(fresh, 0, sizeof(fresh));
+            if (hist_read(ctx, bstart, len, fresh) != 0) {
+                FAIL_MSG("hist_sweep: hist_read() failed\n");
+                return 1;
+            }
+
+            /* these wrap for a count that went down, and come out right */
+            for (c = 0; c < 256; c++) {
+                run[c] += fresh[c] - (next[c] - prev[c]);
+                srun[c] += fresh[c] - (next[c] - prev[c]);
+            }
+            memcpy(prev, next, sizeof(prev));
+            moved = 1;
+        } else if (!moved) {
+            break;
+        }
+
+        /* a span's blocks count from its start, which holds the total */
+        if (!(b % ctx->span)) {
+            for (c = 0; c < 256; c++) {
+                ctx->spans[((b / ctx->span) * 256) + c] += run[c];
+            }
+            memcpy(shift, run, sizeof(shift));
+            memset(srun, 0, sizeof(srun));
+            moved = 0;
+        } else {
+            for (c = 0; c < 256; c++) {
+                ctx->counts[(b * 256) + c] += (uint32_t) srun[c];
+            }
+        }
+    }
+
+    /* only the totals of the spans after that move */
+    for (b = ((b / ctx->span) + 1) * ctx->span; b <= ctx->nblocks;
+         b += ctx->span) {
+        for (c = 0; c < 256; c++) {
+            ctx->spans[((b / ctx->span) * 256) + c] += run[c];
+        }
+    }
+
+    return 0;
+}
+
+
+/* hist_recount counts start to end again after it has changed in place.
+ * It fails if the counting hasn't finished, which then has to start
+ * again. */
+int hist_recount(struct hist_ctx *ctx, unsigned long start,
+                 unsigned long end)
+{
+    if (!ctx || (end < start)) {
+        FAIL_MSG("hist_recount: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->summed != 1) {
+        return 2;
+    }
+
+    if (end > ctx->size) {
+        end = ctx->size;
+    }
+    if (start >= end) {
+        return 0;
+    }
+
+    if (hist_sweep(ctx, start / ctx->blocksize, (end - 1) / ctx->blocksize)
+        != 0) {
+        FAIL_MSG("hist_recount: hist_sweep() failed\n");
+        ctx->summed = -1;
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* hist_grow counts the bytes the file has grown by to size.  It fails if
+ * the counting hasn't finished, which then has to start again. */
+int hist_grow(struct hist_ctx *ctx, unsigned long size)
+{
+    uint64_t at[256];
+    uint32_t *counts;
+    uint64_t *spans;
+    unsigned long oldreserved, last, b;
+
+    if (!ctx || (size < ctx->size)) {
+        FAIL_MSG("hist_grow: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->summed != 1) {
+        return 2;
+    }
+
+    if (size == ctx->size) {
+        return 0;
+    }
+
+    /* the last block, if it was short, is counted again with the rest */
+    last = ctx->size / ctx->blocksize;
+    hist_at(ctx, last, at);
+
+    oldreserved = ctx->reserved;
+    ctx->size = size;
+    hist_layout(ctx);
+    budget_charge(BUDGET_CACHE, ctx->reserved - oldreserved);
+
+    counts = (uint32_t *) realloc(ctx->counts, (ctx->nblocks + 1) * 256 *
+                                  sizeof(uint32_t));
+    if (!counts) {
+        FAIL_MSG("hist_grow: realloc() failed\n");
+        ctx->summed = -1;
+        return 3;
+    }
+    ctx->counts = counts;
+
+    spans = (uint64_t *) realloc(ctx->spans, ((ctx->nblocks / ctx->span) +
+                                              1) * 256 * sizeof(uint64_t));
+    if (!spans) {
+        FAIL_MSG("hist_grow: realloc() failed\n");
+        ctx->summed = -1;
+        return 4;
+    }
+    ctx->spans = spans;
+
+    /* as if everything from the last block on were empty */
+    for (b = last + 1; b <= ctx->nblocks; b++) {
+        if (!(b % ctx->span)) {
+            memcpy(ctx->spans + ((b / ctx->span) * 256), at, sizeof(at));
+            memset(ctx->counts + (b * 256), 0, 256 * sizeof(uint32_t));
+        } else if ((b / ctx->span) == (last / ctx->span)) {
+            memcpy(ctx->counts + (b * 256), ctx->counts + (last * 256),
+                   256 * sizeof(uint32_t));
+        } else {
+            memset(ctx->counts + (b * 256), 0, 256 * sizeof(uint32_t));
+        }
+    }
+
+    if (hist_sweep(ctx, last, ctx->nblocks - 1) != 0) {
+        FAIL_MSG("hist_grow: hist_sweep() failed\n");
+        ctx->summed = -1;
+        return 5;
+    }
+
+
+    return 0;
+}
+
+
+/* hist_free stops the counting if it is running and frees the index */
+int hist_free(struct hist_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("hist_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->scan.running) {
+        __atomic_store_n(&ctx->scan.cancel, 1, __ATOMIC_RELAXED);
+        rb_scan_wait(&ctx->scan);
+    }
+
+    free(ctx->counts);
+    free(ctx->spans);
+    free(ctx->edge);
+    budget_release(BUDGET_CACHE, ctx->reserved);
+    free(ctx);
+
+    return 0;
+}
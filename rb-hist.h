@@ -0,0 +1,84 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-hist.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_HIST_H
+#define _RB_HIST_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/types.h>
+
+#include "rb-scan.h"
+#include "rb-blkdev.h"
+#include "rb-budget.h"
+#include "macro.h"
+
+/* blocks start at this size and double while the index doesn't fit in
+ * the memory budget, up to HIST_MAX_BLOCK */
+#define HIST_BLOCK_SIZE (1024 * 1024)
+#define HIST_MAX_BLOCK (256 * 1024 * 1024)
+
+/* the counts within a span this big fit in 32 bits; the spans' own
+ * counts are 64 bit */
+#define HIST_SPAN (1024UL * 1024 * 1024)
+
+/* the edges of a query are read this much at a time */
+#define HIST_READ_SIZE (1024 * 1024)
+
+/* the byte counts of a range, and what follows from them */
+struct hist_summary {
+    unsigned long bytes;
+    uint64_t counts[256];
+    double entropy;
+    double ascii;
+    double zero;
+    double high;
+};
+
+/* the running byte counts of a file at every block boundary, as a 64 bit
+ * count at the start of each span and a 32 bit one from there on.  While
+ * it is scanned each block holds only its own counts. */
+struct hist_ctx {
+    unsigned long size;
+    unsigned long blocksize;
+    unsigned long nblocks;
+    unsigned long span;         /* blocks in a span */
+    uint32_t *counts;           /* 256 for each block, and the end */
+    uint64_t *spans;            /* 256 for each span */
+    unsigned long reserved;     /* from the memory budget */
+    int summed;
+    struct scan_ctx scan;
+
+    /* for reading the edges of queries */
+    uint8_t *edge;
+};
+
+struct hist_ctx *hist_new(unsigned long size);
+int hist_start(struct hist_ctx *ctx, int fd);
+int hist_finished(struct hist_ctx *ctx);
+int hist_progress(struct hist_ctx *ctx);
+int hist_query(struct hist_ctx *ctx, unsigned long start, unsigned long end,
+               struct hist_summary *summary);
+int hist_recount(struct hist_ctx *ctx, unsigned long start,
+                 unsigned long end);
+int hist_grow(struct hist_ctx *ctx, unsigned long size);
+int hist_free(struct hist_ctx *ctx);
+
+#endif
@@ -45,6 +45,8 @@ void *rb_init_mmap()
 */
 int rb_mmap(struct filemmap *mmap_ctx, int fd, unsigned long offset, unsigned long filesize)
 {
+	struct stats_mark mark;
+	unsigned long chunk;
 	
 	if (!mmap_ctx || !fd || (offset > filesize)) {
 		FAIL_MSG("rb_mmap: invalid params\n");
@@ -52,6 +54,8 @@ int rb_mmap(struct filemmap *mmap_ctx, int fd, unsigned long offset, unsigned lo
 	}
 	
 	
+	stats_begin(&mark);
+
 	/* if we already have a chunk, then unmap it */
 	if (mmap_ctx->mmap_ptr) {
 		if (munmap(mmap_ctx->mmap_ptr, mmap_ctx->mmap_size) != 0) {
@@ -59,6 +63,8 @@ int rb_mmap(struct filemmap *mmap_ctx, int fd, unsigned long offset, unsigned lo
 			return 2;
 		}
 
+		stats_munmap(STATS_MMAP);
+		budget_release(BUDGET_MMAP, mmap_ctx->mmap_size);
 	}
 
 	/* invalid pointers */
@@ -67,9 +73,12 @@ int rb_mmap(struct filemmap *mmap_ctx, int fd, unsigned long offset, unsigned lo
 	
 	/* shift the values to align with a page */
     mmap_ctx->mmap_offset = offset & ~(sysconf(_SC_PAGE_SIZE) - 1);
+
+	/* smaller chunks when the session is near its memory budget */
+	chunk = budget_pressure() ? MMAP_CHUNK_LOW : MMAP_CHUNK_SIZE;
 	
-	if ((mmap_ctx->mmap_offset + MMAP_CHUNK_SIZE) < filesize) {
-		mmap_ctx->mmap_size = MMAP_CHUNK_SIZE;
+	if ((mmap_ctx->mmap_offset + chunk) < filesize) {
+		mmap_ctx->mmap_size = chunk;
 	} else {
 		mmap_ctx->mmap_size = filesize - mmap_ctx->mmap_offset;
 	}
@@ -89,11 +98,18 @@ int rb_mmap(struct filemmap *mmap_ctx, int fd, unsigned long offset, unsigned lo
         fprintf(stderr, "mmap_size = 0x%lx\n", mmap_ctx->mmap_size);
         fprintf(stderr, "fd = %d\n", fd);
 
+        mmap_ctx->mmap_ptr = NULL;
+        mmap_ctx->mmap_size = 0;
         return 3;
     }
 
     /* set user data pointer */
     mmap_ctx->ptr = mmap_ctx->mmap_ptr + (offset - mmap_ctx->mmap_offset);
+
+	stats_mmap(STATS_MMAP);
+	stats_add(STATS_MMAP, mmap_ctx->mmap_size, 0);
+	stats_end(STATS_MMAP, &mark);
+	budget_charge(BUDGET_MMAP, mmap_ctx->mmap_size);
 	
 	return 0;
 }
@@ -117,6 +133,8 @@ int rb_munmap(struct filemmap *mmap_ctx)
 			return 2;
 		}
 
+		stats_munmap(STATS_MMAP);
+		budget_release(BUDGET_MMAP, mmap_ctx->mmap_size);
 	}
 
 	/* invalid pointers */
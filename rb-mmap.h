@@ -27,9 +27,12 @@
 #include <errno.h>
 
 //#include "rb-data.h"
+#include "rb-stats.h"
+#include "rb-budget.h"
 #include "macro.h"
 
 #define MMAP_CHUNK_SIZE 32 * 1024 * 1024
+#define MMAP_CHUNK_LOW 4 * 1024 * 1024       /* when the memory budget is short */
 
 /* mmap context */
 struct filemmap {
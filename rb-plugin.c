@@ -0,0 +1,349 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-plugin.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to run visualisers that are shared libraries inside
+ * rubbermarbles.  Each plugin is loaded with dlopen() and run on a thread
+ * of its own, which makes every call into it.  It reads the file through a
+ * mapping of the whole of it rather than a copy, and is told of each new
+ * zoom selection; it draws into a bitmap that is handed back for the main
+ * thread to show.  What rubbermarbles has worked out about the file is
+ * read in place too, so the main thread pauses the plugins while it
+ * changes any of it.  The forked visualisers are still there for anything
+ * that should be kept apart.
+ */
+
+#include "rb-plugin.h"
+
+/* what the plugins are given of the summaries, which the main thread only
+ * changes with the plugins paused */
+static struct vis_summaries plugin_found;
+static pthread_rwlock_t plugin_found_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+/* plugin_summaries is the view's summaries call; the plugin's thread holds
+ * the read lock for as long as the call it is made from */
+static void plugin_summaries(struct vis_summaries *found)
+{
+    if (!found) {
+        FAIL_MSG("plugin_summaries: invalid params\n");
+        return;
+    }
+
+    memcpy(found, &plugin_found, sizeof(struct vis_summaries));
+}
+
+
+/* plugin_thread sets the plugin up and then updates and draws it whenever
+ * asked, until it is stopped */
+static void *plugin_thread(void *arg)
+{
+    struct plugin_ctx *ctx = (struct plugin_ctx *) arg;
+    struct vis_canvas canvas;
+    unsigned long offset, len;
+    int update;
+
+    update = 0;
+    ctx->state = ctx->api->init();
+    if (ctx->state) {
+        pthread_rwlock_rdlock(&plugin_found_lock);
+        update = ctx->api->attach(ctx->state, &ctx->view);
+        pthread_rwlock_unlock(&plugin_found_lock);
+    }
+    if (!ctx->state || (update != 0)) {
+        FAIL_MSG("plugin_thread: plugin failed to start\n");
+        if (ctx->state) {
+            ctx->api->free(ctx->state);
+            ctx->state = NULL;
+        }
+        pthread_mutex_lock(&ctx->lock);
+        ctx->failed = 1;
+        pthread_mutex_unlock(&ctx->lock);
+        return NULL;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->quit) {
+        if (!ctx->update && !ctx->redraw) {
+            pthread_cond_wait(&ctx->wake, &ctx->lock);
+            continue;
+        }
+
+        update = ctx->update;
+        offset = ctx->offset;
+        len = ctx->len;
+        canvas.width = ctx->width;
+        canvas.height = ctx->height;
+        ctx->update = 0;
+        ctx->redraw = 0;
+        pthread_mutex_unlock(&ctx->lock);
+
+        pthread_rwlock_rdlock(&plugin_found_lock);
+        if (update && (ctx->api->on_update(ctx->state, offset, len) != 0)) {
+            FAIL_MSG("plugin_thread: on_update() failed\n");
+        }
+
+        /* each picture is a new bitmap, so the last one can be shown
+         * while this one is drawn */
+        canvas.stride = canvas.width * 3;
+        canvas.rgb = (uint8_t *) calloc(canvas.height, canvas.stride);
+        if (!canvas.rgb) {
+            FAIL_MSG("plugin_thread: calloc() failed\n");
+        } else if (ctx->api->draw(ctx->state, &canvas) != 0) {
+            FAIL_MSG("plugin_thread: draw() failed\n");
+        }
+        pthread_rwlock_unlock(&plugin_found_lock);
+
+        pthread_mutex_lock(&ctx->lock);
+        if (canvas.rgb) {
+            free(ctx->picture);
+            ctx->picture = canvas.rgb;
+            ctx->pwidth = canvas.width;
+            ctx->pheight = canvas.height;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    ctx->api->free(ctx->state);
+    ctx->state = NULL;
+
+    return NULL;
+}
+
+
+/* plugin_start loads the plugin at path and starts it on the file open on
+ * fd */
+struct plugin_ctx *plugin_start(char *path, int fd, unsigned long size,
+                                char *filename)
+{
+    struct plugin_ctx *ctx;
+    vis_plugin_entry_fn entry;
+
+    if (!path || (fd < 0) || !size) {
+        FAIL_MSG("plugin_start: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct plugin_ctx *) calloc(1, sizeof(struct plugin_ctx));
+    if (!ctx) {
+        FAIL_MSG("plugin_start: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!ctx->lib) {
+        fprintf(stderr, "plugin_start: dlopen() failed: %s\n", dlerror());
+        free(ctx);
+        return NULL;
+    }
+
+
+    entry = (vis_plugin_entry_fn) dlsym(ctx->lib, VIS_PLUGIN_ENTRY);
+    if (entry) {
+        ctx->api = entry();
+    }
+    if (!ctx->api || (ctx->api->abi != VIS_PLUGIN_ABI) || !ctx->api->init
+        || !ctx->api->attach || !ctx->api->on_update || !ctx->api->draw
+        || !ctx->api->free) {
+        fprintf(stderr, "plugin_start: %s is not a version %d plugin\n",
+                path, VIS_PLUGIN_ABI);
+        dlclose(ctx->lib);
+        free(ctx);
+        return NULL;
+    }
+
+
+    ctx->view.data = (const uint8_t *) mmap(NULL, size, PROT_READ,
+                                            MAP_SHARED, fd, 0);
+    if (ctx->view.data == MAP_FAILED) {
+        FAIL_ERR("plugin_start: mmap() failed\n");
+        dlclose(ctx->lib);
+        free(ctx);
+        return NULL;
+    }
+
+    ctx->view.size = size;
+    if (filename) {
+        strncpy(ctx->filename, filename, PATH_MAX - 1);
+    }
+    ctx->view.filename = ctx->filename;
+    ctx->view.summaries = plugin_summaries;
+
+    ctx->width = PLUGIN_WIDTH;
+    ctx->height = PLUGIN_HEIGHT;
+
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wake, NULL);
+
+    if (pthread_create(&ctx->thread, NULL, plugin_thread, ctx) != 0) {
+        FAIL_MSG("plugin_start: pthread_create() failed\n");
+        munmap((void *) ctx->view.data, size);
+        dlclose(ctx->lib);
+        free(ctx);
+        return NULL;
+    }
+
+
+    return ctx;
+}
+
+
+/* plugin_update tells the plugin that the zoom selection has changed */
+int plugin_update(struct plugin_ctx *ctx, unsigned long offset,
+                  unsigned long len)
+{
+    if (!ctx) {
+        FAIL_MSG("plugin_update: invalid params\n");
+        return 1;
+    }
+
+
+    /* the plugin only has the file as it was when it started */
+    if (offset > ctx->view.size) {
+        offset = ctx->view.size;
+    }
+    if (len > ctx->view.size - offset) {
+        len = ctx->view.size - offset;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->offset = offset;
+    ctx->len = len;
+    ctx->update = 1;
+    pthread_cond_signal(&ctx->wake);
+    pthread_mutex_unlock(&ctx->lock);
+
+    return 0;
+}
+
+
+/* plugin_resize asks the plugin to draw itself again at a new size */
+int plugin_resize(struct plugin_ctx *ctx, int width, int height)
+{
+    if (!ctx || (width < 1) || (height < 1)) {
+        FAIL_MSG("plugin_resize: invalid params\n");
+        return 1;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    if ((width != ctx->width) || (height != ctx->height)) {
+        ctx->width = width;
+        ctx->height = height;
+        ctx->redraw = 1;
+        pthread_cond_signal(&ctx->wake);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return 0;
+}
+
+
+/* plugin_picture returns the plugin's latest picture, for the caller to
+ * free, or NULL if it hasn't drawn one since it was last called */
+uint8_t *plugin_picture(struct plugin_ctx *ctx, int *width, int *height)
+{
+    uint8_t *picture;
+
+    if (!ctx || !width || !height) {
+        FAIL_MSG("plugin_picture: invalid params\n");
+        return NULL;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    picture = ctx->picture;
+    ctx->picture = NULL;
+    *width = ctx->pwidth;
+    *height = ctx->pheight;
+    pthread_mutex_unlock(&ctx->lock);
+
+    return picture;
+}
+
+
+/* plugin_failed returns whether the plugin could not be started */
+int plugin_failed(struct plugin_ctx *ctx)
+{
+    int failed;
+
+    if (!ctx) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    failed = ctx->failed;
+    pthread_mutex_unlock(&ctx->lock);
+
+    return failed;
+}
+
+
+/* plugin_pause waits for the plugins to finish the calls they are in, and
+ * holds them out of any more until plugin_resume() */
+void plugin_pause()
+{
+    pthread_rwlock_wrlock(&plugin_found_lock);
+}
+
+
+/* plugin_resume lets the plugins make calls again */
+void plugin_resume()
+{
+    pthread_rwlock_unlock(&plugin_found_lock);
+}
+
+
+/* plugin_publish changes what the plugins are given of the summaries; the
+ * plugins have to be paused */
+void plugin_publish(const struct vis_summaries *found)
+{
+    if (!found) {
+        memset(&plugin_found, 0, sizeof(struct vis_summaries));
+        return;
+    }
+
+    memcpy(&plugin_found, found, sizeof(struct vis_summaries));
+}
+
+
+/* plugin_stop stops the plugin's thread and unloads it */
+int plugin_stop(struct plugin_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("plugin_stop: invalid params\n");
+        return 1;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->quit = 1;
+    pthread_cond_signal(&ctx->wake);
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (pthread_join(ctx->thread, NULL) != 0) {
+        FAIL_MSG("plugin_stop: pthread_join() failed\n");
+        return 2;
+    }
+
+
+    free(ctx->picture);
+    munmap((void *) ctx->view.data, ctx->view.size);
+    dlclose(ctx->lib);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_cond_destroy(&ctx->wake);
+    free(ctx);
+
+    return 0;
+}
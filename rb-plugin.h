@@ -0,0 +1,85 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-plugin.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_PLUGIN_H
+#define _RB_PLUGIN_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <linux/limits.h>
+#elif __APPLE__
+#include <sys/syslimits.h>
+#endif
+
+#include "vis-plugin.h"
+#include "macro.h"
+
+/* the config line's exe starts with this for a plugin */
+#define PLUGIN_PREFIX "plugin:"
+
+#define PLUGIN_WIDTH 512
+#define PLUGIN_HEIGHT 512
+
+/* a plugin running on its own thread */
+struct plugin_ctx {
+    void *lib;
+    const struct vis_plugin *api;
+    void *state;
+    struct vis_view view;
+    char filename[PATH_MAX];
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    /* asked for by the main thread */
+    unsigned long offset;
+    unsigned long len;
+    int update;
+    int width;
+    int height;
+    int redraw;
+    int quit;
+
+    /* handed back by the plugin thread */
+    uint8_t *picture;
+    int pwidth;
+    int pheight;
+    int failed;
+};
+
+struct plugin_ctx *plugin_start(char *path, int fd, unsigned long size,
+                                char *filename);
+int plugin_update(struct plugin_ctx *ctx, unsigned long offset,
+                  unsigned long len);
+int plugin_resize(struct plugin_ctx *ctx, int width, int height);
+uint8_t *plugin_picture(struct plugin_ctx *ctx, int *width, int *height);
+int plugin_failed(struct plugin_ctx *ctx);
+int plugin_stop(struct plugin_ctx *ctx);
+void plugin_pause();
+void plugin_resume();
+void plugin_publish(const struct vis_summaries *found);
+
+#endif
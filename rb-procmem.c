@@ -0,0 +1,523 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-procmem.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to look at a running process's memory as if it were
+ * a file.  The readable mappings in /proc/<pid>/maps are laid end to end,
+ * leaving out the gaps between them, and copied into a memfd that the plots
+ * and visualisers open like any other file.  The memory is read with
+ * process_vm_readv() in batches of many iovecs rather than a seek and read
+ * of /proc/<pid>/mem per region.  A refresh reads it all again in the
+ * background and copies in only the pages that changed, keeping a list of
+ * the ranges so that only they are drawn again.
+ */
+
+#include "rb-procmem.h"
+
+
+/* proc_maps reads the readable mappings of a process and lays them end to
+ * end; the caller frees regions */
+int proc_maps(pid_t pid, struct proc_region **regions, int *nregions,
+              unsigned long *size)
+{
+    struct proc_region *list, *tmp;
+    char line[PATH_MAX + 128];
+    char path[64];
+    unsigned long start, end, offset;
+    char perms[5];
+    int max, n, name;
+    FILE *fp;
+
+    if ((pid <= 0) || !regions || !nregions || !size) {
+        FAIL_MSG("proc_maps: invalid params\n");
+        return 1;
+    }
+
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int) pid);
+    fp = fopen(path, "r");
+    if (!fp) {
+        FAIL_ERR("proc_maps: fopen() failed\n");
+        return 2;
+    }
+
+
+    list = NULL;
+    max = 0;
+    n = 0;
+    offset = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        name = 0;
+        if (sscanf(line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, perms,
+                   &name) < 3) {
+            continue;
+        }
+
+        /* the kernel's [vsyscall] page can't be read from another process */
+        if ((perms[0] != 'r') || (end <= start)
+            || strstr(line, "[vsyscall]")) {
+            continue;
+        }
+
+        if (n == max) {
+            max = max ? max * 2 : 64;
+            tmp = (struct proc_region *) realloc(list,
+                                                 max *
+                                                 sizeof(struct proc_region));
+            if (!tmp) {
+                FAIL_MSG("proc_maps: realloc() failed\n");
+                free(list);
+                fclose(fp);
+                return 3;
+            }
+
+            list = tmp;
+        }
+
+        list[n].addr = start;
+        list[n].len = end - start;
+        list[n].offset = offset;
+        memcpy(list[n].perms, perms, sizeof(perms));
+        list[n].name[0] = 0x00;
+        if (name && line[name]) {
+            strncpy(list[n].name, line + name, PROC_NAMESIZE - 1);
+            list[n].name[PROC_NAMESIZE - 1] = 0x00;
+            list[n].name[strcspn(list[n].name, "\n")] = 0x00;
+        }
+        offset += end - start;
+        n++;
+    }
+
+    fclose(fp);
+
+    if (!n) {
+        FAIL_MSG("proc_maps: no readable mappings\n");
+        free(list);
+        return 4;
+    }
+
+
+    *regions = list;
+    *nregions = n;
+    *size = offset;
+
+    return 0;
+}
+
+
+/* proc_readv reads n remote iovecs into n local ones.  A mapping that has
+ * gone or can't be read stops process_vm_readv() at that iovec, so it is
+ * zeroed and the read carries on from the next. */
+static int proc_readv(pid_t pid, struct iovec *local, struct iovec *remote,
+                      int n)
+{
+#ifdef __linux__
+    long ret;
+    int done;
+
+    done = 0;
+    while (done < n) {
+        ret = syscall(SYS_process_vm_readv, pid, local + done, n - done,
+                      remote + done, n - done, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno != EFAULT) && (errno != EIO) && (errno != ENOMEM)) {
+                return -1;
+            }
+            ret = 0;
+        }
+
+        /* whole iovecs are transferred or none of one is */
+        while ((done < n) && ((unsigned long) ret >= remote[done].iov_len)) {
+            ret -= remote[done].iov_len;
+            done++;
+        }
+
+        if (done < n) {
+            memset(local[done].iov_base, 0, local[done].iov_len);
+            done++;
+        }
+    }
+
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+/* proc_batch reads the snapshot range from offset into dest, up to len
+ * bytes, in as few calls as it can; it returns the bytes read */
+static long proc_batch(struct proc_ctx *ctx, unsigned long offset,
+                       uint8_t * dest, unsigned long len)
+{
+    struct iovec local[PROC_IOVECS];
+    struct iovec remote[PROC_IOVECS];
+    struct proc_region *region;
+    unsigned long got, skip, piece;
+    int n;
+
+    region = proc_region(ctx, offset);
+    if (!region) {
+        return 0;
+    }
+
+    n = 0;
+    got = 0;
+    while ((got < len) && (n < PROC_IOVECS)
+           && (region < ctx->regions + ctx->nregions)) {
+        skip = offset + got - region->offset;
+        piece = region->len - skip;
+        if (piece > len - got) {
+            piece = len - got;
+        }
+
+        local[n].iov_base = dest + got;
+        local[n].iov_len = piece;
+        remote[n].iov_base = (void *) (region->addr + skip);
+        remote[n].iov_len = piece;
+        n++;
+
+        got += piece;
+        if (skip + piece == region->len) {
+            region++;
+        }
+    }
+
+    if (proc_readv(ctx->pid, local, remote, n) != 0) {
+        FAIL_ERR("proc_batch: process_vm_readv() failed\n");
+        return -1;
+    }
+
+
+    return got;
+}
+
+
+/* proc_add_changed adds a changed range, joining it to the last if they
+ * touch */
+static int proc_add_changed(struct proc_ctx *ctx, unsigned long start,
+                            unsigned long end)
+{
+    struct proc_range *tmp;
+    int max;
+
+    if (ctx->nchanged && (ctx->changed[ctx->nchanged - 1].end == start)) {
+        ctx->changed[ctx->nchanged - 1].end = end;
+        return 0;
+    }
+
+    if (ctx->nchanged == ctx->maxchanged) {
+        max = ctx->maxchanged ? ctx->maxchanged * 2 : 256;
+        tmp = (struct proc_range *) realloc(ctx->changed,
+                                            max * sizeof(struct proc_range));
+        if (!tmp) {
+            FAIL_MSG("proc_add_changed: realloc() failed\n");
+            return 1;
+        }
+
+        ctx->changed = tmp;
+        ctx->maxchanged = max;
+    }
+
+    ctx->changed[ctx->nchanged].start = start;
+    ctx->changed[ctx->nchanged].end = end;
+    ctx->nchanged++;
+
+    return 0;
+}
+
+
+/* proc_open snapshots the memory of process pid */
+struct proc_ctx *proc_open(pid_t pid)
+{
+    struct proc_ctx *ctx;
+    unsigned long offset;
+    char path[64];
+    char comm[PROC_COMMSIZE];
+    char *nl;
+    FILE *fp;
+    long got;
+
+    if (pid <= 0) {
+        FAIL_MSG("proc_open: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct proc_ctx *) calloc(1, sizeof(struct proc_ctx));
+    if (!ctx) {
+        FAIL_MSG("proc_open: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->pid = pid;
+    ctx->fd = -1;
+    ctx->snap = MAP_FAILED;
+
+    if (proc_maps(pid, &ctx->regions, &ctx->nregions, &ctx->size) != 0) {
+        FAIL_MSG("proc_open: proc_maps() failed\n");
+        proc_free(ctx);
+        return NULL;
+    }
+
+
+    /* the title shows the command name */
+    snprintf(path, sizeof(path), "/proc/%d/comm", (int) pid);
+    snprintf(ctx->name, PROC_NAMESIZE, "pid %d", (int) pid);
+    fp = fopen(path, "r");
+    if (fp) {
+        if (fgets(comm, sizeof(comm), fp)) {
+            nl = strchr(comm, '\n');
+            if (nl) {
+                *nl = 0x00;
+            }
+            snprintf(ctx->name, PROC_NAMESIZE, "%s (pid %d)", comm,
+                     (int) pid);
+        }
+        fclose(fp);
+    }
+#ifdef __linux__
+    ctx->fd = syscall(SYS_memfd_create, "rubbermarbles", 0);
+#endif
+    if (ctx->fd < 0) {
+        FAIL_ERR("proc_open: memfd_create() failed\n");
+        proc_free(ctx);
+        return NULL;
+    }
+
+
+    /* the copy lives in memory, so it has to fit the session's budget */
+    if (budget_pressure()
+        || (budget_reserve(BUDGET_SNAPSHOT, ctx->size) != 0)) {
+        FAIL_MSG("proc_open: the snapshot doesn't fit in the memory budget\n");
+        proc_free(ctx);
+        return NULL;
+    }
+    ctx->reserved = ctx->size;
+
+    if (ftruncate(ctx->fd, ctx->size) != 0) {
+        FAIL_ERR("proc_open: ftruncate() failed\n");
+        proc_free(ctx);
+        return NULL;
+    }
+
+
+    ctx->snap = (uint8_t *) mmap(NULL, ctx->size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, ctx->fd, 0);
+    if (ctx->snap == MAP_FAILED) {
+        FAIL_ERR("proc_open: mmap() failed\n");
+        proc_free(ctx);
+        return NULL;
+    }
+
+
+    /* the visualisers open it through this process's fd */
+    snprintf(ctx->path, PATH_MAX, "/proc/%d/fd/%d", (int) getpid(),
+             ctx->fd);
+
+    /* the first snapshot is read straight into the memfd */
+    for (offset = 0; offset < ctx->size; offset += got) {
+        got = proc_batch(ctx, offset, ctx->snap + offset,
+                         ctx->size - offset);
+        if (got <= 0) {
+            FAIL_MSG("proc_open: proc_batch() failed\n");
+            proc_free(ctx);
+            return NULL;
+        }
+
+    }
+
+    return ctx;
+}
+
+
+/* proc_remapped returns whether the process's mappings are no longer the
+ * ones in the snapshot */
+static int proc_remapped(struct proc_ctx *ctx)
+{
+    struct proc_region *regions;
+    unsigned long size;
+    int nregions, i, ret;
+
+    if (proc_maps(ctx->pid, &regions, &nregions, &size) != 0) {
+        return 1;
+    }
+
+    ret = (nregions != ctx->nregions) || (size != ctx->size);
+    for (i = 0; !ret && (i < nregions); i++) {
+        ret = (regions[i].addr != ctx->regions[i].addr)
+            || (regions[i].len != ctx->regions[i].len);
+    }
+
+    free(regions);
+
+    return ret;
+}
+
+
+/* proc_refresh reads the memory again a batch at a time and copies in the
+ * pages that changed */
+static void *proc_refresh(void *data)
+{
+    struct proc_ctx *ctx = (struct proc_ctx *) data;
+    unsigned long offset, page, len;
+    long got;
+
+    ctx->nchanged = 0;
+    ctx->remapped = proc_remapped(ctx);
+
+    /* mappings that have gone read as zeroes until the snapshot is taken
+     * again */
+    for (offset = 0; (offset < ctx->size) && !ctx->error; offset += got) {
+        got = proc_batch(ctx, offset, ctx->buf, PROC_BATCH_SIZE);
+        if (got <= 0) {
+            FAIL_MSG("proc_refresh: proc_batch() failed\n");
+            ctx->error = 1;
+            break;
+        }
+
+        for (page = 0; page < (unsigned long) got; page += PROC_PAGE_SIZE) {
+            len = got - page;
+            if (len > PROC_PAGE_SIZE) {
+                len = PROC_PAGE_SIZE;
+            }
+
+            if (memcmp(ctx->snap + offset + page, ctx->buf + page, len) ==
+                0) {
+                continue;
+            }
+
+            memcpy(ctx->snap + offset + page, ctx->buf + page, len);
+            if (proc_add_changed(ctx, offset + page, offset + page + len) !=
+                0) {
+                ctx->error = 2;
+                break;
+            }
+
+        }
+    }
+
+    ctx->refreshes++;
+    __atomic_store_n(&ctx->finished, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+
+/* proc_refresh_start starts a refresh in the background */
+int proc_refresh_start(struct proc_ctx *ctx)
+{
+    if (!ctx || ctx->running) {
+        FAIL_MSG("proc_refresh_start: invalid params\n");
+        return 1;
+    }
+
+
+    if (!ctx->buf) {
+        ctx->buf = (uint8_t *) malloc(PROC_BATCH_SIZE);
+        if (!ctx->buf) {
+            FAIL_MSG("proc_refresh_start: malloc() failed\n");
+            return 2;
+        }
+
+    }
+
+    ctx->error = 0;
+    ctx->finished = 0;
+    ctx->running = 1;
+    if (pthread_create(&ctx->thread, NULL, proc_refresh, ctx) != 0) {
+        FAIL_MSG("proc_refresh_start: pthread_create() failed\n");
+        ctx->running = 0;
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* proc_refresh_finished returns whether a refresh has ended, or was never
+ * started */
+int proc_refresh_finished(struct proc_ctx *ctx)
+{
+    if (!ctx || !ctx->running) {
+        return 1;
+    }
+
+    if (!__atomic_load_n(&ctx->finished, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    pthread_join(ctx->thread, NULL);
+    ctx->running = 0;
+
+    return 1;
+}
+
+
+/* proc_free waits for any refresh and frees the snapshot */
+int proc_free(struct proc_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("proc_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->running) {
+        pthread_join(ctx->thread, NULL);
+    }
+
+    if (ctx->snap != MAP_FAILED) {
+        munmap(ctx->snap, ctx->size);
+    }
+    if (ctx->fd >= 0) {
+        close(ctx->fd);
+    }
+
+    budget_release(BUDGET_SNAPSHOT, ctx->reserved);
+
+    free(ctx->regions);
+    free(ctx->buf);
+    free(ctx->changed);
+    free(ctx);
+
+    return 0;
+}
+
+
+/* proc_region returns the mapping that holds offset in the snapshot */
+struct proc_region *proc_region(struct proc_ctx *ctx, unsigned long offset)
+{
+    int lo, hi, mid;
+
+    if (!ctx || (offset >= ctx->size)) {
+        return NULL;
+    }
+
+    lo = 0;
+    hi = ctx->nregions - 1;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (ctx->regions[mid].offset <= offset) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return &ctx->regions[lo];
+}
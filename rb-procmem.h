@@ -0,0 +1,101 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-procmem.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_PROCMEM_H
+#define _RB_PROCMEM_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/limits.h>
+#elif __APPLE__
+#include <sys/syslimits.h>
+#endif
+
+#include "rb-budget.h"
+#include "macro.h"
+
+/* bytes read from the process per refresh batch */
+#define PROC_BATCH_SIZE (4 * 1024 * 1024)
+/* iovecs per process_vm_readv() */
+#define PROC_IOVECS 1024
+/* changes are found a page at a time */
+#define PROC_PAGE_SIZE 4096
+#define PROC_NAMESIZE 64
+/* a command name, as the kernel keeps it (TASK_COMM_LEN) */
+#define PROC_COMMSIZE 16
+
+/* a readable mapping in the process and where it is in the snapshot */
+struct proc_region {
+    unsigned long addr;
+    unsigned long len;
+    unsigned long offset;
+    char perms[5];
+    char name[PROC_NAMESIZE];
+};
+
+/* a range of the snapshot that changed */
+struct proc_range {
+    unsigned long start;
+    unsigned long end;
+};
+
+/* a snapshot of a process's memory, with the gaps between the mappings
+ * left out */
+struct proc_ctx {
+    pid_t pid;
+    char name[PROC_NAMESIZE];   /* for the window title */
+    char path[PATH_MAX];        /* where other processes can open it */
+
+    /* the snapshot */
+    int fd;
+    uint8_t *snap;
+    unsigned long size;
+    unsigned long reserved;     /* charged to the memory budget */
+    int nregions;
+    struct proc_region *regions;
+
+    /* the last refresh, run in the background */
+    uint8_t *buf;
+    struct proc_range *changed;
+    int nchanged;
+    int maxchanged;
+    int remapped;               /* the mappings differ from the snapshot's */
+    unsigned long refreshes;
+    pthread_t thread;
+    int running;
+    int finished;
+    int error;
+};
+
+int proc_maps(pid_t pid, struct proc_region **regions, int *nregions,
+              unsigned long *size);
+struct proc_ctx *proc_open(pid_t pid);
+int proc_refresh_start(struct proc_ctx *ctx);
+int proc_refresh_finished(struct proc_ctx *ctx);
+int proc_free(struct proc_ctx *ctx);
+struct proc_region *proc_region(struct proc_ctx *ctx, unsigned long offset);
+
+#endif
@@ -38,11 +38,13 @@ struct ren_ctx {
     GtkWidget *window;
     GtkWidget *vbox;
 	GtkWidget *hilbert;
+	GtkWidget *stats;
+	int stats_show;
 	
 	/* display */
 	int col_set;
 	int disp_hilbert;
-	GdkPixbuf *pixbuf;
+	cairo_surface_t *surface;
 	
     /* data buffer */
 	int fd;
@@ -262,17 +262,43 @@ plot_point(struct ren_ctx *ctx, struct rgb *pic, int width, int height, int x, i
 }
 
 
-/* freepic is a callback that frees the data when the pixbuf is destroyed.
- * It has to be void to meet the fn spec */
-void freepic(guchar * pixels, gpointer data)
+/* draw_surface returns the pixels of a surface width by height, making it
+ * again if it is another size.  They are written directly, so the caller
+ * marks it dirty when it is done. */
+struct rgb *draw_surface(cairo_surface_t ** surface, int width, int height)
 {
-    if (!pixels) {
-        FAIL_MSG("freepic: pixels is NULL\n");
-        return;
+    if (!surface || (width < 1) || (height < 1)) {
+        FAIL_MSG("draw_surface: invalid params\n");
+        return NULL;
     }
 
 
-    free(pixels);
+    if (*surface
+        && ((cairo_image_surface_get_width(*surface) != width)
+            || (cairo_image_surface_get_height(*surface) != height))) {
+        cairo_surface_destroy(*surface);
+        *surface = NULL;
+    }
+
+    if (!*surface) {
+        *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width,
+                                              height);
+
+        /* the pixels are indexed as (width * y) + x */
+        if ((cairo_surface_status(*surface) != CAIRO_STATUS_SUCCESS)
+            || (cairo_image_surface_get_stride(*surface) !=
+                width * (int) sizeof(struct rgb))) {
+            FAIL_MSG("draw_surface: cairo_image_surface_create() failed\n");
+            cairo_surface_destroy(*surface);
+            *surface = NULL;
+            return NULL;
+        }
+
+    }
+
+    cairo_surface_flush(*surface);
+
+    return (struct rgb *) cairo_image_surface_get_data(*surface);
 }
 
 
@@ -286,7 +312,13 @@ int getxy(struct ren_ctx *ctx, int width, int point_index, int *x, int *y)
 
 
     /* find the location */
-	if (ctx->disp_hilbert == DISP_HILBERTFLIPPED) {
+	if (ctx->disp_hilbert == DISP_MORTON) {
+		if (morton_d2xy(point_index, x, y) != 0) {
+			FAIL_MSG("getxy: morton_d2xy() failed\n");
+			return 4;
+		}
+
+	} else if (ctx->disp_hilbert == DISP_HILBERTFLIPPED) {
 		if (d2xy(width, point_index, y, x) != 0) {
 			FAIL_MSG("getxy: d2xy() failed\n");
 			return 2;
@@ -315,6 +347,7 @@ int draw_img(struct ren_ctx *ctx)
     float step;
 	unsigned char value;
 	int width, height;
+	struct stats_mark mark;
 
     if (!ctx) {
         FAIL_MSG("draw_img: invalid params\n");
@@ -322,13 +355,15 @@ int draw_img(struct ren_ctx *ctx)
     }
 
 
+	stats_begin(&mark);
+
     width = ctx->xsize;
     height = ctx->ysize;
 
-    /* create a rgb bitmap */
-    pic = (struct rgb *) malloc(sizeof(struct rgb) * ctx->xsize * ctx->ysize);
+    /* draw straight into the surface the window is painted from */
+    pic = draw_surface(&ctx->surface, width, height);
     if (!pic) {
-        FAIL_MSG("draw_img: malloc() failed\n");
+        FAIL_MSG("draw_img: draw_surface() failed\n");
         return 2;
     }
 
@@ -395,20 +430,15 @@ int draw_img(struct ren_ctx *ctx)
 		data_index = data_start + (point_index * step);
 	}
 
+	/* the entropy reads a window for each pixel */
+	stats_add(STATS_REN_DRAW_IMG,
+			  point_index * (ctx->buftype == REN_SHANNON ? SHANNON_BS : 1),
+			  point_index);
 
-    /* copy the bitmap to the pixbuf */
-    if (ctx->pixbuf)
-        g_object_unref(ctx->pixbuf);
+    /* the surface is painted as it is */
+    cairo_surface_mark_dirty(ctx->surface);
 
-    ctx->pixbuf = gdk_pixbuf_new_from_data((const guchar *) pic,        /* the data */
-                                                       GDK_COLORSPACE_RGB,        /* colorspace */
-                                                       FALSE,        /* has alpha */
-                                                       8,        /* bits per sample */
-                                                       width,        /* width */
-                                                       height,        /* height */
-                                                       width * 3,        /* rowstride */
-                                                       &freepic,        /* destroy fn */
-                                                       NULL);        /* destroy data */
+	stats_end(STATS_REN_DRAW_IMG, &mark);
 
     return 0;
 }
@@ -35,6 +35,7 @@
 #include "rb-hilbert.h"
 #include "rb-shm.h"
 #include "rb-mmap.h"
+#include "rb-stats.h"
 #include "macro.h"
 
 
@@ -84,7 +85,7 @@ int cortesicolbyte(int b, guchar * red, guchar * green, guchar * blue);
 int plot_point(struct ren_ctx *ctx, struct rgb *pic, int width, int height, int x, int y,
                int colraw);
 void build_shannon_lookup();
-void freepic(guchar * pixels, gpointer data);
+struct rgb *draw_surface(cairo_surface_t ** surface, int width, int height);
 int draw_img(struct ren_ctx *ctx);
 
 #endif
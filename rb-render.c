@@ -65,6 +65,7 @@ void sig_handler(int signo)
         }
 */
 		
+        trace_instant("sigusr1");
         gctx->reload = 1;
     } else if (signo == SIGHUP) {
         if (disable_usr1() != 0) {
@@ -79,20 +80,30 @@ void sig_handler(int signo)
 
 
 /* onIdle is run whenever there is time.  It monitors ctx->reload and
- * calls render_redraw() and enable_usr1() when it is set.
+ * calls render_redraw() and enable_usr1() when it is set, and then
+ * acknowledges the update it drew.  It also writes out the trace when
+ * the main window asks.
  */
 gboolean onIdle(gpointer data)
 {
     struct ren_ctx *ctx = (struct ren_ctx *) data;
+    unsigned long seq;
+    uint64_t start;
 
     if (ctx->reload) {
         ctx->reload = 0;
 
+        start = trace_now();
+        seq = shm_update_seq(shm);
+        trace_flow("update", TRACE_FLOW_END, seq);
         if (render_redraw(gctx) != 0) {
             FAIL_MSG("onIdle: render_redraw() failed\n");
             return TRUE;
         }
 
+        trace_span("reload", start);
+        shm_ack(shm, seq);
+
         if (enable_usr1() != 0) {
             FAIL_MSG("onIdle: enable_usr1() failed\n");
             return TRUE;
@@ -100,6 +111,10 @@ gboolean onIdle(gpointer data)
 
     }
 
+    if (trace_poll(shm) != 0) {
+        FAIL_MSG("onIdle: trace_poll() failed\n");
+    }
+
     return TRUE;
 }
 
@@ -142,8 +157,9 @@ change_display(gpointer callback_data, guint callback_action,
 
 
     if (GTK_CHECK_MENU_ITEM(menu_item)->active) {
-        if ((callback_action >= DISP_HILBERTFLIPPED)
-            && (callback_action <= DISP_HILBERT)) {
+        if (((callback_action >= DISP_HILBERTFLIPPED)
+             && (callback_action <= DISP_HILBERT))
+            || (callback_action == DISP_MORTON)) {
             gctx->disp_hilbert = callback_action;
 			if (render_redraw(gctx) != 0) {
 				FAIL_MSG("change_col: render_redraw() failed\n");
@@ -155,6 +171,51 @@ change_display(gpointer callback_data, guint callback_action,
 }
 
 
+/* hide_stats is a menu callback.  It shows/hides the drawing statistics
+ * under the picture */
+void hide_stats(gpointer data, guint action, GtkWidget * widget)
+{
+    struct ren_ctx *ctx = (struct ren_ctx *) data;
+
+    if (!ctx) {
+        FAIL_MSG("hide_stats: invalid params\n");
+        return;
+    }
+
+
+    ctx->stats_show = !ctx->stats_show;
+    if (ctx->stats_show) {
+        stats_timer(ctx);
+        gtk_widget_show(ctx->stats);
+    } else {
+        gtk_widget_hide(ctx->stats);
+    }
+}
+
+
+/* stats_timer refreshes the drawing statistics and dumps them if asked */
+gboolean stats_timer(gpointer data)
+{
+    struct ren_ctx *ctx = (struct ren_ctx *) data;
+    char buf[STATS_DUMPSIZE];
+
+    if (stats_poll() != 0) {
+        FAIL_MSG("stats_timer: stats_poll() failed\n");
+    }
+
+    if (ctx && ctx->stats_show) {
+        if (stats_format(buf, sizeof(buf)) != 0) {
+            FAIL_MSG("stats_timer: stats_format() failed\n");
+            return TRUE;
+        }
+
+        gtk_label_set_text(GTK_LABEL(ctx->stats), buf);
+    }
+
+    return TRUE;
+}
+
+
 /* set_update is a menu callback.  It holds/unholds the updating of the
  * display */
 void set_update(gpointer data, guint action, GtkWidget * widget)
@@ -218,12 +279,19 @@ GtkItemFactoryEntry ren_menu_items_hil[] = {
     {"/Curve/Hilbert", NULL, change_display, DISP_HILBERT,
 	"/Curve/HilbertFlipped"}
     ,
+    {"/Curve/Morton", NULL, change_display, DISP_MORTON,
+	"/Curve/HilbertFlipped"}
+    ,
     {"/_Update", NULL, NULL, 0, "<Branch>"}
     ,
     {"/Update/Continuous", "c", set_update, UPDATE_CONT, "<RadioItem>"}
     ,
     {"/Update/Hold", "h", set_update, UPDATE_HOLD, "/Update/Continuous"}
     ,
+    {"/_Window", NULL, NULL, 0, "<Branch>"}
+    ,
+    {"/Window/Statistics on-off", NULL, hide_stats, 0, "<Item>"}
+    ,
 };
 
 GtkItemFactoryEntry ren_menu_items_shan[] = {
@@ -253,12 +321,19 @@ GtkItemFactoryEntry ren_menu_items_shan[] = {
 	{"/Curve/Hilbert", NULL, change_display, DISP_HILBERT,
 	"/Curve/HilbertFlipped"}
 	,
+	{"/Curve/Morton", NULL, change_display, DISP_MORTON,
+	"/Curve/HilbertFlipped"}
+	,
 	{"/_Update", NULL, NULL, 0, "<Branch>"}
     ,
     {"/Update/Continuous", "c", set_update, UPDATE_CONT, "<RadioItem>"}
     ,
     {"/Update/Hold", "h", set_update, UPDATE_HOLD, "/Update/Continuous"}
     ,
+    {"/_Window", NULL, NULL, 0, "<Branch>"}
+    ,
+    {"/Window/Statistics on-off", NULL, hide_stats, 0, "<Item>"}
+    ,
 };
 
 
@@ -396,6 +471,12 @@ configure_event(GtkWidget * widget, GdkEventConfigure * event,
     }
 
 
+    /* the window is a fixed size, so once it is drawn only a change to
+     * the selection draws it again */
+    if (ctx->surface) {
+        return TRUE;
+    }
+
     if (render_redraw(ctx) != 0) {
         FAIL_MSG("configure_event: render_redraw() failed\n");
         return TRUE;
@@ -406,21 +487,26 @@ configure_event(GtkWidget * widget, GdkEventConfigure * event,
 }
 
 
-/* expose_event redraws the screen from the backing pixbuf */
+/* expose_event repaints the damaged part of the screen from the backing
+ * surface */
 gboolean
 expose_event(GtkWidget * widget, GdkEventExpose * event, gpointer data)
 {
     cairo_t *cr;
-    GdkPixbuf *pb;
 	struct ren_ctx *ctx = (struct ren_ctx *)data;
+    uint64_t start;
 
-    if (!widget || !ctx) {
+    if (!widget || !event || !ctx) {
         FAIL_MSG("expose_event: invalid params\n");
         return FALSE;
     }
 
 
-    pb = ctx->pixbuf;
+    if (!ctx->surface) {
+        return FALSE;
+    }
+
+    start = trace_now();
 
     cr = gdk_cairo_create(gtk_widget_get_window(widget));
     if (!cr) {
@@ -429,10 +515,14 @@ expose_event(GtkWidget * widget, GdkEventExpose * event, gpointer data)
     }
 
 
-    gdk_cairo_set_source_pixbuf(cr, pb, 0, 0);
+    gdk_cairo_region(cr, event->region);
+    cairo_clip(cr);
+    cairo_set_source_surface(cr, ctx->surface, 0, 0);
     cairo_paint(cr);
     cairo_destroy(cr);
 
+    trace_span("paint", start);
+
     return FALSE;
 }
 
@@ -448,7 +538,7 @@ int init_arrays(struct ren_ctx *ctx)
 	
     ctx->col_set = COL_CORTESI;
     ctx->disp_hilbert = DISP_HILBERTFLIPPED;
-	ctx->pixbuf = NULL;
+	ctx->surface = NULL;
 
     /* clear the savepic struct */
 	save.pic = NULL;
@@ -578,6 +668,11 @@ int copyshm(struct ren_ctx *ctx)
     ctx->offset = shm->offset;
     ctx->type = shm->buf_type;
 
+    /* a followed file may have grown */
+    if (shm->filestat.st_size > ctx->filestat.st_size) {
+        ctx->filestat.st_size = shm->filestat.st_size;
+    }
+
     /* unlock the shared memory */
     if (sem_post(sem) != 0) {
         FAIL_ERR("copyshm: sem_post() failed\n");
@@ -593,6 +688,7 @@ int render_display(void *rawctx)
 {
     struct ren_ctx *ctx = (struct ren_ctx *) rawctx;
     GtkWidget *menubar;
+    PangoFontDescription *pfd;
 
     if (!ctx) {
         FAIL_MSG("render_display: invalid params\n");
@@ -675,6 +771,21 @@ int render_display(void *rawctx)
     }
 
 
+    /* drawing statistics, hidden until asked for */
+    ctx->stats = gtk_label_new("");
+    if (!ctx->stats) {
+        FAIL_MSG("render_display: gtk_label_new() failed\n");
+        return 9;
+    }
+
+    gtk_misc_set_alignment(GTK_MISC(ctx->stats), 0, 0);
+    pfd = pango_font_description_from_string("Monospace 8");
+    if (pfd) {
+        gtk_widget_modify_font(ctx->stats, pfd);
+        pango_font_description_free(pfd);
+    }
+    gtk_box_pack_start(GTK_BOX(ctx->vbox), ctx->stats, FALSE, FALSE, 0);
+
     gtk_widget_show(ctx->window);
 
     return 0;
@@ -699,7 +810,9 @@ int main(int argc, char *argv[])
 {
     struct ren_ctx *ctx = NULL;
     struct stat stattmp;
+    char shmpath[256];
 	char *ptr = NULL;
+    char *arg;
 
 	if (argc <= 0) {
 		printf
@@ -714,15 +827,36 @@ int main(int argc, char *argv[])
 
     gtk_init(&argc, &argv);
 
-    if (!strncmp(argv[1], "/rb_shm.", 8)) {
+    ctx = render_init(256, 256, 200, 200);
+    if (!ctx) {
+        FAIL_MSG("main: render_init() failed\n");
+        return 5;
+    }
+
+
+    gctx = ctx;
+
+    /* a zygote gets GTK ready and then waits to be given the shm name */
+    arg = argv[1];
+    if (strcmp(argv[1], SHM_ZYGOTE_ARG) == 0) {
+        if (shm_zygote_wait(shmpath, sizeof(shmpath)) != 0) {
+            exit(0);
+        }
+        arg = shmpath;
+    }
+
+    if (!strncmp(arg, "/rb_shm.", 8)) {
 
         /* argument is named shared memory buffer */
 		shm_destroy = 0;
-        if (shm_open_buffer(argv[1], &shm, &sem) != 0) {
+        if (shm_open_buffer(arg, &shm, &sem) != 0) {
             FAIL_MSG("main: shm_open_buffer() failed\n");
             return 2;
         }
 
+        /* with the memory budget rubbermarbles has set */
+        budget_attach(shm, "rb-render");
+
     } else {
 
         /* argument is a file */
@@ -732,12 +866,12 @@ int main(int argc, char *argv[])
             return 3;
         }
 
-        if (stat(argv[1], &stattmp) != 0) {
-            FAIL_ERR("main: stat() failed\n");
+        if (blkdev_stat(arg, &stattmp) != 0) {
+            FAIL_MSG("main: blkdev_stat() failed\n");
             return 4;
         }
 
-        strncpy(shm->filename, argv[1], PATH_MAX - 1);
+        strncpy(shm->filename, arg, PATH_MAX - 1);
         shm->filename[PATH_MAX - 1] = 0x00;
         shm->offset = 0;
         shm->bufsize = stattmp.st_size;
@@ -754,15 +888,6 @@ int main(int argc, char *argv[])
         ptr++;
     }
 
-    ctx = render_init(256, 256, 200, 200);
-    if (!ctx) {
-        FAIL_MSG("main: render_init() failed\n");
-        return 5;
-    }
-
-
-    gctx = ctx;
-
     /* open the file */
     ctx->fd = open(shm->filename, O_RDONLY);
     if (ctx->fd == -1) {
@@ -771,9 +896,9 @@ int main(int argc, char *argv[])
     }
 
 
-    /* stat it */
-    if (fstat(ctx->fd, &(ctx->filestat)) != 0) {
-        FAIL_ERR("main: cannot stat file\n");
+    /* stat it, sizing block devices */
+    if (blkdev_fstat(ctx->fd, &(ctx->filestat)) != 0) {
+        FAIL_MSG("main: cannot stat file\n");
         return 7;
     }
 
@@ -823,6 +948,26 @@ int main(int argc, char *argv[])
     }
 
 
+    /* count where the drawing time goes; RB_STATS dumps it */
+    if (stats_init(argv[0]) != 0) {
+        FAIL_MSG("main: stats_init() failed\n");
+        return 13;
+    }
+
+
+    if (g_timeout_add(STATS_HUD_MS, stats_timer, ctx) <= 0) {
+        FAIL_ERR("main: g_timeout_add() failed\n");
+        return 14;
+    }
+
+
+    /* RB_TRACE adds this process to the main window's trace */
+    if (trace_init(argv[0], 0) != 0) {
+        FAIL_MSG("main: trace_init() failed\n");
+        return 15;
+    }
+
+
     gtk_main();
 
 	cleanup();
@@ -26,6 +26,8 @@
 #include "rb-ren-draw.h"
 #include "rb-data.h"
 #include "rb-mmap.h"
+#include "rb-blkdev.h"
+#include "rb-trace.h"
 #include "macro.h"
 
 
@@ -43,6 +45,8 @@ int render_free(void *rawctx);
 
 void sig_handler(int signo);
 void set_update(gpointer data, guint action, GtkWidget * widget);
+void hide_stats(gpointer data, guint action, GtkWidget * widget);
+gboolean stats_timer(gpointer data);
 GtkWidget *hd_menubar_menu(struct ren_ctx *ctx);
 void quit_local(gpointer data, guint action, GtkWidget * widget);
 gboolean destroy_local(GtkWidget * widget, gpointer data);
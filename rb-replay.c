@@ -0,0 +1,663 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-replay.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to record the selection drags and menu choices of a
+ * session and to replay them against the main window.  Each replayed event
+ * is timed until the pixbufs it redrew have been exposed, and until every
+ * running visualiser has acknowledged the update through the shared memory,
+ * and the latencies are reported as percentiles.
+ */
+
+#include "rb-gtk.h"
+#include "rb-replay.h"
+
+extern struct widgets wx;
+extern struct vis child[MAX_VIS];
+extern struct visualiser *visualisers;
+extern unsigned int visualiser_count;
+extern struct rb_shm *shm;
+
+/* the trace being recorded */
+static FILE *record = NULL;
+static uint64_t record_start = 0;
+
+/* the replay */
+static struct replay_ctx replay;
+
+static char *replay_names[] = { "press", "release", "motion", "menu" };
+
+
+/* replay_record_open starts recording the session to a trace file */
+int replay_record_open(char *path)
+{
+    if (!path || !shm) {
+        FAIL_MSG("replay_record_open: invalid params\n");
+        return 1;
+    }
+
+
+    record = fopen(path, "w");
+    if (!record) {
+        FAIL_ERR("replay_record_open: fopen() failed\n");
+        return 2;
+    }
+
+
+    fprintf(record, "# rubbermarbles trace\n# file %s %ld\n",
+            shm->filename, (long) shm->filestat.st_size);
+    fflush(record);
+    record_start = shm_now();
+
+    return 0;
+}
+
+
+/* replay_record_button records a mouse event on one of the pixbufs */
+int replay_record_button(int type, int pixbuf, int x, int y, int button)
+{
+    if (!record) {
+        return 0;
+    }
+
+    if ((type < REPLAY_PRESS) || (type > REPLAY_MOTION)) {
+        FAIL_MSG("replay_record_button: invalid params\n");
+        return 1;
+    }
+
+
+    fprintf(record, "%.3f %s %d %d %d %d\n",
+            (shm_now() - record_start) / 1e6, replay_names[type], pixbuf,
+            x, y, button);
+    fflush(record);
+
+    return 0;
+}
+
+
+/* replay_record_menu records a menu choice by its item path */
+int replay_record_menu(GtkWidget * menu_item)
+{
+    const gchar *path;
+
+    if (!record || !menu_item) {
+        return 0;
+    }
+
+    path = gtk_item_factory_path_from_widget(menu_item);
+    if (!path) {
+        FAIL_MSG("replay_record_menu: not a menu item\n");
+        return 1;
+    }
+
+
+    fprintf(record, "%.3f %s %s\n", (shm_now() - record_start) / 1e6,
+            replay_names[REPLAY_MENU], path);
+    fflush(record);
+
+    return 0;
+}
+
+
+/* replay_parse reads one trace line into an event; returns 1 for lines to skip */
+static int replay_parse(char *line, struct replay_event *ev)
+{
+    char name[16];
+    double ms;
+    int used;
+    int len;
+
+    if ((line[0] == '#') || (line[0] == '\n') || (line[0] == 0x00)) {
+        return 1;
+    }
+
+    if (sscanf(line, "%lf %15s %n", &ms, name, &used) != 2) {
+        return -1;
+    }
+
+    memset(ev, 0, sizeof(struct replay_event));
+    ev->at = ms * 1e6;
+
+    for (ev->type = 0; ev->type < REPLAY_TYPES; ev->type++) {
+        if (strcmp(name, replay_names[ev->type]) == 0) {
+            break;
+        }
+    }
+
+    switch (ev->type) {
+    case REPLAY_PRESS:
+    case REPLAY_RELEASE:
+    case REPLAY_MOTION:
+        if ((sscanf(line + used, "%d %d %d %d", &ev->pixbuf, &ev->x,
+                    &ev->y, &ev->button) != 4) || (ev->pixbuf < 0)
+            || (ev->pixbuf > PIXBUF_ZOOM_HILBERT)) {
+            return -1;
+        }
+        break;
+    case REPLAY_MENU:
+        len = strlen(line + used);
+        while (len && ((line[used + len - 1] == '\n')
+                       || (line[used + len - 1] == '\r'))) {
+            len--;
+        }
+        if (!len) {
+            return -1;
+        }
+        ev->path = strndup(line + used, len);
+        if (!ev->path) {
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* replay_load reads a trace file */
+int replay_load(struct replay_ctx *ctx, char *path)
+{
+    FILE *fp;
+    char line[REPLAY_MAXLINE];
+    char filename[REPLAY_MAXLINE];
+    long size;
+    unsigned long alloced;
+    struct replay_event *events;
+    int lineno;
+    int ret;
+
+    if (!ctx || !path) {
+        FAIL_MSG("replay_load: invalid params\n");
+        return 1;
+    }
+
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        FAIL_ERR("replay_load: fopen() failed\n");
+        return 2;
+    }
+
+
+    alloced = 0;
+    lineno = 0;
+    while (fgets(line, REPLAY_MAXLINE, fp)) {
+        lineno++;
+
+        /* warn if the trace came from a different file */
+        if (sscanf(line, "# file %1023s %ld", filename, &size) == 2) {
+            if (size != (long) shm->filestat.st_size) {
+                fprintf(stderr, "replay_load: trace recorded against %s "
+                        "(%ld bytes), not this file\n", filename, size);
+            }
+            continue;
+        }
+
+        if (ctx->nevents == alloced) {
+            alloced = alloced ? alloced * 2 : 1024;
+            events = (struct replay_event *) realloc(ctx->events,
+                                                     alloced *
+                                                     sizeof(struct
+                                                            replay_event));
+            if (!events) {
+                FAIL_MSG("replay_load: realloc() failed\n");
+                fclose(fp);
+                return 3;
+            }
+
+            ctx->events = events;
+        }
+
+        ret = replay_parse(line, &ctx->events[ctx->nevents]);
+        if (ret < 0) {
+            fprintf(stderr, "replay_load: bad event on line %d\n", lineno);
+            continue;
+        }
+        if (ret == 0) {
+            ctx->nevents++;
+        }
+    }
+
+    fclose(fp);
+
+    if (!ctx->nevents) {
+        FAIL_MSG("replay_load: no events in trace\n");
+        return 4;
+    }
+
+
+    return 0;
+}
+
+
+/* replay_start loads a trace and starts replaying it once the window is up */
+int replay_start(char *path, char *outpath)
+{
+    if (!path) {
+        FAIL_MSG("replay_start: invalid params\n");
+        return 1;
+    }
+
+
+    memset(&replay, 0, sizeof(struct replay_ctx));
+    replay.trace = path;
+    if (replay_load(&replay, path) != 0) {
+        FAIL_MSG("replay_start: replay_load() failed\n");
+        return 2;
+    }
+
+
+    replay.child =
+        (struct replay_stat *) calloc(visualiser_count + 1,
+                                      sizeof(struct replay_stat));
+    if (!replay.child) {
+        FAIL_MSG("replay_start: calloc() failed\n");
+        return 3;
+    }
+
+
+    replay.out = stdout;
+    if (outpath) {
+        replay.out = fopen(outpath, "w");
+        if (!replay.out) {
+            FAIL_ERR("replay_start: fopen() failed\n");
+            return 4;
+        }
+
+    }
+
+    /* the events keep their recorded spacing from when the window settles */
+    replay.start = shm_now() + (REPLAY_SETTLE_MS * 1000000ULL);
+    gdk_threads_add_timeout(REPLAY_POLL_MS, replay_poll, NULL);
+
+    return 0;
+}
+
+
+/* replay_stat_add adds a latency to a set */
+static int replay_stat_add(struct replay_stat *stat, uint64_t ns)
+{
+    uint64_t *grown;
+
+    if (stat->count == stat->size) {
+        stat->size = stat->size ? stat->size * 2 : 256;
+        grown = (uint64_t *) realloc(stat->ns, stat->size * sizeof(uint64_t));
+        if (!grown) {
+            FAIL_MSG("replay_stat_add: realloc() failed\n");
+            return 1;
+        }
+
+        stat->ns = grown;
+    }
+
+    stat->ns[stat->count++] = ns;
+
+    return 0;
+}
+
+
+/* replay_widget returns the drawing area for a pixbuf */
+static GtkWidget *replay_widget(int pixbufnum)
+{
+    switch (pixbufnum) {
+    case PIXBUF_WHOLE_HILBERT:
+        return wx.hilbert_whole;
+    case PIXBUF_WHOLE_ZIGZAG:
+        return wx.zigzag_whole;
+    case PIXBUF_WIN:
+        return wx.zigzag_win;
+    case PIXBUF_ZOOM_ZIGZAG:
+        return wx.zigzag_zoom;
+    case PIXBUF_ZOOM_HILBERT:
+        return wx.hilbert_zoom;
+    }
+
+    return NULL;
+}
+
+
+/* replay_dispatch feeds one event to the main window's handlers */
+static int replay_dispatch(struct replay_event *ev)
+{
+    GdkEventButton button;
+    GdkEventMotion motion;
+    GtkItemFactory *factory;
+    GtkWidget *widget = NULL;
+    GtkWidget *item;
+    gpointer data;
+
+    replay.busy = 1;
+    replay.type = ev->type;
+    replay.queued = 0;
+    replay.seq = 0;
+    replay.nchildren = 0;
+
+    if (ev->type != REPLAY_MENU) {
+        widget = replay_widget(ev->pixbuf);
+        if (!widget) {
+            FAIL_MSG("replay_dispatch: no widget\n");
+            return 1;
+        }
+
+    }
+    data = (gpointer) (long) ev->pixbuf;
+
+    replay.t0 = shm_now();
+
+    switch (ev->type) {
+    case REPLAY_PRESS:
+    case REPLAY_RELEASE:
+        memset(&button, 0, sizeof(GdkEventButton));
+        button.type =
+            ev->type == REPLAY_PRESS ? GDK_BUTTON_PRESS : GDK_BUTTON_RELEASE;
+        button.window = widget->window;
+        button.send_event = TRUE;
+        button.x = ev->x;
+        button.y = ev->y;
+        button.button = ev->button;
+        if (ev->type == REPLAY_PRESS) {
+            button_press_event(widget, &button, data);
+        } else {
+            button_release_event(widget, &button, data);
+        }
+        break;
+    case REPLAY_MOTION:
+        memset(&motion, 0, sizeof(GdkEventMotion));
+        motion.type = GDK_MOTION_NOTIFY;
+        motion.window = widget->window;
+        motion.send_event = TRUE;
+        motion.x = ev->x;
+        motion.y = ev->y;
+        motion.state =
+            ev->button == 3 ? GDK_BUTTON3_MASK : GDK_BUTTON1_MASK;
+        motion_notify_event(widget, &motion, data);
+        break;
+    case REPLAY_MENU:
+        factory = gtk_item_factory_from_path(ev->path);
+        item = factory ? gtk_item_factory_get_item(factory, ev->path) : NULL;
+        if (!item) {
+            fprintf(stderr, "replay_dispatch: no menu item %s\n", ev->path);
+            break;
+        }
+        /* radio items call back when they become active */
+        if (GTK_IS_CHECK_MENU_ITEM(item)) {
+            gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item), TRUE);
+        } else {
+            gtk_menu_item_activate(GTK_MENU_ITEM(item));
+        }
+        /* give a new visualiser time to start */
+        if (strstr(ev->path, "/Visualise/")) {
+            replay.hold = shm_now() + (REPLAY_SETTLE_MS * 1000000ULL);
+        }
+        break;
+    }
+
+    /* events that redrew nothing are not timed */
+    if (!replay.queued && !replay.seq) {
+        replay.busy = 0;
+        replay.skipped++;
+    }
+
+    return 0;
+}
+
+
+/* replay_silent returns whether a visualiser has never acknowledged a redraw */
+static int replay_silent(pid_t pid)
+{
+    int i;
+
+    for (i = 0; i < MAX_VIS; i++) {
+        if (replay.silent[i] == pid) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* replay_running returns whether a visualiser is still running */
+static int replay_running(pid_t pid)
+{
+    int i;
+
+    for (i = 0; i < MAX_VIS; i++) {
+        if (child[i].pid == pid) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* replay_waiting collects the redraws of the event in flight and returns
+ * whether any are still outstanding */
+static int replay_waiting(uint64_t now)
+{
+    unsigned long seq;
+    uint64_t ns;
+    int waiting;
+    int i, j;
+
+    /* the visualisers that never answer aren't waited for again */
+    if (now - replay.t0 > REPLAY_TIMEOUT_MS * 1000000ULL) {
+        replay.timeouts++;
+        for (i = 0; i < replay.nchildren; i++) {
+            if (replay.pids[i]) {
+                for (j = 0; j < MAX_VIS; j++) {
+                    if (!replay.silent[j]) {
+                        replay.silent[j] = replay.pids[i];
+                        break;
+                    }
+                }
+            }
+        }
+        return 0;
+    }
+
+    waiting = replay.queued != 0;
+
+    for (i = 0; i < replay.nchildren; i++) {
+        if (!replay.pids[i]) {
+            continue;
+        }
+
+        if (!replay_running(replay.pids[i])) {
+            replay.pids[i] = 0;
+            continue;
+        }
+
+        if ((shm_ack_get(shm, replay.pids[i], &seq, &ns) == 0)
+            && (seq >= replay.seq)) {
+            replay_stat_add(&replay.child[replay.visids[i]],
+                            ns > replay.t0 ? ns - replay.t0 : 0);
+            replay.pids[i] = 0;
+            continue;
+        }
+
+        waiting = 1;
+    }
+
+    return waiting;
+}
+
+
+/* replay_poll runs the replay from a timer */
+gboolean replay_poll(gpointer data)
+{
+    struct replay_event *ev;
+    uint64_t now;
+
+    now = shm_now();
+
+    if (replay.busy) {
+        if (replay_waiting(now)) {
+            return TRUE;
+        }
+        replay.busy = 0;
+    }
+
+    if (replay.next >= replay.nevents) {
+        if (replay_report(&replay, replay.out) != 0) {
+            FAIL_MSG("replay_poll: replay_report() failed\n");
+        }
+        if (replay.out != stdout) {
+            fclose(replay.out);
+        }
+        quit();
+        return FALSE;
+    }
+
+    /* keep the recorded spacing, but never overlap events */
+    ev = &replay.events[replay.next];
+    if ((now < replay.start + ev->at) || (now < replay.hold)) {
+        return TRUE;
+    }
+
+    replay.next++;
+    if (replay_dispatch(ev) != 0) {
+        FAIL_MSG("replay_poll: replay_dispatch() failed\n");
+        replay.busy = 0;
+    }
+
+    return TRUE;
+}
+
+
+/* replay_queued notes that the event in flight redrew a pixbuf */
+int replay_queued(int pixbufnum)
+{
+    if (!replay.busy) {
+        return 0;
+    }
+
+    replay.queued |= 1 << pixbufnum;
+
+    return 0;
+}
+
+
+/* replay_exposed notes that a pixbuf has been painted; the event's paint
+ * latency is taken when the last of its pixbufs is exposed */
+int replay_exposed(int pixbufnum)
+{
+    uint64_t ns;
+
+    if (!replay.busy || !(replay.queued & (1 << pixbufnum))) {
+        return 0;
+    }
+
+    replay.queued &= ~(1 << pixbufnum);
+    if (!replay.queued) {
+        ns = shm_now() - replay.t0;
+        replay_stat_add(&replay.paint[replay.type], ns);
+        replay_stat_add(&replay.all, ns);
+    }
+
+    return 0;
+}
+
+
+/* replay_children notes that the event in flight updated the visualisers */
+int replay_children(unsigned long seq)
+{
+    int i;
+
+    if (!replay.busy) {
+        return 0;
+    }
+
+    replay.seq = seq;
+    replay.nchildren = 0;
+    for (i = 0; i < MAX_VIS; i++) {
+        if (child[i].pid && !replay_silent(child[i].pid)
+            && (child[i].visid >= 0)
+            && (child[i].visid < visualiser_count)) {
+            replay.pids[replay.nchildren] = child[i].pid;
+            replay.visids[replay.nchildren] = child[i].visid;
+            replay.nchildren++;
+        }
+    }
+
+    return 0;
+}
+
+
+/* replay_cmp orders latencies */
+static int replay_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+/* replay_line prints the percentiles of a set of latencies */
+static void replay_line(FILE * fp, char *name, struct replay_stat *stat)
+{
+    unsigned long n = stat->count;
+
+    if (!n) {
+        fprintf(fp, "%-24s %8d\n", name, 0);
+        return;
+    }
+
+    qsort(stat->ns, n, sizeof(uint64_t), replay_cmp);
+
+    /* nearest rank */
+    fprintf(fp, "%-24s %8lu %9.3f %9.3f %9.3f %9.3f\n", name, n,
+            stat->ns[((n * 50) + 99) / 100 - 1] / 1e6,
+            stat->ns[((n * 95) + 99) / 100 - 1] / 1e6,
+            stat->ns[((n * 99) + 99) / 100 - 1] / 1e6,
+            stat->ns[n - 1] / 1e6);
+}
+
+
+/* replay_report prints the latency percentiles */
+int replay_report(struct replay_ctx *ctx, FILE * fp)
+{
+    char name[300];
+    int i;
+
+    if (!ctx || !fp) {
+        FAIL_MSG("replay_report: invalid params\n");
+        return 1;
+    }
+
+
+    fprintf(fp, "replay of %s: %lu events, %lu without redraws, "
+            "%lu timed out\n\n", ctx->trace, ctx->nevents, ctx->skipped,
+            ctx->timeouts);
+    fprintf(fp, "%-24s %8s %9s %9s %9s %9s\n", "input to repaint", "count",
+            "p50 ms", "p95 ms", "p99 ms", "max ms");
+    for (i = 0; i < REPLAY_TYPES; i++) {
+        replay_line(fp, replay_names[i], &ctx->paint[i]);
+    }
+    replay_line(fp, "all", &ctx->all);
+
+    fprintf(fp, "\n%-24s %8s %9s %9s %9s %9s\n", "input to child redraw",
+            "count", "p50 ms", "p95 ms", "p99 ms", "max ms");
+    for (i = 0; i < visualiser_count; i++) {
+        if (ctx->child[i].count) {
+            snprintf(name, sizeof(name), "%s", visualisers[i].name);
+            replay_line(fp, name, &ctx->child[i]);
+        }
+    }
+
+    fflush(fp);
+
+    return 0;
+}
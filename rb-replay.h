@@ -0,0 +1,111 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-replay.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_REPLAY_H
+#define _RB_REPLAY_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "rb-data.h"
+#include "rb-shm.h"
+#include "macro.h"
+
+/* environment variables that record and replay a session */
+#define REPLAY_RECORD_ENV "RB_RECORD"
+#define REPLAY_ENV "RB_REPLAY"
+#define REPLAY_OUT_ENV "RB_REPLAY_OUT"
+
+/* how often the replay looks for repaints and redraws, in ms */
+#define REPLAY_POLL_MS 1
+/* how long the window and new visualisers get to settle, in ms */
+#define REPLAY_SETTLE_MS 1000
+/* how long to wait for an event's redraws, in ms */
+#define REPLAY_TIMEOUT_MS 10000
+
+/* recorded events */
+#define REPLAY_PRESS 0
+#define REPLAY_RELEASE 1
+#define REPLAY_MOTION 2
+#define REPLAY_MENU 3
+#define REPLAY_TYPES 4
+
+#define REPLAY_MAXLINE 1024
+
+/* one recorded event; menu events are replayed by their item path */
+struct replay_event {
+    uint64_t at;
+    int type;
+    int pixbuf;
+    int x;
+    int y;
+    int button;
+    char *path;
+};
+
+/* a set of latencies */
+struct replay_stat {
+    uint64_t *ns;
+    unsigned long count;
+    unsigned long size;
+};
+
+/* a replay in progress */
+struct replay_ctx {
+    /* the trace */
+    char *trace;
+    struct replay_event *events;
+    unsigned long nevents;
+    unsigned long next;
+    uint64_t start;
+    uint64_t hold;
+    FILE *out;
+
+    /* the event in flight */
+    int busy;
+    int type;
+    uint64_t t0;
+    unsigned int queued;
+    unsigned long seq;
+    pid_t pids[MAX_VIS];
+    int visids[MAX_VIS];
+    int nchildren;
+
+    /* visualisers that never acknowledge a redraw */
+    pid_t silent[MAX_VIS];
+
+    /* results */
+    struct replay_stat paint[REPLAY_TYPES];
+    struct replay_stat all;
+    struct replay_stat *child;
+    unsigned long skipped;
+    unsigned long timeouts;
+};
+
+int replay_record_open(char *path);
+int replay_record_button(int type, int pixbuf, int x, int y, int button);
+int replay_record_menu(GtkWidget * menu_item);
+int replay_load(struct replay_ctx *ctx, char *path);
+int replay_start(char *path, char *outpath);
+gboolean replay_poll(gpointer data);
+int replay_queued(int pixbufnum);
+int replay_exposed(int pixbufnum);
+int replay_children(unsigned long seq);
+int replay_report(struct replay_ctx *ctx, FILE * fp);
+
+#endif
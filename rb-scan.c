@@ -0,0 +1,300 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-scan.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to scan a file in parallel.  The file is split into
+ * blocks that worker threads take in turn, read with pread() and pass to a
+ * callback together with a few bytes of the following block, so that
+ * matches across block boundaries are seen exactly once.  The reads are
+ * large, sequential and aligned to the logical block size, so block devices
+ * can be scanned without mmap().  A file whose bytes aren't what pread()
+ * returns, such as the view of a compressed file, can be given a reader of
+ * its own.
+ */
+
+#include "rb-scan.h"
+
+
+/* worker arguments */
+struct scan_worker {
+    struct scan_ctx *ctx;
+    int thread;
+};
+
+
+/* the file that is read with a reader of its own */
+static int source_fd = -1;
+static scan_read_fn source_read = NULL;
+static void *source_arg = NULL;
+
+
+/* scan_threads returns the number of worker threads to use */
+int scan_threads()
+{
+    long cpus;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    if (cpus > SCAN_MAX_THREADS) {
+        cpus = SCAN_MAX_THREADS;
+    }
+
+    return (int) cpus;
+}
+
+
+/* rb_scan_source makes scans of fd read with read instead of pread(); a
+ * NULL read puts it back */
+int rb_scan_source(int fd, scan_read_fn read, void *arg)
+{
+    if (read && (fd < 0)) {
+        FAIL_MSG("rb_scan_source: invalid params\n");
+        return 1;
+    }
+
+
+    source_fd = read ? fd : -1;
+    source_read = read;
+    source_arg = arg;
+
+    return 0;
+}
+
+
+/* rb_scan_init sets up a scan of the file from start to end */
+int rb_scan_init(struct scan_ctx *ctx, int fd, unsigned long start,
+                 unsigned long end, unsigned long blocksize,
+                 unsigned long overlap, scan_fn fn, void *arg)
+{
+    if (!ctx || (fd < 0) || (end < start) || !blocksize || !fn) {
+        FAIL_MSG("rb_scan_init: invalid params\n");
+        return 1;
+    }
+
+
+    memset(ctx, 0, sizeof(struct scan_ctx));
+    ctx->fd = fd;
+    ctx->start = start;
+    ctx->end = end;
+    ctx->blocksize = blocksize;
+    ctx->overlap = overlap;
+    ctx->align = blkdev_align(fd);
+    ctx->threads = scan_threads();
+    if (fd == source_fd) {
+        ctx->read = source_read;
+        ctx->read_arg = source_arg;
+    }
+    ctx->fn = fn;
+    ctx->arg = arg;
+    ctx->nblocks = (end - start + blocksize - 1) / blocksize;
+
+    return 0;
+}
+
+
+/* scan_worker takes blocks until there are none left */
+static void *scan_worker(void *data)
+{
+    struct scan_worker *worker = (struct scan_worker *) data;
+    struct scan_ctx *ctx = worker->ctx;
+    uint8_t *buf;
+    unsigned long skip;
+    unsigned long block;
+    unsigned long offset;
+    unsigned long len;
+    unsigned long want;
+    long got;
+
+    /* room for the read to be rounded out to the alignment both ends */
+    if (posix_memalign((void **) &buf, ctx->align,
+                       ctx->blocksize + ctx->overlap + (2 * ctx->align)) !=
+        0) {
+        FAIL_MSG("scan_worker: posix_memalign() failed\n");
+        __atomic_store_n(&ctx->error, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+
+    while (!__atomic_load_n(&ctx->cancel, __ATOMIC_RELAXED)
+           && !__atomic_load_n(&ctx->error, __ATOMIC_RELAXED)) {
+        block = __atomic_fetch_add(&ctx->next_block, 1, __ATOMIC_RELAXED);
+        if (block >= ctx->nblocks) {
+            break;
+        }
+
+        offset = ctx->start + (block * ctx->blocksize);
+        len = ctx->blocksize;
+        if (offset + len > ctx->end) {
+            len = ctx->end - offset;
+        }
+
+        /* the overlap may run past the end of the scan, not the file */
+        want = len + ctx->overlap;
+        if (ctx->read) {
+            skip = 0;
+            got = ctx->read(ctx->read_arg, buf, want, offset);
+        } else {
+            got = blkdev_pread_aligned(ctx->fd, buf, want, offset,
+                                       ctx->align, &skip);
+        }
+        if (got < 0) {
+            FAIL_ERR("scan_worker: pread() failed\n");
+            __atomic_store_n(&ctx->error, 2, __ATOMIC_RELAXED);
+            break;
+        }
+
+        if (got < len) {
+            len = got;
+        }
+
+        if (ctx->fn(ctx->arg, worker->thread, block, offset, buf + skip, len,
+                    got) != 0) {
+            FAIL_MSG("scan_worker: scan callback failed\n");
+            __atomic_store_n(&ctx->error, 3, __ATOMIC_RELAXED);
+            break;
+        }
+
+        __atomic_fetch_add(&ctx->done_blocks, 1, __ATOMIC_RELAXED);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+
+/* rb_scan runs the scan across the worker threads and waits for them */
+int rb_scan(struct scan_ctx *ctx)
+{
+    pthread_t threads[SCAN_MAX_THREADS];
+    struct scan_worker workers[SCAN_MAX_THREADS];
+    int i;
+    int started;
+
+    if (!ctx || (ctx->threads < 1) || (ctx->threads > SCAN_MAX_THREADS)) {
+        FAIL_MSG("rb_scan: invalid params\n");
+        return 1;
+    }
+
+
+    ctx->next_block = 0;
+    ctx->done_blocks = 0;
+    ctx->error = 0;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    /* the blocks are taken in order, so read ahead */
+    posix_fadvise(ctx->fd, ctx->start, ctx->end - ctx->start,
+                  POSIX_FADV_SEQUENTIAL);
+#endif
+
+    started = 0;
+    for (i = 0; i < ctx->threads; i++) {
+        workers[i].ctx = ctx;
+        workers[i].thread = i;
+        if (pthread_create(&threads[i], NULL, scan_worker, &workers[i]) !=
+            0) {
+            FAIL_MSG("rb_scan: pthread_create() failed\n");
+            break;
+        }
+        started++;
+    }
+
+    /* run it in this thread if no workers would start */
+    if (!started) {
+        workers[0].ctx = ctx;
+        workers[0].thread = 0;
+        scan_worker(&workers[0]);
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (ctx->error) {
+        FAIL_MSG("rb_scan: scan failed\n");
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* scan_controller runs a whole scan in the background */
+static void *scan_controller(void *data)
+{
+    struct scan_ctx *ctx = (struct scan_ctx *) data;
+
+    if (rb_scan(ctx) != 0) {
+        FAIL_MSG("scan_controller: rb_scan() failed\n");
+    }
+
+    __atomic_store_n(&ctx->finished, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+
+/* rb_scan_start starts the scan in the background and returns */
+int rb_scan_start(struct scan_ctx *ctx)
+{
+    if (!ctx || ctx->running) {
+        FAIL_MSG("rb_scan_start: invalid params\n");
+        return 1;
+    }
+
+
+    ctx->finished = 0;
+    ctx->running = 1;
+    if (pthread_create(&ctx->controller, NULL, scan_controller, ctx) != 0) {
+        FAIL_MSG("rb_scan_start: pthread_create() failed\n");
+        ctx->running = 0;
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* rb_scan_wait waits for a background scan to end */
+int rb_scan_wait(struct scan_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("rb_scan_wait: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->running) {
+        if (pthread_join(ctx->controller, NULL) != 0) {
+            FAIL_MSG("rb_scan_wait: pthread_join() failed\n");
+            return 2;
+        }
+
+        ctx->running = 0;
+    }
+
+    return ctx->error ? 3 : 0;
+}
+
+
+/* rb_scan_progress returns how far through the scan is, in percent */
+int rb_scan_progress(struct scan_ctx *ctx)
+{
+    if (!ctx || !ctx->nblocks) {
+        return 100;
+    }
+
+    return (int) ((__atomic_load_n(&ctx->done_blocks, __ATOMIC_RELAXED) *
+                   100) / ctx->nblocks);
+}
@@ -0,0 +1,87 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-scan.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_SCAN_H
+#define _RB_SCAN_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "rb-blkdev.h"
+#include "macro.h"
+
+#define SCAN_BLOCK_SIZE (4 * 1024 * 1024)
+#define SCAN_MAX_THREADS 32
+
+/* scan callback: called once per block with the bytes the block owns
+ * (len) followed by up to overlap bytes of the next block (total).
+ * thread is the worker number, for per-thread state. */
+typedef int (*scan_fn) (void *arg, int thread, unsigned long block,
+                        unsigned long offset, const uint8_t * buf,
+                        unsigned long len, unsigned long total);
+
+/* scan reader: reads len bytes at offset into buf for files that can't
+ * be read with pread(), returning how many were read or -1 */
+typedef long (*scan_read_fn) (void *arg, uint8_t * buf, unsigned long len,
+                              unsigned long offset);
+
+/* a parallel scan of part of a file */
+struct scan_ctx {
+    /* what to scan */
+    int fd;
+    unsigned long start;
+    unsigned long end;
+    unsigned long blocksize;
+    unsigned long overlap;
+    /* reads are aligned to this, for block devices */
+    unsigned long align;
+    int threads;
+    /* or read this way instead */
+    scan_read_fn read;
+    void *read_arg;
+
+    /* what to do with it */
+    scan_fn fn;
+    void *arg;
+
+    /* progress, read by other threads */
+    unsigned long nblocks;
+    unsigned long next_block;
+    unsigned long done_blocks;
+    int cancel;
+    int error;
+    int running;
+    int finished;
+
+    pthread_t controller;
+};
+
+int scan_threads();
+int rb_scan_init(struct scan_ctx *ctx, int fd, unsigned long start,
+                 unsigned long end, unsigned long blocksize,
+                 unsigned long overlap, scan_fn fn, void *arg);
+int rb_scan_source(int fd, scan_read_fn read, void *arg);
+int rb_scan(struct scan_ctx *ctx);
+int rb_scan_start(struct scan_ctx *ctx);
+int rb_scan_wait(struct scan_ctx *ctx);
+int rb_scan_progress(struct scan_ctx *ctx);
+
+#endif
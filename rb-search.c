@@ -0,0 +1,960 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-search.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to search a file for many patterns at once.  Patterns
+ * are hex strings (with ? as a wildcard nibble), "ascii" strings, or
+ * u"utf-16le" and ub"utf-16be" strings.  The longest fixed run of each
+ * pattern goes into an Aho-Corasick automaton; a nibble-bucket prefilter
+ * skips bytes that cannot start a match, and every candidate is checked
+ * against the whole pattern under its mask.  The file is scanned in
+ * parallel with rb_scan() and the hits are kept as a sorted offset index.
+ */
+
+#include "rb-search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEARCH_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+
+static int search_simd = -1;
+
+
+/* search_hexval returns the value of a hex digit, or -1 */
+static int search_hexval(char c)
+{
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+/* search_add adds a byte and mask to a pattern */
+static int search_add(struct search_pattern *pat, uint8_t byte,
+                      uint8_t mask)
+{
+    if (pat->len >= SEARCH_MAXLEN) {
+        return 1;
+    }
+
+    pat->bytes[pat->len] = byte & mask;
+    pat->mask[pat->len] = mask;
+    pat->len++;
+
+    return 0;
+}
+
+
+/* search_unescape reads the next character of a quoted string, handling
+ * \\, \", \n, \r, \t, \0 and \xHH.  Returns the number of chars used.
+ */
+static int search_unescape(char *s, uint8_t * c)
+{
+    int hi, lo;
+
+    if (s[0] != '\\') {
+        *c = s[0];
+        return 1;
+    }
+
+    switch (s[1]) {
+    case 'n':
+        *c = '\n';
+        return 2;
+    case 'r':
+        *c = '\r';
+        return 2;
+    case 't':
+        *c = '\t';
+        return 2;
+    case '0':
+        *c = 0x00;
+        return 2;
+    case 'x':
+        hi = search_hexval(s[2]);
+        lo = (hi < 0) ? -1 : search_hexval(s[3]);
+        if (lo < 0) {
+            return -1;
+        }
+        *c = (hi << 4) | lo;
+        return 4;
+    case '\\':
+    case '"':
+        *c = s[1];
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+
+/* search_utf8 decodes one utf-8 character from a string of bytes */
+static int search_utf8(uint8_t * s, int len, uint32_t * cp)
+{
+    int need, i;
+
+    if (s[0] < 0x80) {
+        *cp = s[0];
+        return 1;
+    } else if ((s[0] & 0xe0) == 0xc0) {
+        *cp = s[0] & 0x1f;
+        need = 1;
+    } else if ((s[0] & 0xf0) == 0xe0) {
+        *cp = s[0] & 0x0f;
+        need = 2;
+    } else if ((s[0] & 0xf8) == 0xf0) {
+        *cp = s[0] & 0x07;
+        need = 3;
+    } else {
+        return -1;
+    }
+
+    if (need >= len) {
+        return -1;
+    }
+    for (i = 1; i <= need; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return -1;
+        }
+        *cp = (*cp << 6) | (s[i] & 0x3f);
+    }
+
+    return need + 1;
+}
+
+
+/* search_add16 adds a utf-16 code unit in the given byte order */
+static int search_add16(struct search_pattern *pat, uint16_t unit,
+                        int bigendian)
+{
+    if (bigendian) {
+        return search_add(pat, unit >> 8, 0xff)
+            || search_add(pat, unit & 0xff, 0xff);
+    }
+    return search_add(pat, unit & 0xff, 0xff)
+        || search_add(pat, unit >> 8, 0xff);
+}
+
+
+/* search_parse_string parses a quoted string pattern; wide is 0 for bytes,
+ * 1 for utf-16le and 2 for utf-16be.
+ */
+static int search_parse_string(char *s, struct search_pattern *pat,
+                               int wide)
+{
+    uint8_t raw[SEARCH_MAXLEN * 4];
+    int rawlen;
+    int used;
+    int i;
+    uint32_t cp;
+
+    rawlen = 0;
+    while (*s && (*s != '"')) {
+        if (rawlen >= (int) sizeof(raw)) {
+            return 1;
+        }
+        used = search_unescape(s, &raw[rawlen]);
+        if (used < 0) {
+            return 2;
+        }
+        s += used;
+        rawlen++;
+    }
+    if (*s != '"') {
+        return 3;
+    }
+    s++;
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    if (*s) {
+        return 4;
+    }
+
+    if (!wide) {
+        for (i = 0; i < rawlen; i++) {
+            if (search_add(pat, raw[i], 0xff)) {
+                return 5;
+            }
+        }
+        return 0;
+    }
+
+    for (i = 0; i < rawlen; i += used) {
+        used = search_utf8(&raw[i], rawlen - i, &cp);
+        if ((used < 0) || (cp > 0x10ffff)) {
+            return 6;
+        }
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            if (search_add16(pat, 0xd800 | (cp >> 10), wide == 2)
+                || search_add16(pat, 0xdc00 | (cp & 0x3ff), wide == 2)) {
+                return 7;
+            }
+        } else if (search_add16(pat, cp, wide == 2)) {
+            return 8;
+        }
+    }
+
+    return 0;
+}
+
+
+/* search_parse_hex parses a hex pattern; ? is a wildcard nibble and
+ * whitespace is ignored.
+ */
+static int search_parse_hex(char *s, struct search_pattern *pat)
+{
+    int nibbles;
+    int val;
+    uint8_t byte, mask;
+
+    nibbles = 0;
+    byte = 0;
+    mask = 0;
+    for (; *s; s++) {
+        if (isspace((unsigned char) *s)) {
+            continue;
+        }
+        if (*s == '?') {
+            byte <<= 4;
+            mask <<= 4;
+        } else {
+            val = search_hexval(*s);
+            if (val < 0) {
+                return 1;
+            }
+            byte = (byte << 4) | val;
+            mask = (mask << 4) | 0x0f;
+        }
+        nibbles++;
+        if (!(nibbles & 1)) {
+            if (search_add(pat, byte, mask)) {
+                return 2;
+            }
+            byte = 0;
+            mask = 0;
+        }
+    }
+
+    if (nibbles & 1) {
+        return 3;
+    }
+
+    return 0;
+}
+
+
+/* search_parse parses a single pattern and finds its anchor */
+int search_parse(char *spec, struct search_pattern *pat)
+{
+    int i, run;
+    int ret;
+
+    if (!spec || !pat) {
+        FAIL_MSG("search_parse: invalid params\n");
+        return 1;
+    }
+
+
+    memset(pat, 0, sizeof(struct search_pattern));
+    pat->next = -1;
+
+    while (isspace((unsigned char) *spec)) {
+        spec++;
+    }
+
+    if (spec[0] == '"') {
+        ret = search_parse_string(spec + 1, pat, 0);
+    } else if ((spec[0] == 'u') && (spec[1] == '"')) {
+        ret = search_parse_string(spec + 2, pat, 1);
+    } else if ((spec[0] == 'u') && (spec[1] == 'b') && (spec[2] == '"')) {
+        ret = search_parse_string(spec + 3, pat, 2);
+    } else {
+        ret = search_parse_hex(spec, pat);
+    }
+
+    if (ret) {
+        return 2;
+    }
+
+    if (!pat->len) {
+        return 3;
+    }
+
+    /* the automaton looks for the longest run of fixed bytes */
+    run = 0;
+    for (i = 0; i < pat->len; i++) {
+        if (pat->mask[i] == 0xff) {
+            run++;
+            if (run > pat->anchorlen) {
+                pat->anchorlen = run;
+                pat->anchor = i + 1 - run;
+            }
+        } else {
+            run = 0;
+        }
+    }
+
+    if (!pat->anchorlen) {
+        return 4;
+    }
+
+
+    return 0;
+}
+
+
+/* search_build builds the automaton and the prefilter tables */
+static int search_build(struct search_ctx *ctx)
+{
+    struct search_pattern *pat;
+    int32_t *fail;
+    int32_t *queue;
+    int maxstates;
+    int head, tail;
+    int i, j, s, t, f;
+    uint8_t c;
+
+    maxstates = 1;
+    for (i = 0; i < ctx->npatterns; i++) {
+        maxstates += ctx->patterns[i].anchorlen;
+    }
+
+    ctx->delta = (int32_t *) malloc(maxstates * 256 * sizeof(int32_t));
+    ctx->own = (int32_t *) malloc(maxstates * sizeof(int32_t));
+    ctx->dict = (int32_t *) malloc(maxstates * sizeof(int32_t));
+    ctx->hasout = (uint8_t *) calloc(maxstates, 1);
+    fail = (int32_t *) calloc(maxstates, sizeof(int32_t));
+    queue = (int32_t *) malloc(maxstates * sizeof(int32_t));
+    if (!ctx->delta || !ctx->own || !ctx->dict || !ctx->hasout || !fail
+        || !queue) {
+        FAIL_MSG("search_build: malloc() failed\n");
+        free(fail);
+        free(queue);
+        return 1;
+    }
+
+
+    memset(ctx->delta, 0xff, maxstates * 256 * sizeof(int32_t));
+    memset(ctx->own, 0xff, maxstates * sizeof(int32_t));
+    memset(ctx->dict, 0xff, maxstates * sizeof(int32_t));
+    memset(ctx->first, 0, sizeof(ctx->first));
+    memset(ctx->nib_lo, 0, sizeof(ctx->nib_lo));
+    memset(ctx->nib_hi, 0, sizeof(ctx->nib_hi));
+
+    /* the trie of anchors */
+    ctx->nstates = 1;
+    for (i = 0; i < ctx->npatterns; i++) {
+        pat = &ctx->patterns[i];
+        s = 0;
+        for (j = 0; j < pat->anchorlen; j++) {
+            c = pat->bytes[pat->anchor + j];
+            if (ctx->delta[(s * 256) + c] < 0) {
+                ctx->delta[(s * 256) + c] = ctx->nstates++;
+            }
+            s = ctx->delta[(s * 256) + c];
+        }
+        pat->next = ctx->own[s];
+        ctx->own[s] = i;
+        ctx->hasout[s] = 1;
+
+        c = pat->bytes[pat->anchor];
+        ctx->first[c] = 1;
+        ctx->nib_lo[c & 0x0f] |= 1 << ((c >> 4) & 0x07);
+        ctx->nib_hi[c >> 4] |= 1 << ((c >> 4) & 0x07);
+    }
+
+    /* breadth first, turning the trie into a full transition table */
+    head = 0;
+    tail = 0;
+    for (c = 0;; c++) {
+        t = ctx->delta[c];
+        if (t < 0) {
+            ctx->delta[c] = 0;
+        } else {
+            fail[t] = 0;
+            queue[tail++] = t;
+        }
+        if (c == 255) {
+            break;
+        }
+    }
+
+    while (head < tail) {
+        s = queue[head++];
+        f = fail[s];
+        if (ctx->own[f] >= 0) {
+            ctx->dict[s] = f;
+        } else {
+            ctx->dict[s] = ctx->dict[f];
+        }
+        if (ctx->dict[s] >= 0) {
+            ctx->hasout[s] = 1;
+        }
+
+        for (c = 0;; c++) {
+            t = ctx->delta[(s * 256) + c];
+            if (t < 0) {
+                ctx->delta[(s * 256) + c] = ctx->delta[(f * 256) + c];
+            } else {
+                fail[t] = ctx->delta[(f * 256) + c];
+                queue[tail++] = t;
+            }
+            if (c == 255) {
+                break;
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+
+    return 0;
+}
+
+
+/* search_new parses newline separated patterns and builds the search */
+struct search_ctx *search_new(char *specs)
+{
+    struct search_ctx *ctx;
+    char *copy, *line, *next;
+    int i;
+
+    if (!specs) {
+        FAIL_MSG("search_new: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct search_ctx *) calloc(1, sizeof(struct search_ctx));
+    copy = strdup(specs);
+    if (ctx) {
+        ctx->patterns = (struct search_pattern *)
+            malloc(SEARCH_MAXPATTERNS * sizeof(struct search_pattern));
+    }
+    if (!ctx || !copy || !ctx->patterns) {
+        FAIL_MSG("search_new: malloc() failed\n");
+        if (ctx) {
+            free(ctx->patterns);
+        }
+        free(ctx);
+        free(copy);
+        return NULL;
+    }
+
+
+    for (line = copy; line; line = next) {
+        next = strchr(line, '\n');
+        if (next) {
+            *next++ = 0x00;
+        }
+
+        /* skip blank lines */
+        for (i = 0; line[i] && isspace((unsigned char) line[i]); i++);
+        if (!line[i]) {
+            continue;
+        }
+
+        if (ctx->npatterns >= SEARCH_MAXPATTERNS) {
+            FAIL_MSG("search_new: too many patterns\n");
+            break;
+        }
+
+        if (search_parse(line, &ctx->patterns[ctx->npatterns]) != 0) {
+            fprintf(stderr, "search_new: cannot parse pattern: %s\n",
+                    line);
+            break;
+        }
+
+        if (ctx->patterns[ctx->npatterns].len > ctx->maxlen) {
+            ctx->maxlen = ctx->patterns[ctx->npatterns].len;
+        }
+        ctx->npatterns++;
+    }
+
+    free(copy);
+
+    if (line || !ctx->npatterns) {
+        search_free(ctx);
+        return NULL;
+    }
+
+    if (search_build(ctx) != 0) {
+        FAIL_MSG("search_new: search_build() failed\n");
+        search_free(ctx);
+        return NULL;
+    }
+
+#ifdef SEARCH_X86
+    if (search_simd < 0) {
+        __builtin_cpu_init();
+        search_simd = __builtin_cpu_supports("ssse3");
+    }
+#else
+    search_simd = 0;
+#endif
+
+    return ctx;
+}
+
+
+#ifdef SEARCH_X86
+/* search_skip_ssse3 finds the next byte that may start an anchor, 16 bytes
+ * at a time.  Each byte's low nibble and high nibble look up a bucket mask
+ * and the byte is a candidate if the two masks share a bucket.
+ */
+__attribute__ ((target("ssse3")))
+static unsigned long search_skip_ssse3(struct search_ctx *ctx,
+                                       const uint8_t * buf,
+                                       unsigned long i, unsigned long end)
+{
+    __m128i lo_tab, hi_tab, nib, v, m;
+    int bits;
+
+    lo_tab = _mm_loadu_si128((const __m128i *) ctx->nib_lo);
+    hi_tab = _mm_loadu_si128((const __m128i *) ctx->nib_hi);
+    nib = _mm_set1_epi8(0x0f);
+
+    while (i + 16 <= end) {
+        v = _mm_loadu_si128((const __m128i *) (buf + i));
+        m = _mm_and_si128(_mm_shuffle_epi8(lo_tab, _mm_and_si128(v, nib)),
+                          _mm_shuffle_epi8(hi_tab,
+                                           _mm_and_si128(_mm_srli_epi16
+                                                         (v, 4), nib)));
+        bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(m, _mm_setzero_si128()))
+            & 0xffff;
+        while (bits) {
+            if (ctx->first[buf[i + __builtin_ctz(bits)]]) {
+                return i + __builtin_ctz(bits);
+            }
+            bits &= bits - 1;
+        }
+        i += 16;
+    }
+
+    while ((i < end) && !ctx->first[buf[i]]) {
+        i++;
+    }
+
+    return i;
+}
+#endif
+
+
+/* search_skip finds the next byte that may start an anchor */
+static inline unsigned long search_skip(struct search_ctx *ctx,
+                                        const uint8_t * buf,
+                                        unsigned long i, unsigned long end)
+{
+#ifdef SEARCH_X86
+    if (search_simd > 0) {
+        return search_skip_ssse3(ctx, buf, i, end);
+    }
+#endif
+
+    while ((i < end) && !ctx->first[buf[i]]) {
+        i++;
+    }
+
+    return i;
+}
+
+
+/* search_record adds a hit to a block's list; the search is cut short,
+ * as it is at SEARCH_MAXHITS, when the list can't grow within the memory
+ * budget */
+static int search_record(struct search_ctx *ctx, struct search_block *blk,
+                         uint64_t offset, int pattern)
+{
+    struct search_hit *hits;
+    unsigned long size, more;
+
+    if (__atomic_add_fetch(&ctx->hitcount, 1, __ATOMIC_RELAXED) >
+        SEARCH_MAXHITS) {
+        ctx->index.truncated = 1;
+        return 1;
+    }
+
+    if (blk->count == blk->size) {
+        size = blk->size ? blk->size * 2 : 256;
+        more = (size - blk->size) * sizeof(struct search_hit);
+        if (budget_pressure() || (budget_reserve(BUDGET_CACHE, more) != 0)) {
+            ctx->index.truncated = 1;
+            return 1;
+        }
+        __atomic_add_fetch(&ctx->reserved, more, __ATOMIC_RELAXED);
+
+        hits = (struct search_hit *) realloc(blk->hits,
+                                             size *
+                                             sizeof(struct search_hit));
+        if (!hits) {
+            FAIL_MSG("search_record: realloc() failed\n");
+            return 2;
+        }
+        blk->hits = hits;
+        blk->size = size;
+    }
+
+    blk->hits[blk->count].offset = offset;
+    blk->hits[blk->count].pattern = pattern;
+    blk->count++;
+
+    return 0;
+}
+
+
+/* search_verify checks a whole pattern against the data */
+static inline int search_verify(struct search_pattern *pat,
+                                const uint8_t * buf)
+{
+    int i;
+
+    for (i = 0; i < pat->len; i++) {
+        if ((buf[i] & pat->mask[i]) != pat->bytes[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* search_cmp orders hits by offset then pattern */
+static int search_cmp(const void *a, const void *b)
+{
+    const struct search_hit *x = (const struct search_hit *) a;
+    const struct search_hit *y = (const struct search_hit *) b;
+
+    if (x->offset != y->offset) {
+        return (x->offset < y->offset) ? -1 : 1;
+    }
+    return (int) x->pattern - (int) y->pattern;
+}
+
+
+/* search_block searches one block.  A hit belongs to the block if it starts
+ * in the first len bytes; the rest of the buffer is the start of the next
+ * block, there so that hits across the boundary can be checked.
+ */
+int search_block(struct search_ctx *ctx, struct search_block *blk,
+                 unsigned long offset, const uint8_t * buf,
+                 unsigned long len, unsigned long total)
+{
+    struct search_pattern *pat;
+    unsigned long i;
+    long start;
+    int32_t s, o, p;
+
+    if (!ctx || !blk || !buf || (len > total)) {
+        FAIL_MSG("search_block: invalid params\n");
+        return 1;
+    }
+
+
+    s = 0;
+    i = 0;
+    while (i < total) {
+        /* at the root nothing is matched yet, so skip to a possible start */
+        if (!s) {
+            i = search_skip(ctx, buf, i, total);
+            if (i >= total) {
+                break;
+            }
+        }
+
+        s = ctx->delta[(s * 256) + buf[i]];
+        i++;
+
+        if (!ctx->hasout[s]) {
+            continue;
+        }
+
+        for (o = (ctx->own[s] >= 0) ? s : ctx->dict[s]; o >= 0;
+             o = ctx->dict[o]) {
+            for (p = ctx->own[o]; p >= 0; p = ctx->patterns[p].next) {
+                pat = &ctx->patterns[p];
+                start = (long) i - pat->anchorlen - pat->anchor;
+                if ((start < 0) || ((unsigned long) start >= len)
+                    || ((unsigned long) start + pat->len > total)) {
+                    continue;
+                }
+                if (search_verify(pat, buf + start)) {
+                    if (search_record(ctx, blk, offset + start, p) != 0) {
+                        return ctx->index.truncated ? 0 : 2;
+                    }
+                }
+            }
+        }
+    }
+
+    if (blk->count > 1) {
+        qsort(blk->hits, blk->count, sizeof(struct search_hit), search_cmp);
+    }
+    blk->done = 1;
+
+    return 0;
+}
+
+
+/* search_scan is the scan callback */
+static int search_scan(void *arg, int thread, unsigned long block,
+                       unsigned long offset, const uint8_t * buf,
+                       unsigned long len, unsigned long total)
+{
+    struct search_ctx *ctx = (struct search_ctx *) arg;
+
+    if (ctx->index.truncated) {
+        return 0;
+    }
+
+    return search_block(ctx, &ctx->blocks[block], offset, buf, len, total);
+}
+
+
+/* search_start starts searching the file in the background */
+int search_start(struct search_ctx *ctx, int fd, unsigned long size)
+{
+    if (!ctx || (fd < 0)) {
+        FAIL_MSG("search_start: invalid params\n");
+        return 1;
+    }
+
+
+    if (rb_scan_init(&ctx->scan, fd, 0, size, SCAN_BLOCK_SIZE,
+                     ctx->maxlen - 1, search_scan, ctx) != 0) {
+        FAIL_MSG("search_start: rb_scan_init() failed\n");
+        return 2;
+    }
+
+
+    ctx->blocks = (struct search_block *) calloc(ctx->scan.nblocks + 1,
+                                                 sizeof(struct
+                                                        search_block));
+    if (!ctx->blocks) {
+        FAIL_MSG("search_start: calloc() failed\n");
+        return 3;
+    }
+
+
+    if (rb_scan_start(&ctx->scan) != 0) {
+        FAIL_MSG("search_start: rb_scan_start() failed\n");
+        return 4;
+    }
+
+
+    return 0;
+}
+
+
+/* search_finished returns whether a background search has ended */
+int search_finished(struct search_ctx *ctx)
+{
+    if (!ctx) {
+        return 1;
+    }
+
+    return __atomic_load_n(&ctx->scan.finished, __ATOMIC_ACQUIRE);
+}
+
+
+/* search_finish waits for the search and merges the per-block hits into
+ * the index.  Blocks are in file order and each is sorted, so the index is
+ * sorted too.  If the search ran out of room only the blocks before the
+ * first one that wasn't finished are kept, so that the index is all of the
+ * hits up to a point, and not some from everywhere.  The index is cut
+ * shorter still if it doesn't all fit in the memory budget.
+ */
+int search_finish(struct search_ctx *ctx)
+{
+    unsigned long i, j, n, fit;
+
+    if (!ctx || !ctx->blocks) {
+        FAIL_MSG("search_finish: invalid params\n");
+        return 1;
+    }
+
+
+    if (rb_scan_wait(&ctx->scan) != 0) {
+        FAIL_MSG("search_finish: rb_scan_wait() failed\n");
+        return 2;
+    }
+
+
+    n = 0;
+    ctx->index.end = ctx->scan.end;
+    for (i = 0; i < ctx->scan.nblocks; i++) {
+        if (!ctx->blocks[i].done) {
+            ctx->index.end = ctx->scan.start + (i * ctx->scan.blocksize);
+            break;
+        }
+        n += ctx->blocks[i].count;
+    }
+
+    /* the index takes the place of the block lists */
+    budget_release(BUDGET_CACHE, ctx->reserved);
+    ctx->reserved = budget_fit(BUDGET_CACHE, (n + 1) * SEARCH_HITBYTES,
+                               SEARCH_HITBYTES);
+    fit = (ctx->reserved / SEARCH_HITBYTES) - 1;
+    if (fit < n) {
+        ctx->index.truncated = 1;
+        n = fit;
+    }
+
+    ctx->index.offsets = (uint64_t *) malloc((n + 1) * sizeof(uint64_t));
+    ctx->index.pattern = (uint16_t *) malloc((n + 1) * sizeof(uint16_t));
+    if (!ctx->index.offsets || !ctx->index.pattern) {
+        FAIL_MSG("search_finish: malloc() failed\n");
+        return 3;
+    }
+
+
+    n = 0;
+    for (i = 0; i < ctx->scan.nblocks; i++) {
+        if (ctx->scan.start + (i * ctx->scan.blocksize) >= ctx->index.end) {
+            ctx->blocks[i].count = 0;
+        }
+        for (j = 0; j < ctx->blocks[i].count; j++) {
+            if (n == fit) {
+                if (ctx->blocks[i].hits[j].offset < ctx->index.end) {
+                    ctx->index.end = ctx->blocks[i].hits[j].offset;
+                }
+                break;
+            }
+            ctx->index.offsets[n] = ctx->blocks[i].hits[j].offset;
+            ctx->index.pattern[n] = ctx->blocks[i].hits[j].pattern;
+            n++;
+        }
+        free(ctx->blocks[i].hits);
+        ctx->blocks[i].hits = NULL;
+        ctx->blocks[i].count = 0;
+    }
+    ctx->index.count = n;
+
+    return 0;
+}
+
+
+/* search_cancel stops a background search */
+int search_cancel(struct search_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("search_cancel: invalid params\n");
+        return 1;
+    }
+
+
+    __atomic_store_n(&ctx->scan.cancel, 1, __ATOMIC_RELAXED);
+    rb_scan_wait(&ctx->scan);
+
+    return 0;
+}
+
+
+/* search_free cancels the search if it is running and frees it */
+int search_free(struct search_ctx *ctx)
+{
+    unsigned long i;
+
+    if (!ctx) {
+        FAIL_MSG("search_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->scan.running) {
+        search_cancel(ctx);
+    }
+
+    if (ctx->blocks) {
+        for (i = 0; i < ctx->scan.nblocks; i++) {
+            free(ctx->blocks[i].hits);
+        }
+        free(ctx->blocks);
+    }
+
+    budget_release(BUDGET_CACHE, ctx->reserved);
+    free(ctx->index.offsets);
+    free(ctx->index.pattern);
+    free(ctx->delta);
+    free(ctx->own);
+    free(ctx->dict);
+    free(ctx->hasout);
+    free(ctx->patterns);
+    free(ctx);
+
+    return 0;
+}
+
+
+/* search_lower_bound returns the index of the first hit at or after offset */
+unsigned long search_lower_bound(struct search_index *idx, uint64_t offset)
+{
+    unsigned long lo, hi, mid;
+
+    if (!idx) {
+        return 0;
+    }
+
+    lo = 0;
+    hi = idx->count;
+    while (lo < hi) {
+        mid = lo + ((hi - lo) / 2);
+        if (idx->offsets[mid] < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+/* search_jump finds the hit after (or before) offset */
+int search_jump(struct search_index *idx, uint64_t offset, int direction,
+                uint64_t * hit)
+{
+    unsigned long i;
+
+    if (!idx || !hit) {
+        FAIL_MSG("search_jump: invalid params\n");
+        return 1;
+    }
+
+
+    if (direction == SEARCH_NEXT) {
+        i = search_lower_bound(idx, offset + 1);
+        if (i >= idx->count) {
+            return 2;
+        }
+    } else {
+        i = search_lower_bound(idx, offset);
+        if (!i) {
+            return 2;
+        }
+        i--;
+    }
+
+    *hit = idx->offsets[i];
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-search.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_SEARCH_H
+#define _RB_SEARCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "rb-scan.h"
+#include "rb-budget.h"
+#include "macro.h"
+
+/* longest pattern, in bytes */
+#define SEARCH_MAXLEN 256
+/* most patterns in one search */
+#define SEARCH_MAXPATTERNS 256
+/* most hits kept in the index; fewer if they don't fit in the memory
+ * budget */
+#define SEARCH_MAXHITS (16 * 1024 * 1024)
+/* what each hit takes in the index */
+#define SEARCH_HITBYTES (sizeof(uint64_t) + sizeof(uint16_t))
+
+#define SEARCH_NEXT 0
+#define SEARCH_PREV 1
+
+/* a pattern; bytes are compared under the mask so '?' nibbles match anything */
+struct search_pattern {
+    uint8_t bytes[SEARCH_MAXLEN];
+    uint8_t mask[SEARCH_MAXLEN];
+    int len;
+    /* the longest run of unmasked bytes, which the automaton looks for */
+    int anchor;
+    int anchorlen;
+    /* next pattern with the same anchor */
+    int next;
+};
+
+/* a single hit */
+struct search_hit {
+    uint64_t offset;
+    uint32_t pattern;
+};
+
+/* the hits found in one scan block */
+struct search_block {
+    struct search_hit *hits;
+    unsigned long count;
+    unsigned long size;
+    /* set once the whole block has been searched */
+    int done;
+};
+
+/* the sorted hit index */
+struct search_index {
+    unsigned long count;
+    uint64_t *offsets;
+    uint16_t *pattern;
+    /* when truncated, there are only the hits before end */
+    int truncated;
+    uint64_t end;
+};
+
+/* a search */
+struct search_ctx {
+    /* patterns */
+    struct search_pattern *patterns;
+    int npatterns;
+    int maxlen;
+
+    /* Aho-Corasick automaton over the pattern anchors, as a full DFA */
+    int nstates;
+    int32_t *delta;
+    int32_t *own;
+    int32_t *dict;
+    uint8_t *hasout;
+
+    /* prefilter: first anchor bytes, by nibble bucket */
+    uint8_t first[256];
+    uint8_t nib_lo[16];
+    uint8_t nib_hi[16];
+
+    /* results */
+    struct search_block *blocks;
+    unsigned long hitcount;
+    struct search_index index;
+    unsigned long reserved;     /* from the memory budget */
+
+    struct scan_ctx scan;
+};
+
+int search_parse(char *spec, struct search_pattern *pat);
+struct search_ctx *search_new(char *specs);
+int search_start(struct search_ctx *ctx, int fd, unsigned long size);
+int search_finished(struct search_ctx *ctx);
+int search_finish(struct search_ctx *ctx);
+int search_cancel(struct search_ctx *ctx);
+int search_free(struct search_ctx *ctx);
+unsigned long search_lower_bound(struct search_index *idx,
+                                 uint64_t offset);
+int search_jump(struct search_index *idx, uint64_t offset, int direction,
+                uint64_t * hit);
+int search_block(struct search_ctx *ctx, struct search_block *blk,
+                 unsigned long offset, const uint8_t * buf,
+                 unsigned long len, unsigned long total);
+
+#endif
@@ -152,3 +152,122 @@ int rb_shm_close(struct shm_buf *shm_ctx, struct rb_shm *shm)
 
 	return 0;
 }
+
+
+/* shm_now returns a monotonic time in nanoseconds that can be compared
+ * between processes */
+uint64_t shm_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+
+/* shm_update numbers a new update; call it with the semaphore held */
+unsigned long shm_update(struct rb_shm *shm)
+{
+    if (!shm) {
+        FAIL_MSG("shm_update: invalid params\n");
+        return 0;
+    }
+
+    return __atomic_add_fetch(&shm->update_seq, 1, __ATOMIC_RELEASE);
+}
+
+
+/* shm_update_seq returns the number of the latest update; visualisers read
+ * it before they copy the shared values */
+unsigned long shm_update_seq(struct rb_shm *shm)
+{
+    if (!shm) {
+        FAIL_MSG("shm_update_seq: invalid params\n");
+        return 0;
+    }
+
+    return __atomic_load_n(&shm->update_seq, __ATOMIC_ACQUIRE);
+}
+
+
+/* shm_ack records that this process has finished redrawing update seq */
+int shm_ack(struct rb_shm *shm, unsigned long seq)
+{
+    pid_t pid;
+    int i;
+
+    if (!shm) {
+        FAIL_MSG("shm_ack: invalid params\n");
+        return 1;
+    }
+
+
+    pid = getpid();
+
+    /* find our slot, or claim a free one */
+    for (i = 0; i < SHM_ACKS; i++) {
+        if (shm->acks[i].pid == pid) {
+            break;
+        }
+    }
+    if (i == SHM_ACKS) {
+        for (i = 0; i < SHM_ACKS; i++) {
+            if (__sync_bool_compare_and_swap(&shm->acks[i].pid, 0, pid)) {
+                break;
+            }
+        }
+    }
+    if (i == SHM_ACKS) {
+        return 2;
+    }
+
+    shm->acks[i].ns = shm_now();
+    __atomic_store_n(&shm->acks[i].seq, seq, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+/* shm_ack_get returns the last update a process finished redrawing and when */
+int shm_ack_get(struct rb_shm *shm, pid_t pid, unsigned long *seq,
+                uint64_t * ns)
+{
+    int i;
+
+    if (!shm || !pid || !seq || !ns) {
+        FAIL_MSG("shm_ack_get: invalid params\n");
+        return 1;
+    }
+
+
+    for (i = 0; i < SHM_ACKS; i++) {
+        if (shm->acks[i].pid == pid) {
+            *seq = __atomic_load_n(&shm->acks[i].seq, __ATOMIC_ACQUIRE);
+            *ns = shm->acks[i].ns;
+            return 0;
+        }
+    }
+
+    return 2;
+}
+
+
+/* shm_ack_clear frees the slot of a process that has ended */
+int shm_ack_clear(struct rb_shm *shm, pid_t pid)
+{
+    int i;
+
+    if (!shm || !pid) {
+        return 1;
+    }
+
+    for (i = 0; i < SHM_ACKS; i++) {
+        if (shm->acks[i].pid == pid) {
+            shm->acks[i].seq = 0;
+            shm->acks[i].ns = 0;
+            __atomic_store_n(&shm->acks[i].pid, 0, __ATOMIC_RELEASE);
+        }
+    }
+
+    return 0;
+}
@@ -24,6 +24,7 @@
 #include <sys/time.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <time.h>
 
 #ifdef __linux__
 #include <linux/limits.h>
@@ -41,5 +42,12 @@
 struct shm_buf *shm_create_buffer(unsigned long size, int clear);
 int rb_shm_init(struct shm_buf **shm_ctx, struct rb_shm **shm);
 int rb_shm_close(struct shm_buf *shm_ctx, struct rb_shm *shm);
+uint64_t shm_now();
+unsigned long shm_update(struct rb_shm *shm);
+unsigned long shm_update_seq(struct rb_shm *shm);
+int shm_ack(struct rb_shm *shm, unsigned long seq);
+int shm_ack_get(struct rb_shm *shm, pid_t pid, unsigned long *seq,
+                uint64_t * ns);
+int shm_ack_clear(struct rb_shm *shm, pid_t pid);
 
 #endif
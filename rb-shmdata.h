@@ -19,6 +19,22 @@
 #define BUF_TYPE_SHM 0
 #define BUF_TYPE_FD 1
 
+/* visualisers that can acknowledge redraws */
+#define SHM_ACKS 16
+/* ranges of the file that changed in place */
+#define SHM_DIRTY 32
+/* the config, parsed once by rubbermarbles */
+#define SHM_CONF 64
+#define SHM_CONF_KEY 32
+#define SHM_CONF_VALUE 512
+/* processes sharing the memory budget, and what they spend it on */
+#define SHM_BUDGETS 32
+#define SHM_BUDGET_KINDS 6
+
+/* a visualiser started with this instead of the shm name sets itself up,
+ * then reads the shm name from stdin when it is wanted */
+#define SHM_ZYGOTE_ARG "--zygote"
+
 /* struct for shared memory object */
 struct shm_buf {
     int buf_fd;
@@ -29,6 +45,32 @@ struct shm_buf {
     sem_t *sem;
 };
 
+/* the last update a visualiser finished redrawing */
+struct shm_ack {
+    pid_t pid;
+    unsigned long seq;
+    uint64_t ns;
+};
+
+/* a param: value line from the config files */
+struct shm_conf {
+    char key[SHM_CONF_KEY];
+    char value[SHM_CONF_VALUE];
+};
+
+/* what one process has reserved from the memory budget */
+struct shm_budget {
+    pid_t pid;
+    char name[16];
+    unsigned long used[SHM_BUDGET_KINDS];
+};
+
+/* a range of the file */
+struct shm_range {
+    unsigned long start;
+    unsigned long end;
+};
+
 /* shared memory object for buffer details */
 struct rb_shm {
     /* file */
@@ -41,6 +83,27 @@ struct rb_shm {
     uint8_t *buf;
     unsigned long offset;
     unsigned long bufsize;
+    /* updates sent to the visualisers, and their redraws */
+    unsigned long update_seq;
+    struct shm_ack acks[SHM_ACKS];
+    /* bumped to have every process write out its trace */
+    unsigned long trace_seq;
+    /* the ranges that changed in place, sent with update dirty_seq */
+    unsigned long dirty_seq;
+    int ndirty;
+    struct shm_range dirty[SHM_DIRTY];
+    /* the file being compared with, if any, changed with compare_seq */
+    unsigned long compare_seq;
+    char compare[PATH_MAX];
+    long compare_delta;         /* where the zoom selection is in it */
+    /* the config; conf_seq is odd while it is being rewritten and 0
+     * before it is first published */
+    unsigned long conf_seq;
+    int nconf;
+    struct shm_conf conf[SHM_CONF];
+    /* bytes the whole session may reserve, 0 for no limit */
+    unsigned long budget;
+    struct shm_budget budgets[SHM_BUDGETS];
 };
 
 
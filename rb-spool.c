@@ -0,0 +1,310 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-spool.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to look at a pipe, such as stdin, as if it were a
+ * file.  A thread copies the pipe into a memfd as it arrives, so the plots
+ * can follow it as it grows.  When it outgrows the RAM budget it is moved
+ * to a temp file that has already been unlinked, so nothing is left behind.
+ */
+
+#include "rb-spool.h"
+
+
+/* spool_write writes all of len bytes at offset */
+static int spool_write(int fd, uint8_t * buf, unsigned long len,
+                       unsigned long offset)
+{
+    unsigned long done;
+    ssize_t ret;
+
+    done = 0;
+    while (done < len) {
+        ret = pwrite(fd, buf + done, len - done, offset + done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        done += ret;
+    }
+
+    return 0;
+}
+
+
+/* spool_tmpfile creates a temp file and sets path to where it can be
+ * opened, and tmpname to the name to remove when done, if any; it returns
+ * the fd */
+int spool_tmpfile(char *path, char *tmpname)
+{
+    char *dir;
+    int fd;
+
+    if (!path || !tmpname) {
+        FAIL_MSG("spool_tmpfile: invalid params\n");
+        return -1;
+    }
+
+
+    dir = getenv("TMPDIR");
+    if (!dir) {
+        dir = SPOOL_TMPDIR;
+    }
+
+    snprintf(tmpname, PATH_MAX, "%s/rubbermarbles-XXXXXX", dir);
+    fd = mkstemp(tmpname);
+    if (fd < 0) {
+        FAIL_ERR("spool_tmpfile: mkstemp() failed\n");
+        tmpname[0] = 0x00;
+        return -1;
+    }
+
+#ifdef __linux__
+    /* it stays open through /proc, so it can go now */
+    unlink(tmpname);
+    tmpname[0] = 0x00;
+    snprintf(path, PATH_MAX, "/proc/%d/fd/%d", (int) getpid(), fd);
+#else
+    strncpy(path, tmpname, PATH_MAX);
+#endif
+
+    return fd;
+}
+
+
+/* spool_move copies what has been spooled so far into a temp file and
+ * carries on there */
+static int spool_move(struct spool_ctx *ctx)
+{
+    uint8_t *buf;
+    unsigned long offset;
+    ssize_t got;
+    int fd;
+
+    buf = (uint8_t *) malloc(SPOOL_CHUNK);
+    if (!buf) {
+        FAIL_MSG("spool_move: malloc() failed\n");
+        return 1;
+    }
+
+
+    fd = spool_tmpfile(ctx->path, ctx->tmpname);
+    if (fd < 0) {
+        FAIL_MSG("spool_move: spool_tmpfile() failed\n");
+        free(buf);
+        return 2;
+    }
+
+
+    for (offset = 0; offset < ctx->size; offset += got) {
+        got = pread(ctx->fd, buf, SPOOL_CHUNK, offset);
+        if ((got <= 0) || (spool_write(fd, buf, got, offset) != 0)) {
+            FAIL_ERR("spool_move: copy failed\n");
+            close(fd);
+            free(buf);
+            return 3;
+        }
+
+    }
+
+    free(buf);
+
+    /* readers that already have the memfd open keep it until they load
+     * the new path */
+    close(ctx->fd);
+    ctx->fd = fd;
+    ctx->inmem = 0;
+    budget_release(BUDGET_SPOOL, ctx->reserved);
+    ctx->reserved = 0;
+    __atomic_add_fetch(&ctx->moved, 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+/* spool_thread copies the pipe until it ends */
+static void *spool_thread(void *data)
+{
+    struct spool_ctx *ctx = (struct spool_ctx *) data;
+    uint8_t *buf;
+    ssize_t got;
+
+    buf = (uint8_t *) malloc(SPOOL_CHUNK);
+    if (!buf) {
+        FAIL_MSG("spool_thread: malloc() failed\n");
+        ctx->error = 1;
+        __atomic_store_n(&ctx->done, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+
+
+    /* spool_free() cancels the thread if it is waiting on the pipe */
+    pthread_cleanup_push(free, buf);
+
+    for (;;) {
+        got = read(ctx->in, buf, SPOOL_CHUNK);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            FAIL_ERR("spool_thread: read() failed\n");
+            ctx->error = 2;
+            break;
+        }
+        if (got == 0) {
+            break;
+        }
+
+        /* to a file once it outgrows its own limit, or the session's
+         * memory budget */
+        if (ctx->inmem && ((ctx->size + got > ctx->budget)
+                           || (budget_reserve(BUDGET_SPOOL, got) != 0))) {
+            if (spool_move(ctx) != 0) {
+                FAIL_MSG("spool_thread: spool_move() failed\n");
+                ctx->error = 3;
+                break;
+            }
+
+        }
+        if (ctx->inmem) {
+            ctx->reserved += got;
+        }
+
+        if (spool_write(ctx->fd, buf, got, ctx->size) != 0) {
+            FAIL_ERR("spool_thread: write() failed\n");
+            ctx->error = 4;
+            break;
+        }
+
+        __atomic_store_n(&ctx->size, ctx->size + got, __ATOMIC_RELEASE);
+    }
+
+    pthread_cleanup_pop(1);
+    __atomic_store_n(&ctx->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+
+/* spool_open starts copying the pipe in into memory, or a temp file where
+ * there is no memfd */
+struct spool_ctx *spool_open(int in)
+{
+    struct spool_ctx *ctx;
+    char *mb;
+
+    if (in < 0) {
+        FAIL_MSG("spool_open: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct spool_ctx *) calloc(1, sizeof(struct spool_ctx));
+    if (!ctx) {
+        FAIL_MSG("spool_open: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->in = in;
+    ctx->budget = (unsigned long) SPOOL_RAM_MB * 1024 * 1024;
+    mb = getenv(SPOOL_RAM_ENV);
+    if (mb) {
+        ctx->budget = strtoul(mb, NULL, 10) * 1024 * 1024;
+    }
+
+    ctx->fd = -1;
+#ifdef __linux__
+    ctx->fd = syscall(SYS_memfd_create, "rubbermarbles", 0);
+    if (ctx->fd >= 0) {
+        snprintf(ctx->path, PATH_MAX, "/proc/%d/fd/%d", (int) getpid(),
+                 ctx->fd);
+        ctx->inmem = 1;
+    }
+#endif
+    if (ctx->fd < 0) {
+        ctx->fd = spool_tmpfile(ctx->path, ctx->tmpname);
+    }
+    if (ctx->fd < 0) {
+        FAIL_MSG("spool_open: no memfd or temp file\n");
+        free(ctx);
+        return NULL;
+    }
+
+
+    ctx->running = 1;
+    if (pthread_create(&ctx->thread, NULL, spool_thread, ctx) != 0) {
+        FAIL_MSG("spool_open: pthread_create() failed\n");
+        ctx->running = 0;
+        spool_free(ctx);
+        return NULL;
+    }
+
+
+    return ctx;
+}
+
+
+/* spool_wait waits until something has arrived, or the pipe has ended;
+ * it returns 0 if there is something to look at */
+int spool_wait(struct spool_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("spool_wait: invalid params\n");
+        return 1;
+    }
+
+
+    while (!__atomic_load_n(&ctx->size, __ATOMIC_ACQUIRE)
+           && !__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        usleep(10000);
+    }
+
+    if (!__atomic_load_n(&ctx->size, __ATOMIC_ACQUIRE)) {
+        FAIL_MSG("spool_wait: nothing to read\n");
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* spool_free stops copying the pipe and closes the copy */
+int spool_free(struct spool_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("spool_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->running) {
+        if (!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+            pthread_cancel(ctx->thread);
+        }
+        pthread_join(ctx->thread, NULL);
+    }
+
+    if (ctx->fd >= 0) {
+        close(ctx->fd);
+    }
+    if (ctx->tmpname[0]) {
+        unlink(ctx->tmpname);
+    }
+    budget_release(BUDGET_SPOOL, ctx->reserved);
+
+    free(ctx);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-spool.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_SPOOL_H
+#define _RB_SPOOL_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/limits.h>
+#elif __APPLE__
+#include <sys/syslimits.h>
+#endif
+
+#include "rb-budget.h"
+#include "macro.h"
+
+/* bytes read from the pipe at a time */
+#define SPOOL_CHUNK (1024 * 1024)
+/* how much is kept in memory before moving to a temp file, in MB */
+#define SPOOL_RAM_ENV "RB_SPOOL_MB"
+#define SPOOL_RAM_MB 1024
+#define SPOOL_TMPDIR "/var/tmp"
+
+/* a pipe being copied somewhere it can be mmap()ed and read at random */
+struct spool_ctx {
+    int in;
+    int fd;
+    char path[PATH_MAX];        /* where other processes can open it */
+    char tmpname[PATH_MAX];     /* the temp file to remove, if any */
+    unsigned long budget;
+    int inmem;                  /* still in the memfd */
+    unsigned long reserved;     /* of the memory budget, while inmem */
+
+    /* progress, read by other threads */
+    unsigned long size;
+    int moved;                  /* bumped when it moves to a temp file */
+    int done;
+    int error;
+
+    pthread_t thread;
+    int running;
+};
+
+int spool_tmpfile(char *path, char *tmpname);
+struct spool_ctx *spool_open(int in);
+int spool_wait(struct spool_ctx *ctx);
+int spool_free(struct spool_ctx *ctx);
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-stats.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to count where the time goes in the drawing code.
+ * Each instrumented function is timed with stats_begin() and stats_end(),
+ * which also take the page faults from getrusage(), and adds the bytes it
+ * read, the pixels it wrote and the mmap()s it made.  The counters can be
+ * formatted for a window, or dumped as a line of JSON every STATS_DUMP_MS
+ * when RB_STATS names a file.  Each timed call is also added to the trace
+ * as a span.
+ */
+
+#include "rb-stats.h"
+#include "rb-trace.h"
+
+/* the counters for this process */
+static struct stats_site stats[STATS_SITES];
+
+static char *stats_names[] = { "draw_img", "ren_draw_img", "mmap",
+    "add_highlight", "update_children", "tg_load_buffer", "onDisplay",
+    "populate"
+};
+
+/* the dump */
+static char *stats_prog = "rubbermarbles";
+static int stats_fd = -1;
+static uint64_t stats_interval = STATS_DUMP_MS * 1000000ULL;
+static uint64_t stats_last = 0;
+
+
+/* stats_now returns the monotonic time in ns */
+static uint64_t stats_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+
+/* stats_faults returns the page faults so far, for this thread if it can */
+static unsigned long stats_faults()
+{
+    struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+    if (getrusage(RUSAGE_THREAD, &ru) != 0) {
+        return 0;
+    }
+#else
+    if (getrusage(RUSAGE_SELF, &ru) != 0) {
+        return 0;
+    }
+#endif
+
+    return ru.ru_minflt + ru.ru_majflt;
+}
+
+
+/* stats_init names the process and opens the dump if RB_STATS is set */
+int stats_init(char *prog)
+{
+    char *path;
+    char *ms;
+
+    if (!prog) {
+        FAIL_MSG("stats_init: invalid params\n");
+        return 1;
+    }
+
+
+    stats_prog = prog;
+
+    path = getenv(STATS_ENV);
+    if (!path) {
+        return 0;
+    }
+
+    ms = getenv(STATS_MS_ENV);
+    if (ms && (atoi(ms) > 0)) {
+        stats_interval = atoi(ms) * 1000000ULL;
+    }
+
+    /* every process appends its own lines to the one file */
+    stats_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (stats_fd < 0) {
+        FAIL_ERR("stats_init: open() failed\n");
+        return 2;
+    }
+
+
+    stats_last = stats_now();
+
+    return 0;
+}
+
+
+/* stats_begin marks the start of a timed call */
+void stats_begin(struct stats_mark *mark)
+{
+    mark->faults = stats_faults();
+    mark->ns = stats_now();
+}
+
+
+/* stats_end adds a timed call to a site's counters */
+void stats_end(int site, struct stats_mark *mark)
+{
+    struct stats_site *s = &stats[site];
+    uint64_t ns;
+
+    ns = stats_now() - mark->ns;
+
+    s->calls++;
+    s->ns += ns;
+    s->last_ns = ns;
+    if (ns > s->max_ns) {
+        s->max_ns = ns;
+    }
+    s->faults += stats_faults() - mark->faults;
+
+    trace_span(stats_names[site], mark->ns);
+}
+
+
+/* stats_add adds the bytes read and pixels written to a site's counters */
+void stats_add(int site, unsigned long bytes, unsigned long pixels)
+{
+    stats[site].bytes += bytes;
+    stats[site].pixels += pixels;
+}
+
+
+/* stats_mmap counts an mmap() */
+void stats_mmap(int site)
+{
+    stats[site].mmaps++;
+}
+
+
+/* stats_munmap counts a munmap() */
+void stats_munmap(int site)
+{
+    stats[site].munmaps++;
+}
+
+
+/* stats_format writes a line for each site that has been called */
+int stats_format(char *buf, size_t size)
+{
+    struct stats_site *s;
+    size_t len = 0;
+    int i;
+
+    if (!buf || !size) {
+        FAIL_MSG("stats_format: invalid params\n");
+        return 1;
+    }
+
+
+    buf[0] = 0x00;
+    for (i = 0; (i < STATS_SITES) && (len + STATS_LINESIZE < size); i++) {
+        s = &stats[i];
+        if (!s->calls) {
+            continue;
+        }
+
+        len += snprintf(buf + len, size - len,
+                        "%s%-15s %6lu  last %7.2f ms  avg %7.2f ms  "
+                        "%8.1f KB %9lu px  %6lu faults  %lu/%lu maps",
+                        len ? "\n" : "", stats_names[i], s->calls,
+                        s->last_ns / 1e6, s->ns / 1e6 / s->calls,
+                        s->bytes / 1024.0, s->pixels, s->faults, s->mmaps,
+                        s->munmaps);
+    }
+
+    return 0;
+}
+
+
+/* stats_dump appends the counters to the dump as a line of JSON */
+int stats_dump()
+{
+    char buf[STATS_DUMPSIZE];
+    struct stats_site *s;
+    size_t len;
+    int first = 1;
+    int i;
+
+    if (stats_fd < 0) {
+        return 0;
+    }
+
+    len = snprintf(buf, sizeof(buf),
+                   "{\"prog\":\"%s\",\"pid\":%d,\"time\":%ld,\"sites\":{",
+                   stats_prog, (int) getpid(), (long) time(NULL));
+
+    for (i = 0; (i < STATS_SITES) && (len + STATS_LINESIZE * 2 < sizeof(buf));
+         i++) {
+        s = &stats[i];
+        if (!s->calls && !s->mmaps && !s->munmaps) {
+            continue;
+        }
+
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "%s\"%s\":{\"calls\":%lu,\"ns\":%llu,"
+                        "\"last_ns\":%llu,\"max_ns\":%llu,\"bytes\":%lu,"
+                        "\"pixels\":%lu,\"mmaps\":%lu,\"munmaps\":%lu,"
+                        "\"faults\":%lu}", first ? "" : ",",
+                        stats_names[i], s->calls,
+                        (unsigned long long) s->ns,
+                        (unsigned long long) s->last_ns,
+                        (unsigned long long) s->max_ns, s->bytes,
+                        s->pixels, s->mmaps, s->munmaps, s->faults);
+        first = 0;
+    }
+
+    len += snprintf(buf + len, sizeof(buf) - len, "}}\n");
+
+    /* one write() so lines from different processes don't interleave */
+    if (write(stats_fd, buf, len) != (ssize_t) len) {
+        FAIL_ERR("stats_dump: write() failed\n");
+        return 1;
+    }
+
+
+    return 0;
+}
+
+
+/* stats_poll dumps the counters if STATS_DUMP_MS has passed */
+int stats_poll()
+{
+    uint64_t now;
+
+    if (stats_fd < 0) {
+        return 0;
+    }
+
+    now = stats_now();
+    if (now - stats_last < stats_interval) {
+        return 0;
+    }
+
+    stats_last = now;
+    if (stats_dump() != 0) {
+        FAIL_MSG("stats_poll: stats_dump() failed\n");
+        return 1;
+    }
+
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-stats.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_STATS_H
+#define _RB_STATS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "macro.h"
+
+/* environment variables that turn on the JSON dump */
+#define STATS_ENV "RB_STATS"
+#define STATS_MS_ENV "RB_STATS_MS"
+
+/* how often to dump the counters and refresh the on-screen stats, in ms */
+#define STATS_DUMP_MS 1000
+#define STATS_HUD_MS 500
+
+#define STATS_LINESIZE 128
+#define STATS_DUMPSIZE 4096
+
+/* the instrumented code */
+#define STATS_DRAW_IMG 0
+#define STATS_REN_DRAW_IMG 1
+#define STATS_MMAP 2
+#define STATS_ADD_HIGHLIGHT 3
+#define STATS_UPDATE_CHILDREN 4
+#define STATS_TG_LOAD_BUFFER 5
+#define STATS_ONDISPLAY 6
+#define STATS_POPULATE 7
+#define STATS_SITES 8
+
+/* the counters for one instrumented function */
+struct stats_site {
+    unsigned long calls;
+    uint64_t ns;
+    uint64_t last_ns;
+    uint64_t max_ns;
+    unsigned long bytes;
+    unsigned long pixels;
+    unsigned long mmaps;
+    unsigned long munmaps;
+    unsigned long faults;
+};
+
+/* the start of a timed call */
+struct stats_mark {
+    uint64_t ns;
+    unsigned long faults;
+};
+
+int stats_init(char *prog);
+void stats_begin(struct stats_mark *mark);
+void stats_end(int site, struct stats_mark *mark);
+void stats_add(int site, unsigned long bytes, unsigned long pixels);
+void stats_mmap(int site);
+void stats_munmap(int site);
+int stats_format(char *buf, size_t size);
+int stats_dump();
+int stats_poll();
+
+#endif
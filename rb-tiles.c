@@ -0,0 +1,476 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-tiles.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to draw a file as tiles of a Hilbert curve at any
+ * zoom, for the deep zoom window.  Each square of the curve holds a run of
+ * the file, so a tile at any level is a run of bytes, and a point in it is
+ * the first byte of the smaller square it covers.  Tiles are drawn by a few
+ * worker threads from the file mapped whole, into a fixed set of slots
+ * that are reused least recently used first.  The window asks for the
+ * tiles on screen, and for the ones around and under them once those are
+ * drawn, and puts up a bigger piece of an ancestor while it waits.
+ */
+
+#include "rb-tiles.h"
+
+
+/* tile_point returns the offset of the byte shown at point x, y of the
+ * level */
+static unsigned long tile_point(struct tile_ctx *ctx, int level,
+                                unsigned long x, unsigned long y)
+{
+    unsigned long cx, cy, d;
+    int shift;
+
+    /* each point is a square of 1 << shift bytes a side, or when zoomed
+     * past a byte a point, a byte is 1 << -shift points a side */
+    shift = ctx->order - TILE_SHIFT - level;
+    if (shift >= 0) {
+        cx = x << shift;
+        cy = y << shift;
+    } else {
+        cx = x >> -shift;
+        cy = y >> -shift;
+    }
+
+    if (ctx->flipped) {
+        d = xy2d_long(1UL << ctx->order, cy, cx);
+    } else {
+        d = xy2d_long(1UL << ctx->order, cx, cy);
+    }
+
+    /* the square is a run of the curve; show its first byte */
+    if (shift > 0) {
+        d &= ~((1UL << (2 * shift)) - 1);
+    }
+
+    return d;
+}
+
+
+/* tile_draw fills in a tile's points; it gives up if the colours change */
+static void tile_draw(struct tile_ctx *ctx, struct tile *slot,
+                      unsigned long gen)
+{
+    unsigned long x0, y0, d;
+    uint8_t *p;
+    int x, y;
+
+    x0 = slot->tx << TILE_SHIFT;
+    y0 = slot->ty << TILE_SHIFT;
+    p = slot->rgb;
+
+    for (y = 0; y < TILE_SIZE; y++) {
+        if (__atomic_load_n(&ctx->gen, __ATOMIC_RELAXED) != gen) {
+            return;
+        }
+
+        for (x = 0; x < TILE_SIZE; x++) {
+            d = tile_point(ctx, slot->level, x0 + x, y0 + y);
+            if (d < ctx->size) {
+                memcpy(p, ctx->palette[ctx->data[d]], 3);
+            } else {
+                memset(p, 0, 3);
+            }
+            p += 3;
+        }
+    }
+}
+
+
+/* tile_worker draws queued tiles, those on screen first and the most
+ * recently asked for of them first */
+static void *tile_worker(void *arg)
+{
+    struct tile_ctx *ctx = (struct tile_ctx *) arg;
+    struct tile *slot, *best;
+    unsigned long gen;
+    int i;
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->quit) {
+        best = NULL;
+        for (i = 0; i < TILE_CACHE_TILES; i++) {
+            slot = &ctx->cache[i];
+            if ((slot->state == TILE_QUEUED)
+                && (!best || (slot->prefetch < best->prefetch)
+                    || ((slot->prefetch == best->prefetch)
+                        && (slot->used > best->used)))) {
+                best = slot;
+            }
+        }
+
+        if (!best) {
+            pthread_cond_wait(&ctx->wake, &ctx->lock);
+            continue;
+        }
+
+        best->state = TILE_DRAWING;
+        gen = best->gen;
+        pthread_mutex_unlock(&ctx->lock);
+
+        if (!best->rgb) {
+            best->rgb = (uint8_t *) malloc(TILE_BYTES);
+        }
+        if (best->rgb) {
+            tile_draw(ctx, best, gen);
+        } else {
+            FAIL_MSG("tile_worker: malloc() failed\n");
+        }
+
+        pthread_mutex_lock(&ctx->lock);
+        if (!best->rgb && best->reserved) {
+            budget_release(BUDGET_CACHE, TILE_BYTES);
+            best->reserved = 0;
+        }
+        if (best->rgb && (best->gen == ctx->gen)) {
+            best->state = TILE_READY;
+            ctx->drawn++;
+        } else {
+            best->state = TILE_EMPTY;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return NULL;
+}
+
+
+/* tile_new maps the file and starts the workers */
+struct tile_ctx *tile_new(int fd, unsigned long size)
+{
+    struct tile_ctx *ctx;
+    int i;
+
+    if ((fd < 0) || !size) {
+        FAIL_MSG("tile_new: invalid params\n");
+        return NULL;
+    }
+
+
+    ctx = (struct tile_ctx *) calloc(1, sizeof(struct tile_ctx));
+    if (!ctx) {
+        FAIL_MSG("tile_new: calloc() failed\n");
+        return NULL;
+    }
+
+
+    ctx->size = size;
+    ctx->data = (const uint8_t *) mmap(NULL, size, PROT_READ, MAP_SHARED,
+                                       fd, 0);
+    if (ctx->data == MAP_FAILED) {
+        FAIL_ERR("tile_new: mmap() failed\n");
+        free(ctx);
+        return NULL;
+    }
+
+
+    /* the curve is the smallest square holding the file, and at least a
+     * tile */
+    ctx->order = TILE_SHIFT;
+    while ((1UL << (2 * ctx->order)) < size) {
+        ctx->order++;
+    }
+    ctx->levels = ctx->order - TILE_SHIFT + TILE_MAX_MAG + 1;
+
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wake, NULL);
+
+    ctx->nthreads = scan_threads();
+    if (ctx->nthreads > TILE_MAX_THREADS) {
+        ctx->nthreads = TILE_MAX_THREADS;
+    }
+    for (i = 0; i < ctx->nthreads; i++) {
+        if (pthread_create(&ctx->threads[i], NULL, tile_worker, ctx) != 0) {
+            FAIL_MSG("tile_new: pthread_create() failed\n");
+            ctx->nthreads = i;
+            tile_free(ctx);
+            return NULL;
+        }
+
+    }
+
+    return ctx;
+}
+
+
+/* tile_colours sets the colour of each byte value and the way round the
+ * curve goes, forgetting the tiles drawn before */
+int tile_colours(struct tile_ctx *ctx, uint8_t palette[256][3], int flipped)
+{
+    int i;
+
+    if (!ctx || !palette) {
+        FAIL_MSG("tile_colours: invalid params\n");
+        return 1;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    memcpy(ctx->palette, palette, sizeof(ctx->palette));
+    ctx->flipped = flipped;
+    __atomic_store_n(&ctx->gen, ctx->gen + 1, __ATOMIC_RELAXED);
+
+    /* tiles being drawn are thrown away when they are done */
+    for (i = 0; i < TILE_CACHE_TILES; i++) {
+        if (ctx->cache[i].state != TILE_DRAWING) {
+            ctx->cache[i].state = TILE_EMPTY;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return 0;
+}
+
+
+/* tile_find returns the slot holding a tile, if any; the lock is held */
+static struct tile *tile_find(struct tile_ctx *ctx, int level,
+                              unsigned long tx, unsigned long ty)
+{
+    struct tile *slot;
+    int i;
+
+    for (i = 0; i < TILE_CACHE_TILES; i++) {
+        slot = &ctx->cache[i];
+        if ((slot->state != TILE_EMPTY) && (slot->gen == ctx->gen)
+            && (slot->level == level) && (slot->tx == tx)
+            && (slot->ty == ty)) {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* tile_get returns a tile if it has been drawn, and otherwise queues it
+ * to be drawn and returns NULL.  Only the thread that shows the tiles may
+ * call it, as it reuses slots that thread could be reading. */
+struct tile *tile_get(struct tile_ctx *ctx, int level, unsigned long tx,
+                      unsigned long ty, int prefetch)
+{
+    struct tile *slot, *victim;
+    int i;
+
+    if (!ctx || (level < 0) || (level >= ctx->levels)
+        || (tx >= (1UL << level)) || (ty >= (1UL << level))) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    slot = tile_find(ctx, level, tx, ty);
+    if (slot) {
+        slot->used = ++ctx->tick;
+        if (!prefetch) {
+            slot->prefetch = 0;
+        }
+        pthread_mutex_unlock(&ctx->lock);
+        return slot->state == TILE_READY ? slot : NULL;
+    }
+
+    /* it replaces the least recently used tile nobody is drawing */
+    victim = NULL;
+    for (i = 0; i < TILE_CACHE_TILES; i++) {
+        slot = &ctx->cache[i];
+        if (slot->state == TILE_DRAWING) {
+            continue;
+        }
+        if (!victim || (slot->state == TILE_EMPTY)
+            || ((victim->state != TILE_EMPTY) && (slot->used < victim->used))) {
+            victim = slot;
+            if (slot->state == TILE_EMPTY) {
+                break;
+            }
+        }
+    }
+
+    /* a slot without a bitmap needs one; if the memory budget won't have
+     * it, the least recently used tile that has one gives up its own */
+    if (victim && !victim->rgb) {
+        if (budget_reserve(BUDGET_CACHE, TILE_BYTES) == 0) {
+            victim->reserved = 1;
+        } else {
+            slot = NULL;
+            for (i = 0; i < TILE_CACHE_TILES; i++) {
+                if (ctx->cache[i].rgb
+                    && (ctx->cache[i].state != TILE_DRAWING)
+                    && (!slot || (ctx->cache[i].used < slot->used))) {
+                    slot = &ctx->cache[i];
+                }
+            }
+            if (slot) {
+                victim = slot;
+            } else {
+                budget_charge(BUDGET_CACHE, TILE_BYTES);
+                victim->reserved = 1;
+            }
+        }
+    }
+
+    if (victim) {
+        victim->level = level;
+        victim->tx = tx;
+        victim->ty = ty;
+        victim->state = TILE_QUEUED;
+        victim->prefetch = prefetch;
+        victim->gen = ctx->gen;
+        victim->used = ++ctx->tick;
+        pthread_cond_signal(&ctx->wake);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return NULL;
+}
+
+
+/* tile_peek returns a tile if it has been drawn, without queueing it */
+struct tile *tile_peek(struct tile_ctx *ctx, int level, unsigned long tx,
+                       unsigned long ty)
+{
+    struct tile *slot;
+
+    if (!ctx) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    slot = tile_find(ctx, level, tx, ty);
+    if (slot && (slot->state == TILE_READY)) {
+        slot->used = ++ctx->tick;
+    } else {
+        slot = NULL;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return slot;
+}
+
+
+/* tile_drop_queued forgets the tiles that have been asked for but not
+ * started, when the view has moved on */
+int tile_drop_queued(struct tile_ctx *ctx)
+{
+    int i;
+
+    if (!ctx) {
+        FAIL_MSG("tile_drop_queued: invalid params\n");
+        return 1;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    for (i = 0; i < TILE_CACHE_TILES; i++) {
+        if (ctx->cache[i].state == TILE_QUEUED) {
+            ctx->cache[i].state = TILE_EMPTY;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return 0;
+}
+
+
+/* tile_pending returns how many tiles are waiting or being drawn */
+int tile_pending(struct tile_ctx *ctx)
+{
+    int i, n = 0;
+
+    if (!ctx) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    for (i = 0; i < TILE_CACHE_TILES; i++) {
+        if ((ctx->cache[i].state == TILE_QUEUED)
+            || (ctx->cache[i].state == TILE_DRAWING)) {
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return n;
+}
+
+
+/* tile_drawn returns how many tiles have been drawn since it was last
+ * called */
+unsigned long tile_drawn(struct tile_ctx *ctx)
+{
+    unsigned long n;
+
+    if (!ctx) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    n = ctx->drawn;
+    ctx->drawn = 0;
+    pthread_mutex_unlock(&ctx->lock);
+
+    return n;
+}
+
+
+/* tile_offset returns the offset of the byte at point x, y of a level, or
+ * the file size if it is past the end */
+unsigned long tile_offset(struct tile_ctx *ctx, int level, unsigned long x,
+                          unsigned long y)
+{
+    unsigned long d;
+
+    if (!ctx || (level < 0) || (level >= ctx->levels)
+        || (x >= ((unsigned long) TILE_SIZE << level))
+        || (y >= ((unsigned long) TILE_SIZE << level))) {
+        return ctx ? ctx->size : 0;
+    }
+
+    d = tile_point(ctx, level, x, y);
+
+    return d < ctx->size ? d : ctx->size;
+}
+
+
+/* tile_free stops the workers and frees the tiles */
+int tile_free(struct tile_ctx *ctx)
+{
+    int i;
+
+    if (!ctx) {
+        FAIL_MSG("tile_free: invalid params\n");
+        return 1;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->quit = 1;
+    __atomic_store_n(&ctx->gen, ctx->gen + 1, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&ctx->wake);
+    pthread_mutex_unlock(&ctx->lock);
+
+    for (i = 0; i < ctx->nthreads; i++) {
+        pthread_join(ctx->threads[i], NULL);
+    }
+
+    for (i = 0; i < TILE_CACHE_TILES; i++) {
+        free(ctx->cache[i].rgb);
+        if (ctx->cache[i].reserved) {
+            budget_release(BUDGET_CACHE, TILE_BYTES);
+        }
+    }
+
+    munmap((void *) ctx->data, ctx->size);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_cond_destroy(&ctx->wake);
+    free(ctx);
+
+    return 0;
+}
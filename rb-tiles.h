@@ -0,0 +1,101 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-tiles.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_TILES_H
+#define _RB_TILES_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "rb-hilbert.h"
+#include "rb-scan.h"
+#include "rb-budget.h"
+#include "macro.h"
+
+/* tiles are this many points a side */
+#define TILE_SHIFT 8
+#define TILE_SIZE (1 << TILE_SHIFT)
+#define TILE_BYTES (TILE_SIZE * TILE_SIZE * 3)
+/* drawn tiles kept, about 48MB of them */
+#define TILE_CACHE_TILES 256
+/* how far past a byte a point the view can zoom, as a power of 2 */
+#define TILE_MAX_MAG 4
+#define TILE_MAX_THREADS 8
+
+/* the states of a tile in the cache */
+#define TILE_EMPTY 0
+#define TILE_QUEUED 1
+#define TILE_DRAWING 2
+#define TILE_READY 3
+
+/* a square of the Hilbert curve at one zoom level */
+struct tile {
+    int level;
+    unsigned long tx;
+    unsigned long ty;
+    int state;
+    int prefetch;               /* not on screen, so drawn after those that are */
+    unsigned long gen;
+    unsigned long used;
+    uint8_t *rgb;
+    int reserved;               /* rgb is counted in the memory budget */
+};
+
+/* the file as a quadtree of tiles; level 0 is one tile of the whole file,
+ * and each level has twice as many tiles a side as the one before */
+struct tile_ctx {
+    unsigned long size;
+    const uint8_t *data;
+    int order;                  /* the curve is 1 << order bytes a side */
+    int levels;
+
+    /* how the tiles are drawn, set with tile_colours() */
+    uint8_t palette[256][3];
+    int flipped;
+    unsigned long gen;
+
+    /* least recently used tiles go first */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    struct tile cache[TILE_CACHE_TILES];
+    unsigned long tick;
+    unsigned long drawn;
+
+    int nthreads;
+    pthread_t threads[TILE_MAX_THREADS];
+    int quit;
+};
+
+struct tile_ctx *tile_new(int fd, unsigned long size);
+int tile_colours(struct tile_ctx *ctx, uint8_t palette[256][3], int flipped);
+struct tile *tile_get(struct tile_ctx *ctx, int level, unsigned long tx,
+                      unsigned long ty, int prefetch);
+struct tile *tile_peek(struct tile_ctx *ctx, int level, unsigned long tx,
+                       unsigned long ty);
+int tile_drop_queued(struct tile_ctx *ctx);
+int tile_pending(struct tile_ctx *ctx);
+unsigned long tile_drawn(struct tile_ctx *ctx);
+unsigned long tile_offset(struct tile_ctx *ctx, int level, unsigned long x,
+                          unsigned long y);
+int tile_free(struct tile_ctx *ctx);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-trace.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to trace the main window and the visualisers on one
+ * timeline.  When RB_TRACE names a file, each process keeps its recent
+ * events in a ring that is written without locks, so events can be added
+ * from threads and signal handlers.  The events are timed on the monotonic
+ * clock, which all the processes share.  When the main window asks for a
+ * trace through the shm, every process appends its ring to the file in the
+ * Chrome trace format, which chrome://tracing and the Perfetto UI both
+ * open.  The updates sent to the visualisers are drawn as flows from the
+ * main window's publish to each visualiser's reload.
+ */
+
+#include "rb-trace.h"
+
+/* the ring for this process */
+static struct trace_event *ring = NULL;
+static unsigned long ring_head = 0;
+static unsigned long ring_flushed = 0;
+
+static char *trace_path = NULL;
+static unsigned long trace_seen = 0;
+
+
+/* trace_init allocates the ring if RB_TRACE is set; the main window
+ * creates the file and the visualisers append to it */
+int trace_init(char *prog, int create)
+{
+    char line[TRACE_LINESIZE];
+    int fd;
+    int len;
+
+    if (!prog) {
+        FAIL_MSG("trace_init: invalid params\n");
+        return 1;
+    }
+
+
+    trace_path = getenv(TRACE_ENV);
+    if (!trace_path) {
+        return 0;
+    }
+
+    ring = (struct trace_event *) calloc(TRACE_EVENTS,
+                                         sizeof(struct trace_event));
+    if (!ring) {
+        FAIL_MSG("trace_init: calloc() failed\n");
+        return 2;
+    }
+
+
+    fd = open(trace_path, O_WRONLY | O_CREAT | O_APPEND | (create ? O_TRUNC
+                                                            : 0), 0644);
+    if (fd < 0) {
+        FAIL_ERR("trace_init: open() failed\n");
+        return 3;
+    }
+
+
+    /* the closing ] is optional in the array format, so any process can
+     * append to the file at any time */
+    len = snprintf(line, sizeof(line), "%s{\"name\":\"process_name\","
+                   "\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                   create ? "[\n" : "", (int) getpid(), prog);
+    if (write(fd, line, len) != len) {
+        FAIL_ERR("trace_init: write() failed\n");
+        close(fd);
+        return 4;
+    }
+
+
+    close(fd);
+
+    return 0;
+}
+
+
+/* trace_now returns the time on the shared clock in ns */
+uint64_t trace_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+
+/* trace_add claims the next slot in the ring and fills it in; the slot's
+ * seq is stored last so a flush can tell whether it is complete */
+static void trace_add(const char *name, char type, uint64_t ns,
+                      uint64_t dur, unsigned long id)
+{
+    struct trace_event *ev;
+    unsigned long i;
+
+    if (!ring) {
+        return;
+    }
+
+    i = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+    ev = &ring[i & (TRACE_EVENTS - 1)];
+
+    __atomic_store_n(&ev->seq, 0, __ATOMIC_RELAXED);
+    ev->ns = ns;
+    ev->dur = dur;
+    ev->name = name;
+    ev->id = id;
+    ev->type = type;
+    __atomic_store_n(&ev->seq, i + 1, __ATOMIC_RELEASE);
+}
+
+
+/* trace_span adds an event that ran from start until now */
+void trace_span(const char *name, uint64_t start)
+{
+    uint64_t now;
+
+    if (!ring) {
+        return;
+    }
+
+    now = trace_now();
+    trace_add(name, TRACE_SPAN, start, now - start, 0);
+}
+
+
+/* trace_instant adds a point event; it is safe in a signal handler */
+void trace_instant(const char *name)
+{
+    if (!ring) {
+        return;
+    }
+
+    trace_add(name, TRACE_INSTANT, trace_now(), 0, 0);
+}
+
+
+/* trace_flow adds the start or end of an arrow between processes */
+void trace_flow(const char *name, char type, unsigned long id)
+{
+    if (!ring) {
+        return;
+    }
+
+    trace_add(name, type, trace_now(), 0, id);
+}
+
+
+/* trace_flush appends the events since the last flush to the trace file */
+int trace_flush()
+{
+    char buf[TRACE_BUFSIZE];
+    struct trace_event ev;
+    unsigned long head;
+    unsigned long i;
+    size_t len;
+    int pid;
+    int fd;
+
+    if (!ring) {
+        return 0;
+    }
+
+    fd = open(trace_path, O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        FAIL_ERR("trace_flush: open() failed\n");
+        return 1;
+    }
+
+
+    /* events older than the ring have been overwritten */
+    head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    if (head - ring_flushed > TRACE_EVENTS) {
+        ring_flushed = head - TRACE_EVENTS;
+    }
+
+    pid = getpid();
+    len = 0;
+    for (i = ring_flushed; i < head; i++) {
+        ev = ring[i & (TRACE_EVENTS - 1)];
+
+        /* skip slots that are still being written or were reused */
+        if (__atomic_load_n(&ring[i & (TRACE_EVENTS - 1)].seq,
+                            __ATOMIC_ACQUIRE) != i + 1 || ev.seq != i + 1) {
+            continue;
+        }
+
+        switch (ev.type) {
+        case TRACE_SPAN:
+            len += snprintf(buf + len, sizeof(buf) - len,
+                            "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,"
+                            "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+                            ev.name, pid, pid, ev.ns / 1e3, ev.dur / 1e3);
+            break;
+        case TRACE_INSTANT:
+            len += snprintf(buf + len, sizeof(buf) - len,
+                            "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"p\","
+                            "\"pid\":%d,\"tid\":%d,\"ts\":%.3f},\n",
+                            ev.name, pid, pid, ev.ns / 1e3);
+            break;
+        case TRACE_FLOW_START:
+        case TRACE_FLOW_END:
+            len += snprintf(buf + len, sizeof(buf) - len,
+                            "{\"name\":\"%s\",\"cat\":\"update\","
+                            "\"ph\":\"%c\",%s\"id\":%lu,\"pid\":%d,"
+                            "\"tid\":%d,\"ts\":%.3f},\n", ev.name, ev.type,
+                            ev.type == TRACE_FLOW_END ? "\"bp\":\"e\"," : "",
+                            ev.id, pid, pid, ev.ns / 1e3);
+            break;
+        }
+
+        /* write whole lines so processes don't interleave within one */
+        if (len > sizeof(buf) - TRACE_LINESIZE) {
+            if (write(fd, buf, len) != (ssize_t) len) {
+                FAIL_ERR("trace_flush: write() failed\n");
+                close(fd);
+                return 2;
+            }
+
+            len = 0;
+        }
+    }
+
+    if (len && (write(fd, buf, len) != (ssize_t) len)) {
+        FAIL_ERR("trace_flush: write() failed\n");
+        close(fd);
+        return 3;
+    }
+
+
+    close(fd);
+    ring_flushed = head;
+
+    return 0;
+}
+
+
+/* trace_request has every process write out its trace */
+int trace_request(struct rb_shm *shm)
+{
+    if (!shm) {
+        FAIL_MSG("trace_request: invalid params\n");
+        return 1;
+    }
+
+
+    if (!ring) {
+        fprintf(stderr, "trace_request: set %s to trace\n", TRACE_ENV);
+        return 0;
+    }
+
+    trace_seen = __atomic_add_fetch(&shm->trace_seq, 1, __ATOMIC_RELEASE);
+
+    if (trace_flush() != 0) {
+        FAIL_MSG("trace_request: trace_flush() failed\n");
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* trace_poll writes out the trace if the main window has asked for it */
+int trace_poll(struct rb_shm *shm)
+{
+    unsigned long seq;
+
+    if (!ring || !shm) {
+        return 0;
+    }
+
+    seq = __atomic_load_n(&shm->trace_seq, __ATOMIC_ACQUIRE);
+    if (seq == trace_seen) {
+        return 0;
+    }
+
+    trace_seen = seq;
+    if (trace_flush() != 0) {
+        FAIL_MSG("trace_poll: trace_flush() failed\n");
+        return 1;
+    }
+
+
+    return 0;
+}
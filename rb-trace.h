@@ -0,0 +1,64 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-trace.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_TRACE_H
+#define _RB_TRACE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "rb-shm.h"
+#include "macro.h"
+
+/* environment variable naming the trace file */
+#define TRACE_ENV "RB_TRACE"
+
+/* events kept by each process; a power of 2 */
+#define TRACE_EVENTS 65536
+#define TRACE_BUFSIZE 65536
+#define TRACE_LINESIZE 256
+
+/* event types, as in the Chrome trace format */
+#define TRACE_SPAN 'X'
+#define TRACE_INSTANT 'i'
+#define TRACE_FLOW_START 's'
+#define TRACE_FLOW_END 'f'
+
+/* one event; names are always string constants */
+struct trace_event {
+    unsigned long seq;
+    uint64_t ns;
+    uint64_t dur;
+    const char *name;
+    unsigned long id;
+    char type;
+};
+
+int trace_init(char *prog, int create);
+uint64_t trace_now();
+void trace_span(const char *name, uint64_t start);
+void trace_instant(const char *name);
+void trace_flow(const char *name, char type, unsigned long id);
+int trace_flush();
+int trace_request(struct rb_shm *shm);
+int trace_poll(struct rb_shm *shm);
+
+#endif
@@ -22,6 +22,10 @@ struct visualiser *visualisers = NULL;
 /* load_vis loads a visualiser name and exe from a single line.
  * format for this is:
  * "name" exe
+ * or for a plugin:
+ * "name" plugin:library
+ * or for a program that can be started before it is wanted:
+ * "name" zygote:exe
 */
 int load_vis(char *str)
 {
@@ -105,6 +109,20 @@ int load_vis(char *str)
     }
 
 
+    /* a plugin is a shared library to load rather than a program */
+    visualisers[visualiser_count].plugin = 0;
+    if (strncmp(ptr, PLUGIN_PREFIX, strlen(PLUGIN_PREFIX)) == 0) {
+        visualisers[visualiser_count].plugin = 1;
+        ptr += strlen(PLUGIN_PREFIX);
+    }
+
+    /* a zygote is a program that is kept started and waiting */
+    visualisers[visualiser_count].zygote = 0;
+    if (strncmp(ptr, ZYGOTE_PREFIX, strlen(ZYGOTE_PREFIX)) == 0) {
+        visualisers[visualiser_count].zygote = 1;
+        ptr += strlen(ZYGOTE_PREFIX);
+    }
+
     /* copy exe string to visualiser */
     strncpy(visualisers[visualiser_count].exe, ptr, ptr2 - ptr);
     visualisers[visualiser_count].exe[ptr2 - ptr] = 0x00;
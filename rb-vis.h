@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "rb-data.h"
+#include "rb-plugin.h"
+#include "rb-zygote.h"
 #include "macro.h"
 
 int load_vis(char *str);
@@ -0,0 +1,1520 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-zsrc.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to look at compressed files without decompressing
+ * them first.  Each file gets an index of the places decompression can
+ * start: gzip access points with the 32KB window before them, found with
+ * one pass through the file as in zlib's zran.c; the xz block index; or
+ * the frames of zstd's seekable format.  The index is made on a thread of
+ * its own, as the pass over a big gzip file takes a while, and is kept
+ * next to the file so the pass is only made once.
+ *
+ * The plots and visualisers read a sparse view file the size of the
+ * decompressed data, and only the parts of it they are about to read are
+ * decompressed into it, a block per thread.  The scans read through an LRU
+ * of decompressed blocks instead, so a whole-file scan doesn't fill the
+ * view.
+ */
+
+#include "rb-zsrc.h"
+
+
+/* the index file header */
+struct zsrc_header {
+    char magic[8];
+    uint32_t format;
+    uint32_t npoints;
+    uint64_t csize;
+    uint64_t size;
+    uint64_t mtime;
+};
+
+/* a thread's share of zsrc_fill() */
+struct zsrc_fill {
+    struct zsrc_ctx *ctx;
+    long *lo;
+    long *hi;
+    long data_start;
+    float step;
+    int dense;                  /* data_start plus a page a sample */
+    long next;
+    int error;
+};
+
+
+/* zsrc_detect returns the format of the file from its magic bytes */
+int zsrc_detect(int fd)
+{
+    uint8_t magic[6];
+
+    if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic)) {
+        return ZSRC_NONE;
+    }
+
+    if ((magic[0] == 0x1f) && (magic[1] == 0x8b)) {
+        return ZSRC_GZIP;
+    }
+    if (memcmp(magic, "\xfd" "7zXZ\x00", 6) == 0) {
+        return ZSRC_XZ;
+    }
+    if ((magic[0] == 0x28) && (magic[1] == 0xb5) && (magic[2] == 0x2f)
+        && (magic[3] == 0xfd)) {
+        return ZSRC_ZSTD;
+    }
+
+    return ZSRC_NONE;
+}
+
+
+/* zsrc_add_point adds an access point to the index */
+static int zsrc_add_point(struct zsrc_ctx *ctx, int *max,
+                          struct zsrc_point *point)
+{
+    struct zsrc_point *tmp;
+
+    if (ctx->npoints == *max) {
+        *max = *max ? *max * 2 : 256;
+        tmp = (struct zsrc_point *) realloc(ctx->points,
+                                            *max *
+                                            sizeof(struct zsrc_point));
+        if (!tmp) {
+            FAIL_MSG("zsrc_add_point: realloc() failed\n");
+            return 1;
+        }
+
+        ctx->points = tmp;
+    }
+
+    ctx->points[ctx->npoints] = *point;
+    ctx->npoints++;
+
+    return 0;
+}
+
+
+/* zsrc_index_gzip makes one pass through a gzip file, adding an access
+ * point at the end of a deflate block every ZSRC_SPAN bytes and at the
+ * start of each member */
+static int zsrc_index_gzip(struct zsrc_ctx *ctx)
+{
+    struct zsrc_point point;
+    z_stream strm;
+    uint8_t *input, *window, *flat;
+    unsigned long totin, totout, last;
+    uLongf flatlen;
+    ssize_t got;
+    int ret, max;
+
+    input = (uint8_t *) malloc(ZSRC_CHUNK);
+    window = (uint8_t *) malloc(ZSRC_WINSIZE);
+    flat = (uint8_t *) malloc(compressBound(ZSRC_WINSIZE));
+    if (!input || !window || !flat) {
+        FAIL_MSG("zsrc_index_gzip: malloc() failed\n");
+        free(input);
+        free(window);
+        free(flat);
+        return 1;
+    }
+
+
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 47) != Z_OK) {
+        FAIL_MSG("zsrc_index_gzip: inflateInit2() failed\n");
+        free(input);
+        free(window);
+        free(flat);
+        return 2;
+    }
+
+
+    memset(&point, 0, sizeof(point));
+    point.flags = ZSRC_POINT_MEMBER;
+    max = 0;
+    ret = zsrc_add_point(ctx, &max, &point);
+
+    totin = totout = last = 0;
+    strm.avail_out = 0;
+    while (ret == 0) {
+        if (__atomic_load_n(&ctx->cancel, __ATOMIC_RELAXED)) {
+            ret = 7;
+            break;
+        }
+        __atomic_store_n(&ctx->index_in, totin, __ATOMIC_RELAXED);
+
+        if (strm.avail_in == 0) {
+            got = pread(ctx->fd, input, ZSRC_CHUNK, totin);
+            if (got < 0) {
+                FAIL_ERR("zsrc_index_gzip: pread() failed\n");
+                ret = 3;
+                break;
+            }
+            if (got == 0) {
+                break;
+            }
+            strm.next_in = input;
+            strm.avail_in = got;
+        }
+
+        /* the output goes round the window, so it always holds the last
+         * 32KB */
+        if (strm.avail_out == 0) {
+            strm.next_out = window;
+            strm.avail_out = ZSRC_WINSIZE;
+        }
+
+        totin += strm.avail_in;
+        totout += strm.avail_out;
+        ret = inflate(&strm, Z_BLOCK);
+        totin -= strm.avail_in;
+        totout -= strm.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            /* another member may follow; anything else is ignored.  Its
+             * magic may be cut off at the end of the input. */
+            if ((strm.avail_in < 2)
+                && (pread(ctx->fd, input, 2, totin) == 2)) {
+                strm.next_in = input;
+                strm.avail_in = 2;
+            }
+            if ((strm.avail_in < 2) || (strm.next_in[0] != 0x1f)
+                || (strm.next_in[1] != 0x8b)) {
+                ret = 0;
+                break;
+            }
+
+            inflateReset(&strm);
+            ret = 0;
+            if (totout - last > ZSRC_SPAN) {
+                memset(&point, 0, sizeof(point));
+                point.flags = ZSRC_POINT_MEMBER;
+                point.in = totin;
+                point.out = totout;
+                ret = zsrc_add_point(ctx, &max, &point);
+                last = totout;
+            }
+            continue;
+        }
+
+        if (ret != Z_OK) {
+            FAIL_MSG("zsrc_index_gzip: inflate() failed\n");
+            ret = 4;
+            break;
+        }
+
+        ret = 0;
+
+        /* at the end of a deflate block that isn't the last */
+        if ((strm.data_type & 128) && !(strm.data_type & 64)
+            && (totout - last > ZSRC_SPAN)) {
+            memset(&point, 0, sizeof(point));
+            point.in = totin;
+            point.out = totout;
+            point.bits = strm.data_type & 7;
+
+            /* unroll the window and keep it compressed */
+            memcpy(flat, window + (ZSRC_WINSIZE - strm.avail_out),
+                   strm.avail_out);
+            memcpy(flat + strm.avail_out, window,
+                   ZSRC_WINSIZE - strm.avail_out);
+            point.window = (uint8_t *) malloc(compressBound(ZSRC_WINSIZE));
+            flatlen = compressBound(ZSRC_WINSIZE);
+            if (!point.window
+                || (compress2(point.window, &flatlen, flat, ZSRC_WINSIZE,
+                              Z_BEST_SPEED) != Z_OK)) {
+                FAIL_MSG("zsrc_index_gzip: compress2() failed\n");
+                free(point.window);
+                ret = 5;
+                break;
+            }
+
+            point.wlen = flatlen;
+            ret = zsrc_add_point(ctx, &max, &point);
+            last = totout;
+        }
+    }
+
+    inflateEnd(&strm);
+    free(input);
+    free(window);
+    free(flat);
+
+    ctx->size = totout;
+    if (ret == 0 && !totout) {
+        FAIL_MSG("zsrc_index_gzip: nothing in the file\n");
+        ret = 6;
+    }
+
+    return ret;
+}
+
+
+/* zsrc_index_xz reads the xz block index from the end of the file */
+static int zsrc_index_xz(struct zsrc_ctx *ctx)
+{
+    struct zsrc_point point;
+    lzma_stream strm = LZMA_STREAM_INIT;
+    lzma_index *index = NULL;
+    lzma_index_iter iter;
+    uint8_t *input;
+    uint64_t pos;
+    ssize_t got;
+    lzma_ret lret;
+    int ret, max;
+
+    input = (uint8_t *) malloc(ZSRC_CHUNK);
+    if (!input) {
+        FAIL_MSG("zsrc_index_xz: malloc() failed\n");
+        return 1;
+    }
+
+
+    if (lzma_file_info_decoder(&strm, &index, UINT64_MAX, ctx->csize) !=
+        LZMA_OK) {
+        FAIL_MSG("zsrc_index_xz: lzma_file_info_decoder() failed\n");
+        free(input);
+        return 2;
+    }
+
+
+    /* the decoder asks for the parts of the file it needs */
+    pos = 0;
+    do {
+        if (strm.avail_in == 0) {
+            got = pread(ctx->fd, input, ZSRC_CHUNK, pos);
+            if (got < 0) {
+                lret = LZMA_DATA_ERROR;
+                break;
+            }
+            strm.next_in = input;
+            strm.avail_in = got;
+            pos += got;
+        }
+
+        lret = lzma_code(&strm, LZMA_RUN);
+        if (lret == LZMA_SEEK_NEEDED) {
+            pos = strm.seek_pos;
+            strm.avail_in = 0;
+            lret = LZMA_OK;
+        }
+    } while (lret == LZMA_OK);
+
+    lzma_end(&strm);
+    free(input);
+
+    if (lret != LZMA_STREAM_END) {
+        FAIL_MSG("zsrc_index_xz: cannot read the xz index\n");
+        return 3;
+    }
+
+
+    max = 0;
+    ret = 0;
+    lzma_index_iter_init(&iter, index);
+    while ((ret == 0) && !lzma_index_iter_next(&iter,
+                                               LZMA_INDEX_ITER_NONEMPTY_BLOCK))
+    {
+        memset(&point, 0, sizeof(point));
+        point.in = iter.block.compressed_file_offset;
+        point.inlen = iter.block.total_size;
+        point.out = iter.block.uncompressed_file_offset;
+        point.check = iter.stream.flags->check;
+        if (iter.block.uncompressed_size > ZSRC_MAX_BLOCK) {
+            fprintf(stderr, "zsrc_index_xz: %s has blocks too big to look "
+                    "at randomly; compress it with xz -T0, or pipe it in "
+                    "with xz -dc\n", ctx->name);
+            ret = 4;
+            break;
+        }
+        ret = zsrc_add_point(ctx, &max, &point);
+    }
+
+    ctx->size = lzma_index_uncompressed_size(index);
+    lzma_index_end(index, NULL);
+
+    if ((ret == 0) && !ctx->npoints) {
+        FAIL_MSG("zsrc_index_xz: nothing in the file\n");
+        ret = 5;
+    }
+
+    return ret;
+}
+
+
+/* zsrc_le32 reads a little endian 32 bit number */
+static uint32_t zsrc_le32(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+
+/* zsrc_index_zstd reads the seek table of a zstd seekable file */
+static int zsrc_index_zstd(struct zsrc_ctx *ctx)
+{
+    struct zsrc_point point;
+    uint8_t footer[9];
+    uint8_t *table;
+    unsigned long tablelen, in, out;
+    uint32_t frames, i, entry;
+    int ret, max;
+
+    /* the footer is the frame count, a descriptor and a magic number */
+    if ((ctx->csize < sizeof(footer))
+        || (pread(ctx->fd, footer, sizeof(footer),
+                  ctx->csize - sizeof(footer)) != sizeof(footer))
+        || (zsrc_le32(footer + 5) != 0x8F92EAB1)) {
+        fprintf(stderr, "zsrc_index_zstd: %s isn't in the seekable format; "
+                "pipe it in with zstd -dc\n", ctx->name);
+        return 1;
+    }
+
+
+    frames = zsrc_le32(footer);
+    entry = (footer[4] & 0x80) ? 12 : 8;
+    tablelen = (unsigned long) frames * entry;
+    if (tablelen + sizeof(footer) + 8 > ctx->csize) {
+        FAIL_MSG("zsrc_index_zstd: bad seek table\n");
+        return 2;
+    }
+
+
+    table = (uint8_t *) malloc(tablelen + 1);
+    if (!table) {
+        FAIL_MSG("zsrc_index_zstd: malloc() failed\n");
+        return 3;
+    }
+
+
+    if (pread(ctx->fd, table, tablelen,
+              ctx->csize - sizeof(footer) - tablelen) != (ssize_t) tablelen) {
+        FAIL_ERR("zsrc_index_zstd: pread() failed\n");
+        free(table);
+        return 4;
+    }
+
+
+    max = 0;
+    ret = 0;
+    in = out = 0;
+    for (i = 0; (i < frames) && (ret == 0); i++) {
+        memset(&point, 0, sizeof(point));
+        point.in = in;
+        point.inlen = zsrc_le32(table + (i * entry));
+        point.out = out;
+        in += point.inlen;
+        out += zsrc_le32(table + (i * entry) + 4);
+        if (out - point.out > ZSRC_MAX_BLOCK) {
+            FAIL_MSG("zsrc_index_zstd: frame too big\n");
+            ret = 5;
+            break;
+        }
+        if (out > point.out) {
+            ret = zsrc_add_point(ctx, &max, &point);
+        }
+    }
+
+    free(table);
+    ctx->size = out;
+
+    if ((ret == 0) && !ctx->npoints) {
+        FAIL_MSG("zsrc_index_zstd: nothing in the file\n");
+        ret = 6;
+    }
+
+    return ret;
+}
+
+
+/* zsrc_index_name sets name to the index file for fname */
+static void zsrc_index_name(char *name, char *fname)
+{
+    snprintf(name, PATH_MAX, "%s%s", fname, ZSRC_INDEX_EXT);
+}
+
+
+/* zsrc_load_index reads the index kept next to the file, if it is for
+ * this version of the file */
+static int zsrc_load_index(struct zsrc_ctx *ctx, char *fname,
+                           struct stat *filestat)
+{
+    struct zsrc_header header;
+    char name[PATH_MAX];
+    FILE *fp;
+    int i, ok;
+
+    zsrc_index_name(name, fname);
+    fp = fopen(name, "r");
+    if (!fp) {
+        return 1;
+    }
+
+    if ((fread(&header, sizeof(header), 1, fp) != 1)
+        || memcmp(header.magic, ZSRC_INDEX_MAGIC, 8)
+        || ((int) header.format != ctx->format)
+        || (header.csize != ctx->csize)
+        || (header.mtime != (uint64_t) filestat->st_mtime)
+        || !header.npoints) {
+        fclose(fp);
+        return 2;
+    }
+
+    ctx->points = (struct zsrc_point *) calloc(header.npoints,
+                                               sizeof(struct zsrc_point));
+    if (!ctx->points) {
+        fclose(fp);
+        return 3;
+    }
+
+    /* the windows follow their points */
+    ok = 1;
+    for (i = 0; ok && (i < (int) header.npoints); i++) {
+        ok = (fread(&ctx->points[i], sizeof(struct zsrc_point), 1, fp) == 1);
+        ctx->points[i].window = NULL;
+        ctx->npoints = i + 1;
+        if (ok && ctx->points[i].wlen) {
+            ctx->points[i].window = (uint8_t *) malloc(ctx->points[i].wlen);
+            ok = ctx->points[i].window
+                && (fread(ctx->points[i].window, ctx->points[i].wlen, 1, fp)
+                    == 1);
+        }
+    }
+
+    fclose(fp);
+
+    if (!ok) {
+        return 4;
+    }
+
+    ctx->size = header.size;
+
+    return 0;
+}
+
+
+/* zsrc_save_index keeps the index next to the file */
+static int zsrc_save_index(struct zsrc_ctx *ctx, char *fname,
+                           struct stat *filestat)
+{
+    struct zsrc_header header;
+    struct zsrc_point point;
+    char name[PATH_MAX];
+    FILE *fp;
+    int i, ok;
+
+    zsrc_index_name(name, fname);
+    fp = fopen(name, "w");
+    if (!fp) {
+        FAIL_ERR("zsrc_save_index: cannot write the index\n");
+        return 1;
+    }
+
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ZSRC_INDEX_MAGIC, 8);
+    header.format = ctx->format;
+    header.npoints = ctx->npoints;
+    header.csize = ctx->csize;
+    header.size = ctx->size;
+    header.mtime = filestat->st_mtime;
+
+    ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+    for (i = 0; ok && (i < ctx->npoints); i++) {
+        point = ctx->points[i];
+        point.window = NULL;
+        ok = (fwrite(&point, sizeof(point), 1, fp) == 1)
+            && (!point.wlen
+                || (fwrite(ctx->points[i].window, point.wlen, 1, fp) == 1));
+    }
+
+    if ((fclose(fp) != 0) || !ok) {
+        FAIL_MSG("zsrc_save_index: cannot write the index\n");
+        unlink(name);
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* zsrc_open opens the compressed file fd, reading its index if one has
+ * been kept; fd is closed with the ctx, or straight away if it fails */
+struct zsrc_ctx *zsrc_open(int fd, char *fname)
+{
+    struct zsrc_ctx *ctx;
+    struct stat filestat;
+    char *base;
+
+    if ((fd < 0) || !fname) {
+        FAIL_MSG("zsrc_open: invalid params\n");
+        return NULL;
+    }
+
+
+    if (fstat(fd, &filestat) != 0) {
+        FAIL_ERR("zsrc_open: fstat() failed\n");
+        close(fd);
+        return NULL;
+    }
+
+
+    ctx = (struct zsrc_ctx *) calloc(1, sizeof(struct zsrc_ctx));
+    if (!ctx) {
+        FAIL_MSG("zsrc_open: calloc() failed\n");
+        close(fd);
+        return NULL;
+    }
+
+
+    ctx->fd = fd;
+    ctx->view = -1;
+    ctx->format = zsrc_detect(fd);
+    ctx->csize = filestat.st_size;
+    pthread_mutex_init(&ctx->lock, NULL);
+
+    base = strrchr(fname, '/');
+    strncpy(ctx->name, base ? base + 1 : fname, PATH_MAX);
+    ctx->name[PATH_MAX - 1] = 0x00;
+    strncpy(ctx->source, fname, PATH_MAX);
+    ctx->source[PATH_MAX - 1] = 0x00;
+    memcpy(&ctx->filestat, &filestat, sizeof(filestat));
+
+#ifndef RB_ZSTD
+    if (ctx->format == ZSRC_ZSTD) {
+        fprintf(stderr, "zsrc_open: built without zstd; pipe %s in with "
+                "zstd -dc\n", ctx->name);
+        zsrc_free(ctx);
+        return NULL;
+    }
+#endif
+
+    /* the index is made once and kept */
+    if (zsrc_load_index(ctx, fname, &filestat) != 0) {
+        while (ctx->npoints) {
+            free(ctx->points[--ctx->npoints].window);
+        }
+        free(ctx->points);
+        ctx->points = NULL;
+    } else {
+        ctx->indexed = 1;
+    }
+
+    return ctx;
+}
+
+
+/* zsrc_indexer is the thread that makes the index */
+static void *zsrc_indexer(void *data)
+{
+    struct zsrc_ctx *ctx = (struct zsrc_ctx *) data;
+    int ret;
+
+    switch (ctx->format) {
+    case ZSRC_GZIP:
+        ret = zsrc_index_gzip(ctx);
+        break;
+    case ZSRC_XZ:
+        ret = zsrc_index_xz(ctx);
+        break;
+    case ZSRC_ZSTD:
+        ret = zsrc_index_zstd(ctx);
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+
+    if (ret != 0) {
+        FAIL_MSG("zsrc_indexer: cannot index the file\n");
+        ctx->index_error = 1;
+    }
+
+    ctx->made = 1;
+    __atomic_store_n(&ctx->indexed, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+
+/* zsrc_index_start makes the index in the background, unless it was
+ * kept */
+int zsrc_index_start(struct zsrc_ctx *ctx)
+{
+    if (!ctx || ctx->indexing) {
+        FAIL_MSG("zsrc_index_start: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->indexed) {
+        return 0;
+    }
+
+    ctx->indexing = 1;
+    if (pthread_create(&ctx->indexer, NULL, zsrc_indexer, ctx) != 0) {
+        FAIL_MSG("zsrc_index_start: pthread_create() failed\n");
+        ctx->indexing = 0;
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* zsrc_index_done returns whether the index is ready, or has failed */
+int zsrc_index_done(struct zsrc_ctx *ctx)
+{
+    if (!ctx) {
+        return 1;
+    }
+
+    if (!__atomic_load_n(&ctx->indexed, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    if (ctx->indexing) {
+        pthread_join(ctx->indexer, NULL);
+        ctx->indexing = 0;
+    }
+
+    return 1;
+}
+
+
+/* zsrc_index_progress returns how far through the index is, in percent;
+ * only gzip needs a pass through the file */
+int zsrc_index_progress(struct zsrc_ctx *ctx)
+{
+    if (!ctx || !ctx->csize || ctx->indexed) {
+        return 100;
+    }
+
+    return (int) ((__atomic_load_n(&ctx->index_in, __ATOMIC_RELAXED) *
+                   100) / ctx->csize);
+}
+
+
+/* zsrc_view keeps the index if it was just made, and makes an empty view
+ * of the decompressed data */
+int zsrc_view(struct zsrc_ctx *ctx)
+{
+    if (!ctx || !zsrc_index_done(ctx)) {
+        FAIL_MSG("zsrc_view: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->index_error) {
+        FAIL_MSG("zsrc_view: the file has no index\n");
+        return 2;
+    }
+
+
+    if (ctx->made) {
+        zsrc_save_index(ctx, ctx->source, &ctx->filestat);
+    }
+
+    /* the view is sparse until parts of it are looked at */
+    ctx->view = spool_tmpfile(ctx->path, ctx->tmpname);
+    if (ctx->view < 0) {
+        FAIL_MSG("zsrc_view: spool_tmpfile() failed\n");
+        return 3;
+    }
+
+
+    if (ftruncate(ctx->view, ctx->size) != 0) {
+        FAIL_ERR("zsrc_view: ftruncate() failed\n");
+        return 4;
+    }
+
+
+    ctx->pages = (uint8_t *) calloc((ctx->size / ZSRC_PAGE_SIZE / 8) + 1, 1);
+    if (!ctx->pages) {
+        FAIL_MSG("zsrc_view: calloc() failed\n");
+        return 5;
+    }
+
+
+    return 0;
+}
+
+
+/* zsrc_free stops indexing the compressed file, if it still is, and
+ * closes it and its view */
+int zsrc_free(struct zsrc_ctx *ctx)
+{
+    int i;
+
+    if (!ctx) {
+        FAIL_MSG("zsrc_free: invalid params\n");
+        return 1;
+    }
+
+
+    if (ctx->indexing) {
+        __atomic_store_n(&ctx->cancel, 1, __ATOMIC_RELAXED);
+        pthread_join(ctx->indexer, NULL);
+        ctx->indexing = 0;
+    }
+
+    for (i = 0; i < ctx->npoints; i++) {
+        free(ctx->points[i].window);
+    }
+    for (i = 0; i < ZSRC_CACHE_BLOCKS; i++) {
+        free(ctx->cache[i].data);
+    }
+    budget_release(BUDGET_CACHE, ctx->cached);
+
+    if (ctx->view >= 0) {
+        close(ctx->view);
+    }
+    if (ctx->tmpname[0]) {
+        unlink(ctx->tmpname);
+    }
+
+    close(ctx->fd);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx->points);
+    free(ctx->pages);
+    free(ctx);
+
+    return 0;
+}
+
+
+/* zsrc_block returns the block holding offset */
+long zsrc_block(struct zsrc_ctx *ctx, unsigned long offset)
+{
+    long lo, hi, mid;
+
+    if (!ctx || (offset >= ctx->size)) {
+        return -1;
+    }
+
+    lo = 0;
+    hi = ctx->npoints - 1;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (ctx->points[mid].out <= offset) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return lo;
+}
+
+
+/* zsrc_block_end returns where block ends in the decompressed data */
+static unsigned long zsrc_block_end(struct zsrc_ctx *ctx, long block)
+{
+    if (block + 1 < ctx->npoints) {
+        return ctx->points[block + 1].out;
+    }
+
+    return ctx->size;
+}
+
+
+/* zsrc_inflate decompresses a gzip block from its access point */
+static long zsrc_inflate(struct zsrc_ctx *ctx, long block, uint8_t * out,
+                         unsigned long len)
+{
+    struct zsrc_point *point = &ctx->points[block];
+    uint8_t window[ZSRC_WINSIZE];
+    uint8_t input[ZSRC_CHUNK];
+    unsigned long pos, skip;
+    uLongf wlen;
+    z_stream strm;
+    ssize_t got;
+    int ret, raw;
+
+    memset(&strm, 0, sizeof(strm));
+    raw = !(point->flags & ZSRC_POINT_MEMBER);
+    if (inflateInit2(&strm, raw ? -15 : 31) != Z_OK) {
+        FAIL_MSG("zsrc_inflate: inflateInit2() failed\n");
+        return -1;
+    }
+
+
+    /* part of the first byte may belong to the block before */
+    pos = point->in;
+    if (raw) {
+        if (point->bits) {
+            pos--;
+            if (pread(ctx->fd, input, 1, pos) != 1) {
+                FAIL_ERR("zsrc_inflate: pread() failed\n");
+                inflateEnd(&strm);
+                return -1;
+            }
+
+            inflatePrime(&strm, point->bits, input[0] >> (8 - point->bits));
+            pos++;
+        }
+
+        wlen = ZSRC_WINSIZE;
+        if ((uncompress(window, &wlen, point->window, point->wlen) != Z_OK)
+            || (inflateSetDictionary(&strm, window, wlen) != Z_OK)) {
+            FAIL_MSG("zsrc_inflate: cannot set the window\n");
+            inflateEnd(&strm);
+            return -1;
+        }
+
+    }
+
+    strm.next_out = out;
+    strm.avail_out = len;
+    skip = 0;
+    ret = Z_OK;
+    while (strm.avail_out) {
+        if (strm.avail_in == 0) {
+            got = pread(ctx->fd, input, ZSRC_CHUNK, pos);
+            if (got <= 0) {
+                break;
+            }
+            pos += got;
+            strm.next_in = input;
+            strm.avail_in = got;
+        }
+
+        /* a raw stream is followed by its member's trailer */
+        if (skip) {
+            got = skip < strm.avail_in ? skip : strm.avail_in;
+            skip -= got;
+            strm.next_in += got;
+            strm.avail_in -= got;
+            continue;
+        }
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            if (raw) {
+                skip = 8;
+                raw = 0;
+                inflateReset2(&strm, 31);
+            } else {
+                inflateReset(&strm);
+            }
+            continue;
+        }
+        if (ret != Z_OK) {
+            break;
+        }
+    }
+
+    inflateEnd(&strm);
+
+    if (strm.avail_out) {
+        FAIL_MSG("zsrc_inflate: inflate() failed\n");
+        return -1;
+    }
+
+
+    return len;
+}
+
+
+/* zsrc_unxz decompresses an xz block */
+static long zsrc_unxz(struct zsrc_ctx *ctx, long block, uint8_t * out,
+                      unsigned long len)
+{
+    struct zsrc_point *point = &ctx->points[block];
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block lblock;
+    uint8_t *input;
+    size_t in_pos, out_pos;
+    lzma_ret ret;
+    int i;
+
+    input = (uint8_t *) malloc(point->inlen);
+    if (!input) {
+        FAIL_MSG("zsrc_unxz: malloc() failed\n");
+        return -1;
+    }
+
+
+    if (pread(ctx->fd, input, point->inlen, point->in) !=
+        (ssize_t) point->inlen) {
+        FAIL_ERR("zsrc_unxz: pread() failed\n");
+        free(input);
+        return -1;
+    }
+
+
+    memset(&lblock, 0, sizeof(lblock));
+    memset(filters, 0, sizeof(filters));
+    lblock.version = 1;
+    lblock.check = point->check;
+    lblock.filters = filters;
+    lblock.header_size = lzma_block_header_size_decode(input[0]);
+
+    ret = lzma_block_header_decode(&lblock, NULL, input);
+    if (ret == LZMA_OK) {
+        in_pos = lblock.header_size;
+        out_pos = 0;
+        ret = lzma_block_buffer_decode(&lblock, NULL, input, &in_pos,
+                                       point->inlen, out, &out_pos, len);
+        if (out_pos != len) {
+            ret = LZMA_DATA_ERROR;
+        }
+    }
+
+    for (i = 0; filters[i].id != LZMA_VLI_UNKNOWN && i < LZMA_FILTERS_MAX;
+         i++) {
+        free(filters[i].options);
+    }
+    free(input);
+
+    if (ret != LZMA_OK) {
+        FAIL_MSG("zsrc_unxz: cannot decode the block\n");
+        return -1;
+    }
+
+
+    return len;
+}
+
+
+#ifdef RB_ZSTD
+/* zsrc_unzstd decompresses a zstd frame */
+static long zsrc_unzstd(struct zsrc_ctx *ctx, long block, uint8_t * out,
+                        unsigned long len)
+{
+    struct zsrc_point *point = &ctx->points[block];
+    uint8_t *input;
+    size_t ret;
+
+    input = (uint8_t *) malloc(point->inlen);
+    if (!input) {
+        FAIL_MSG("zsrc_unzstd: malloc() failed\n");
+        return -1;
+    }
+
+
+    if (pread(ctx->fd, input, point->inlen, point->in) !=
+        (ssize_t) point->inlen) {
+        FAIL_ERR("zsrc_unzstd: pread() failed\n");
+        free(input);
+        return -1;
+    }
+
+
+    ret = ZSTD_decompress(out, len, input, point->inlen);
+    free(input);
+
+    if (ZSTD_isError(ret) || (ret != len)) {
+        FAIL_MSG("zsrc_unzstd: ZSTD_decompress() failed\n");
+        return -1;
+    }
+
+
+    return len;
+}
+#endif
+
+
+/* zsrc_decompress decompresses a whole block into out, which must hold
+ * it; it returns the block's size */
+long zsrc_decompress(struct zsrc_ctx *ctx, long block, uint8_t * out)
+{
+    unsigned long len;
+
+    if (!ctx || !out || (block < 0) || (block >= ctx->npoints)) {
+        FAIL_MSG("zsrc_decompress: invalid params\n");
+        return -1;
+    }
+
+
+    len = zsrc_block_end(ctx, block) - ctx->points[block].out;
+
+    switch (ctx->format) {
+    case ZSRC_GZIP:
+        return zsrc_inflate(ctx, block, out, len);
+    case ZSRC_XZ:
+        return zsrc_unxz(ctx, block, out, len);
+#ifdef RB_ZSTD
+    case ZSRC_ZSTD:
+        return zsrc_unzstd(ctx, block, out, len);
+#endif
+    }
+
+    return -1;
+}
+
+
+/* zsrc_lru returns the least recently used cached block nobody is reading,
+ * or NULL; the lock must be held */
+static struct zsrc_cached *zsrc_lru(struct zsrc_ctx *ctx)
+{
+    struct zsrc_cached *slot, *victim = NULL;
+    int i;
+
+    for (i = 0; i < ZSRC_CACHE_BLOCKS; i++) {
+        slot = &ctx->cache[i];
+        if (slot->data && !slot->refs
+            && (!victim || (slot->used < victim->used))) {
+            victim = slot;
+        }
+    }
+
+    return victim;
+}
+
+
+/* zsrc_evict drops a cached block; the lock must be held */
+static void zsrc_evict(struct zsrc_ctx *ctx, struct zsrc_cached *slot)
+{
+    free(slot->data);
+    slot->data = NULL;
+    ctx->cached -= slot->len;
+    budget_release(BUDGET_CACHE, slot->len);
+    slot->len = 0;
+}
+
+
+/* zsrc_get returns a decompressed block from the cache, decompressing it
+ * if need be; zsrc_put must be called when done with it */
+static struct zsrc_cached *zsrc_get(struct zsrc_ctx *ctx, long block)
+{
+    struct zsrc_cached *slot, *victim;
+    unsigned long limit;
+    uint8_t *data;
+    long len;
+    int i;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (i = 0; i < ZSRC_CACHE_BLOCKS; i++) {
+        slot = &ctx->cache[i];
+        if (slot->data && (slot->block == block)) {
+            slot->refs++;
+            slot->used = ++ctx->tick;
+            pthread_mutex_unlock(&ctx->lock);
+            return slot;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    /* decompress it without holding the lock */
+    len = zsrc_block_end(ctx, block) - ctx->points[block].out;
+    data = (uint8_t *) malloc(len);
+    if (!data) {
+        FAIL_MSG("zsrc_get: malloc() failed\n");
+        return NULL;
+    }
+
+    if (zsrc_decompress(ctx, block, data) != len) {
+        FAIL_MSG("zsrc_get: zsrc_decompress() failed\n");
+        free(data);
+        return NULL;
+    }
+
+
+    pthread_mutex_lock(&ctx->lock);
+    victim = NULL;
+    for (i = 0; i < ZSRC_CACHE_BLOCKS; i++) {
+        slot = &ctx->cache[i];
+        if (slot->data && (slot->block == block)) {
+            /* another thread got there first */
+            slot->refs++;
+            slot->used = ++ctx->tick;
+            pthread_mutex_unlock(&ctx->lock);
+            free(data);
+            return slot;
+        }
+        if (!slot->data && !slot->refs) {
+            victim = slot;
+        }
+    }
+
+    /* the least recently used blocks nobody is reading make room for it */
+    limit = budget_pressure() ? ZSRC_CACHE_LOW : ZSRC_CACHE_BYTES;
+    while ((ctx->cached + len > limit) && (slot = zsrc_lru(ctx))) {
+        zsrc_evict(ctx, slot);
+        if (!victim) {
+            victim = slot;
+        }
+    }
+
+    if (!victim && (victim = zsrc_lru(ctx))) {
+        zsrc_evict(ctx, victim);
+    }
+
+    if (!victim) {
+        pthread_mutex_unlock(&ctx->lock);
+        FAIL_MSG("zsrc_get: cache full\n");
+        free(data);
+        return NULL;
+    }
+
+    victim->block = block;
+    victim->data = data;
+    victim->len = len;
+    victim->refs = 1;
+    victim->used = ++ctx->tick;
+    ctx->cached += len;
+    budget_charge(BUDGET_CACHE, len);
+    pthread_mutex_unlock(&ctx->lock);
+
+    return victim;
+}
+
+
+/* zsrc_put lets a cached block be replaced again */
+static void zsrc_put(struct zsrc_ctx *ctx, struct zsrc_cached *slot)
+{
+    pthread_mutex_lock(&ctx->lock);
+    slot->refs--;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+
+/* zsrc_pread reads decompressed bytes through the cache; it is a scan
+ * reader, so the scans see the data rather than the view */
+long zsrc_pread(void *arg, uint8_t * buf, unsigned long len,
+                unsigned long offset)
+{
+    struct zsrc_ctx *ctx = (struct zsrc_ctx *) arg;
+    struct zsrc_cached *slot;
+    unsigned long got, skip, piece;
+    long block;
+
+    if (!ctx || !buf) {
+        FAIL_MSG("zsrc_pread: invalid params\n");
+        return -1;
+    }
+
+
+    got = 0;
+    while ((got < len) && (offset + got < ctx->size)) {
+        block = zsrc_block(ctx, offset + got);
+        slot = zsrc_get(ctx, block);
+        if (!slot) {
+            FAIL_MSG("zsrc_pread: zsrc_get() failed\n");
+            return -1;
+        }
+
+        skip = offset + got - ctx->points[block].out;
+        piece = slot->len - skip;
+        if (piece > len - got) {
+            piece = len - got;
+        }
+
+        memcpy(buf + got, slot->data + skip, piece);
+        zsrc_put(ctx, slot);
+        got += piece;
+    }
+
+    return got;
+}
+
+
+/* zsrc_page_done returns whether the page holding offset is in the view */
+static int zsrc_page_done(struct zsrc_ctx *ctx, unsigned long offset)
+{
+    unsigned long page = offset / ZSRC_PAGE_SIZE;
+
+    return (__atomic_load_n(&ctx->pages[page / 8], __ATOMIC_ACQUIRE) >>
+            (page % 8)) & 1;
+}
+
+
+/* zsrc_page_mark counts the page holding offset as in the view */
+static void zsrc_page_mark(struct zsrc_ctx *ctx, unsigned long offset)
+{
+    unsigned long page = offset / ZSRC_PAGE_SIZE;
+
+    __atomic_or_fetch(&ctx->pages[page / 8], 1 << (page % 8),
+                      __ATOMIC_RELEASE);
+}
+
+
+/* zsrc_write_page writes the part of the page holding offset that is in
+ * the decompressed block data, which starts at out */
+static int zsrc_write_page(struct zsrc_ctx *ctx, uint8_t * data,
+                           unsigned long out, unsigned long end,
+                           unsigned long offset)
+{
+    unsigned long page, start, stop;
+
+    page = offset / ZSRC_PAGE_SIZE;
+    start = page * ZSRC_PAGE_SIZE;
+    stop = start + ZSRC_PAGE_SIZE;
+
+    /* a page across blocks is written a part at a time by each of them,
+     * and zsrc_fill() counts it as done once they all have */
+    if (start < out) {
+        start = out;
+    }
+    if (stop > end) {
+        stop = end;
+    }
+
+    if (pwrite(ctx->view, data + (start - out), stop - start, start) !=
+        (ssize_t) (stop - start)) {
+        FAIL_ERR("zsrc_write_page: pwrite() failed\n");
+        return 1;
+    }
+
+
+    if ((start == page * ZSRC_PAGE_SIZE)
+        && ((stop == (page + 1) * ZSRC_PAGE_SIZE) || (stop == ctx->size))) {
+        zsrc_page_mark(ctx, offset);
+    }
+
+    return 0;
+}
+
+
+/* zsrc_offset returns where sample i is */
+static unsigned long zsrc_offset(struct zsrc_fill *fill, long i)
+{
+    float data_index;
+
+    /* the samples are found the same way draw_img() finds them */
+    if (!fill->dense) {
+        data_index = fill->data_start + (i * fill->step);
+        return (unsigned long) data_index;
+    }
+
+    return fill->data_start + ((unsigned long) i * ZSRC_PAGE_SIZE);
+}
+
+
+/* zsrc_fill_worker decompresses blocks with samples in pages not yet in
+ * the view, and writes those pages */
+static void *zsrc_fill_worker(void *data)
+{
+    struct zsrc_fill *fill = (struct zsrc_fill *) data;
+    struct zsrc_ctx *ctx = fill->ctx;
+    unsigned long out, end, offset, page, last, buflen;
+    uint8_t *buf, *tmp;
+    long block, i;
+
+    buf = NULL;
+    buflen = 0;
+    while (!__atomic_load_n(&fill->error, __ATOMIC_RELAXED)) {
+        block = __atomic_fetch_add(&fill->next, 1, __ATOMIC_RELAXED);
+        if (block >= ctx->npoints) {
+            break;
+        }
+
+        if (fill->lo[block] >= fill->hi[block]) {
+            continue;
+        }
+
+        out = ctx->points[block].out;
+        end = zsrc_block_end(ctx, block);
+        if (end - out > buflen) {
+            tmp = (uint8_t *) realloc(buf, end - out);
+            if (!tmp) {
+                FAIL_MSG("zsrc_fill_worker: realloc() failed\n");
+                __atomic_store_n(&fill->error, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            buf = tmp;
+            buflen = end - out;
+        }
+
+        if (zsrc_decompress(ctx, block, buf) != (long) (end - out)) {
+            FAIL_MSG("zsrc_fill_worker: zsrc_decompress() failed\n");
+            __atomic_store_n(&fill->error, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        /* every page with a part in this block, not just those whose
+         * samples are in it */
+        last = (unsigned long) -1;
+        for (i = fill->lo[block]; i < fill->hi[block]; i++) {
+            offset = zsrc_offset(fill, i);
+            page = offset / ZSRC_PAGE_SIZE;
+            if ((page == last) || (page * ZSRC_PAGE_SIZE >= end)
+                || ((page + 1) * ZSRC_PAGE_SIZE <= out)) {
+                continue;
+            }
+            last = page;
+
+            if (zsrc_write_page(ctx, buf, out, end, offset) != 0) {
+                __atomic_store_n(&fill->error, 2, __ATOMIC_RELAXED);
+                break;
+            }
+
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+
+/* zsrc_fill works out which blocks have parts of pages not yet in the view
+ * that hold samples, and fills them in across the threads */
+static int zsrc_fill(struct zsrc_ctx *ctx, long data_start, float step,
+                     int dense, long first, long count)
+{
+    pthread_t threads[SCAN_MAX_THREADS];
+    struct zsrc_fill fill;
+    unsigned long offset, pstart, pend;
+    long block, from, to, b, i, needed;
+    int t, nthreads, started;
+
+    memset(&fill, 0, sizeof(fill));
+    fill.ctx = ctx;
+    fill.data_start = data_start;
+    fill.step = step;
+    fill.dense = dense;
+    fill.lo = (long *) calloc(ctx->npoints, sizeof(long));
+    fill.hi = (long *) calloc(ctx->npoints, sizeof(long));
+    if (!fill.lo || !fill.hi) {
+        FAIL_MSG("zsrc_fill: calloc() failed\n");
+        free(fill.lo);
+        free(fill.hi);
+        return 1;
+    }
+
+
+    /* the samples run forwards, so each block's are a run of them; a
+     * sample's page goes to every block it has a part in */
+    needed = 0;
+    block = -1;
+    for (i = first; i < first + count; i++) {
+        offset = zsrc_offset(&fill, i);
+        if (offset >= ctx->size) {
+            break;
+        }
+        if (zsrc_page_done(ctx, offset)) {
+            continue;
+        }
+
+        pstart = (offset / ZSRC_PAGE_SIZE) * ZSRC_PAGE_SIZE;
+        pend = pstart + ZSRC_PAGE_SIZE;
+        if (pend > ctx->size) {
+            pend = ctx->size;
+        }
+
+        if ((block < 0) || (pstart < ctx->points[block].out)
+            || (pend > zsrc_block_end(ctx, block))) {
+            from = zsrc_block(ctx, pstart);
+            to = zsrc_block(ctx, pend - 1);
+        } else {
+            from = to = block;
+        }
+
+        for (b = from; b <= to; b++) {
+            if (fill.lo[b] >= fill.hi[b]) {
+                fill.lo[b] = i;
+                needed++;
+            }
+            fill.hi[b] = i + 1;
+        }
+        block = to;
+    }
+
+    if (needed) {
+        nthreads = scan_threads();
+        if (nthreads > needed) {
+            nthreads = needed;
+        }
+
+        started = 0;
+        for (t = 0; t < nthreads; t++) {
+            if (pthread_create(&threads[t], NULL, zsrc_fill_worker, &fill)
+                != 0) {
+                break;
+            }
+            started++;
+        }
+
+        if (!started) {
+            zsrc_fill_worker(&fill);
+        }
+
+        for (t = 0; t < started; t++) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+
+    free(fill.lo);
+    free(fill.hi);
+
+    if (fill.error) {
+        FAIL_MSG("zsrc_fill: decompression failed\n");
+        return 2;
+    }
+
+
+    /* the pages across blocks have had all of their parts written now */
+    for (i = first; i < first + count; i++) {
+        offset = zsrc_offset(&fill, i);
+        if (offset >= ctx->size) {
+            break;
+        }
+        zsrc_page_mark(ctx, offset);
+    }
+
+    return 0;
+}
+
+
+/* zsrc_sample fills in the view's pages that hold the count bytes a plot
+ * samples from data_start every step, starting at sample first */
+int zsrc_sample(struct zsrc_ctx *ctx, long data_start, float step,
+                long first, long count)
+{
+    if (!ctx || (data_start < 0) || (step <= 0.0) || (first < 0)
+        || (count < 0)) {
+        FAIL_MSG("zsrc_sample: invalid params\n");
+        return 1;
+    }
+
+
+    if (zsrc_fill(ctx, data_start, step, 0, first, count) != 0) {
+        FAIL_MSG("zsrc_sample: zsrc_fill() failed\n");
+        return 2;
+    }
+
+
+    return 0;
+}
+
+
+/* zsrc_need fills in the view from start to end, up to ZSRC_VIS_MAX
+ * bytes, for the visualisers */
+int zsrc_need(struct zsrc_ctx *ctx, unsigned long start, unsigned long end)
+{
+    if (!ctx || (end < start)) {
+        FAIL_MSG("zsrc_need: invalid params\n");
+        return 1;
+    }
+
+
+    if (end > ctx->size) {
+        end = ctx->size;
+    }
+    if (start >= end) {
+        return 0;
+    }
+    if (end - start > ZSRC_VIS_MAX) {
+        end = start + ZSRC_VIS_MAX;
+    }
+
+    /* every page is a sample */
+    start -= start % ZSRC_PAGE_SIZE;
+    if (zsrc_fill(ctx, start, ZSRC_PAGE_SIZE, 1, 0,
+                  (end - start + ZSRC_PAGE_SIZE - 1) / ZSRC_PAGE_SIZE) != 0) {
+        FAIL_MSG("zsrc_need: zsrc_fill() failed\n");
+        return 2;
+    }
+
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-zsrc.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_ZSRC_H
+#define _RB_ZSRC_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <lzma.h>
+#ifdef RB_ZSTD
+#include <zstd.h>
+#endif
+#ifdef __linux__
+#include <linux/limits.h>
+#elif __APPLE__
+#include <sys/syslimits.h>
+#endif
+
+#include "rb-scan.h"
+#include "rb-spool.h"
+#include "rb-budget.h"
+#include "macro.h"
+
+/* compressed formats */
+#define ZSRC_NONE 0
+#define ZSRC_GZIP 1
+#define ZSRC_XZ 2
+#define ZSRC_ZSTD 3
+
+/* gzip access points are at least this far apart */
+#define ZSRC_SPAN (8 * 1024 * 1024)
+/* deflate looks back this far */
+#define ZSRC_WINSIZE 32768
+/* bytes read from the compressed file at a time */
+#define ZSRC_CHUNK (64 * 1024)
+/* blocks bigger than this can't be looked at randomly */
+#define ZSRC_MAX_BLOCK (256 * 1024 * 1024)
+/* decompressed blocks kept for the scans: no more than this many, and
+ * no more than this much of them, or the low mark near the memory budget,
+ * once they aren't being read */
+#define ZSRC_CACHE_BLOCKS 32
+#define ZSRC_CACHE_BYTES (256 * 1024 * 1024)
+#define ZSRC_CACHE_LOW (64 * 1024 * 1024)
+/* the view is filled in a page at a time */
+#define ZSRC_PAGE_SIZE 4096
+/* the most of the zoom selection decompressed for the visualisers */
+#define ZSRC_VIS_MAX (256 * 1024 * 1024)
+
+/* the index is kept next to the file with this on the end */
+#define ZSRC_INDEX_EXT ".rbidx"
+#define ZSRC_INDEX_MAGIC "RBIDX001"
+
+/* access point flags */
+#define ZSRC_POINT_MEMBER 1     /* starts a gzip member */
+
+/* where decompression can start */
+struct zsrc_point {
+    uint64_t out;               /* offset in the decompressed data */
+    uint64_t in;                /* offset in the compressed file */
+    uint64_t inlen;             /* compressed size, for xz and zstd */
+    uint32_t flags;
+    uint32_t bits;              /* gzip: bits of the byte before in */
+    uint32_t check;             /* xz: the block's check type */
+    uint32_t wlen;              /* gzip: the compressed window's size */
+    uint8_t *window;            /* gzip: the 32KB before, compressed */
+};
+
+/* a decompressed block in the cache */
+struct zsrc_cached {
+    long block;
+    uint8_t *data;
+    unsigned long len;
+    unsigned long used;
+    int refs;
+};
+
+/* a compressed file and a sparse view of it decompressed */
+struct zsrc_ctx {
+    int fd;
+    int format;
+    char name[PATH_MAX];        /* for the window title */
+    unsigned long csize;
+    unsigned long size;
+    int npoints;
+    struct zsrc_point *points;
+
+    /* the index, made on a thread of its own if none was kept */
+    char source[PATH_MAX];      /* the compressed file */
+    struct stat filestat;
+    pthread_t indexer;
+    int indexing;               /* the thread hasn't been waited for */
+    int indexed;                /* set when the index is ready or failed */
+    int index_error;
+    int made;                   /* made, not read, so it is to be kept */
+    unsigned long index_in;     /* compressed bytes looked at so far */
+    int cancel;
+
+    /* the view, filled in as parts of it are looked at */
+    int view;
+    char path[PATH_MAX];        /* where other processes can open it */
+    char tmpname[PATH_MAX];
+    uint8_t *pages;             /* a bit for each page written */
+
+    /* decompressed blocks, least recently used go first */
+    pthread_mutex_t lock;
+    struct zsrc_cached cache[ZSRC_CACHE_BLOCKS];
+    unsigned long cached;       /* bytes, charged to the memory budget */
+    unsigned long tick;
+};
+
+int zsrc_detect(int fd);
+struct zsrc_ctx *zsrc_open(int fd, char *fname);
+int zsrc_index_start(struct zsrc_ctx *ctx);
+int zsrc_index_done(struct zsrc_ctx *ctx);
+int zsrc_index_progress(struct zsrc_ctx *ctx);
+int zsrc_view(struct zsrc_ctx *ctx);
+int zsrc_free(struct zsrc_ctx *ctx);
+long zsrc_block(struct zsrc_ctx *ctx, unsigned long offset);
+long zsrc_decompress(struct zsrc_ctx *ctx, long block, uint8_t * out);
+long zsrc_pread(void *arg, uint8_t * buf, unsigned long len,
+                unsigned long offset);
+int zsrc_sample(struct zsrc_ctx *ctx, long data_start, float step,
+                long first, long count);
+int zsrc_need(struct zsrc_ctx *ctx, unsigned long start, unsigned long end);
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-zygote.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * Provides functions to start visualisers before they are wanted.  A
+ * visualiser started with SHM_ZYGOTE_ARG does everything it can without
+ * the file (GL, shaders, fonts, GTK, config) and then waits reading stdin,
+ * which is a pipe from here.  Opening it from the menu just writes it the
+ * shm name, and another is started in its place.  Closing the pipe, or
+ * rubbermarbles going away, makes a waiting one exit.
+ */
+
+#include "rb-zygote.h"
+
+/* one waiting visualiser for each configured one that can */
+static struct zygote *zygotes = NULL;
+static unsigned int zygote_count = 0;
+
+
+/* zygote_init makes the table for count visualisers */
+int zygote_init(unsigned int count)
+{
+    unsigned int i;
+
+    if (!count) {
+        FAIL_MSG("zygote_init: invalid params\n");
+        return 1;
+    }
+
+
+    zygotes = (struct zygote *) calloc(count, sizeof(struct zygote));
+    if (!zygotes) {
+        FAIL_MSG("zygote_init: calloc() failed\n");
+        return 2;
+    }
+
+
+    for (i = 0; i < count; i++) {
+        zygotes[i].fd = -1;
+    }
+    zygote_count = count;
+
+    /* a write to one that has just died must not kill us */
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+        FAIL_ERR("zygote_init: cannot ignore SIGPIPE\n");
+        return 3;
+    }
+
+
+    return 0;
+}
+
+
+/* zygote_spawn starts exe waiting, unless there is one already */
+int zygote_spawn(unsigned int visid, char *exe)
+{
+    struct zygote *z;
+    int fds[2];
+    pid_t pid;
+
+    if (!zygotes || (visid >= zygote_count) || !exe) {
+        FAIL_MSG("zygote_spawn: invalid params\n");
+        return 1;
+    }
+
+
+    z = &zygotes[visid];
+
+    /* one that died is reaped with its pid cleared; close its pipe */
+    if (!__atomic_load_n(&z->pid, __ATOMIC_ACQUIRE) && (z->fd >= 0)) {
+        close(z->fd);
+        z->fd = -1;
+    }
+
+    if (z->fd >= 0) {
+        return 0;
+    }
+
+    if (pipe(fds) != 0) {
+        FAIL_ERR("zygote_spawn: pipe() failed\n");
+        return 2;
+    }
+
+
+    /* only the zygote has the reading end, and nothing else we start
+     * has the writing end */
+    if (fcntl(fds[1], F_SETFD, FD_CLOEXEC) != 0) {
+        FAIL_ERR("zygote_spawn: fcntl() failed\n");
+        close(fds[0]);
+        close(fds[1]);
+        return 3;
+    }
+
+
+    pid = fork();
+    if (pid < 0) {
+        FAIL_ERR("zygote_spawn: fork() failed\n");
+        close(fds[0]);
+        close(fds[1]);
+        return 4;
+    } else if (pid == 0) {
+        /* child */
+        if (dup2(fds[0], STDIN_FILENO) < 0) {
+            _exit(1);
+        }
+        close(fds[0]);
+        signal(SIGPIPE, SIG_DFL);
+
+        execlp(exe, exe, SHM_ZYGOTE_ARG, NULL);
+        _exit(1);
+    }
+
+    /* parent */
+    close(fds[0]);
+    z->fd = fds[1];
+    __atomic_store_n(&z->pid, pid, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+/* zygote_take hands shmpath to the waiting visualiser and returns its pid,
+ * or 0 if there isn't one */
+pid_t zygote_take(unsigned int visid, char *shmpath)
+{
+    struct zygote *z;
+    char line[256 + 1];
+    pid_t pid;
+    int len;
+
+    if (!zygotes || (visid >= zygote_count) || !shmpath) {
+        FAIL_MSG("zygote_take: invalid params\n");
+        return 0;
+    }
+
+
+    z = &zygotes[visid];
+    pid = __atomic_exchange_n(&z->pid, 0, __ATOMIC_ACQ_REL);
+    if (z->fd < 0) {
+        return 0;
+    }
+
+    len = snprintf(line, sizeof(line), "%s\n", shmpath);
+
+    /* a dead one gives EPIPE; its slot is free again either way */
+    if (!pid || (len >= (int) sizeof(line))
+        || (write(z->fd, line, len) != len)) {
+        pid = 0;
+    }
+
+    close(z->fd);
+    z->fd = -1;
+
+    return pid;
+}
+
+
+/* zygote_reaped clears a zygote that has died, returning 1 if pid was
+ * one; it is called from the SIGCHLD handler */
+int zygote_reaped(pid_t pid)
+{
+    unsigned int i;
+    pid_t expected;
+
+    if (!zygotes || (pid <= 0)) {
+        return 0;
+    }
+
+    for (i = 0; i < zygote_count; i++) {
+        expected = pid;
+        if (__atomic_compare_exchange_n(&zygotes[i].pid, &expected, 0, 0,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            return 1;
+        }
+        expected = pid;
+        if (__atomic_compare_exchange_n(&zygotes[i].retired, &expected, 0,
+                                        0, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* zygote_retire sends the waiting visualisers away, so that those started
+ * next see the config as it is now */
+int zygote_retire()
+{
+    unsigned int i;
+    pid_t pid;
+
+    if (!zygotes) {
+        return 0;
+    }
+
+    for (i = 0; i < zygote_count; i++) {
+        if (zygotes[i].fd < 0) {
+            continue;
+        }
+
+        /* kept until it is reaped, to know it when it is */
+        pid = __atomic_exchange_n(&zygotes[i].pid, 0, __ATOMIC_ACQ_REL);
+        __atomic_store_n(&zygotes[i].retired, pid, __ATOMIC_RELEASE);
+        close(zygotes[i].fd);
+        zygotes[i].fd = -1;
+    }
+
+    return 0;
+}
+
+
+/* zygote_free sends the waiting visualisers away */
+int zygote_free()
+{
+    struct zygote *z = zygotes;
+    unsigned int i, count = zygote_count;
+
+    if (!z) {
+        return 0;
+    }
+
+    /* gone before the SIGCHLD handler can look at it */
+    zygotes = NULL;
+    zygote_count = 0;
+
+    /* they exit when the pipe closes */
+    for (i = 0; i < count; i++) {
+        if (z[i].fd >= 0) {
+            close(z[i].fd);
+        }
+    }
+
+    free(z);
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * rb-zygote.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ */
+
+
+#ifndef _RB_ZYGOTE_H
+#define _RB_ZYGOTE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#elif __APPLE__
+#include <sys/syslimits.h>
+#endif
+
+#include "rb-shm.h"
+#include "macro.h"
+
+/* the config line's exe starts with this for a visualiser that can be
+ * started ahead of time, with SHM_ZYGOTE_ARG */
+#define ZYGOTE_PREFIX "zygote:"
+
+/* a visualiser that has set itself up and is waiting for the shm name */
+struct zygote {
+    pid_t pid;                  /* 0 if there isn't one */
+    int fd;                     /* where the shm name is written */
+    pid_t retired;              /* one sent away, until it is reaped */
+};
+
+int zygote_init(unsigned int count);
+int zygote_spawn(unsigned int visid, char *exe);
+pid_t zygote_take(unsigned int visid, char *shmpath);
+int zygote_reaped(pid_t pid);
+int zygote_retire();
+int zygote_free();
+
+#endif
@@ -18,6 +18,10 @@
 
 extern struct window zoom[2];
 extern struct savepic save[5];
+extern struct proc_ctx *procmem;
+extern struct spool_ctx *spool;
+extern struct zsrc_ctx *zsrc;
+extern unsigned int visualiser_count;
 /* memory access */
 struct filemmap mmap_ctx;
 struct shm_buf *shm_ctx = NULL;
@@ -67,9 +71,9 @@ int load_file(char *fname)
     }
 
 
-    /* stat it */
-    if (fstat(filed, &filestat) != 0) {
-        FAIL_ERR("load_file: cannot stat file\n");
+    /* stat it; block devices are sized by their driver */
+    if (blkdev_fstat(filed, &filestat) != 0) {
+        FAIL_MSG("load_file: cannot stat file\n");
         return 3;
     }
 
@@ -81,19 +85,62 @@ int load_file(char *fname)
     }
 
 
+    /* stop searching and classifying the current file */
+    if (clear_search() != 0) {
+        FAIL_MSG("load_file: clear_search() failed\n");
+        return 5;
+    }
+
+    if (clear_classify() != 0) {
+        FAIL_MSG("load_file: clear_classify() failed\n");
+        return 6;
+    }
+
+    if (clear_hist() != 0) {
+        FAIL_MSG("load_file: clear_hist() failed\n");
+        return 7;
+    }
+
+    if (clear_changes() != 0) {
+        FAIL_MSG("load_file: clear_changes() failed\n");
+        return 8;
+    }
+
+    if (clear_compressed() != 0) {
+        FAIL_MSG("load_file: clear_compressed() failed\n");
+        return 9;
+    }
+
+    if (clear_compare() != 0) {
+        FAIL_MSG("load_file: clear_compare() failed\n");
+        return 10;
+    }
+
+    if (clear_dupes() != 0) {
+        FAIL_MSG("load_file: clear_dupes() failed\n");
+        return 11;
+    }
+
+    if (clear_tiles() != 0) {
+        FAIL_MSG("load_file: clear_tiles() failed\n");
+        return 12;
+    }
+
+
     /* unmap and close the current file */
     if (mmap_ctx.filedata) {
         if (munmap(mmap_ctx.filedata, mmap_ctx.mmap_size) != 0) {
             FAIL_MSG("load_file: munmap() failed\n");
-            return 5;
+            return 13;
         }
 
+        budget_release(BUDGET_MMAP, mmap_ctx.mmap_size);
     }
 
     if (shm->fd) {
         if (close(shm->fd) != 0) {
             FAIL_ERR("load_file: close() failed\n");
-            return 6;
+            return 14;
         }
 
     }
@@ -101,7 +148,7 @@ int load_file(char *fname)
     /* initialise shared memory to new file */
     if (sem_wait(shm_ctx->sem) != 0) {
         FAIL_ERR("load_file: sem_wait() failed\n");
-        return 7;
+        return 15;
     }
 
     memcpy(&(shm->filestat), &filestat, sizeof(filestat));
@@ -113,7 +160,7 @@ int load_file(char *fname)
     shm->buf_type = BUF_TYPE_FD;
     if (sem_post(shm_ctx->sem) != 0) {
         FAIL_ERR("load_file: sem_post() failed\n");
-        return 8;
+        return 16;
     }
 
 
@@ -139,6 +186,7 @@ int load_file(char *fname)
             save[i].pic = NULL;
         }
     }
+    budget_set(BUDGET_PICS, 0);
 
     /* set the mmap params */
     mmap_ctx.mmap_offset = 0;
@@ -154,14 +202,258 @@ int load_file(char *fname)
 
     if (mmap_ctx.filedata == MAP_FAILED) {
         FAIL_ERR("load_file: mmap() failed\n");
-        return 9;
+        mmap_ctx.filedata = NULL;
+        return 17;
     }
 
+    budget_charge(BUDGET_MMAP, mmap_ctx.mmap_size);
 
     /* update any remaining children */
     if (update_children() != 0) {
         FAIL_ERR("load_file: update_children() failed\n");
-        return 10;
+        return 18;
+    }
+
+
+    /* count the bytes in the background for the selection statistics */
+    if (hist_file() != 0) {
+        FAIL_MSG("load_file: hist_file() failed\n");
+        return 19;
+    }
+
+
+    return 0;
+}
+
+
+/* load_process loads a snapshot of a running process's memory and keeps
+ * it up to date */
+int load_process(pid_t pid)
+{
+    struct proc_ctx *ctx;
+
+    if (pid <= 0) {
+        FAIL_MSG("load_process: invalid params\n");
+        return 1;
+    }
+
+
+    ctx = proc_open(pid);
+    if (!ctx) {
+        FAIL_MSG("load_process: proc_open() failed\n");
+        return 2;
+    }
+
+
+    /* the snapshot is loaded like a file, through its memfd */
+    if (load_file(ctx->path) != 0) {
+        FAIL_MSG("load_process: load_file() failed\n");
+        proc_free(ctx);
+        return 3;
+    }
+
+
+    /* the last snapshot, if any, is no longer needed */
+    if (clear_process() != 0) {
+        FAIL_MSG("load_process: clear_process() failed\n");
+        proc_free(ctx);
+        return 4;
+    }
+
+
+    procmem = ctx;
+
+    if (watch_process() != 0) {
+        FAIL_MSG("load_process: watch_process() failed\n");
+        return 5;
+    }
+
+
+    return 0;
+}
+
+
+/* load_stream loads stdin as it is read, so a pipe can be looked at */
+int load_stream()
+{
+    struct spool_ctx *ctx;
+
+    ctx = spool_open(STDIN_FILENO);
+    if (!ctx) {
+        FAIL_MSG("load_stream: spool_open() failed\n");
+        return 1;
+    }
+
+
+    /* a file can't be mapped until there is something in it */
+    if (spool_wait(ctx) != 0) {
+        FAIL_MSG("load_stream: spool_wait() failed\n");
+        spool_free(ctx);
+        return 2;
+    }
+
+
+    if (load_file(ctx->path) != 0) {
+        FAIL_MSG("load_stream: load_file() failed\n");
+        spool_free(ctx);
+        return 3;
+    }
+
+
+    spool = ctx;
+
+    if (watch_spool() != 0) {
+        FAIL_MSG("load_stream: watch_spool() failed\n");
+        return 4;
+    }
+
+
+    return 0;
+}
+
+
+/* load_compressed loads a gzip, xz or zstd file, decompressing the parts
+ * of it that are looked at; until its index is made the compressed data
+ * is shown as it is */
+int load_compressed(char *fname)
+{
+    struct zsrc_ctx *ctx;
+    int filed;
+
+    if (!fname) {
+        FAIL_MSG("load_compressed: invalid params\n");
+        return 1;
+    }
+
+
+    filed = open(fname, O_RDONLY);
+    if (filed == -1) {
+        FAIL_ERR("load_compressed: cannot open file\n");
+        return 2;
+    }
+
+
+    ctx = zsrc_open(filed, fname);
+    if (!ctx) {
+        FAIL_MSG("load_compressed: zsrc_open() failed\n");
+        return 3;
+    }
+
+
+    if (zsrc_index_done(ctx)) {
+        if (load_indexed(ctx) != 0) {
+            FAIL_MSG("load_compressed: load_indexed() failed\n");
+            return 4;
+        }
+
+
+        return 0;
+    }
+
+    if (load_file(fname) != 0) {
+        FAIL_MSG("load_compressed: load_file() failed\n");
+        zsrc_free(ctx);
+        return 5;
+    }
+
+
+    if (zsrc_index_start(ctx) != 0) {
+        FAIL_MSG("load_compressed: zsrc_index_start() failed\n");
+        zsrc_free(ctx);
+        return 6;
+    }
+
+
+    if (watch_compressed(ctx) != 0) {
+        FAIL_MSG("load_compressed: watch_compressed() failed\n");
+        zsrc_free(ctx);
+        return 7;
+    }
+
+
+    return 0;
+}
+
+
+/* load_indexed loads the view of a compressed file once its index is
+ * made; ctx is freed if it fails */
+int load_indexed(struct zsrc_ctx *ctx)
+{
+    if (!ctx) {
+        FAIL_MSG("load_indexed: invalid params\n");
+        return 1;
+    }
+
+
+    if (zsrc_view(ctx) != 0) {
+        FAIL_MSG("load_indexed: zsrc_view() failed\n");
+        zsrc_free(ctx);
+        return 2;
+    }
+
+
+    /* the view is loaded like a file, and is the decompressed size */
+    if (load_file(ctx->path) != 0) {
+        FAIL_MSG("load_indexed: load_file() failed\n");
+        zsrc_free(ctx);
+        return 3;
+    }
+
+
+    zsrc = ctx;
+
+    /* the scans read the data rather than the sparse view */
+    if (rb_scan_source(shm->fd, zsrc_pread, zsrc) != 0) {
+        FAIL_MSG("load_indexed: rb_scan_source() failed\n");
+        return 4;
+    }
+
+
+    /* so the byte counts load_file() started have to start again */
+    if ((clear_hist() != 0) || (hist_file() != 0)) {
+        FAIL_MSG("load_indexed: hist_file() failed\n");
+        return 5;
+    }
+
+
+    return 0;
+}
+
+
+/* load_path loads a file, decompressing it as it is looked at if it is
+ * compressed */
+int load_path(char *fname)
+{
+    struct stat filestat;
+    int filed, format;
+
+    if (!fname) {
+        FAIL_MSG("load_path: invalid params\n");
+        return 1;
+    }
+
+
+    filed = open(fname, O_RDONLY);
+    if (filed == -1) {
+        FAIL_ERR("load_path: cannot open file\n");
+        return 2;
+    }
+
+
+    /* devices and pipes are looked at as they are */
+    format = ZSRC_NONE;
+    if ((fstat(filed, &filestat) == 0) && S_ISREG(filestat.st_mode)) {
+        format = zsrc_detect(filed);
+    }
+    close(filed);
+
+    if (format == ZSRC_NONE) {
+        return load_file(fname) ? 3 : 0;
+    }
+
+    if (load_compressed(fname) != 0) {
+        FAIL_MSG("load_path: load_compressed() failed\n");
+        return 4;
     }
 
 
@@ -174,6 +466,7 @@ int main(int argc, char *argv[])
 {
     struct sigaction sa;
     char *homepath = NULL;
+    int how = CMP_POSITIONAL;
 
     gdk_threads_init();
     gdk_threads_enter();
@@ -189,15 +482,45 @@ int main(int argc, char *argv[])
     }
 
 
-    if (argc != 2) {
-        printf("usage: rubbermarbles filename\n");
+    /* the file is counted from the start; the config can change the
+     * budget once it has been read */
+    if (budget_init(shm, budget_default()) != 0) {
+        FAIL_MSG("RubberMarbles: budget_init() failed\n");
+        return 17;
+    }
+
+
+    /* -a lines a second file up with the first before comparing */
+    if ((argc == 4) && (strcmp(argv[1], "-a") == 0)) {
+        how = CMP_ALIGNED;
+        argc--;
+        argv++;
+    }
+
+    if ((argc != 2) && (argc != 3)) {
+        printf("usage: rubbermarbles filename\n"
+               "       rubbermarbles [-a] filename otherfile\n"
+               "       rubbermarbles -p pid\n"
+               "       command | rubbermarbles -\n");
         exit(1);
     }
 
     mmap_ctx.filedata = NULL;
 
-    if (load_file(argv[1]) != 0) {
-        FAIL_MSG("RubberMarbles: load_file() failed\n");
+    if ((argc == 3) && (strcmp(argv[1], "-p") == 0)) {
+        if (load_process(atoi(argv[2])) != 0) {
+            FAIL_MSG("RubberMarbles: load_process() failed\n");
+            return 2;
+        }
+
+    } else if (strcmp(argv[1], "-") == 0) {
+        if (load_stream() != 0) {
+            FAIL_MSG("RubberMarbles: load_stream() failed\n");
+            return 2;
+        }
+
+    } else if (load_path(argv[1]) != 0) {
+        FAIL_MSG("RubberMarbles: load_path() failed\n");
         return 2;
     }
 
@@ -234,6 +557,28 @@ int main(int argc, char *argv[])
     }
 
 
+    /* the visualisers look their params up in the shm, kept up to date as
+     * the files change */
+    if (conf_publish(shm, homepath) != 0) {
+        FAIL_MSG("RubberMarbles: conf_publish() failed\n");
+        return 15;
+    }
+
+
+    /* without inotify the files' mtimes are compared instead */
+    if (conf_watch(homepath) != 0) {
+        fprintf(stderr, "RubberMarbles: cannot watch the config, "
+                "checking it every %d ms\n", CONF_POLL_MS);
+    }
+
+    if (budget_configure() != 0) {
+        FAIL_MSG("RubberMarbles: budget_configure() failed\n");
+        return 16;
+    }
+
+    gdk_threads_add_timeout(CONF_POLL_MS, conf_poll, NULL);
+
+
     if (make_main_window() != 0) {
         FAIL_MSG("RubberMarbles: make_main_window() failed\n");
         return 8;
@@ -246,6 +591,52 @@ int main(int argc, char *argv[])
     }
 
 
+    /* a second file is compared with the first */
+    if ((argc == 3) && strcmp(argv[1], "-p")) {
+        if ((compare_with(argv[2], how) != 0)
+            || (show_differences() != 0)) {
+            FAIL_MSG("RubberMarbles: cannot compare with second file\n");
+            return 18;
+        }
+
+    }
+
+    /* record the session, or replay a recorded one */
+    if (getenv(REPLAY_RECORD_ENV)
+        && (replay_record_open(getenv(REPLAY_RECORD_ENV)) != 0)) {
+        FAIL_MSG("RubberMarbles: replay_record_open() failed\n");
+        return 10;
+    }
+
+
+    if (getenv(REPLAY_ENV)
+        && (replay_start(getenv(REPLAY_ENV), getenv(REPLAY_OUT_ENV)) != 0)) {
+        FAIL_MSG("RubberMarbles: replay_start() failed\n");
+        return 11;
+    }
+
+
+    /* count where the drawing time goes; RB_STATS dumps it */
+    if (stats_init("rubbermarbles") != 0) {
+        FAIL_MSG("RubberMarbles: stats_init() failed\n");
+        return 12;
+    }
+
+
+    /* RB_TRACE traces this window and the visualisers it starts */
+    if (trace_init("rubbermarbles", 1) != 0) {
+        FAIL_MSG("RubberMarbles: trace_init() failed\n");
+        return 13;
+    }
+
+
+    /* have the visualisers that can be waiting to be opened */
+    if ((zygote_init(visualiser_count) != 0) || (start_zygotes() != 0)) {
+        FAIL_MSG("RubberMarbles: cannot start the visualisers\n");
+        return 14;
+    }
+
+
     gtk_main();
 
     gdk_threads_leave();
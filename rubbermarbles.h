@@ -41,6 +41,11 @@
 
 void hexdump(unsigned char *data, int data_len);
 int load_file(char *fname);
+int load_process(pid_t pid);
+int load_stream();
+int load_compressed(char *fname);
+int load_indexed(struct zsrc_ctx *ctx);
+int load_path(char *fname);
 int main(int argc, char *argv[]);
 
 #endif
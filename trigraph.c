@@ -74,6 +74,7 @@ void sig_handler(int signo)
             return;
         }
 
+        trace_instant("sigusr1");
         ctx->reload = 1;
         ctx->display = 1;
     } else if (signo == SIGHUP) {
@@ -118,6 +119,7 @@ int trigraph_free(void *rawctx)
     if (ctx->colours) {
         free(ctx->colours);
     }
+    budget_release(BUDGET_POINTS, ctx->reserved);
     free(ctx);
 
     return 0;
@@ -294,6 +296,7 @@ int tg_load_fd()
 {
     unsigned long offset;
     long size;
+    struct stats_mark mark;
 
     if (tg_fd_initialised() != 0) {
         FAIL_MSG("tg_load_fd: invalid params\n");
@@ -301,6 +304,8 @@ int tg_load_fd()
     }
 
 
+    stats_begin(&mark);
+
     /* check if we need to unmap an old segment */
     if (ctx->mmap_ptr) {
         if (munmap(ctx->mmap_ptr, ctx->mmap_size) != 0) {
@@ -308,6 +313,8 @@ int tg_load_fd()
             return 2;
         }
 
+        stats_munmap(STATS_MMAP);
+        budget_release(BUDGET_MMAP, ctx->mmap_size);
     }
 
     if (sem_wait(sem) != 0) {
@@ -343,6 +350,10 @@ int tg_load_fd()
         return 5;
     }
 
+    stats_mmap(STATS_MMAP);
+    stats_add(STATS_MMAP, ctx->mmap_size, 0);
+    budget_charge(BUDGET_MMAP, ctx->mmap_size);
+    stats_end(STATS_MMAP, &mark);
 
     ctx->buf = ctx->mmap_ptr + (offset - ctx->mmap_offset);
     ctx->bufsize = size;
@@ -366,11 +377,12 @@ int tg_load_fd()
 /* tg_load_buffer loads the vertices and colours from buf */
 int tg_load_buffer()
 {
-    unsigned long total_elements, i;
+    unsigned long total_elements, i, base, want;
     int j;
     unsigned long long value;
     unsigned long long value2;
     unsigned long long divider;
+    struct stats_mark mark;
 
     if (tg_buf_initialised() != 0) {
         FAIL_MSG("tg_load_buffer: invalid params\n");
@@ -378,6 +390,8 @@ int tg_load_buffer()
     }
 
 
+    stats_begin(&mark);
+
     total_elements = ctx->bufsize / ctx->dsize;
 
     if (ctx->vertices) {
@@ -405,6 +419,23 @@ int tg_load_buffer()
             ctx->type = TG_NORMAL;
     }
 
+    /* as many points as the memory budget allows, spread evenly through
+     * the selection when that is fewer than the elements */
+    budget_release(BUDGET_POINTS, ctx->reserved);
+    ctx->reserved = 0;
+    ctx->step = 1;
+    if (ctx->vert_count > 0) {
+        want = ctx->vert_count * 6 * sizeof(GLfloat);
+        ctx->reserved = budget_fit(BUDGET_POINTS, want,
+                                   (want < TG_MIN_BYTES) ? want :
+                                   TG_MIN_BYTES);
+        if (ctx->reserved < want) {
+            ctx->step = (want + ctx->reserved - 1) / ctx->reserved;
+            ctx->vert_count =
+                (ctx->vert_count + ctx->step - 1) / ctx->step;
+        }
+    }
+
     ctx->vertices =
         (GLfloat *) calloc(ctx->vert_count * 3, sizeof(GLfloat));
     ctx->colours =
@@ -424,23 +455,24 @@ int tg_load_buffer()
     }
 
     for (i = 0; i < ctx->vert_count; i++) {
+        base = i * ctx->step;
         for (j = 0; j < 3; j++) {
             switch (ctx->type) {
                 case TG_NORMAL:
-                    value = tg_get_value(i + j);
+                    value = tg_get_value(base + j);
                     ctx->vertices[(i * 3) + j] =
                         ((GLfloat) (value) / divider) - 1.0;
                     break;
                 case TG_DELAYED:
-                    value = tg_get_value(i + j);
-                    value2 = tg_get_value(i + j + 1);
+                    value = tg_get_value(base + j);
+                    value2 = tg_get_value(base + j + 1);
                     ctx->vertices[(i * 3) + j] =
                         (((GLfloat) (value2) -
                           (GLfloat) (value)) / divider) / 2.0;
                     break;
                 case BG_NORMAL:
                     if (j < 2) {
-                        value = tg_get_value(i + j);
+                        value = tg_get_value(base + j);
                         ctx->vertices[(i * 3) + j] =
                             ((GLfloat) (value) / divider) - 1.0;
                     } else {
@@ -449,8 +481,8 @@ int tg_load_buffer()
                     break;
                 case BG_DELAYED:
                     if (j < 2) {
-                        value = tg_get_value(i + j);
-                        value2 = tg_get_value(i + j + 1);
+                        value = tg_get_value(base + j);
+                        value2 = tg_get_value(base + j + 1);
                         ctx->vertices[(i * 3) + j] =
                             (((GLfloat) (value2) -
                               (GLfloat) (value)) / divider) / 2.0;
@@ -471,6 +503,10 @@ int tg_load_buffer()
     }
 
 
+    /* a vertex for each element */
+    stats_add(STATS_TG_LOAD_BUFFER, ctx->bufsize, ctx->vert_count);
+    stats_end(STATS_TG_LOAD_BUFFER, &mark);
+
     return 0;
 }
 
@@ -816,6 +852,9 @@ int init_resources()
 */
 void onIdle()
 {
+    unsigned long seq = 0;
+    uint64_t start = 0;
+
     /* running refers to the rotation animation.
        display refers to whether the display needs updating.
        If neither are true then there is nothing to do.
@@ -830,6 +869,16 @@ void onIdle()
 
     glFlush();
 
+    /* dump the counters, and keep them fresh on the screen */
+    stats_poll();
+    trace_poll(shm);
+    if (ctx->stats_show
+        && ((int) (glfwGetTime() * 1000.0) - ctx->stats_time >
+            STATS_HUD_MS)) {
+        ctx->stats_time = (int) (glfwGetTime() * 1000.0);
+        ctx->display = 1;
+    }
+
     if (!(ctx->display) && !(ctx->running)) {
         return;
     }
@@ -850,6 +899,9 @@ void onIdle()
     }
 
     if (ctx->reload) {
+        start = trace_now();
+        seq = shm_update_seq(shm);
+        trace_flow("update", TRACE_FLOW_END, seq);
         if (tg_load_data() != 0) {
             FAIL_MSG("onIdle: tg_load_data() failed\n");
             return;
@@ -880,6 +932,12 @@ void onIdle()
 
 
     onDisplay();
+
+    /* acknowledge the update once it is on the screen */
+    if (seq) {
+        trace_span("reload", start);
+        shm_ack(shm, seq);
+    }
 }
 
 
@@ -887,15 +945,19 @@ void onIdle()
 int drawPoints()
 {
     GLfloat m_mvp[4][4];
+    uint64_t start;
 
     glUseProgram(ctx->program);
 
     /* make the VBOs available */
+    start = trace_now();
     if (enableArrays(ctx->vertices, ctx->colours, ctx->vert_count) != 0) {
         FAIL_MSG("drawPoints: enableArrays() failed\n");
         return 1;
     }
 
+    trace_span("upload", start);
+
     /* mvp = projview * model */
     if (multm4(m_mvp, ctx->m_projview, ctx->m_model) != 0) {
         FAIL_MSG("drawPoints: multm4() failed\n");
@@ -957,6 +1019,9 @@ int statusText()
     float textoff;
     int fontsize = 24 * ctx->screen_width / 600;
     int fontgap = fontsize / 3;
+    char stats[STATS_DUMPSIZE];
+    char *line;
+    char *save;
 
     /* print the data sizes 1, 2, 4 and 8 with the current one highlighted */
     textoff = fontgap;
@@ -989,6 +1054,13 @@ int statusText()
     if (!ctx->connected) {
         strcpy(msg, "HOLD");
         textoff = display_text(msg, fontsize, textoff, ctx->screen_height - (fontsize + (fontgap * 2)), white);
+        textoff += fontgap * 2;
+    }
+
+    /* fewer points than elements, to stay within the memory budget */
+    if (ctx->step > 1) {
+        snprintf(msg, 128, "1/%lu", ctx->step);
+        textoff = display_text(msg, fontsize, textoff, ctx->screen_height - (fontsize + (fontgap * 2)), grey);
     }
 
 
@@ -996,6 +1068,22 @@ int statusText()
     snprintf(msg, 128, "0x%016lx - 0x%016lx", ctx->offset & ~0x7, (ctx->offset + ctx->bufsize) & ~0x7);
     textoff = display_text(msg, fontsize, fontgap, ctx->screen_height - fontgap, white);
 
+    /* print the drawing statistics down from the top, a line at a time */
+    if (ctx->stats_show) {
+        if (stats_format(stats, sizeof(stats)) != 0) {
+            FAIL_MSG("statusText: stats_format() failed\n");
+            return 1;
+        }
+
+        fontsize = 10 * ctx->screen_width / 600;
+        i = 1;
+        for (line = strtok_r(stats, "\n", &save); line;
+             line = strtok_r(NULL, "\n", &save)) {
+            display_text(line, fontsize, fontgap,
+                         (fontsize + fontgap) * i++, grey);
+        }
+    }
+
     return 0;
 }
 
@@ -1003,6 +1091,10 @@ int statusText()
 /* onDisplay runs when display needs updating */
 void onDisplay()
 {
+    struct stats_mark mark;
+
+    stats_begin(&mark);
+
     /* clear the screen to black */
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1049,6 +1141,10 @@ void onDisplay()
         return;
     }
 
+    /* the swap waits for the screen, so it isn't counted */
+    stats_add(STATS_ONDISPLAY, 0, ctx->screen_width * ctx->screen_height);
+    stats_end(STATS_ONDISPLAY, &mark);
+
     /* update display */
     glfwSwapBuffers(ctx->window);
 }
@@ -1185,6 +1281,11 @@ void key_callback(GLFWwindow * window, int key, int scancode,
         }
         ctx->display = 1;
         break;
+    case 'S':
+        /* show / hide the drawing statistics */
+        ctx->stats_show = !ctx->stats_show;
+        ctx->display = 1;
+        break;
     default:
         break;
     }
@@ -1223,6 +1324,20 @@ static void error_callback(int error, const char *desc)
 
 /* tg_display is the display routine */
 int tg_display()
+{
+    if (tg_display_init(1) != 0) {
+        FAIL_MSG("tg_display: tg_display_init() failed\n");
+        return 1;
+    }
+
+
+    return tg_run();
+}
+
+
+/* tg_display_init opens the window and sets up GL, the shaders and the
+ * text; a zygote does this before it has the file, with the window hidden */
+int tg_display_init(int visible)
 {
 
     /* set up glfw error callback */
@@ -1230,11 +1345,13 @@ int tg_display()
 
     /* init glfw */
     if (!glfwInit()) {
-        FAIL_MSG("tg_display: glfwInit() failed\n");
+        FAIL_MSG("tg_display_init: glfwInit() failed\n");
         return 1;
     }
 
 
+    glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
+
     /* create window */
     switch (ctx->type) {
         case TG_NORMAL:
@@ -1265,7 +1382,7 @@ int tg_display()
     }
 
     if (!ctx->window) {
-        fprintf(stderr, "tg_display: glfwCreateWindow() failed\n");
+        fprintf(stderr, "tg_display_init: glfwCreateWindow() failed\n");
         glfwTerminate();
         return 2;
     }
@@ -1296,7 +1413,7 @@ int tg_display()
 
 
     if (enable_usr1() != 0) {
-        FAIL_MSG("tg_display: enable_usr1() failed\n");
+        FAIL_MSG("tg_display_init: enable_usr1() failed\n");
         return 5;
     }
 
@@ -1308,12 +1425,12 @@ int tg_display()
 
 
     if (init_resources() != 0) {
-        FAIL_MSG("tg_display: init_resources() failed\n");
+        FAIL_MSG("tg_display_init: init_resources() failed\n");
         return 7;
     }
 
     if (init_text_resources() == 0) {
-        FAIL_MSG("tg_display: init_text_resources() failed\n");
+        FAIL_MSG("tg_display_init: init_text_resources() failed\n");
         return 8;
     }
 
@@ -1322,6 +1439,15 @@ int tg_display()
     //glDepthFunc(GL_LESS);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    return 0;
+}
+
+
+/* tg_run shows the window and runs it until it is closed */
+int tg_run()
+{
+    glfwShowWindow(ctx->window);
+
     while (!glfwWindowShouldClose(ctx->window)) {
         onIdle();
 
@@ -1352,10 +1478,36 @@ int cleanup()
 }
 
 
+/* tg_progtype is the plot drawn by the program called name, or -1 */
+int tg_progtype(char *name)
+{
+    if (!name) {
+        FAIL_MSG("tg_progtype: invalid params\n");
+        return -1;
+    }
+
+
+    if (strncmp(name, "trigraph", 9) == 0) {
+        return TG_NORMAL;
+    } else if (strncmp(name, "delayedtrigraph", 16) == 0) {
+        return TG_DELAYED;
+    } else if (strncmp(name, "bigraph", 8) == 0) {
+        return BG_NORMAL;
+    } else if (strncmp(name, "delayedbigraph", 15) == 0) {
+        return BG_DELAYED;
+    }
+
+    return -1;
+}
+
+
 int main(int argc, char *argv[])
 {
     struct stat stattmp;
+    char shmpath[256];
     char *ptr = NULL;
+    char *arg;
+    int type, zygote;
 
     if (argc <= 0) {
         printf
@@ -1367,30 +1519,73 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    if (!strncmp(argv[1], "/rb_shm.", 8)) {
+    ptr = strrchr(argv[0], '/');
+    if (!ptr) {
+        ptr = argv[0];
+    } else {
+        ptr++;
+    }
+
+    type = tg_progtype(ptr);
+    if (type < 0) {
+
+        FAIL_MSG("unknown program name\n");
+
+        exit(1);
+    }
+
+    ctx = trigraph_init(600, 600, 200, 200);
+    if (!ctx) {
+        FAIL_MSG("main: trigraph_init() failed\n");
+        return 2;
+    }
+
+    ctx->type = type;
+
+    /* a zygote gets everything but the file ready and then waits to be
+     * given the shm name */
+    arg = argv[1];
+    zygote = (strcmp(argv[1], SHM_ZYGOTE_ARG) == 0);
+    if (zygote) {
+        if (tg_display_init(0) != 0) {
+            FAIL_MSG("main: tg_display_init() failed\n");
+            return 3;
+        }
+
+        if (shm_zygote_wait(shmpath, sizeof(shmpath)) != 0) {
+            exit(0);
+        }
+        arg = shmpath;
+    }
+
+    if (!strncmp(arg, "/rb_shm.", 8)) {
 
         /* argument is named shared memory buffer */
 		shm_destroy = 0;
-        if (shm_open_buffer(argv[1], &shm, &sem) != 0) {
+        if (shm_open_buffer(arg, &shm, &sem) != 0) {
             FAIL_MSG("main: shm_open_buffer() failed\n");
-            return 2;
+            return 4;
         }
 
+        /* with the config rubbermarbles has read, and its memory budget */
+        conf_attach(shm);
+        budget_attach(shm, "trigraph");
+
     } else {
 
         /* argument is a file */
 		shm_destroy = 1;
         if (rb_shm_init(&shm_ctx, &shm) != 0) {
             FAIL_MSG("main: rb_shm_init() failed\n");
-            return 3;
+            return 5;
         }
 
-        if (stat(argv[1], &stattmp) != 0) {
-            FAIL_ERR("main: stat() failed\n");
-            return 4;
+        if (blkdev_stat(arg, &stattmp) != 0) {
+            FAIL_MSG("main: blkdev_stat() failed\n");
+            return 6;
         }
 
-        strncpy(shm->filename, argv[1], PATH_MAX - 1);
+        strncpy(shm->filename, arg, PATH_MAX - 1);
         shm->filename[PATH_MAX - 1] = 0x00;
         shm->offset = 0;
         shm->bufsize = stattmp.st_size;
@@ -1400,81 +1595,51 @@ int main(int argc, char *argv[])
     }
 
 
-    ptr = strrchr(argv[0], '/');
-    if (!ptr) {
-        ptr = argv[0];
-    } else {
-        ptr++;
-    }
-
-    ctx = trigraph_init(600, 600, 200, 200);
-    if (!ctx) {
-        FAIL_MSG("main: trigraph_init() failed\n");
-        return 5;
-    }
-
-
     /* open the file */
     ctx->fd = open(shm->filename, O_RDONLY);
     if (ctx->fd == -1) {
         FAIL_ERR("main: cannot open file\n");
-        return 6;
-    }
-
-
-    /* stat it */
-    if (fstat(ctx->fd, &(ctx->filestat)) != 0) {
-        FAIL_ERR("main: cannot stat file\n");
         return 7;
     }
 
 
-    if (strncmp(ptr, "trigraph", 9) == 0) {
-        if (trigraph_filedesc(ctx, ctx->fd, &(ctx->filestat),
-                              shm->offset, shm->bufsize,
-                              1, TG_LITTLE_ENDIAN) != 0) {
-            FAIL_MSG("main: trigraph_filedesc() failed\n");
-            return 8;
-        }
-
-    } else if (strncmp(ptr, "delayedtrigraph", 16) == 0) {
+    /* stat it, sizing block devices */
+    if (blkdev_fstat(ctx->fd, &(ctx->filestat)) != 0) {
+        FAIL_MSG("main: cannot stat file\n");
+        return 8;
+    }
 
-        if (delayedtrigraph_filedesc(ctx, ctx->fd, &(ctx->filestat),
-                                     shm->offset, shm->bufsize,
-                                     1, TG_LITTLE_ENDIAN) != 0) {
-            FAIL_MSG("main: delayedtrigraph_filedesc() failed\n");
-            return 9;
-        }
 
-    } else if (strncmp(ptr, "bigraph", 8) == 0) {
+    /* the bigraphs start still */
+    if ((type == BG_NORMAL) || (type == BG_DELAYED)) {
         ctx->running = 0;
         ctx->display = 1;
-        if (bigraph_filedesc(ctx, ctx->fd, &(ctx->filestat),
-                              shm->offset, shm->bufsize,
-                              1, TG_LITTLE_ENDIAN) != 0) {
-            FAIL_MSG("main: bigraph_filedesc() failed\n");
-            return 10;
-        }
+    }
 
-    } else if (strncmp(ptr, "delayedbigraph", 15) == 0) {
-        ctx->running = 0;
-        ctx->display = 1;
-        if (delayedbigraph_filedesc(ctx, ctx->fd, &(ctx->filestat),
-                                     shm->offset, shm->bufsize,
-                                     1, TG_LITTLE_ENDIAN) != 0) {
-            FAIL_MSG("main: delayedbigraph_filedesc() failed\n");
-            return 11;
-        }
+    if (tg_filedesc(ctx->fd, &(ctx->filestat), shm->offset, shm->bufsize,
+                    type, 1, TG_LITTLE_ENDIAN) != 0) {
+        FAIL_MSG("main: tg_filedesc() failed\n");
+        return 9;
+    }
 
-    } else {
 
-        FAIL_MSG("unknown program name\n");
+    /* count where the drawing time goes; RB_STATS dumps it */
+    if (stats_init(ptr) != 0) {
+        FAIL_MSG("main: stats_init() failed\n");
+        return 10;
+    }
 
-        exit(1);
+
+    /* RB_TRACE adds this process to the main window's trace */
+    if (trace_init(ptr, 0) != 0) {
+        FAIL_MSG("main: trace_init() failed\n");
+        return 11;
     }
 
 
-    if (trigraph_display(ctx) != 0) {
+    if (zygote) {
+        tg_run();
+    } else if (trigraph_display(ctx) != 0) {
         FAIL_MSG("main: trigraph_display() failed\n");
         return 12;
     }
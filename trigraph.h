@@ -32,6 +32,10 @@
 #include "shader_utils.h"
 #include "matrixm.h"
 #include "tg-text.h"
+#include "rb-blkdev.h"
+#include "rb-stats.h"
+#include "rb-trace.h"
+#include "rb-budget.h"
 #include "macro.h"
 
 #ifndef _TRIGRAPH_H
@@ -45,6 +49,10 @@
 #define BG_NORMAL 2
 #define BG_DELAYED 3
 
+/* the fewest vertex bytes a selection is drawn with, whatever the memory
+ * budget says */
+#define TG_MIN_BYTES (65536 * 6 * sizeof(GLfloat))
+
 
 struct tg_ctx {
     /* program vars */
@@ -61,6 +69,8 @@ struct tg_ctx {
     int rot_start_time;
     float angle_start_delta;
     int connected;
+    int stats_show;
+    int stats_time;
 
     /* glfw vars */
     GLFWwindow *window;
@@ -100,6 +110,8 @@ struct tg_ctx {
     GLfloat *vertices;
     GLfloat *colours;
     long vert_count;
+    unsigned long step;         /* elements between points */
+    unsigned long reserved;     /* from the memory budget */
 };
 
 
@@ -141,6 +153,9 @@ void free_resources();
 int trigraph_display(void *ctx);
 int delayedtrigraph_display(void *ctx);
 int tg_display();
+int tg_display_init(int visible);
+int tg_run();
+int tg_progtype(char *name);
 int cleanup();
 
 #endif
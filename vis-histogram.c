@@ -0,0 +1,215 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * vis-histogram.c
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * A plugin visualiser that draws how often each byte value appears in the
+ * zoom selection, as bars on a log scale in the Cortesi colours (with 0x00
+ * grey, to show up on the black), and the selection's entropy as a line
+ * across them.  It is an example of the interface in vis-plugin.h as much
+ * as anything, including the byte counts rubbermarbles keeps: once they are
+ * there only the ends of the selection are read.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "vis-plugin.h"
+
+struct histogram {
+    const struct vis_view *view;
+    unsigned long counts[256];
+    unsigned long total;
+    double entropy;
+};
+
+
+/* hist_init makes the plugin's state */
+static void *hist_init(void)
+{
+    return calloc(1, sizeof(struct histogram));
+}
+
+
+/* hist_attach keeps the view of the file */
+static int hist_attach(void *state, const struct vis_view *view)
+{
+    struct histogram *h = (struct histogram *) state;
+
+    h->view = view;
+
+    return 0;
+}
+
+
+/* hist_at adds sign times the counts before block b to counts */
+static void hist_at(const struct vis_summaries *found, unsigned long b,
+                    int sign, unsigned long *counts)
+{
+    const uint64_t *span = found->count_spans +
+        ((b / found->count_span) * 256);
+    const uint32_t *block = found->counts + (b * 256);
+    int v;
+
+    for (v = 0; v < 256; v++) {
+        counts[v] += sign * (span[v] + block[v]);
+    }
+}
+
+
+/* hist_update counts the bytes of the new selection */
+static int hist_update(void *state, unsigned long offset, unsigned long len)
+{
+    struct histogram *h = (struct histogram *) state;
+    struct vis_summaries found;
+    const uint8_t *p;
+    unsigned long i, first, last, fb, lb, bs;
+    double f;
+
+    memset(h->counts, 0, sizeof(h->counts));
+    memset(&found, 0, sizeof(found));
+    if (h->view->summaries) {
+        h->view->summaries(&found);
+    }
+
+    /* the whole blocks in the middle come from rubbermarbles' counts */
+    first = last = offset;
+    bs = found.count_blocksize;
+    if (found.counts && bs && (len > 2 * bs)) {
+        fb = (offset + bs - 1) / bs;
+        lb = (offset + len) / bs;
+        if (lb > found.count_blocks) {
+            lb = found.count_blocks;
+        }
+
+        if (lb > fb) {
+            hist_at(&found, lb, 1, h->counts);
+            hist_at(&found, fb, -1, h->counts);
+            first = fb * bs;
+            last = lb * bs;
+        }
+    }
+
+    /* and the rest is read */
+    p = h->view->data;
+    for (i = offset; i < first; i++) {
+        h->counts[p[i]]++;
+    }
+    for (i = last; i < offset + len; i++) {
+        h->counts[p[i]]++;
+    }
+    h->total = len;
+
+    h->entropy = 0.0;
+    for (i = 0; (i < 256) && len; i++) {
+        if (h->counts[i]) {
+            f = (double) h->counts[i] / len;
+            h->entropy -= f * log2(f);
+        }
+    }
+
+    return 0;
+}
+
+
+/* hist_colour is the Cortesi colour of a byte value */
+static void hist_colour(int b, uint8_t * rgb)
+{
+    if (b == 0x00) {
+        rgb[0] = 0x80;
+        rgb[1] = 0x80;
+        rgb[2] = 0x80;
+    } else if (b == 0xff) {
+        rgb[0] = 0xff;
+        rgb[1] = 0xff;
+        rgb[2] = 0xff;
+    } else if ((b >= 0x20) && (b < 0x7f)) {
+        rgb[0] = 0x10;
+        rgb[1] = 0x72;
+        rgb[2] = 0xb8;
+    } else if (b < 0x20) {
+        rgb[0] = 0x4d;
+        rgb[1] = 0xaf;
+        rgb[2] = 0x4a;
+    } else {
+        rgb[0] = 0xe4;
+        rgb[1] = 0x1a;
+        rgb[2] = 0x1c;
+    }
+}
+
+
+/* hist_draw draws the bars and the entropy line */
+static int hist_draw(void *state, struct vis_canvas *canvas)
+{
+    struct histogram *h = (struct histogram *) state;
+    uint8_t colour[3];
+    uint8_t *p;
+    double top;
+    int b, x, y, x0, x1, bar, line;
+
+    if (!h->total) {
+        return 0;
+    }
+
+    top = log2((double) h->total + 1);
+    for (b = 0; b < 256; b++) {
+        hist_colour(b, colour);
+        x0 = (b * canvas->width) / 256;
+        x1 = ((b + 1) * canvas->width) / 256;
+        bar = (int) ((log2((double) h->counts[b] + 1) / top) *
+                     canvas->height);
+        for (y = canvas->height - bar; y < canvas->height; y++) {
+            p = canvas->rgb + (y * canvas->stride) + (x0 * 3);
+            for (x = x0; x < x1; x++) {
+                memcpy(p, colour, 3);
+                p += 3;
+            }
+        }
+    }
+
+    /* 8 bits of entropy is the top */
+    line = canvas->height - 1 - (int) ((h->entropy / 8.0) *
+                                       (canvas->height - 1));
+    p = canvas->rgb + (line * canvas->stride);
+    for (x = 0; x < canvas->width; x++) {
+        p[0] = 0xff;
+        p[1] = 0xd0;
+        p[2] = 0x00;
+        p += 3;
+    }
+
+    return 0;
+}
+
+
+/* hist_free frees the plugin's state */
+static void hist_free(void *state)
+{
+    free(state);
+}
+
+
+static const struct vis_plugin histogram_plugin = {
+    VIS_PLUGIN_ABI,
+    hist_init,
+    hist_attach,
+    hist_update,
+    hist_draw,
+    hist_free
+};
+
+
+/* vis_plugin_entry is what rubbermarbles looks for */
+const struct vis_plugin *vis_plugin_entry(void)
+{
+    return &histogram_plugin;
+}
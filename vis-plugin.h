@@ -0,0 +1,87 @@
+/*
+ * Rubber Marbles - K Sheldrake
+ * vis-plugin.h
+ *
+ * This file is part of rubbermarbles.
+ *
+ * Copyright (C) 2016 Kevin Sheldrake <rtfcode at gmail.com>
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file or
+ * http://www.wtfpl.net/for more details.
+ *
+ * The interface for visualisers that are shared libraries loaded into
+ * rubbermarbles, rather than programs it runs.  See VISUALISERS.
+ */
+
+#ifndef _VIS_PLUGIN_H
+#define _VIS_PLUGIN_H
+
+#include <stdint.h>
+
+/* bumped whenever the structs or calls below change */
+#define VIS_PLUGIN_ABI 2
+
+/* the one symbol a plugin exports */
+#define VIS_PLUGIN_ENTRY "vis_plugin_entry"
+
+/* what rubbermarbles has worked out about the file, read where it keeps
+ * it rather than copied.  Anything it hasn't worked out is NULL, and the
+ * pointers are only good until the call they were got in returns. */
+struct vis_summaries {
+    /* the region label of block i is label[i * label_stride], 0 until it
+     * has been classified; the labels are CLASS_* in rb-classify.h */
+    const uint8_t *label;
+    unsigned long label_stride;
+    unsigned long label_blocks;
+    unsigned long label_blocksize;
+
+    /* the count of byte value v before block b, for b up to count_blocks,
+     * is count_spans[((b / count_span) * 256) + v] + counts[(b * 256) + v] */
+    const uint32_t *counts;
+    const uint64_t *count_spans;
+    unsigned long count_blocks;
+    unsigned long count_blocksize;
+    unsigned long count_span;
+
+    /* whether each block was unhashed (0), the same (1) or changed (2) at
+     * the last rescan */
+    const uint8_t *change;
+    unsigned long change_blocks;
+    unsigned long change_blocksize;
+};
+
+/* the file being looked at, mapped by rubbermarbles and read-only */
+struct vis_view {
+    const uint8_t *data;
+    unsigned long size;
+    const char *filename;
+    /* fills in found; it can only be called from within a call */
+    void (*summaries) (struct vis_summaries * found);
+};
+
+/* where a plugin draws; rgb is height rows of stride bytes, 3 a point */
+struct vis_canvas {
+    uint8_t *rgb;
+    int width;
+    int height;
+    int stride;
+};
+
+/* what a plugin does.  Every call is made on the plugin's own thread, one
+ * at a time, so a plugin needs no locks of its own; and all but init are
+ * given what init returned.  A call that fails returns non-zero. */
+struct vis_plugin {
+    int abi;                    /* VIS_PLUGIN_ABI */
+    void *(*init) (void);
+    int (*attach) (void *state, const struct vis_view * view);
+    /* the zoom selection is now len bytes from offset */
+    int (*on_update) (void *state, unsigned long offset, unsigned long len);
+    /* called after each update, and when the window changes size */
+    int (*draw) (void *state, struct vis_canvas * canvas);
+    void (*free) (void *state);
+};
+
+typedef const struct vis_plugin *(*vis_plugin_entry_fn) (void);
+
+#endif
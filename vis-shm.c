@@ -57,5 +57,47 @@ int shm_open_buffer(char *shmpath, struct rb_shm **shm, sem_t ** sem)
     }
 
 
+    return 0;
+}
+
+
+/* shm_zygote_wait waits for rubbermarbles to write the shm name to stdin,
+ * for a visualiser started with SHM_ZYGOTE_ARG.  It returns 0 with the name
+ * in shmpath, or non-zero if it isn't wanted after all */
+int shm_zygote_wait(char *shmpath, int len)
+{
+    int i = 0;
+    ssize_t ret;
+    char c;
+
+    if (!shmpath || (len < 2)) {
+        FAIL_MSG("shm_zygote_wait: invalid params\n");
+        return 1;
+    }
+
+
+    /* a byte at a time, so nothing after the line is taken */
+    while (i < len - 1) {
+        ret = read(STDIN_FILENO, &c, 1);
+        if ((ret < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (ret != 1) {
+            /* the pipe was closed */
+            return 2;
+        }
+        if (c == '\n') {
+            break;
+        }
+        shmpath[i++] = c;
+    }
+    shmpath[i] = 0x00;
+
+    if (strncmp(shmpath, "/rb_shm.", 8) != 0) {
+        FAIL_MSG("shm_zygote_wait: not a shm name\n");
+        return 3;
+    }
+
+
     return 0;
 }
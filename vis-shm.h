@@ -24,6 +24,7 @@
 #include <sys/time.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <errno.h>
 
 #ifdef __linux__
 #include <linux/limits.h>
@@ -38,5 +39,6 @@
 #define _VIS_SHM_H
 
 int shm_open_buffer(char *shmpath, struct rb_shm **shm, sem_t **sem);
+int shm_zygote_wait(char *shmpath, int len);
 
 #endif